@@ -42,7 +42,7 @@ enum keyMasks {
 };
 
 // IDs.
-GLuint vao, ibo, points_vbo, colors_vbo, uv_vbo, mvp_ID;
+GLuint vao, ibo, points_vbo, colors_vbo, uv_vbo, normals_vbo, mvp_ID;
 
 // Matrices.
 glm::mat4 MVP, View, Projection;
@@ -152,6 +152,9 @@ void init(void)
 		uv_vbo = 0;
 		glGenBuffers(1, &uv_vbo);
 
+		normals_vbo = 0;
+		glGenBuffers(1, &normals_vbo);
+
 	glBindVertexArray(0); // Can optionally unbind the vertex array to avoid modification.
 
 	// Enable depth test.
@@ -213,15 +216,15 @@ void display(void)
 	
 
 	glBindTexture(GL_TEXTURE_2D, blankTx);
-	g_grid.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
+	g_grid.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo, &normals_vbo);
 	transformObject(glm::vec3(1.0f, 1.0f, 1.0f), X_AXIS, -90.0f, glm::vec3(0.0f, 0.0f, 0.0f));
-	glDrawElements(GL_LINE_STRIP, g_grid.NumIndices(), GL_UNSIGNED_SHORT, 0);
+	glDrawElements(GL_LINE_STRIP, g_grid.NumIndices(), g_grid.IndexType(), 0);
 
 	// Draw plane with different texture.
 	glBindTexture(GL_TEXTURE_2D, alexTx);
-	g_plane.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
+	g_plane.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo, &normals_vbo);
 	transformObject(glm::vec3(5.0f, 5.0f, 1.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -2.0f));
-	glDrawElements(GL_TRIANGLES, g_plane.NumIndices(), GL_UNSIGNED_SHORT, 0);
+	glDrawElements(GL_TRIANGLES, g_plane.NumIndices(), g_plane.IndexType(), 0);
 
 	glBindVertexArray(0); // Done writing.
 	glutSwapBuffers(); // Now for a potentially smoother render.
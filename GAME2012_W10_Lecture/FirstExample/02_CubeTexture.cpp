@@ -8,18 +8,41 @@ using namespace std;
 
 #include <cstdlib>
 #include <ctime>
+#include <algorithm>
+#include <set>
+#include <chrono>
+#include <cmath>
 #include "vgl.h"
 #include "LoadShaders.h"
 #include "Light.h"
 #include "Shape.h"
+#include "MeshOptimizer.h"
+#include "Meshlets.h"
+#include "Terrain.h"
+#include "Shapes\Teapot.h"
+#include "PatchTessellator.h"
+#include "Scene.h"
+#include "ShadowMap.h"
+#include "LightCulling.h"
+#include "RenderTarget.h"
+#include "FrameGovernor.h"
+#include "PostAA.h"
+#include "TextureResidency.h"
 #include "glm\glm.hpp"
 #include "glm\gtc\matrix_transform.hpp"
 #include <iostream>
 
+#define STBI_PARALLEL_JPEG
+// Decodes allocate from the loader's per-worker arenas (see ScratchArena.h).
+#define STBI_MALLOC(sz) scratchMalloc(sz)
+#define STBI_REALLOC(p, newsz) scratchRealloc(p, 0, newsz)
+#define STBI_REALLOC_SIZED(p, oldsz, newsz) scratchRealloc(p, oldsz, newsz)
+#define STBI_FREE(p) scratchFree(p)
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #define FPS 60
+#define FRAME_BUDGET_MS (1000.0f / FPS)
 #define MOVESPEED 0.1f
 #define TURNSPEED 0.05f
 #define X_AXIS glm::vec3(1,0,0)
@@ -28,6 +51,10 @@ using namespace std;
 #define XY_AXIS glm::vec3(1,1,0)
 #define YZ_AXIS glm::vec3(0,1,1)
 #define XZ_AXIS glm::vec3(1,0,1)
+#define NUM_POINT_LIGHTS 2
+#define SHADOW_BUDGET (32 * 1024 * 1024) // Bytes for all point light cube maps.
+#define ORBIT_RADIUS 1.5f // Of the caster circling the yellow light, in world units.
+#define ORBIT_SPEED 0.045f // Degrees per millisecond, a lap every 8 seconds.
 
 enum keyMasks {
 	KEY_FORWARD = 0b00000001,		// 0x01 or 1 or 01
@@ -41,10 +68,13 @@ enum keyMasks {
 };
 
 // IDs.
-GLuint vao, ibo, points_vbo, colors_vbo, uv_vbo, modelID, viewID, projID;// mvp_ID;
+GLuint vao, ibo, points_vbo, colors_vbo, uv_vbo, normals_vbo, modelID, viewID, projID, eyeID, lightCountID, lightIndicesID, lodBiasID;// mvp_ID;
+GLuint program, shadowProgram, depthProgram;
+GLint depthModelID, depthViewID, depthProjID;
 
 // Matrices.
 glm::mat4 MVP, View, Projection;
+glm::mat4 FrameProjection; // Projection plus any TAA jitter, used for drawing.
 
 // Our bitflags. 1 byte for up to 8 keys.
 unsigned char keys = 0; // Initialized to 0 or 0b00000000.
@@ -56,15 +86,55 @@ GLfloat pitch, yaw;
 int lastX, lastY;
 
 // Texture variables.
-GLuint brickTx, blankTx, grassTx, hedgeTx, gateTx, gatetowerTx, stoneTx, woodTx;
+vector<GLuint> sceneTextures; // One per texture the scene file names, in its order.
 GLint width, height, bitDepth;
+TextureCache textures;
+TextureResidency residency; // Trims cached textures to a video memory budget.
+TextureTier textureTier = TIER_HIGH; // -low or -medium on the command line for less texture memory.
+int gridQuads = 0;	 // -grid N on the command line draws a Grid(N) in place of the scene's grid.
+Grid* bigGrid = NULL;
+bool terrainEnabled = false;		 // -terrain [heightmap] on the command line streams hills in around the castle.
+const char* terrainHeightmap = NULL; // Noise if not given.
+GLuint terrainTx;
+vector<float> terrainCpuMs, terrainGpuMs; // Frame times since the last stats line, for its percentiles.
+int teapotCount = 0;	 // -teapots [N] on the command line puts N Bezier teapots east of the castle.
+GLuint teapotTx, teapotProgram;
+chrono::high_resolution_clock::time_point startTime; // For reporting time to first frame.
+bool firstFrame = true;
 
 //Light variables			Ambient colour		Ambient strength
 AmbientLight aLight(glm::vec3(1.0f, 1.0f, 1.0f), 0.5f);
 
-PointLight pLights[2] = { { glm::vec3(7.5f, 1.0f, -10.0f), 10.0f, glm::vec3(1.0f, 1.0f, 0.0f), 10.0f }, //Yellow
+PointLight pLights[NUM_POINT_LIGHTS] = { { glm::vec3(7.5f, 1.0f, -10.0f), 10.0f, glm::vec3(1.0f, 1.0f, 0.0f), 10.0f }, //Yellow
 						  { glm::vec3(-3.5f, 1.0f, -5.0f), 10.0f, glm::vec3(0.0f, 0.0f, 5.0f), 10.0f } }; //Blue
 
+// Shadow variables.
+PointShadowAtlas shadows;
+bool shadowsEnabled = true;
+int lastStatsTime = 0;
+int orbiter = -1; // Into sceneObjects, a tower cone 'n' sends around the yellow light.
+bool orbiting = false;
+float orbitAngle = 0.0f;
+int lastOrbitTime = 0;
+
+// Per-object light lists.
+LightAssigner lightAssigner;
+
+// Depth pre-pass variables.
+bool depthPrepass = true, frontToBack = true;
+GpuTimer prepassTimer, shadingTimer;
+
+// Frame budget variables. The scene is drawn offscreen so resolution and MSAA can change at runtime.
+RenderTarget sceneTarget;
+FrameGovernor governor;
+GpuTimer frameTimer;
+float lastCpuMs = 0.0f;
+
+// Anti-aliasing, either MSAA in the scene target or a post pass on a single-sample one.
+PostAA postAA;
+#define AA_COMPARE_FRAMES 32
+#define VERTEX_BENCH_DRAWS 20 // Per shape and order in compareVertexOrders().
+
 void timer(int);
 
 void resetView()
@@ -77,115 +147,301 @@ void resetView()
 	// View will now get set only in transformObject
 }
 
-// Shapes. Recommend putting in a map
-//ground
-Grid g_grid(10);
-Plane g_plane;
-//castle walls
-RightWall RWall;
-LeftWall LWall;
-BackWall BWall;
-FrontWallR FWallR;
-FrontWallL FWallL;
-FrontWallM FWallM;
-//parapets
-FrontWallParapet1 FWP1;
-FrontWallParapet2 FWP2;
-FrontWallParapet3 FWP3;
-FrontWallParapet4 FWP4;
-FrontWallParapet5 FWP5;
-
-LeftWallParapet1 LWP1;
-LeftWallParapet2 LWP2;
-LeftWallParapet3 LWP3;
-LeftWallParapet4 LWP4;
-LeftWallParapet5 LWP5;
-
-BackWallParapet1 BWP1;
-BackWallParapet2 BWP2;
-BackWallParapet3 BWP3;
-BackWallParapet4 BWP4;
-BackWallParapet5 BWP5;
-
-RightWallParapet1 RWP1;
-RightWallParapet2 RWP2;
-RightWallParapet3 RWP3;
-RightWallParapet4 RWP4;
-RightWallParapet5 RWP5;
-
-//Gate house parapet
-FrontWallParapet1 GHP1;
-FrontWallParapet1 GHP2;
-FrontWallParapet1 GHP3;
-RightWallParapet1 GHP4;
-RightWallParapet1 GHP5;
-RightWallParapet1 GHP6;
-RightWallParapet1 GHP7;
-FrontWallParapet1 GHP8;
-FrontWallParapet1 GHP9;
-FrontWallParapet1 GHP10;
-
-// gate
-Gate gate;
-Gate gate1;
-Gate gate2;
-//outer hedge maze
-OHedgeMazeF OHMF;
-OHedgeMazeR OHMR;
-OHedgeMazeL OHML;
-OHedgeMazeB OHMB;
-// inner hedge maze
-IHedgeMaze1 IHM1;
-IHedgeMaze2 IHM2;
-IHedgeMaze3 IHM3;
-IHedgeMaze4 IHM4;
-IHedgeMaze5 IHM5;
-
-//mid maze square
-MidMazeSquare MMS;
-
-
-//Back right prism
-TowerPrism BRP(12);
-//Front right prism
-TowerPrism FRP(12);
-//Front left prism
-TowerPrism FLP(12);
-//Back left prism
-TowerPrism BLP(12);
-
-//Back right cone
-TowerCone BRC(12);
-//Front right cone
-TowerCone FRC(12);
-//Back left cone
-TowerCone BLC(12);
-//Front left cone
-TowerCone FLC(12);
-
-//Left gate house tower
-GateTower LGT;
-//Right gate house tower
-GateTower RGT;
-//Middle piece of gate house
-GateTower MGT;
-
-//Steps exiting out of gate
-MidMazeSquare S1;
-MidMazeSquare S2;
-MidMazeSquare S3;
-
-//Stone steps leading to gate
-StoneSteps SS1;
-StoneSteps SS2;
-StoneSteps SS3;
-StoneSteps SS4;
-StoneSteps SS5;
-
-//Gate house walls
-LeftWall GH1;
-RightWall GH2;
-//Prism g_prism(7);
+// The scene file and its meshes, then everything drawn each frame in the order the file lists it.
+SceneDescription scene;
+MeshPack meshPack;
+MeshletCuller meshlets; // Camera culling inside the pack's triangle meshes.
+Terrain terrain;
+PatchTessellator teapots; // Tessellated from Teapot.h's patches each frame, on the CPU or the GPU.
+vector<SceneObject> sceneObjects;
+vector<int> opaqueOrder, otherOrder; // Indices into sceneObjects, rebuilt each frame.
+vector<float> viewDistances;
+
+//---------------------------------------------------------------------
+//
+// addObject
+//
+void addObject(Shape& shape, GLuint& texture, glm::vec3 scale, glm::vec3 rotationAxis, float rotationAngle,
+	glm::vec3 translation, GLenum mode = GL_TRIANGLES)
+{
+	sceneObjects.push_back(SceneObject(shape, texture, scale, rotationAxis, rotationAngle, translation, mode));
+}
+
+//---------------------------------------------------------------------
+//
+// loadScene
+//
+// Reads the scene description and maps its mesh pack, then queues the
+// textures it names. The castle used to be built here from the structs in
+// Shape.h; Tools/SceneExporter turns those into castle.mesh and castle.scene.
+bool loadScene(const char* file)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	if (!scene.Load(file) || !meshPack.Open(scene.meshFile.c_str()))
+		return false;
+	sceneTextures.assign(scene.textureFiles.size(), 0);
+	for (unsigned i = 0; i < scene.textureFiles.size(); i++)
+		textures.Load(scene.textureFiles[i].c_str(), sceneTextures[i]);
+	cout << file << ": " << scene.objects.size() << " objects, " << meshPack.header->meshCount << " meshes ("
+		<< meshPack.file.size / 1024.0f << " KB mapped) in "
+		<< chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count() << " ms" << endl;
+	return true;
+}
+
+//---------------------------------------------------------------------
+//
+// replaceGrid
+//
+// Swaps the scene's grid for a GridLines(quads) over the same ground, one
+// line strip per row and column split by restarts. Past 254 quads a side it
+// has more vertices than 16 bit indices reach below the restart value, so
+// it draws with 32 bit ones; Grid(1000) is a million vertices.
+void replaceGrid(int quads)
+{
+	const MeshPackEntry* grid = meshPack.Find("Grid");
+	if (!grid)
+		return;
+	bigGrid = new GridLines(quads);
+	bigGrid->CalcBounds();
+	glm::mat4 toPack = glm::inverse(meshPack.Relative(*grid)) *
+		glm::scale(glm::mat4(1.0f), glm::vec3(grid->boundsMax[0] / quads, grid->boundsMax[1] / quads, 1.0f));
+	for (unsigned i = 0; i < sceneObjects.size(); i++)
+		if (sceneObjects[i].mesh == grid)
+		{
+			SceneObject& o = sceneObjects[i];
+			SceneObject replaced(*bigGrid, *o.texture, glm::vec3(1.0f), glm::vec3(1.0f, 0.0f, 0.0f), 0.0f, glm::vec3(0.0f), o.mode);
+			replaced.model = o.model * toPack;
+			replaced.castsShadow = o.castsShadow;
+			replaced.CalcWorldBounds(bigGrid->boundsMin, bigGrid->boundsMax);
+			o = replaced;
+		}
+	// Every restart has to still be one at the width the indices went up at.
+	unsigned strips = 1, packedRestarts = 0;
+	for (unsigned k = 0; k < bigGrid->shape_indices.size(); k++)
+		strips += bigGrid->shape_indices[k] == RESTART_INDEX;
+	bool wide = bigGrid->IndexType() == GL_UNSIGNED_INT;
+	for (unsigned k = 0; k < bigGrid->packed_indices.size(); k++)
+		packedRestarts += bigGrid->packed_indices[k] == 0xFFFF;
+	cout << "Grid(" << quads << "): " << bigGrid->shape_vertices.size() / 3 << " vertices, " << bigGrid->NumIndices() << " "
+		<< (wide ? 32 : 16) << " bit indices in " << strips << " line strips" << endl;
+	if (!wide && packedRestarts != strips - 1)
+		cout << "Grid(" << quads << "): " << packedRestarts << " restarts after packing to 16 bits, expected " << strips - 1 << "!" << endl;
+}
+
+//---------------------------------------------------------------------
+//
+// placeOrbiter
+//
+// Puts the orbiting caster at orbitAngle on its circle round the yellow
+// light, the same way buildScene places a pack mesh. It is drawn whole, as
+// the meshlet culler's bounds are built once.
+void placeOrbiter()
+{
+	SceneObject& o = sceneObjects[orbiter];
+	glm::vec3 center = pLights[0].position + ORBIT_RADIUS * glm::vec3(cos(glm::radians(orbitAngle)), 0.0f, sin(glm::radians(orbitAngle)));
+	o = SceneObject(*o.mesh, *o.texture, glm::vec3(0.5f), Y_AXIS, -orbitAngle, glm::vec3(center.x, 0.0f, center.z), GL_TRIANGLES);
+	o.model *= meshPack.Relative(*o.mesh);
+}
+
+//---------------------------------------------------------------------
+//
+// moveOrbiter
+//
+// Advances the orbiting caster and marks the shadow cubes of the lights it
+// left and entered out of date, the only ones that have to be redrawn.
+void moveOrbiter()
+{
+	int now = glutGet(GLUT_ELAPSED_TIME);
+	orbitAngle = fmod(orbitAngle + (now - lastOrbitTime) * ORBIT_SPEED, 360.0f);
+	lastOrbitTime = now;
+	SceneObject& o = sceneObjects[orbiter];
+	shadows.MarkDynamic(pLights, (o.boundsMin + o.boundsMax) * 0.5f, glm::length(o.boundsMax - o.boundsMin) * 0.5f);
+	placeOrbiter();
+	shadows.MarkDynamic(pLights, (o.boundsMin + o.boundsMax) * 0.5f, glm::length(o.boundsMax - o.boundsMin) * 0.5f);
+}
+
+//---------------------------------------------------------------------
+//
+// buildScene
+//
+// Uploads the mesh pack and places every object the scene file lists.
+// Meshes that are another one resized or moved share its vertices, with the
+// difference folded into the object's model matrix.
+void buildScene()
+{
+	if (!meshPack.header)
+		return;
+	meshPack.Deduplicate();
+	meshPack.Upload();
+	for (unsigned i = 0; i < scene.objects.size(); i++)
+	{
+		const ScenePlacement& p = scene.objects[i];
+		const MeshPackEntry* mesh = meshPack.Find(p.mesh);
+		if (!mesh)
+		{
+			cout << "No mesh called " << p.mesh << " in " << scene.meshFile << "!" << endl;
+			continue;
+		}
+		sceneObjects.push_back(SceneObject(*mesh, sceneTextures[p.texture], p.scale, p.rotationAxis, p.rotationAngle, p.translation, p.mode));
+		sceneObjects.back().castsShadow = p.castsShadow;
+		sceneObjects.back().model *= meshPack.Relative(*mesh);
+		if (p.mode == GL_TRIANGLES)
+			sceneObjects.back().meshletObject = meshlets.Add(meshPack, *mesh, sceneObjects.back().model);
+	}
+	meshlets.Finish();
+	set<int> drawnMeshes;
+	for (unsigned i = 0; i < sceneObjects.size(); i++)
+		drawnMeshes.insert(meshPack.representative[meshPack.Index(*sceneObjects[i].mesh)]);
+	cout << sceneObjects.size() << " objects draw " << drawnMeshes.size() << " distinct meshes in " << meshlets.Count() << " meshlets" << endl;
+	const MeshPackEntry* cone = meshPack.Find("TowerCone");
+	for (unsigned i = 0; i < sceneObjects.size() && cone; i++)
+		if (sceneObjects[i].mesh == cone)
+		{
+			orbiter = sceneObjects.size();
+			sceneObjects.push_back(sceneObjects[i]);
+			placeOrbiter();
+			break;
+		}
+	if (gridQuads > 0)
+		replaceGrid(gridQuads);
+}
+
+//---------------------------------------------------------------------
+//
+// drawGeometry
+//
+// Binds whatever holds o's vertices and draws it. Mesh pack objects share
+// one vertex array; shapes are uploaded into the scratch buffers each time.
+// From the camera, meshes draw only the meshlets that survived this frame's
+// culling; the shadow passes look from the lights, so they draw everything.
+void drawGeometry(SceneObject& o, bool positionsOnly = false, bool fromCamera = false)
+{
+	if (o.mesh)
+	{
+		meshPack.Bind();
+		if (fromCamera && meshlets.enabled && o.meshletObject >= 0)
+			meshlets.Draw(o.meshletObject, o.mode, meshPack.IndexType());
+		else
+			meshPack.Draw(*o.mesh, o.mode);
+		return;
+	}
+	glBindVertexArray(vao);
+	if (positionsOnly)
+		o.shape->BufferPositions(&ibo, &points_vbo);
+	else
+		o.shape->BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo, &normals_vbo);
+	glDrawElements(o.mode, o.shape->NumIndices(), o.shape->IndexType(), 0);
+}
+
+//---------------------------------------------------------------------
+//
+// drawTerrain
+//
+// The streamed ground, already in world space. It goes after the castle,
+// which stands in front of most of it.
+void drawTerrain(GLint modelLoc)
+{
+	glm::mat4 identity(1.0f);
+	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &identity[0][0]);
+	terrain.Draw();
+}
+
+//---------------------------------------------------------------------
+//
+// placeTeapots
+//
+// A square of teapots on the grass east of the castle, each turned a bit
+// more than the last.
+void placeTeapots(int count)
+{
+	int side = (int)ceil(sqrt((float)count));
+	for (int i = 0; i < count; i++)
+	{
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(13.0f + 2.0f * (i % side), 0.0f, -1.0f - 2.0f * (i / side)));
+		model = glm::rotate(model, glm::radians(37.0f * i), glm::vec3(0.0f, 1.0f, 0.0f));
+		teapots.instances.push_back(glm::scale(model, glm::vec3(0.25f)));
+	}
+}
+
+//---------------------------------------------------------------------
+//
+// drawShadowCasters
+//
+void drawShadowCasters(GLint modelLoc)
+{
+	for (unsigned i = 0; i < sceneObjects.size(); i++)
+	{
+		SceneObject& o = sceneObjects[i];
+		if (!o.castsShadow)
+			continue;
+		glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &o.model[0][0]);
+		drawGeometry(o);
+	}
+}
+
+//---------------------------------------------------------------------
+//
+// sortObjects
+//
+// Opaque objects are sorted roughly front to back by the distance from the
+// camera to their bounds, so early depth testing rejects hidden fragments.
+bool closerToCamera(int a, int b) { return viewDistances[a] < viewDistances[b]; }
+
+void sortObjects()
+{
+	opaqueOrder.clear();
+	otherOrder.clear();
+	viewDistances.resize(sceneObjects.size());
+	for (unsigned i = 0; i < sceneObjects.size(); i++)
+	{
+		SceneObject& o = sceneObjects[i];
+		viewDistances[i] = distanceSqToBox(position, o.boundsMin, o.boundsMax);
+		if (o.mode == GL_TRIANGLES)
+			opaqueOrder.push_back(i);
+		else
+			otherOrder.push_back(i); // Lines etc. are not in the pre-pass.
+	}
+	if (frontToBack)
+		stable_sort(opaqueOrder.begin(), opaqueOrder.end(), closerToCamera);
+}
+
+//---------------------------------------------------------------------
+//
+// drawDepthPrepass
+//
+void drawDepthPrepass()
+{
+	glUseProgram(depthProgram);
+	glUniformMatrix4fv(depthViewID, 1, GL_FALSE, &View[0][0]);
+	glUniformMatrix4fv(depthProjID, 1, GL_FALSE, &FrameProjection[0][0]);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	for (unsigned i = 0; i < opaqueOrder.size(); i++)
+	{
+		SceneObject& o = sceneObjects[opaqueOrder[i]];
+		glUniformMatrix4fv(depthModelID, 1, GL_FALSE, &o.model[0][0]);
+		drawGeometry(o, true, true);
+	}
+	if (terrainEnabled)
+		drawTerrain(depthModelID);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	glUseProgram(program);
+}
+
+//---------------------------------------------------------------------
+//
+// drawObject
+//
+void drawObject(SceneObject& o)
+{
+	lightAssigner.Assign(o, pLights, governor.Current().lights);
+	textures.Bind(*o.texture);
+	residency.Touch(*o.texture, glm::length(o.boundsMax - o.boundsMin), sqrt(distanceSqToBox(position, o.boundsMin, o.boundsMax)));
+	glUniformMatrix4fv(modelID, 1, GL_FALSE, &o.model[0][0]);
+	glUniform1i(lightCountID, o.lightCount);
+	if (o.lightCount > 0)
+		glUniform1iv(lightIndicesID, o.lightCount, o.lightIndices);
+	drawGeometry(o, false, true);
+}
 
 void init(void)
 {
@@ -197,126 +453,64 @@ void init(void)
 		{ GL_NONE, NULL }
 	};
 
+	ShaderInfo depthShaders[] = {
+		{ GL_VERTEX_SHADER, "depth.vert" },
+		{ GL_FRAGMENT_SHADER, "depth.frag" },
+		{ GL_NONE, NULL }
+	};
+
+	ShaderInfo shadowShaders[] = {
+		{ GL_VERTEX_SHADER, "shadow.vert" },
+		{ GL_FRAGMENT_SHADER, "shadow.frag" },
+		{ GL_NONE, NULL }
+	};
+
 	//Loading and compiling shaders
-	GLuint program = LoadShaders(shaders);
+	shadowProgram = LoadShaders(shadowShaders);
+	depthProgram = LoadShaders(depthShaders);
+	depthModelID = glGetUniformLocation(depthProgram, "model");
+	depthViewID = glGetUniformLocation(depthProgram, "view");
+	depthProjID = glGetUniformLocation(depthProgram, "projection");
+	program = LoadShaders(shaders);
 	glUseProgram(program);	//My Pipeline is set up
 
 	//mvp_ID = glGetUniformLocation(program, "MVP");
 	modelID = glGetUniformLocation(program, "model");
 	projID = glGetUniformLocation(program, "projection");
 	viewID = glGetUniformLocation(program, "view");
+	eyeID = glGetUniformLocation(program, "eyePosition");
+	lightCountID = glGetUniformLocation(program, "lightCount");
+	lightIndicesID = glGetUniformLocation(program, "lightIndices");
+	lodBiasID = glGetUniformLocation(program, "lodBias");
 
 	// Projection matrix : 45∞ Field of View, aspect ratio, display range : 0.1 unit <-> 100 units
 	Projection = glm::perspective(glm::radians(45.0f), 1.0f / 1.0f, 0.1f, 100.0f);
+	if (terrainEnabled)
+		Projection = glm::perspective(glm::radians(45.0f), 1.0f / 1.0f, 0.1f, TERRAIN_VIEW_DISTANCE);
 	// Or, for an ortho camera :
 	// Projection = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, 0.0f, 100.0f); // In world coordinates
 
 	// Camera matrix
 	resetView();
 
-	// Image loading.
-	stbi_set_flip_vertically_on_load(true);
-
-	unsigned char* image = stbi_load("brick.jpg", &width, &height, &bitDepth, 0);
-	if (!image) cout << "Unable to load file!" << endl;
-
-	glGenTextures(1, &brickTx);
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-	// Note: image types with native transparency will need to be GL_RGBA instead of GL_RGB.
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	//glBindTexture(GL_TEXTURE_2D, 0);
-	stbi_image_free(image);
-
-	// Second texture. Blank one.
-
-	unsigned char* image2 = stbi_load("blank.jpg", &width, &height, &bitDepth, 0);
-	if (!image2) cout << "Unable to load file!" << endl;
-
-	glGenTextures(1, &blankTx);
-	glBindTexture(GL_TEXTURE_2D, blankTx);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image2);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	//glBindTexture(GL_TEXTURE_2D, 0);
-	stbi_image_free(image2);
-
-	unsigned char* image3 = stbi_load("grass.png", &width, &height, &bitDepth, 0);
-	if (!image3) cout << "Unable to load file!" << endl;
-
-	glGenTextures(1, &grassTx);
-	glBindTexture(GL_TEXTURE_2D, grassTx);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image3);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	//glBindTexture(GL_TEXTURE_2D, 0);
-	stbi_image_free(image3);
-
-	unsigned char* image4 = stbi_load("hedge.png", &width, &height, &bitDepth, 0);
-	if (!image4) cout << "Unable to load file!" << endl;
-
-	glGenTextures(1, &hedgeTx);
-	glBindTexture(GL_TEXTURE_2D, hedgeTx);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image4);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	//glBindTexture(GL_TEXTURE_2D, 0);
-	stbi_image_free(image4);
-
-	unsigned char* image5 = stbi_load("gate.jpg", &width, &height, &bitDepth, 0);
-	if (!image5) cout << "Unable to load file!" << endl;
-
-	glGenTextures(1, &gateTx);
-	glBindTexture(GL_TEXTURE_2D, gateTx);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image5);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	//glBindTexture(GL_TEXTURE_2D, 0);
-	stbi_image_free(image5);
-
-	unsigned char* image6 = stbi_load("gatetower.jpg", &width, &height, &bitDepth, 0);
-	if (!image6) cout << "Unable to load file!" << endl;
-
-	glGenTextures(1, &gatetowerTx);
-	glBindTexture(GL_TEXTURE_2D, gatetowerTx);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image6);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	stbi_image_free(image6);
-
-	unsigned char* image7 = stbi_load("stairs.jpg", &width, &height, &bitDepth, 0);
-	if (!image7) cout << "Unable to load file!" << endl;
-
-	glGenTextures(1, &stoneTx);
-	glBindTexture(GL_TEXTURE_2D, stoneTx);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image7);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	stbi_image_free(image7);
+	// Image loading. Decoded on worker threads and streamed in over the first
+	// frames; until then every texture points at a placeholder. The cache
+	// loads each file once and shares textures with identical pixels. The
+	// scene file says which images there are.
+	textures.Init();
+	textures.streamer.loader.maxSize = tierMaxSize(textureTier);
+	residency.Init();
+	if (!loadScene("castle.scene"))
+		cout << "Unable to load castle.scene, the scene will be empty!" << endl;
+	if (terrainEnabled)
+		textures.Load("grass.png", terrainTx);
+	if (teapotCount > 0)
+		textures.Load("blank.jpg", teapotTx);
+	textures.Begin();
 
 	glUniform1i(glGetUniformLocation(program, "texture0"), 0);
+	glUniform1i(glGetUniformLocation(program, "shadowMaps"), 1);
+	glUniform1i(glGetUniformLocation(program, "shadowsEnabled"), shadowsEnabled);
 
 	// Setting ambient Light.
 	glUniform3f(glGetUniformLocation(program, "aLight.ambientColour"), aLight.ambientColour.x, aLight.ambientColour.y, aLight.ambientColour.z);
@@ -329,6 +523,7 @@ void init(void)
 	glUniform1f(glGetUniformLocation(program, "pLights[0].constant"), pLights[0].constant);
 	glUniform1f(glGetUniformLocation(program, "pLights[0].linear"), pLights[0].linear);
 	glUniform1f(glGetUniformLocation(program, "pLights[0].exponent"), pLights[0].exponent);
+	glUniform1f(glGetUniformLocation(program, "pLights[0].range"), pLights[0].range);
 
 	glUniform3f(glGetUniformLocation(program, "pLights[1].base.diffuseColour"), pLights[1].diffuseColour.x, pLights[1].diffuseColour.y, pLights[1].diffuseColour.z);
 	glUniform1f(glGetUniformLocation(program, "pLights[1].base.diffuseStrength"), pLights[1].diffuseStrength);
@@ -336,6 +531,7 @@ void init(void)
 	glUniform1f(glGetUniformLocation(program, "pLights[1].constant"), pLights[1].constant);
 	glUniform1f(glGetUniformLocation(program, "pLights[1].linear"), pLights[1].linear);
 	glUniform1f(glGetUniformLocation(program, "pLights[1].exponent"), pLights[1].exponent);
+	glUniform1f(glGetUniformLocation(program, "pLights[1].range"), pLights[1].range);
 
 	vao = 0;
 	glGenVertexArrays(1, &vao);
@@ -353,6 +549,9 @@ void init(void)
 	uv_vbo = 0;
 	glGenBuffers(1, &uv_vbo);
 
+	normals_vbo = 0;
+	glGenBuffers(1, &normals_vbo);
+
 	glBindVertexArray(0); // Can optionally unbind the vertex array to avoid modification.
 
 	// Enable depth test.
@@ -362,6 +561,48 @@ void init(void)
 	glCullFace(GL_BACK);
 
 	glEnable(GL_BLEND);
+	// Strips in index buffers end at the all-ones index of their type, see RESTART_INDEX.
+	glEnable(GL_PRIMITIVE_RESTART_FIXED_INDEX);
+
+	buildScene();
+	meshlets.Init();
+	if (terrainEnabled)
+		terrain.Init(glm::vec3(5.0f, 0.0f, -5.0f), terrainHeightmap); // Middle of the castle's ground plane.
+	if (teapotCount > 0)
+	{
+		// The GPU backend shades with triangles.frag too, without point lights.
+		ShaderInfo teapotShaders[] = {
+			{ GL_VERTEX_SHADER, "teapot.vert" },
+			{ GL_TESS_CONTROL_SHADER, "teapot.tesc" },
+			{ GL_TESS_EVALUATION_SHADER, "teapot.tese" },
+			{ GL_FRAGMENT_SHADER, "triangles.frag" },
+			{ GL_NONE, NULL }
+		};
+		teapotProgram = GLEW_VERSION_4_0 || GLEW_ARB_tessellation_shader ? LoadShaders(teapotShaders) : 0;
+		if (teapotProgram)
+		{
+			glUseProgram(teapotProgram);
+			glUniform1i(glGetUniformLocation(teapotProgram, "texture0"), 0);
+			glUniform1i(glGetUniformLocation(teapotProgram, "shadowMaps"), 1);
+			glUniform1i(glGetUniformLocation(teapotProgram, "shadowsEnabled"), false);
+			glUniform3f(glGetUniformLocation(teapotProgram, "aLight.ambientColour"), aLight.ambientColour.x, aLight.ambientColour.y, aLight.ambientColour.z);
+			glUniform1f(glGetUniformLocation(teapotProgram, "aLight.ambientStrength"), aLight.ambientStrength);
+			glUniform1i(glGetUniformLocation(teapotProgram, "lightCount"), 0);
+			glUniform1f(glGetUniformLocation(teapotProgram, "lodBias"), 0.0f);
+			glUseProgram(program);
+		}
+		loadBezierPatches(TeapotVertices, TeapotIndices, NumTeapotPatches, teapots.patches);
+		placeTeapots(teapotCount);
+		teapots.Init(teapotProgram);
+	}
+	shadows.Init(shadowProgram, NUM_POINT_LIGHTS, SHADOW_BUDGET);
+	prepassTimer.Init();
+	shadingTimer.Init();
+	frameTimer.Init();
+	governor.Init(FRAME_BUDGET_MS, NUM_POINT_LIGHTS, "governor_log.csv");
+	postAA.Init();
+	glUseProgram(program);
+	glUniform1f(lodBiasID, governor.Current().lodBias);
 
 	timer(0);
 }
@@ -387,22 +628,98 @@ void calculateView()
 
 //---------------------------------------------------------------------
 //
-// transformModel
+// renderFrame
 //
-void transformObject(glm::vec3 scale, glm::vec3 rotationAxis, float rotationAngle, glm::vec3 translation) {
-	glm::mat4 Model;
-	Model = glm::mat4(1.0f);
-	Model = glm::translate(Model, translation);
-	Model = glm::rotate(Model, glm::radians(rotationAngle), rotationAxis);
-	Model = glm::scale(Model, scale);
+// Draws one frame into the back buffer without swapping.
+void renderFrame()
+{
+	chrono::high_resolution_clock::time_point cpuStart = chrono::high_resolution_clock::now();
+	frameTimer.Begin();
+
+	// Size the offscreen target for the current quality level.
+	const QualityLevel& quality = governor.Current();
+	int windowWidth = glutGet(GLUT_WINDOW_WIDTH), windowHeight = glutGet(GLUT_WINDOW_HEIGHT);
+	int targetWidth = (int)(windowWidth * quality.scale), targetHeight = (int)(windowHeight * quality.scale);
+	int samples = postAA.SceneSamples(quality.samples);
+	if (!sceneTarget.Matches(targetWidth, targetHeight, samples) && !sceneTarget.Create(targetWidth, targetHeight, samples) && samples > 0)
+	{
+		// The driver turned this sample count down, so the governor stops asking for it.
+		governor.LimitSamples(samples / 2);
+		sceneTarget.Create(targetWidth, targetHeight, 0);
+	}
+	sceneTarget.Bind();
+	FrameProjection = postAA.Jitter(Projection, targetWidth, targetHeight);
+	residency.pixelScale = targetHeight / (2.0f * tan(glm::radians(45.0f) * 0.5f));
+	residency.Update(textures);
+	textures.Update();
 
-	calculateView();
+	glClearColor(0.3, 0.8, 1.0, 1.0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	glBindVertexArray(vao);
+
+	// Only lights whose cube is out of date get re-rendered.
+	if (orbiting)
+		moveOrbiter();
+	shadows.Update(pLights, drawShadowCasters);
 
-	MVP = Projection * View * Model;
-	/*glUniformMatrix4fv(mvp_ID, 1, GL_FALSE, &MVP[0][0]);*/
-	glUniformMatrix4fv(modelID, 1, GL_FALSE, &Model[0][0]);
+	calculateView();
 	glUniformMatrix4fv(viewID, 1, GL_FALSE, &View[0][0]);
-	glUniformMatrix4fv(projID, 1, GL_FALSE, &Projection[0][0]);
+	glUniformMatrix4fv(projID, 1, GL_FALSE, &FrameProjection[0][0]);
+	glUniform3f(eyeID, position.x, position.y, position.z);
+
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, shadows.depthTx);
+	glActiveTexture(GL_TEXTURE0);
+
+	sortObjects();
+	if (meshlets.enabled)
+		meshlets.Cull(FrameProjection * View, position);
+	if (terrainEnabled)
+		terrain.Update(position, FrameProjection * View);
+
+	// Lay down depth first so the lighting shader only runs on visible fragments.
+	prepassTimer.Begin();
+	if (depthPrepass)
+		drawDepthPrepass();
+	prepassTimer.End();
+
+	// Draw all shapes.
+	shadingTimer.Begin();
+	lightAssigner.BeginFrame();
+	if (depthPrepass)
+	{
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+	}
+	for (unsigned i = 0; i < opaqueOrder.size(); i++)
+		drawObject(sceneObjects[opaqueOrder[i]]);
+	if (terrainEnabled)
+	{
+		textures.Bind(terrainTx);
+		residency.Touch(terrainTx, TERRAIN_TEXTURE_METRES, 0.0f);
+		glUniform1i(lightCountID, 0);
+		drawTerrain(modelID);
+	}
+	glDepthFunc(GL_LESS);
+	glDepthMask(GL_TRUE);
+	if (teapotCount > 0) // Not in the pre-pass, the GPU backend's vertices only exist here.
+	{
+		textures.Bind(teapotTx);
+		glUniform1i(lightCountID, 0);
+		teapots.Draw(position, View, FrameProjection, residency.pixelScale, program, modelID);
+		glBindVertexArray(vao);
+	}
+	for (unsigned i = 0; i < otherOrder.size(); i++)
+		drawObject(sceneObjects[otherOrder[i]]);
+	textures.Unbind();
+	shadingTimer.End();
+
+	glBindVertexArray(0); // Done writing.
+
+	postAA.Apply(sceneTarget, Projection * View, windowWidth, windowHeight);
+	frameTimer.End();
+	lastCpuMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - cpuStart).count();
 }
 
 //---------------------------------------------------------------------
@@ -411,459 +728,157 @@ void transformObject(glm::vec3 scale, glm::vec3 rotationAxis, float rotationAngl
 //
 void display(void)
 {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-	glClearColor(0.3, 0.8, 1.0, 1.0);
+	renderFrame();
+	glutSwapBuffers(); // Now for a potentially smoother render.
+	if (firstFrame)
+	{
+		firstFrame = false;
+		cout << "First frame after " << chrono::duration<float, milli>(chrono::high_resolution_clock::now() - startTime).count()
+			<< " ms" << endl;
+	}
 
-	glBindVertexArray(vao);
-	// Draw all shapes.
+	bool gpuResolved = frameTimer.Resolve();
+	if (terrainEnabled)
+	{
+		terrainCpuMs.push_back(lastCpuMs);
+		if (gpuResolved)
+			terrainGpuMs.push_back(frameTimer.lastMs);
+	}
+	if (governor.Update(lastCpuMs, frameTimer.lastMs))
+		glUniform1f(lodBiasID, governor.Current().lodBias);
+}
 
-	glBindTexture(GL_TEXTURE_2D, grassTx);
-	g_grid.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.0f, 1.0f, 1.0f), X_AXIS, -90.0f, glm::vec3(0.0f, 0.0f, 0.0f));
-	glDrawElements(GL_LINE_STRIP, g_grid.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, grassTx);
-	g_plane.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(10.0f, 10.0f, 1.0f), X_AXIS, -90.0f, glm::vec3(0.0f, 0.0f, 0.0f));
-	glDrawElements(GL_TRIANGLES, g_plane.NumIndices(), GL_UNSIGNED_SHORT, 0);
-	//grid and plane/ ground^
-	/// ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	//castse walls
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	LWall.ColorShape(1.0f, 0.9f, 0.65f);
-	LWall.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, LWall.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	RWall.ColorShape(1.0f, 0.9f, 0.65f);
-	RWall.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, RWall.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	BWall.ColorShape(1.0f, 0.9f, 0.65f);
-	BWall.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, BWall.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	FWallR.ColorShape(1.0f, 0.9f, 0.65f);
-	FWallR.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, FWallR.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	FWallM.ColorShape(1.0f, 0.9f, 0.65f);
-	FWallM.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, FWallM.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	FWallL.ColorShape(1.0f, 0.9f, 0.65f);
-	FWallL.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, FWallL.NumIndices(), GL_UNSIGNED_SHORT, 0);
-	////////////////////////////////////////////////////////////////////
-	//parapets
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	FWP1.ColorShape(1.0f, 0.9f, 0.65f);
-	FWP1.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, FWP1.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	FWP2.ColorShape(1.0f, 0.9f, 0.65f);
-	FWP2.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, FWP2.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	FWP3.ColorShape(1.0f, 0.9f, 0.65f);
-	FWP3.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, FWP3.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	FWP4.ColorShape(1.0f, 0.9f, 0.65f);
-	FWP4.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, FWP4.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	FWP5.ColorShape(1.0f, 0.9f, 0.65f);
-	FWP5.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, FWP5.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	LWP1.ColorShape(1.0f, 0.9f, 0.65f);
-	LWP1.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, LWP1.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	LWP2.ColorShape(1.0f, 0.9f, 0.65f);
-	LWP2.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, LWP2.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	LWP3.ColorShape(1.0f, 0.9f, 0.65f);
-	LWP3.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, LWP3.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	LWP4.ColorShape(1.0f, 0.9f, 0.65f);
-	LWP4.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, LWP4.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	LWP5.ColorShape(1.0f, 0.9f, 0.65f);
-	LWP5.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, LWP5.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	BWP1.ColorShape(1.0f, 0.9f, 0.65f);
-	BWP1.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, BWP1.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	BWP2.ColorShape(1.0f, 0.9f, 0.65f);
-	BWP2.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, BWP2.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	BWP3.ColorShape(1.0f, 0.9f, 0.65f);
-	BWP3.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, BWP3.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	BWP4.ColorShape(1.0f, 0.9f, 0.65f);
-	BWP4.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, BWP4.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	BWP5.ColorShape(1.0f, 0.9f, 0.65f);
-	BWP5.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, BWP5.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	RWP1.ColorShape(1.0f, 0.9f, 0.65f);
-	RWP1.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, RWP1.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	RWP2.ColorShape(1.0f, 0.9f, 0.65f);
-	RWP2.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, RWP2.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	RWP3.ColorShape(1.0f, 0.9f, 0.65f);
-	RWP3.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, RWP3.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	RWP4.ColorShape(1.0f, 0.9f, 0.65f);
-	RWP4.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, RWP4.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	RWP5.ColorShape(1.0f, 0.9f, 0.65f);
-	RWP5.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, RWP5.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-
-
-	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	glBindTexture(GL_TEXTURE_2D, gateTx);
-	gate.ColorShape(1.0f, 0.9f, 0.65f);
-	gate.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, gate.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, gateTx);
-	gate1.ColorShape(1.0f, 0.9f, 0.65f);
-	gate1.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -4.4f));
-	glDrawElements(GL_TRIANGLES, gate1.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, gateTx);
-	gate2.ColorShape(1.0f, 0.9f, 0.65f);
-	gate2.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -2.5f));
-	glDrawElements(GL_TRIANGLES, gate2.NumIndices(), GL_UNSIGNED_SHORT, 0);
-	//gate^
-	///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	//outer hedge maze below
-	glBindTexture(GL_TEXTURE_2D, hedgeTx);
-	OHMF.ColorShape(1.0f, 0.9f, 0.65f);
-	OHMF.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, OHMF.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, hedgeTx);
-	OHMR.ColorShape(1.0f, 0.9f, 0.65f);
-	OHMR.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, OHMR.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, hedgeTx);
-	OHML.ColorShape(1.0f, 0.9f, 0.65f);
-	OHML.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, OHML.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, hedgeTx);
-	OHMB.ColorShape(1.0f, 0.9f, 0.65f);
-	OHMB.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, OHMB.NumIndices(), GL_UNSIGNED_SHORT, 0);
-	/// outer hedge maze^
-	/// ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-	/// inner hedge maze
-	glBindTexture(GL_TEXTURE_2D, hedgeTx);
-	IHM1.ColorShape(1.0f, 0.9f, 0.65f);
-	IHM1.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, IHM1.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, hedgeTx);
-	IHM2.ColorShape(1.0f, 0.9f, 0.65f);
-	IHM2.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, IHM2.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, hedgeTx);
-	IHM3.ColorShape(1.0f, 0.9f, 0.65f);
-	IHM3.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, IHM3.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, hedgeTx);
-	IHM4.ColorShape(1.0f, 0.9f, 0.65f);
-	IHM4.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, IHM4.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, hedgeTx);
-	IHM5.ColorShape(1.0f, 0.9f, 0.65f);
-	IHM5.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, IHM5.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	MMS.ColorShape(1.0f, 0.9f, 0.65f);
-	MMS.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f));
-	glDrawElements(GL_TRIANGLES, MMS.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	/*Tower prism*/
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	//BRP.ColorShape(1.0f, 0.9f, 0.65f);
-	BRP.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.0f, 2.5f, 1.0f), X_AXIS, 0.0f, glm::vec3(9.7f, 0.0f, -10.9f));
-	glDrawElements(GL_TRIANGLES, BRP.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	//.ColorShape(1.0f, 0.9f, 0.65f);
-	FRP.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.0f, 2.5f, 1.0f), X_AXIS, 0.0f, glm::vec3(9.7f, 0.0f, -0.2f));
-	glDrawElements(GL_TRIANGLES, FRP.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	//.ColorShape(1.0f, 0.9f, 0.65f);
-	FLP.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.0f, 2.5f, 1.0f), X_AXIS, 0.0f, glm::vec3(-0.8f, 0.0f, -0.2f));
-	glDrawElements(GL_TRIANGLES, FLP.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	//.ColorShape(1.0f, 0.9f, 0.65f);
-	BLP.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.0f, 2.5f, 1.0f), X_AXIS, 0.0f, glm::vec3(-0.8f, 0.0f, -10.9f));
-	glDrawElements(GL_TRIANGLES, BLP.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	/*Tower cone*/
-
-	glBindTexture(GL_TEXTURE_2D, blankTx);
-	//.ColorShape(1.0f, 0.9f, 0.65f);
-	BRC.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.5f, 1.0f, 1.5f), X_AXIS, 0.0f, glm::vec3(9.45f, 2.5f, -11.15f));
-	glDrawElements(GL_TRIANGLES, BRC.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, blankTx);
-	//.ColorShape(1.0f, 0.9f, 0.65f);
-	FRC.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.5f, 1.0f, 1.5f), X_AXIS, 0.0f, glm::vec3(9.45f, 2.5f, -0.45f));
-	glDrawElements(GL_TRIANGLES, FRC.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, blankTx);
-	//.ColorShape(1.0f, 0.9f, 0.65f);
-	BLC.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.5f, 1.0f, 1.5f), X_AXIS, 0.0f, glm::vec3(-1.05f, 2.5f, -11.15f));
-	glDrawElements(GL_TRIANGLES, BLC.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, blankTx);
-	//.ColorShape(1.0f, 0.9f, 0.65f);
-	FLC.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.5f, 1.0f, 1.5f), X_AXIS, 0.0f, glm::vec3(-1.05f, 2.5f, -0.45f));
-	glDrawElements(GL_TRIANGLES, FLC.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	/*Gate house towers*/
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	RGT.ColorShape(1.0f, 0.9f, 0.65f);
-	RGT.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.0f, 3.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(5.5f, 0.0f, -1.0f));
-	glDrawElements(GL_TRIANGLES, RGT.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	LGT.ColorShape(1.0f, 0.9f, 0.65f);
-	LGT.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.0f, 3.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(3.5f, 0.0f, -1.0f));
-	glDrawElements(GL_TRIANGLES, LGT.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	/*Gate house center piece*/
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	MGT.ColorShape(1.0f, 0.9f, 0.65f);
-	MGT.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(1.0f, 1.6f, 2.0f), X_AXIS, 0.0f, glm::vec3(4.5f, 1.4f, -1.0f));
-	glDrawElements(GL_TRIANGLES, MGT.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	/*Gate house parapets*/
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	GHP1.ColorShape(1.0f, 0.9f, 0.65f);
-	GHP1.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(4.0f, 1.0f, -2.5f));
-	glDrawElements(GL_TRIANGLES, GHP1.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	GHP2.ColorShape(1.0f, 0.9f, 0.65f);
-	GHP2.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(3.0f, 1.0f, -2.5f));
-	glDrawElements(GL_TRIANGLES, GHP2.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	GHP3.ColorShape(1.0f, 0.9f, 0.65f);
-	GHP3.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(5.0f, 1.0f, -2.5f));
-	glDrawElements(GL_TRIANGLES, GHP3.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	GHP4.ColorShape(1.0f, 0.9f, 0.65f);
-	GHP4.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(2.0f, 2.0f, 1.0f), X_AXIS, 0.0f, glm::vec3(3.5f, 1.0f, -2.0f));
-	glDrawElements(GL_TRIANGLES, GHP4.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	GHP5.ColorShape(1.0f, 0.9f, 0.65f);
-	GHP5.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(2.0f, 2.0f, 1.0f), X_AXIS, 0.0f, glm::vec3(3.5f, 1.0f, -1.0f));
-	glDrawElements(GL_TRIANGLES, GHP5.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	GHP6.ColorShape(1.0f, 0.9f, 0.65f);
-	GHP6.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(2.0f, 2.0f, 1.0f), X_AXIS, 0.0f, glm::vec3(0.6f, 1.0f, -1.6f));
-	glDrawElements(GL_TRIANGLES, GHP6.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	GHP7.ColorShape(1.0f, 0.9f, 0.65f);
-	GHP7.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(2.0f, 2.0f, 1.0f), X_AXIS, 0.0f, glm::vec3(0.6f, 1.0f, -0.6f));
-	glDrawElements(GL_TRIANGLES, GHP7.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	GHP8.ColorShape(1.0f, 0.9f, 0.65f);
-	GHP8.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.8f, 1.0f, -4.4f));
-	glDrawElements(GL_TRIANGLES, GHP8.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	GHP9.ColorShape(1.0f, 0.9f, 0.65f);
-	GHP9.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(3.8f, 1.0f, -4.4f));
-	glDrawElements(GL_TRIANGLES, GHP9.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	GHP10.ColorShape(1.0f, 0.9f, 0.65f);
-	GHP10.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(4.8f, 1.0f, -4.4f));
-	glDrawElements(GL_TRIANGLES, GHP10.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	/*Stairs exiting out of gate*/
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	S1.ColorShape(1.0f, 0.9f, 0.65f);
-	S1.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 0.5f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.27f, 0.0f, 1.0f));
-	glDrawElements(GL_TRIANGLES, S1.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	S2.ColorShape(1.0f, 0.9f, 0.65f);
-	S2.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 0.5f, 1.5f), X_AXIS, 0.0f, glm::vec3(2.27f, 0.01f, 0.5f));
-	glDrawElements(GL_TRIANGLES, S2.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, brickTx);
-	S3.ColorShape(1.0f, 0.9f, 0.65f);
-	S3.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 0.5f, 1.0f), X_AXIS, 0.0f, glm::vec3(2.27f, 0.02f, 0.0f));
-	glDrawElements(GL_TRIANGLES, S3.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	/*Stone stairs leading towards gate*/
-	glBindTexture(GL_TEXTURE_2D, stoneTx);
-	SS4.ColorShape(1.0f, 0.9f, 0.65f);
-	SS4.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 5.0f), X_AXIS, 0.0f, glm::vec3(2.5f, -2.5f, -7.5f));
-	glDrawElements(GL_TRIANGLES, SS4.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, stoneTx);
-	SS5.ColorShape(1.0f, 0.9f, 0.65f);
-	SS5.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 5.0f), X_AXIS, 0.0f, glm::vec3(2.5f, -2.5f, -7.25f));
-	glDrawElements(GL_TRIANGLES, SS5.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, stoneTx);
-	SS1.ColorShape(1.0f, 0.9f, 0.65f);
-	SS1.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 2.0f, 5.0f), X_AXIS, 0.0f, glm::vec3(2.5f, -2.5f, -7.0f));
-	glDrawElements(GL_TRIANGLES, SS1.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, stoneTx);
-	SS3.ColorShape(1.0f, 0.9f, 0.65f);
-	SS3.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 1.0f, 5.0f), X_AXIS, 0.0f, glm::vec3(2.5f, -1.5f, -6.75f));
-	glDrawElements(GL_TRIANGLES, SS3.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	glBindTexture(GL_TEXTURE_2D, stoneTx);
-	SS2.ColorShape(1.0f, 0.9f, 0.65f);
-	SS2.BufferShape(&ibo, &points_vbo, &colors_vbo, &uv_vbo);
-	transformObject(glm::vec3(5.0f, 0.5f, 5.0f), X_AXIS, 0.0f, glm::vec3(2.5f, -1.0f, -6.5f));
-	glDrawElements(GL_TRIANGLES, SS2.NumIndices(), GL_UNSIGNED_SHORT, 0);
-
-	/*Main front entrance wooden gate*/
+//---------------------------------------------------------------------
+//
+// compareAAModes
+//
+// Renders the current view with every AA mode at full quality and prints
+// GPU time plus the difference from the 8x MSAA image (RMSE and PSNR).
+void compareAAModes()
+{
+	bool governorWas = governor.enabled;
+	int levelWas = governor.level;
+	AAMode modeWas = postAA.mode;
+	governor.enabled = false;
+	governor.level = 0;
+	glUniform1f(lodBiasID, governor.Current().lodBias);
+
+	int w = glutGet(GLUT_WINDOW_WIDTH), h = glutGet(GLUT_WINDOW_HEIGHT);
+	vector<unsigned char> reference, image(w * h * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	cout << "AA comparison at " << w << "x" << h << ", reference is " << governor.Current().samples << "x MSAA" << endl;
+	for (int m = 0; m < AA_MODE_COUNT; m++)
+	{
+		postAA.SetMode((AAMode)m);
+		float gpuMs = 0.0f;
+		int timed = 0;
+		for (int i = 0; i < AA_COMPARE_FRAMES; i++) // Later frames only, TAA needs time to converge.
+		{
+			renderFrame();
+			glFinish();
+			if (frameTimer.Resolve() && i >= AA_COMPARE_FRAMES / 2)
+			{
+				gpuMs += frameTimer.lastMs;
+				timed++;
+			}
+		}
+		glReadBuffer(GL_BACK);
+		glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, &image[0]);
+		if (m == AA_MSAA)
+			reference = image;
+
+		double squared = 0.0;
+		for (unsigned i = 0; i < image.size(); i++)
+		{
+			double d = (double)image[i] - reference[i];
+			squared += d * d;
+		}
+		double mse = squared / image.size();
+		cout << "  " << aaModeNames[m] << ": " << (timed ? gpuMs / timed : 0.0f) << " ms GPU, RMSE " << sqrt(mse)
+			<< ", PSNR ";
+		if (mse > 0.0)
+			cout << 10.0 * log10(255.0 * 255.0 / mse) << " dB" << endl;
+		else
+			cout << "inf" << endl;
+	}
+	postAA.SetMode(modeWas);
+	governor.enabled = governorWas;
+	governor.level = min(levelWas, (int)governor.levels.size() - 1); // MSAA levels may have been dropped meanwhile.
+	glUniform1f(lodBiasID, governor.Current().lodBias);
+}
 
+//---------------------------------------------------------------------
+//
+// countVertexShaderRuns
+//
+// Vertex shader invocations and GPU milliseconds per draw of shape, with
+// whatever program is bound.
+GLuint64 countVertexShaderRuns(Shape& shape, GLuint queries[2], float& gpuMs)
+{
+	glBindVertexArray(vao);
+	shape.BufferPositions(&ibo, &points_vbo);
+	glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, queries[0]);
+	glBeginQuery(GL_TIME_ELAPSED, queries[1]);
+	for (int i = 0; i < VERTEX_BENCH_DRAWS; i++)
+		glDrawElements(GL_TRIANGLES, shape.NumIndices(), shape.IndexType(), 0);
+	glEndQuery(GL_TIME_ELAPSED);
+	glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
+	GLuint64 runs = 0, ns = 0;
+	glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &runs);
+	glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &ns);
+	gpuMs = ns / 1.0e6f / VERTEX_BENCH_DRAWS;
+	return runs / VERTEX_BENCH_DRAWS;
+}
 
-	glBindVertexArray(0); // Done writing.
-	glutSwapBuffers(); // Now for a potentially smoother render.
+//---------------------------------------------------------------------
+//
+// compareVertexOrders
+//
+// Draws big generated shapes in the order they were built and again after
+// MeshOptimizer, counting vertex shader runs with a pipeline statistics
+// query. The measured ACMR (runs per triangle) is printed next to what the
+// FIFO model predicts; GPUs differ in how they reuse vertices, so the two
+// needn't agree. Rasterization is off, so only the vertex stage is timed.
+void compareVertexOrders()
+{
+	if (!GLEW_ARB_pipeline_statistics_query)
+	{
+		cout << "Counting vertex shader runs needs GL_ARB_pipeline_statistics_query." << endl;
+		return;
+	}
+	Grid grid64(64), grid256(256), grid1000(1000);
+	TowerPrism prism(64);
+	TowerCone cone(64);
+	Shape* shapes[] = { &grid64, &grid256, &grid1000, &prism, &cone };
+	const char* names[] = { "Grid(64)", "Grid(256)", "Grid(1000)", "TowerPrism(64)", "TowerCone(64)" };
+
+	GLuint queries[2];
+	glGenQueries(2, queries);
+	glUseProgram(depthProgram);
+	glm::mat4 identity(1.0f);
+	glUniformMatrix4fv(depthModelID, 1, GL_FALSE, &identity[0][0]);
+	glUniformMatrix4fv(depthViewID, 1, GL_FALSE, &identity[0][0]);
+	glUniformMatrix4fv(depthProjID, 1, GL_FALSE, &identity[0][0]);
+	glEnable(GL_RASTERIZER_DISCARD);
+	cout << "Vertex shader runs per draw, built order -> optimized (ACMR measured / " << VCACHE_SIZE << " entry FIFO model):" << endl;
+	for (unsigned s = 0; s < sizeof(shapes) / sizeof(shapes[0]); s++)
+	{
+		Shape optimized = *shapes[s];
+		optimizeShape(optimized);
+		Shape* orders[2] = { shapes[s], &optimized };
+		cout << "  " << names[s] << ", " << shapes[s]->NumIndices() / 3 << " triangles:";
+		for (int o = 0; o < 2; o++)
+		{
+			float gpuMs = 0.0f;
+			GLuint64 runs = countVertexShaderRuns(*orders[o], queries, gpuMs);
+			cout << (o ? " ->" : "") << " " << runs << " (" << (float)runs / (orders[o]->NumIndices() / 3) << " / "
+				<< vertexCacheStats(*orders[o]).Acmr() << ", " << gpuMs << " ms)";
+		}
+		cout << endl;
+	}
+	glDisable(GL_RASTERIZER_DISCARD);
+	glUseProgram(program);
+	glDeleteQueries(2, queries);
 }
 
 void parseKeys()
@@ -882,8 +897,77 @@ void parseKeys()
 		position.y -= MOVESPEED;
 }
 
+// The time p of the way up the sorted list, e.g. 0.99 for the 99th percentile.
+float percentileMs(vector<float>& ms, float p)
+{
+	if (ms.empty())
+		return 0.0f;
+	sort(ms.begin(), ms.end());
+	return ms[min(ms.size() - 1, (size_t)(p * ms.size()))];
+}
+
+void printStats()
+{
+	int now = glutGet(GLUT_ELAPSED_TIME);
+	if (now - lastStatsTime < 2000)
+		return;
+	lastStatsTime = now;
+	cout << "Shadow pass (" << (shadows.cacheEnabled ? "cached" : "uncached") << (orbiting ? ", caster orbiting" : "") << "): "
+		<< shadows.timer.averageMs << " ms GPU, " << shadows.facesRendered << " faces last frame" << endl;
+	cout << "Light evaluations: " << lightAssigner.evaluations << " per frame (every light everywhere: "
+		<< lightAssigner.naiveEvaluations << ", overflows: " << lightAssigner.overflows << ")" << endl;
+	cout << "Pre-pass " << (depthPrepass ? "on" : "off") << ", " << (frontToBack ? "front to back" : "declaration order")
+		<< ": depth " << prepassTimer.averageMs << " ms + shading " << shadingTimer.averageMs << " ms = "
+		<< prepassTimer.averageMs + shadingTimer.averageMs << " ms GPU" << endl;
+	if (!textures.streamer.Done())
+		cout << "Streaming textures: " << textures.streamer.resident << "/" << textures.streamer.loader.requests.size()
+			<< " resident, " << textures.streamer.frameBytes / 1024 << " KB last frame" << endl;
+	cout << "Texture memory: " << residency.usedBytes / (1024 * 1024) << "/" << residency.budgetBytes / (1024 * 1024) << " MB, "
+		<< residency.evictions << " evictions and " << residency.restores << " restores last frame (" << residency.totalEvictions
+		<< " and " << residency.totalRestores << " in all)" << endl;
+	if (meshlets.enabled && meshlets.frames > 0)
+	{
+		float count = (float)meshlets.Count();
+		cout << "Meshlets: " << 100.0f * meshlets.offscreen / count << "% off screen, " << 100.0f * meshlets.backfacing / count
+			<< "% facing away, " << meshlets.drawnTriangles << "/" << meshlets.totalTriangles << " triangles in "
+			<< meshlets.commands.size() << " draws last frame; since 'k': " << 100.0 * meshlets.totalOffscreen / meshlets.totalMeshlets
+			<< "% off screen, " << 100.0 * meshlets.totalBackfacing / meshlets.totalMeshlets << "% facing away, "
+			<< 100.0 * meshlets.totalDrawn / meshlets.totalAll << "% of triangles drawn over " << meshlets.frames << " frames" << endl;
+	}
+	if (terrainEnabled)
+	{
+		cout << "Terrain: " << terrain.resident << " chunks resident, " << terrain.Queued() << " on the way, " << terrain.visible.size()
+			<< " drawn with " << terrain.drawnTriangles << " triangles; " << terrain.totalLoads << " loads and " << terrain.totalUnloads
+			<< " unloads in all, " << terrain.buildMs << " ms to build the last" << endl;
+		// Frames while flying about should stay as even far out as at the castle.
+		float fromCentre = glm::length(glm::vec2(position.x - terrain.originX, position.z - terrain.originZ) - glm::vec2(terrain.ChunkSize() * TERRAIN_CHUNKS * 0.5f));
+		cout << "Terrain frames at " << fromCentre << " m from the centre, " << terrainCpuMs.size() << " frames: CPU p50 "
+			<< percentileMs(terrainCpuMs, 0.5f) << " p95 " << percentileMs(terrainCpuMs, 0.95f) << " p99 " << percentileMs(terrainCpuMs, 0.99f)
+			<< " max " << percentileMs(terrainCpuMs, 1.0f) << " ms, GPU p50 " << percentileMs(terrainGpuMs, 0.5f) << " p95 "
+			<< percentileMs(terrainGpuMs, 0.95f) << " p99 " << percentileMs(terrainGpuMs, 0.99f) << " max " << percentileMs(terrainGpuMs, 1.0f) << " ms" << endl;
+		terrainCpuMs.clear();
+		terrainGpuMs.clear();
+	}
+	if (teapotCount > 0)
+	{
+		teapots.primitives.Resolve();
+		float drawMs = teapots.drawTimer.averageMs, triangles = (float)teapots.primitives.last;
+		cout << "Teapots (" << (teapots.backend == PATCHES_GPU && teapots.gpuSupported ? "GPU" : "CPU") << "): "
+			<< teapots.instances.size() << " x " << teapots.patches.size() << " patches, " << teapots.primitives.last << " triangles";
+		if (teapots.backend == PATCHES_CPU || !teapots.gpuSupported)
+			cout << ", tessellated in " << teapots.tessellateMs << " ms (" << teapots.cpuTriangles / max(teapots.tessellateMs, 0.001f) / 1000.0f
+				<< " M triangles/s) from " << teapots.patchesDrawn << " patches on screen";
+		cout << ", drawn in " << drawMs << " ms GPU (" << triangles / max(drawMs, 0.001f) / 1000.0f << " M triangles/s)" << endl;
+	}
+	const QualityLevel& q = governor.Current();
+	cout << "Frame " << governor.smoothedMs << " ms / " << governor.targetMs << " ms budget, governor "
+		<< (governor.enabled ? "on" : "off") << " at level " << governor.level << " (scale " << q.scale << ", "
+		<< q.samples << "x MSAA, LOD bias " << q.lodBias << ", " << q.lights << " lights), AA " << aaModeNames[postAA.mode] << endl;
+}
+
 void timer(int) { // essentially our update()
 	parseKeys();
+	printStats();
 	glutPostRedisplay();
 	glutTimerFunc(1000 / FPS, timer, 0); // 60 FPS or 16.67ms.
 }
@@ -914,6 +998,68 @@ void keyDown(unsigned char key, int x, int y) // x and y is mouse location upon
 	case 'f':
 		if (!(keys & KEY_DOWN))
 			keys |= KEY_DOWN; break;
+	case 'c': // Toggle shadow caching to compare the cost.
+		shadows.cacheEnabled = !shadows.cacheEnabled;
+		shadows.timer.averageMs = 0.0f;
+		break;
+	case 'n': // Start or stop the caster orbiting the yellow light, which invalidates the cubes it passes through.
+		orbiting = !orbiting && orbiter >= 0;
+		lastOrbitTime = glutGet(GLUT_ELAPSED_TIME);
+		shadows.timer.averageMs = 0.0f;
+		cout << "Shadow caster " << (orbiting ? "orbiting" : orbiter >= 0 ? "stopped" : "missing, no TowerCone in the pack") << endl;
+		break;
+	case 'x':
+		shadowsEnabled = !shadowsEnabled;
+		glUniform1i(glGetUniformLocation(program, "shadowsEnabled"), shadowsEnabled);
+		break;
+	case 'g': // Toggle the frame governor, off means full quality.
+		governor.enabled = !governor.enabled;
+		if (!governor.enabled && governor.SetLevel(0, 0.0f, frameTimer.lastMs, "disabled"))
+			glUniform1f(lodBiasID, governor.Current().lodBias);
+		break;
+	case 'm': // Cycle anti-aliasing modes.
+		postAA.SetMode((AAMode)((postAA.mode + 1) % AA_MODE_COUNT));
+		cout << "Anti-aliasing: " << aaModeNames[postAA.mode] << endl;
+		break;
+	case 'b': // Benchmark every AA mode against MSAA.
+		compareAAModes();
+		break;
+	case '[': // Halve or double the texture streaming budget.
+	case ']':
+		textures.streamer.budgetBytes = key == '[' ? max(textures.streamer.budgetBytes / 2, (size_t)4096) :
+			textures.streamer.budgetBytes * 2;
+		cout << "Texture streaming budget: " << textures.streamer.budgetBytes / 1024 << " KB per frame" << endl;
+		break;
+	case 't': // Texture memory, per file.
+		textures.Report();
+		break;
+	case ',': // Halve or double the texture memory budget.
+	case '.':
+		residency.budgetBytes = key == ',' ? max(residency.budgetBytes / 2, (size_t)1024 * 1024) : residency.budgetBytes * 2;
+		cout << "Texture memory budget: " << residency.budgetBytes / (1024 * 1024) << " MB" << endl;
+		break;
+	case 'p': // Toggle the depth pre-pass.
+		depthPrepass = !depthPrepass;
+		prepassTimer.averageMs = shadingTimer.averageMs = 0.0f;
+		break;
+	case 'o': // Toggle front to back sorting.
+		frontToBack = !frontToBack;
+		prepassTimer.averageMs = shadingTimer.averageMs = 0.0f;
+		break;
+	case 'v': // Vertex shader runs for generated shapes, before and after mesh optimization.
+		compareVertexOrders();
+		break;
+	case 'k': // Toggle meshlet culling, restarting its walk-through averages.
+		meshlets.enabled = !meshlets.enabled && meshlets.supported;
+		meshlets.ResetTotals();
+		cout << "Meshlet culling " << (meshlets.enabled ? "on" : meshlets.supported ? "off" : "needs multi-draw indirect") << endl;
+		break;
+	case 'j': // Tessellate the teapots on the CPU or in tessellation shaders.
+		teapots.backend = teapots.backend == PATCHES_CPU ? PATCHES_GPU : PATCHES_CPU;
+		teapots.drawTimer.averageMs = 0.0f;
+		cout << "Teapot tessellation on the " << (teapots.backend == PATCHES_CPU ? "CPU" : teapots.gpuSupported ? "GPU" :
+			"CPU, tessellation shaders aren't supported") << endl;
+		break;
 	}
 }
 
@@ -996,8 +1142,24 @@ void mouseClick(int btn, int state, int x, int y)
 void clean()
 {
 	cout << "Cleaning up!" << endl;
-	glDeleteTextures(1, &brickTx);
-	glDeleteTextures(1, &blankTx);
+	textures.Clean();
+	meshPack.Clean();
+	meshlets.Clean();
+	if (terrainEnabled)
+		terrain.Clean();
+	if (teapotCount > 0)
+	{
+		teapots.Clean();
+		glDeleteProgram(teapotProgram);
+	}
+	delete bigGrid;
+	shadows.Clean();
+	prepassTimer.Clean();
+	shadingTimer.Clean();
+	frameTimer.Clean();
+	sceneTarget.Destroy();
+	postAA.Clean();
+	governor.Clean();
 }
 
 //---------------------------------------------------------------------
@@ -1006,9 +1168,25 @@ void clean()
 //
 int main(int argc, char** argv)
 {
+	startTime = chrono::high_resolution_clock::now();
 	glutInit(&argc, argv);
-	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA | GLUT_MULTISAMPLE);
-	glutSetOption(GLUT_MULTISAMPLE, 8);
+	for (int i = 1; i < argc; i++)
+		if (strcmp(argv[i], "-low") == 0)
+			textureTier = TIER_LOW;
+		else if (strcmp(argv[i], "-medium") == 0)
+			textureTier = TIER_MEDIUM;
+		else if (strcmp(argv[i], "-grid") == 0 && i + 1 < argc)
+			gridQuads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-terrain") == 0)
+		{
+			terrainEnabled = true;
+			if (i + 1 < argc && argv[i + 1][0] != '-')
+				terrainHeightmap = argv[++i];
+		}
+		else if (strcmp(argv[i], "-teapots") == 0)
+			teapotCount = i + 1 < argc && atoi(argv[i + 1]) > 0 ? atoi(argv[++i]) : 64;
+	// MSAA is done in the offscreen scene target, whose sample count the governor controls.
+	glutInitDisplayMode(GLUT_DEPTH | GLUT_DOUBLE | GLUT_RGBA);
 	glutInitWindowSize(1024, 1024);
 	glutCreateWindow("GAME2012_Final");
 
@@ -0,0 +1,130 @@
+#pragma once
+#include <cstdio>
+#include <vector>
+#include <GL\glew.h>
+using namespace std;
+
+#define GOVERNOR_OVER_FRAMES 10	  // Frames over budget before stepping down.
+#define GOVERNOR_UNDER_FRAMES 90  // Frames well under budget before stepping up.
+#define GOVERNOR_COOLDOWN 30	  // Frames to wait after any change.
+#define GOVERNOR_HEADROOM 0.75f	  // Step up only below this fraction of the budget.
+
+// One rung of the quality ladder.
+struct QualityLevel
+{
+	float scale;	// Render target size relative to the window.
+	int samples;	// MSAA samples, 0 for none.
+	float lodBias;	// Added to texture LOD in the fragment shader.
+	int lights;		// Active point lights.
+};
+
+// Holds the frame time under a budget by walking a quality ladder. Level 0
+// is full quality; each step down trades something cheaper first: MSAA,
+// then resolution, then texture detail, then lights. Over-budget frames
+// react quickly and under-budget frames slowly, and every change is
+// followed by a cooldown so it doesn't oscillate.
+struct FrameGovernor
+{
+	vector<QualityLevel> levels;
+	int level;
+	bool enabled;
+	float targetMs, smoothedMs;
+	int overCount, underCount, cooldown, frame;
+	FILE* log;
+
+	FrameGovernor()
+	{
+		level = 0;
+		enabled = true;
+		targetMs = 1000.0f / 60.0f;
+		smoothedMs = 0.0f;
+		overCount = underCount = cooldown = frame = 0;
+		log = NULL;
+	}
+	void Init(float budgetMs, int maxLights, const char* logPath)
+	{
+		targetMs = budgetMs;
+		QualityLevel q = { 1.0f, 8, 0.0f, maxLights };
+		levels.clear();
+		levels.push_back(q);
+		for (q.samples = 4; q.samples >= 2; q.samples /= 2)
+			levels.push_back(q);
+		q.samples = 0;
+		levels.push_back(q);
+		for (q.scale = 0.875f; q.scale >= 0.5f; q.scale -= 0.125f)
+			levels.push_back(q);
+		q.scale = 0.5f;
+		for (q.lodBias = 1.0f; q.lodBias <= 2.0f; q.lodBias += 1.0f)
+			levels.push_back(q);
+		q.lodBias = 2.0f;
+		for (q.lights = maxLights - 1; q.lights >= 1; q.lights--)
+			levels.push_back(q);
+		GLint maxSamples = 0;
+		glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+		LimitSamples(maxSamples);
+
+#ifdef WIN32
+		fopen_s(&log, logPath, "w");
+#else
+		log = fopen(logPath, "w");
+#endif
+		if (log)
+			fprintf(log, "frame,cpu_ms,gpu_ms,smoothed_ms,level,scale,samples,lod_bias,lights,reason\n");
+	}
+	void Clean()
+	{
+		if (log)
+			fclose(log);
+		log = NULL;
+	}
+	// Drops the MSAA levels above maxSamples, staying on the nearest cheaper level.
+	void LimitSamples(int maxSamples)
+	{
+		for (int i = (int)levels.size() - 1; i >= 0; i--)
+			if (levels[i].samples > maxSamples)
+			{
+				levels.erase(levels.begin() + i);
+				if (level > i)
+					level--;
+			}
+		if (level >= (int)levels.size())
+			level = (int)levels.size() - 1;
+	}
+	const QualityLevel& Current() { return levels[level]; }
+	// Feed one frame's timings. Returns true if the quality level changed.
+	bool Update(float cpuMs, float gpuMs)
+	{
+		frame++;
+		float frameMs = cpuMs > gpuMs ? cpuMs : gpuMs; // Whichever side is the bottleneck.
+		smoothedMs = (smoothedMs == 0.0f) ? frameMs : smoothedMs * 0.9f + frameMs * 0.1f;
+		if (!enabled)
+			return false;
+		if (cooldown > 0)
+		{
+			cooldown--;
+			return false;
+		}
+		overCount = (smoothedMs > targetMs) ? overCount + 1 : 0;
+		underCount = (smoothedMs < targetMs * GOVERNOR_HEADROOM) ? underCount + 1 : 0;
+
+		if (overCount >= GOVERNOR_OVER_FRAMES && level < (int)levels.size() - 1)
+			return SetLevel(level + 1, cpuMs, gpuMs, "over budget");
+		if (underCount >= GOVERNOR_UNDER_FRAMES && level > 0)
+			return SetLevel(level - 1, cpuMs, gpuMs, "under budget");
+		return false;
+	}
+	bool SetLevel(int newLevel, float cpuMs, float gpuMs, const char* reason)
+	{
+		level = newLevel;
+		overCount = underCount = 0;
+		cooldown = GOVERNOR_COOLDOWN;
+		const QualityLevel& q = levels[level];
+		if (log)
+		{
+			fprintf(log, "%d,%.3f,%.3f,%.3f,%d,%.3f,%d,%.1f,%d,%s\n", frame, cpuMs, gpuMs, smoothedMs,
+				level, q.scale, q.samples, q.lodBias, q.lights, reason);
+			fflush(log);
+		}
+		return true;
+	}
+};
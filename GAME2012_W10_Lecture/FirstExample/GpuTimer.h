@@ -0,0 +1,78 @@
+#pragma once
+#include <GL\glew.h>
+
+// Measures GPU time between Begin() and End() with a pair of GL_TIMESTAMP
+// queries. Unlike GL_TIME_ELAPSED these can be nested, so a whole-frame
+// timer can wrap the per-pass ones. Queries are kept in a small ring so
+// reading a result never stalls the pipeline; the value reported is from
+// a frame or two ago.
+#define GPU_TIMER_QUERIES 4
+
+struct GpuTimer
+{
+	GLuint queries[GPU_TIMER_QUERIES * 2]; // Start and end stamp per slot.
+	bool pending[GPU_TIMER_QUERIES];
+	int current;
+	bool running;
+	float lastMs, averageMs;
+
+	GpuTimer()
+	{
+		for (int i = 0; i < GPU_TIMER_QUERIES; i++)
+		{
+			queries[i * 2] = queries[i * 2 + 1] = 0;
+			pending[i] = false;
+		}
+		current = 0;
+		running = false;
+		lastMs = averageMs = 0.0f;
+	}
+	void Init()
+	{
+		glGenQueries(GPU_TIMER_QUERIES * 2, queries);
+	}
+	void Clean()
+	{
+		glDeleteQueries(GPU_TIMER_QUERIES * 2, queries);
+	}
+	void Begin()
+	{
+		Resolve();
+		if (pending[current]) // Ring is full, skip this sample rather than wait.
+			return;
+		glQueryCounter(queries[current * 2], GL_TIMESTAMP);
+		running = true;
+	}
+	void End()
+	{
+		if (!running)
+			return;
+		glQueryCounter(queries[current * 2 + 1], GL_TIMESTAMP);
+		pending[current] = true;
+		running = false;
+		current = (current + 1) % GPU_TIMER_QUERIES;
+	}
+	// Collects every finished query. Returns true if a new value arrived.
+	bool Resolve()
+	{
+		bool updated = false;
+		for (int i = 0; i < GPU_TIMER_QUERIES; i++)
+		{
+			int q = (current + i) % GPU_TIMER_QUERIES; // Oldest first.
+			if (!pending[q])
+				continue;
+			GLint available = 0;
+			glGetQueryObjectiv(queries[q * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+			GLuint64 start = 0, end = 0;
+			glGetQueryObjectui64v(queries[q * 2], GL_QUERY_RESULT, &start);
+			glGetQueryObjectui64v(queries[q * 2 + 1], GL_QUERY_RESULT, &end);
+			pending[q] = false;
+			lastMs = (end - start) / 1000000.0f;
+			averageMs = (averageMs == 0.0f) ? lastMs : averageMs * 0.9f + lastMs * 0.1f;
+			updated = true;
+		}
+		return updated;
+	}
+};
@@ -32,6 +32,7 @@ struct PointLight : public Light
 		glm::vec3 dCol, GLfloat dStr) : Light(dCol, dStr)
 	{
 		position = pos;
+		this->range = range;
 		constant = 1.0f;
 		linear = 4.5f / range;
 		exponent = 75.0f / (range * range);
@@ -0,0 +1,65 @@
+#pragma once
+#include <GL\glew.h>
+#include "glm\glm.hpp"
+#include "Light.h"
+#include "Scene.h"
+
+// Squared distance from a point to a box, zero when the point is inside.
+inline float distanceSqToBox(glm::vec3 p, glm::vec3 boxMin, glm::vec3 boxMax)
+{
+	glm::vec3 closest = glm::clamp(p, boxMin, boxMax);
+	glm::vec3 d = p - closest;
+	return glm::dot(d, d);
+}
+
+// Gives each object the short list of point lights whose range sphere touches
+// its bounds, so the fragment shader loops over those instead of every light.
+// Cheaper than clustered lighting while the scene only has tens of lights.
+struct LightAssigner
+{
+	int evaluations;	  // Per-draw light evaluations this frame.
+	int naiveEvaluations; // What evaluating every light for every draw would cost.
+	int overflows;		  // Objects that hit MAX_LIGHTS_PER_OBJECT.
+
+	LightAssigner()
+	{
+		evaluations = naiveEvaluations = overflows = 0;
+	}
+	void BeginFrame()
+	{
+		evaluations = naiveEvaluations = overflows = 0;
+	}
+	// Keeps the closest lights if more than MAX_LIGHTS_PER_OBJECT overlap.
+	void Assign(SceneObject& o, PointLight* lights, int numLights)
+	{
+		float distances[MAX_LIGHTS_PER_OBJECT];
+		o.lightCount = 0;
+		for (int i = 0; i < numLights; i++)
+		{
+			float d = distanceSqToBox(lights[i].position, o.boundsMin, o.boundsMax);
+			if (d > lights[i].range * lights[i].range)
+				continue;
+			int slot = o.lightCount;
+			if (slot == MAX_LIGHTS_PER_OBJECT)
+			{
+				overflows++;
+				if (d >= distances[slot - 1])
+					continue;
+				slot--; // Drop the farthest one.
+			}
+			else
+				o.lightCount++;
+			// Insertion sort by distance.
+			while (slot > 0 && distances[slot - 1] > d)
+			{
+				distances[slot] = distances[slot - 1];
+				o.lightIndices[slot] = o.lightIndices[slot - 1];
+				slot--;
+			}
+			distances[slot] = d;
+			o.lightIndices[slot] = i;
+		}
+		evaluations += o.lightCount;
+		naiveEvaluations += numLights;
+	}
+};
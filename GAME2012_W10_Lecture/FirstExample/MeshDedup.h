@@ -0,0 +1,135 @@
+#pragma once
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cfloat>
+#include <GL\glew.h>
+#include "glm\glm.hpp"
+#include "glm\gtc\matrix_transform.hpp"
+#include "glm\gtx\hash.hpp"
+using namespace std;
+
+#define DEDUP_GRID 4096.0f // Canonical positions are compared on a grid this fine, so float noise can't split a match.
+
+// A mesh as flat arrays, the way a MeshPack or MeshPackBuilder holds it.
+struct MeshView
+{
+	const GLfloat* positions;
+	const GLfloat* colors;
+	const GLfloat* uvs;
+	const GLfloat* normals; // Not compared: they follow from the positions and indices.
+	unsigned vertexCount;
+	const unsigned char* indices;
+	unsigned indexBytes; // 2 or 4.
+	unsigned indexCount;
+
+	unsigned Index(unsigned i) const { return indexBytes == 2 ? ((const GLushort*)indices)[i] : ((const GLuint*)indices)[i]; }
+};
+
+// A mesh's positions squeezed into the unit cube by its bounds, snapped to
+// DEDUP_GRID. toMesh is the scale and offset that puts them back. Two meshes
+// with the same canonical positions, colours, UVs and indices are the same
+// geometry up to that transform, however they were sized and placed.
+struct CanonicalMesh
+{
+	vector<glm::ivec3> positions;
+	glm::mat4 toMesh;
+	size_t hash;
+};
+
+inline void hashCombine(size_t& seed, size_t value)
+{
+	seed ^= value + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+}
+
+inline void canonicalize(const MeshView& m, CanonicalMesh& c)
+{
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	for (unsigned i = 0; i < m.vertexCount; i++)
+	{
+		glm::vec3 p(m.positions[i * 3], m.positions[i * 3 + 1], m.positions[i * 3 + 2]);
+		boundsMin = glm::min(boundsMin, p);
+		boundsMax = glm::max(boundsMax, p);
+	}
+	// A flat axis keeps its size, so a plane still matches other planes.
+	glm::vec3 extent = boundsMax - boundsMin;
+	for (int axis = 0; axis < 3; axis++)
+		if (extent[axis] <= 0.0f)
+			extent[axis] = 1.0f;
+	c.toMesh = glm::scale(glm::translate(glm::mat4(1.0f), boundsMin), extent);
+
+	hash<glm::ivec3> hashVec3;
+	hash<glm::ivec2> hashVec2;
+	c.positions.resize(m.vertexCount);
+	c.hash = m.vertexCount * 31 + m.indexCount;
+	for (unsigned i = 0; i < m.vertexCount; i++)
+	{
+		glm::vec3 p(m.positions[i * 3], m.positions[i * 3 + 1], m.positions[i * 3 + 2]);
+		c.positions[i] = glm::ivec3(glm::round((p - boundsMin) / extent * DEDUP_GRID));
+		hashCombine(c.hash, hashVec3(c.positions[i]));
+		hashCombine(c.hash, hashVec3(glm::ivec3(glm::round(glm::vec3(m.colors[i * 3], m.colors[i * 3 + 1], m.colors[i * 3 + 2]) * 255.0f))));
+		hashCombine(c.hash, hashVec2(glm::ivec2(glm::round(glm::vec2(m.uvs[i * 2], m.uvs[i * 2 + 1]) * DEDUP_GRID))));
+	}
+	for (unsigned i = 0; i < m.indexCount; i++)
+		hashCombine(c.hash, m.Index(i));
+}
+
+// Full comparison for two meshes whose hashes matched.
+inline bool sameCanonical(const MeshView& a, const CanonicalMesh& ca, const MeshView& b, const CanonicalMesh& cb)
+{
+	if (a.vertexCount != b.vertexCount || a.indexCount != b.indexCount || ca.positions != cb.positions)
+		return false;
+	for (unsigned i = 0; i < a.indexCount; i++)
+		if (a.Index(i) != b.Index(i))
+			return false;
+	for (unsigned i = 0; i < a.vertexCount * 3; i++)
+		if (glm::abs(a.colors[i] - b.colors[i]) > 0.5f / 255.0f)
+			return false;
+	for (unsigned i = 0; i < a.vertexCount * 2; i++)
+		if (glm::abs(a.uvs[i] - b.uvs[i]) > 1.0f / DEDUP_GRID)
+			return false;
+	return true;
+}
+
+// Finds which meshes are the same geometry at a different size or place.
+// Add() every mesh in turn; each gets the index of the first one like it,
+// and Relative() is what to multiply that one's model matrix by to draw it.
+struct MeshDeduplicator
+{
+	vector<MeshView> views;
+	vector<CanonicalMesh> canonical;
+	vector<int> representative;
+	unordered_multimap<size_t, int> byHash;
+	int uniqueCount;
+
+	MeshDeduplicator() { uniqueCount = 0; }
+	int Add(const MeshView& m)
+	{
+		int index = (int)views.size();
+		views.push_back(m);
+		canonical.push_back(CanonicalMesh());
+		canonicalize(m, canonical.back());
+		representative.push_back(index);
+		typedef unordered_multimap<size_t, int>::iterator Iterator;
+		pair<Iterator, Iterator> matches = byHash.equal_range(canonical.back().hash);
+		for (Iterator i = matches.first; i != matches.second; ++i)
+			if (sameCanonical(views[i->second], canonical[i->second], m, canonical.back()))
+			{
+				representative.back() = i->second;
+				break;
+			}
+		if (representative.back() == index)
+		{
+			byHash.insert(make_pair(canonical.back().hash, index));
+			uniqueCount++;
+		}
+		else
+			canonical.back().positions.clear(); // Only kept for meshes others are compared to.
+		return representative.back();
+	}
+	// Maps the representative's vertices onto mesh i's: scale and offset only.
+	glm::mat4 Relative(int i)
+	{
+		return canonical[i].toMesh * glm::inverse(canonical[representative[i]].toMesh);
+	}
+};
@@ -0,0 +1,341 @@
+#pragma once
+#include <vector>
+#include <algorithm>
+#include <cfloat>
+#include <GL\glew.h>
+#include "glm\glm.hpp"
+#include "Shape.h"
+using namespace std;
+
+// Triangle and vertex order for indexed triangle lists, in three passes:
+//  1. Tipsify (Sander, Nehab and Barczak 2007) reorders triangles so the
+//     post-transform vertex cache hits as often as it can. It walks the mesh
+//     fanning around one vertex at a time and moves to whichever vertex just
+//     used will still be in the cache for its remaining triangles.
+//  2. The walk is cut into clusters wherever it had to jump, or once a
+//     cluster's own miss rate has come down to within OVERDRAW_THRESHOLD of
+//     the whole mesh's. Clusters facing out from the middle of the mesh go
+//     first, so they tend to hide the rest instead of being drawn over.
+//  3. Vertices are renumbered in the order the triangles first use them, so
+//     the fetches walk forward through the vertex buffers.
+// Statistics assume a FIFO cache of VCACHE_SIZE entries: ACMR is vertices
+// transformed per triangle (0.5 is the best a regular grid can do, 3 is no
+// reuse at all), ATVR is vertices transformed per vertex in the mesh (1 is
+// each vertex once).
+#define VCACHE_SIZE 16
+#define OVERDRAW_THRESHOLD 1.05f
+
+struct VertexCacheStats
+{
+	unsigned triangles, vertices, transforms;
+
+	VertexCacheStats() { triangles = vertices = transforms = 0; }
+	float Acmr() const { return triangles ? (float)transforms / triangles : 0.0f; }
+	float Atvr() const { return vertices ? (float)transforms / vertices : 0.0f; }
+	void Add(const VertexCacheStats& s)
+	{
+		triangles += s.triangles;
+		vertices += s.vertices;
+		transforms += s.transforms;
+	}
+};
+
+// Only vertices some triangle uses count towards the ATVR.
+inline VertexCacheStats simulateVertexCache(const GLuint* indices, unsigned indexCount, unsigned vertexCount,
+	unsigned cacheSize = VCACHE_SIZE)
+{
+	VertexCacheStats s;
+	vector<unsigned> cachedAt(vertexCount, 0); // Transform count when each vertex entered the cache, 0 for never.
+	for (unsigned i = 0; i < indexCount; i++)
+	{
+		unsigned v = indices[i];
+		if (cachedAt[v] == 0)
+			s.vertices++;
+		if (cachedAt[v] == 0 || s.transforms - cachedAt[v] >= cacheSize)
+			cachedAt[v] = ++s.transforms;
+	}
+	s.triangles = indexCount / 3;
+	return s;
+}
+
+// Which triangles use each vertex, as one flat list.
+struct VertexTriangles
+{
+	vector<unsigned> offsets, counts, triangles;
+
+	void Build(const GLuint* indices, unsigned indexCount, unsigned vertexCount)
+	{
+		counts.assign(vertexCount, 0);
+		for (unsigned i = 0; i < indexCount; i++)
+			counts[indices[i]]++;
+		offsets.resize(vertexCount);
+		unsigned offset = 0;
+		for (unsigned v = 0; v < vertexCount; v++)
+		{
+			offsets[v] = offset;
+			offset += counts[v];
+		}
+		triangles.resize(indexCount);
+		vector<unsigned> filled(vertexCount, 0);
+		for (unsigned i = 0; i < indexCount; i++)
+		{
+			unsigned v = indices[i];
+			triangles[offsets[v] + filled[v]++] = i / 3;
+		}
+	}
+};
+
+// Pass 1. Rewrites indices in cache order; clusterStarts gets the first
+// triangle of each stretch that began with a jump.
+inline void optimizeVertexCache(vector<GLuint>& indices, unsigned vertexCount, vector<unsigned>& clusterStarts,
+	unsigned cacheSize = VCACHE_SIZE)
+{
+	unsigned triangleCount = (unsigned)indices.size() / 3;
+	clusterStarts.clear();
+	if (triangleCount == 0)
+		return;
+	VertexTriangles adjacency;
+	adjacency.Build(&indices[0], (unsigned)indices.size(), vertexCount);
+	vector<unsigned> live(adjacency.counts); // Triangles not yet emitted, per vertex.
+	vector<unsigned> cacheTime(vertexCount, 0);
+	vector<bool> emitted(triangleCount, false);
+	vector<unsigned> deadEnd, candidates;
+	vector<GLuint> out;
+	out.reserve(indices.size());
+	unsigned time = cacheSize + 1, cursor = 0;
+	int fan = 0;
+	while (fan >= 0 && live[fan] == 0 && (unsigned)fan + 1 < vertexCount)
+		fan++;
+	clusterStarts.push_back(0);
+	while (fan >= 0)
+	{
+		candidates.clear();
+		for (unsigned a = 0; a < adjacency.counts[fan]; a++)
+		{
+			unsigned t = adjacency.triangles[adjacency.offsets[fan] + a];
+			if (emitted[t])
+				continue;
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint v = indices[t * 3 + k];
+				out.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[t] = true;
+		}
+		// The candidate that stays cached longest through its remaining triangles.
+		int next = -1, bestPriority = -1;
+		for (unsigned c = 0; c < candidates.size(); c++)
+		{
+			unsigned v = candidates[c];
+			if (live[v] == 0)
+				continue;
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = time - cacheTime[v];
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				next = v;
+			}
+		}
+		if (next < 0)
+		{
+			// Dead end: back up through recent vertices, else take the next one left.
+			while (next < 0 && !deadEnd.empty())
+			{
+				unsigned v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0)
+					next = v;
+			}
+			while (next < 0 && cursor < vertexCount)
+			{
+				if (live[cursor] > 0)
+					next = cursor;
+				cursor++;
+			}
+			if (next >= 0 && out.size() < indices.size())
+				clusterStarts.push_back((unsigned)out.size() / 3);
+		}
+		fan = next;
+	}
+	indices.swap(out);
+}
+
+// Pass 2. Splits the clusters further where they have paid for their cold
+// start, then sorts them outward facing first. Positions are measured in the
+// mesh's unit box so a copy of the mesh scaled on one axis sorts the same.
+inline void optimizeOverdraw(vector<GLuint>& indices, const GLfloat* positions, unsigned vertexCount,
+	const vector<unsigned>& clusterStarts, unsigned cacheSize = VCACHE_SIZE)
+{
+	unsigned triangleCount = (unsigned)indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+	float threshold = simulateVertexCache(&indices[0], (unsigned)indices.size(), vertexCount, cacheSize).Acmr() * OVERDRAW_THRESHOLD;
+
+	// Same FIFO model as simulateVertexCache(); moving the clock on by a
+	// whole cache empties it, as each cluster starts cold once sorted.
+	vector<unsigned> starts;
+	vector<unsigned> cachedAt(vertexCount, 0);
+	unsigned clock = 0;
+	for (unsigned c = 0; c < clusterStarts.size(); c++)
+	{
+		unsigned end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+		unsigned start = clusterStarts[c], transforms = 0;
+		starts.push_back(start);
+		clock += cacheSize;
+		for (unsigned t = start; t < end; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				GLuint v = indices[t * 3 + k];
+				if (clock - cachedAt[v] >= cacheSize)
+				{
+					cachedAt[v] = ++clock;
+					transforms++;
+				}
+			}
+			if ((float)transforms / (t + 1 - start) <= threshold && t + 1 < end)
+			{
+				starts.push_back(t + 1);
+				clock += cacheSize;
+				transforms = 0;
+				start = t + 1;
+			}
+		}
+	}
+	if (starts.size() < 2)
+		return;
+
+	glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+	for (unsigned v = 0; v < vertexCount; v++)
+	{
+		glm::vec3 p(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]);
+		boundsMin = glm::min(boundsMin, p);
+		boundsMax = glm::max(boundsMax, p);
+	}
+	glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(FLT_MIN));
+
+	// Area weighted centre and normal per cluster, and the mesh's centre.
+	vector<glm::vec3> centres(starts.size(), glm::vec3(0.0f)), normals(starts.size(), glm::vec3(0.0f));
+	vector<float> areas(starts.size(), 0.0f);
+	glm::vec3 meshCentre(0.0f);
+	float meshArea = 0.0f;
+	for (unsigned c = 0; c < starts.size(); c++)
+	{
+		unsigned end = c + 1 < starts.size() ? starts[c + 1] : triangleCount;
+		for (unsigned t = starts[c]; t < end; t++)
+		{
+			glm::vec3 p[3];
+			for (int k = 0; k < 3; k++)
+			{
+				const GLfloat* q = positions + indices[t * 3 + k] * 3;
+				p[k] = (glm::vec3(q[0], q[1], q[2]) - boundsMin) / extent;
+			}
+			glm::vec3 n = glm::cross(p[1] - p[0], p[2] - p[0]);
+			float area = glm::length(n);
+			centres[c] += (p[0] + p[1] + p[2]) * (area / 3.0f);
+			normals[c] += n;
+			areas[c] += area;
+		}
+		meshCentre += centres[c];
+		meshArea += areas[c];
+	}
+	if (meshArea <= 0.0f)
+		return;
+	meshCentre /= meshArea;
+	vector<float> facing(starts.size(), 0.0f);
+	vector<unsigned> order(starts.size());
+	for (unsigned c = 0; c < starts.size(); c++)
+	{
+		order[c] = c;
+		float length = glm::length(normals[c]);
+		if (areas[c] > 0.0f && length > 0.0f)
+			facing[c] = glm::dot(centres[c] / areas[c] - meshCentre, normals[c] / length);
+	}
+	stable_sort(order.begin(), order.end(), [&facing](unsigned a, unsigned b) { return facing[a] > facing[b]; });
+
+	vector<GLuint> out;
+	out.reserve(indices.size());
+	for (unsigned i = 0; i < order.size(); i++)
+	{
+		unsigned c = order[i], end = c + 1 < starts.size() ? starts[c + 1] : triangleCount;
+		out.insert(out.end(), indices.begin() + starts[c] * 3, indices.begin() + end * 3);
+	}
+	indices.swap(out);
+}
+
+// Pass 3. remap gets each old vertex's new number. Vertices no triangle uses
+// keep their relative order after the rest.
+inline void optimizeVertexFetch(vector<GLuint>& indices, unsigned vertexCount, vector<unsigned>& remap)
+{
+	const unsigned unused = ~0u;
+	remap.assign(vertexCount, unused);
+	unsigned next = 0;
+	for (unsigned i = 0; i < indices.size(); i++)
+	{
+		if (remap[indices[i]] == unused)
+			remap[indices[i]] = next++;
+		indices[i] = remap[indices[i]];
+	}
+	for (unsigned v = 0; v < vertexCount; v++)
+		if (remap[v] == unused)
+			remap[v] = next++;
+}
+
+// Puts a per-vertex stream of `width` floats in remap order. A stream that
+// is short (some shapes have fewer UVs than vertices) is padded with zeros.
+inline void remapVertexStream(vector<GLfloat>& stream, unsigned width, const vector<unsigned>& remap)
+{
+	if (stream.empty())
+		return;
+	stream.resize(remap.size() * width, 0.0f);
+	vector<GLfloat> out(stream.size());
+	for (unsigned v = 0; v < remap.size(); v++)
+		for (unsigned k = 0; k < width; k++)
+			out[remap[v] * width + k] = stream[v * width + k];
+	stream.swap(out);
+}
+
+// All three passes over a shape drawn as a triangle list. Unless the new
+// triangle order misses the cache less than the old one did (small shapes
+// built in a good order already, or running twice) the old one is kept.
+// Leaves shapes with primitive restarts or a partial triangle alone.
+inline bool optimizeShape(Shape& shape, bool overdraw = true)
+{
+	unsigned vertexCount = (unsigned)shape.shape_vertices.size() / 3;
+	if (shape.shape_indices.empty() || shape.shape_indices.size() % 3 != 0)
+		return false;
+	for (unsigned i = 0; i < shape.shape_indices.size(); i++)
+		if (shape.shape_indices[i] >= vertexCount)
+			return false;
+	vector<unsigned> clusterStarts, remap;
+	vector<GLuint> indices(shape.shape_indices);
+	optimizeVertexCache(indices, vertexCount, clusterStarts);
+	if (overdraw)
+		optimizeOverdraw(indices, &shape.shape_vertices[0], vertexCount, clusterStarts);
+	unsigned indexCount = (unsigned)indices.size();
+	if (simulateVertexCache(&indices[0], indexCount, vertexCount).transforms <
+		simulateVertexCache(&shape.shape_indices[0], indexCount, vertexCount).transforms)
+		shape.shape_indices.swap(indices);
+	optimizeVertexFetch(shape.shape_indices, vertexCount, remap);
+	remapVertexStream(shape.shape_vertices, 3, remap);
+	remapVertexStream(shape.shape_colors, 3, remap);
+	remapVertexStream(shape.shape_uvs, 2, remap);
+	if (shape.shape_normals.size() >= vertexCount * 3)
+		remapVertexStream(shape.shape_normals, 3, remap);
+	shape.indexType = 0; // Packed again on the next upload.
+	return true;
+}
+
+inline VertexCacheStats vertexCacheStats(Shape& shape)
+{
+	if (shape.shape_indices.empty())
+		return VertexCacheStats();
+	return simulateVertexCache(&shape.shape_indices[0], (unsigned)shape.shape_indices.size(), (unsigned)shape.shape_vertices.size() / 3);
+}
@@ -0,0 +1,397 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cfloat>
+#include <GL\glew.h>
+#include "glm\glm.hpp"
+#include "MeshDedup.h"
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+using namespace std;
+
+// A .mesh file is every mesh of a scene in one block that maps straight onto
+// GL buffers: a header, a table of meshes, then one array per vertex stream
+// and one of indices, each 16 byte aligned. Streams match what Shape uploads
+// (position xyz, colour rgb, uv, normal xyz), and each mesh's indices count
+// from its own first vertex, drawn with glDrawElementsBaseVertex. Because of
+// that the indices are 16 bit unless a single mesh has too many vertices for
+// it.
+#define MESH_PACK_MAGIC 0x4b41504d // "MPAK"
+#define MESH_PACK_VERSION 3
+#define MESH_PACK_NAME_LENGTH 32
+
+struct MeshPackHeader
+{
+	unsigned magic, version;
+	unsigned meshCount, vertexCount, indexCount;
+	unsigned meshOffset, positionOffset, colorOffset, uvOffset, normalOffset, indexOffset; // Bytes from the start of the file.
+	unsigned fileBytes;
+	unsigned indexBytes; // 2 or 4.
+};
+
+struct MeshPackEntry
+{
+	char name[MESH_PACK_NAME_LENGTH];
+	unsigned firstIndex, indexCount;
+	unsigned baseVertex, vertexCount;
+	float boundsMin[3], boundsMax[3]; // Local space.
+};
+
+// Read-only view of a whole file, mapped rather than read.
+struct MappedFile
+{
+	const unsigned char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#else
+	int file;
+#endif
+
+	MappedFile()
+	{
+		data = NULL;
+		size = 0;
+#ifdef _WIN32
+		file = mapping = NULL;
+#else
+		file = -1;
+#endif
+	}
+	~MappedFile() { Close(); }
+	bool Open(const char* path)
+	{
+		Close();
+#ifdef _WIN32
+		file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			file = NULL;
+			return false;
+		}
+		LARGE_INTEGER bytes;
+		GetFileSizeEx(file, &bytes);
+		size = (size_t)bytes.QuadPart;
+		mapping = size ? CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+		data = mapping ? (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+#else
+		file = open(path, O_RDONLY);
+		if (file < 0)
+			return false;
+		struct stat info;
+		fstat(file, &info);
+		size = (size_t)info.st_size;
+		void* view = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+		data = view != MAP_FAILED ? (const unsigned char*)view : NULL;
+#endif
+		if (!data)
+			Close();
+		return data != NULL;
+	}
+	void Close()
+	{
+#ifdef _WIN32
+		if (data)
+			UnmapViewOfFile(data);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file)
+			CloseHandle(file);
+		file = mapping = NULL;
+#else
+		if (data)
+			munmap((void*)data, size);
+		if (file >= 0)
+			close(file);
+		file = -1;
+#endif
+		data = NULL;
+		size = 0;
+	}
+};
+
+// A mapped .mesh file and the GL buffers it was uploaded into. All of its
+// meshes share one vertex array, so a scene full of them binds it once.
+// Deduplicate() before Upload() finds meshes that are another one scaled and
+// moved; only the first of each kind goes to the GPU, and the rest draw it
+// with Relative() applied.
+struct MeshPack
+{
+	MappedFile file;
+	const MeshPackHeader* header;
+	const MeshPackEntry* meshes;
+	vector<MeshPackEntry> drawn;  // Per mesh, the index and vertex ranges in the GL buffers that draw it.
+	vector<int> representative;	  // Per mesh, the one whose vertices it uses.
+	vector<glm::mat4> relative;	  // Per mesh, goes after the model matrix of anything drawing it.
+	int uniqueMeshes;
+	GLuint vao, positionVbo, colorVbo, uvVbo, normalVbo, ibo;
+
+	MeshPack()
+	{
+		header = NULL;
+		meshes = NULL;
+		uniqueMeshes = 0;
+		vao = positionVbo = colorVbo = uvVbo = normalVbo = ibo = 0;
+	}
+	// Maps path and checks that everything the header points at is inside it.
+	bool Open(const char* path)
+	{
+		header = NULL;
+		meshes = NULL;
+		if (!file.Open(path))
+		{
+			cout << "Unable to open mesh pack " << path << "!" << endl;
+			return false;
+		}
+		const MeshPackHeader* h = (const MeshPackHeader*)file.data;
+		bool valid = file.size >= sizeof(MeshPackHeader) && h->magic == MESH_PACK_MAGIC && h->version == MESH_PACK_VERSION &&
+			h->fileBytes == file.size &&
+			Fits(h->meshOffset, (size_t)h->meshCount * sizeof(MeshPackEntry)) &&
+			Fits(h->positionOffset, (size_t)h->vertexCount * 3 * sizeof(GLfloat)) &&
+			Fits(h->colorOffset, (size_t)h->vertexCount * 3 * sizeof(GLfloat)) &&
+			Fits(h->uvOffset, (size_t)h->vertexCount * 2 * sizeof(GLfloat)) &&
+			Fits(h->normalOffset, (size_t)h->vertexCount * 3 * sizeof(GLfloat)) &&
+			(h->indexBytes == 2 || h->indexBytes == 4) && Fits(h->indexOffset, (size_t)h->indexCount * h->indexBytes);
+		const MeshPackEntry* m = (const MeshPackEntry*)(file.data + (valid ? h->meshOffset : 0));
+		for (unsigned i = 0; valid && i < h->meshCount; i++)
+			valid = (size_t)m[i].firstIndex + m[i].indexCount <= h->indexCount &&
+				(size_t)m[i].baseVertex + m[i].vertexCount <= h->vertexCount;
+		if (!valid)
+		{
+			cout << path << " is not a version " << MESH_PACK_VERSION << " mesh pack!" << endl;
+			file.Close();
+			return false;
+		}
+		header = h;
+		meshes = m;
+		drawn.assign(meshes, meshes + header->meshCount);
+		representative.resize(header->meshCount);
+		for (unsigned i = 0; i < header->meshCount; i++)
+			representative[i] = i;
+		relative.assign(header->meshCount, glm::mat4(1.0f));
+		uniqueMeshes = header->meshCount;
+		return true;
+	}
+	bool Fits(unsigned offset, size_t bytes) { return offset <= file.size && bytes <= file.size - offset; }
+	const GLfloat* Positions() { return (const GLfloat*)(file.data + header->positionOffset); }
+	const GLfloat* Colors() { return (const GLfloat*)(file.data + header->colorOffset); }
+	const GLfloat* UVs() { return (const GLfloat*)(file.data + header->uvOffset); }
+	const GLfloat* Normals() { return (const GLfloat*)(file.data + header->normalOffset); }
+	const unsigned char* Indices() { return file.data + header->indexOffset; }
+	GLenum IndexType() { return header->indexBytes == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+	// NULL if there's no mesh called name.
+	const MeshPackEntry* Find(const string& name)
+	{
+		for (unsigned i = 0; header && i < header->meshCount; i++)
+			if (name == meshes[i].name)
+				return &meshes[i];
+		return NULL;
+	}
+	unsigned Index(const MeshPackEntry& mesh) { return (unsigned)(&mesh - meshes); }
+	MeshView View(unsigned i)
+	{
+		const MeshPackEntry& m = meshes[i];
+		MeshView v = { Positions() + m.baseVertex * 3, Colors() + m.baseVertex * 3, UVs() + m.baseVertex * 2, Normals() + m.baseVertex * 3,
+			m.vertexCount,
+			Indices() + (size_t)m.firstIndex * header->indexBytes, header->indexBytes, m.indexCount };
+		return v;
+	}
+	// Hashes every mesh's canonical form (see MeshDedup.h) to find the ones
+	// that can share another's vertices.
+	void Deduplicate()
+	{
+		MeshDeduplicator dedup;
+		for (unsigned i = 0; i < header->meshCount; i++)
+		{
+			representative[i] = dedup.Add(View(i));
+			relative[i] = dedup.Relative(i);
+		}
+		uniqueMeshes = dedup.uniqueCount;
+	}
+	// Copies each stream from the mapping into its buffer: all of it in one
+	// go, or with duplicates, just the ranges of the meshes that are drawn.
+	void Upload()
+	{
+		bool compact = uniqueMeshes < (int)header->meshCount;
+		unsigned vertexCount = header->vertexCount, indexCount = header->indexCount;
+		if (compact)
+		{
+			vertexCount = indexCount = 0;
+			for (unsigned i = 0; i < header->meshCount; i++)
+				if (representative[i] == (int)i)
+				{
+					drawn[i].baseVertex = vertexCount;
+					drawn[i].firstIndex = indexCount;
+					vertexCount += meshes[i].vertexCount;
+					indexCount += meshes[i].indexCount;
+				}
+			for (unsigned i = 0; i < header->meshCount; i++)
+				drawn[i] = drawn[representative[i]];
+		}
+
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		GLuint* vbos[4] = { &positionVbo, &colorVbo, &uvVbo, &normalVbo };
+		const GLfloat* streams[4] = { Positions(), Colors(), UVs(), Normals() };
+		GLint sizes[4] = { 3, 3, 2, 3 }; // At attribute locations 0 to 3.
+		for (int s = 0; s < 4; s++)
+		{
+			glGenBuffers(1, vbos[s]);
+			glBindBuffer(GL_ARRAY_BUFFER, *vbos[s]);
+			glBufferData(GL_ARRAY_BUFFER, (size_t)vertexCount * sizes[s] * sizeof(GLfloat), compact ? NULL : streams[s], GL_STATIC_DRAW);
+			for (unsigned i = 0; compact && i < header->meshCount; i++)
+				if (representative[i] == (int)i)
+					glBufferSubData(GL_ARRAY_BUFFER, (size_t)drawn[i].baseVertex * sizes[s] * sizeof(GLfloat),
+						(size_t)meshes[i].vertexCount * sizes[s] * sizeof(GLfloat), streams[s] + (size_t)meshes[i].baseVertex * sizes[s]);
+			glVertexAttribPointer(s, sizes[s], GL_FLOAT, GL_FALSE, 0, 0);
+			glEnableVertexAttribArray(s);
+		}
+		glGenBuffers(1, &ibo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (size_t)indexCount * header->indexBytes, compact ? NULL : Indices(), GL_STATIC_DRAW);
+		for (unsigned i = 0; compact && i < header->meshCount; i++)
+			if (representative[i] == (int)i)
+				glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (size_t)drawn[i].firstIndex * header->indexBytes,
+					(size_t)meshes[i].indexCount * header->indexBytes, Indices() + (size_t)meshes[i].firstIndex * header->indexBytes);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		if (compact)
+			cout << "Mesh pack: " << uniqueMeshes << " of " << header->meshCount << " meshes are unique, "
+				<< ((size_t)(header->vertexCount - vertexCount) * 11 * sizeof(GLfloat) + (size_t)(header->indexCount - indexCount) * header->indexBytes) / 1024.0f
+				<< " KB of duplicates left out" << endl;
+	}
+	void Bind() { glBindVertexArray(vao); }
+	// With the pack bound. The model matrix must include Relative(mesh).
+	void Draw(const MeshPackEntry& mesh, GLenum mode)
+	{
+		const MeshPackEntry& d = drawn[Index(mesh)];
+		glDrawElementsBaseVertex(mode, d.indexCount, IndexType(), (void*)((size_t)d.firstIndex * header->indexBytes), d.baseVertex);
+	}
+	const glm::mat4& Relative(const MeshPackEntry& mesh) { return relative[Index(mesh)]; }
+	void Clean()
+	{
+		GLuint buffers[5] = { positionVbo, colorVbo, uvVbo, normalVbo, ibo };
+		glDeleteBuffers(5, buffers);
+		glDeleteVertexArrays(1, &vao);
+		vao = positionVbo = colorVbo = uvVbo = normalVbo = ibo = 0;
+		file.Close();
+		header = NULL;
+		meshes = NULL;
+	}
+};
+
+// Collects meshes and writes them out as a .mesh file. Used by the tools.
+struct MeshPackBuilder
+{
+	vector<MeshPackEntry> meshes;
+	vector<GLfloat> positions, colors, uvs, normals;
+	vector<GLuint> indices; // Written at 16 bits if every mesh allows it.
+
+	// Streams shorter than the vertex count (some shapes have fewer UVs than
+	// vertices) are padded with zeros, longer ones are cut. Missing normals
+	// point straight up, as lines and other shapes without any draw lit.
+	bool Add(const string& name, const vector<GLuint>& meshIndices, const vector<GLfloat>& vertices,
+		const vector<GLfloat>& meshColors, const vector<GLfloat>& meshUVs, const vector<GLfloat>& meshNormals)
+	{
+		if (name.size() >= MESH_PACK_NAME_LENGTH || vertices.empty() || meshIndices.empty())
+			return false;
+		MeshPackEntry m;
+		memset(&m, 0, sizeof(m));
+		memcpy(m.name, name.c_str(), name.size());
+		m.firstIndex = (unsigned)indices.size();
+		m.indexCount = (unsigned)meshIndices.size();
+		m.baseVertex = (unsigned)(positions.size() / 3);
+		m.vertexCount = (unsigned)(vertices.size() / 3);
+		glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+		for (unsigned i = 0; i < m.vertexCount * 3; i += 3)
+		{
+			glm::vec3 v(vertices[i], vertices[i + 1], vertices[i + 2]);
+			boundsMin = glm::min(boundsMin, v);
+			boundsMax = glm::max(boundsMax, v);
+		}
+		memcpy(m.boundsMin, &boundsMin[0], sizeof(m.boundsMin));
+		memcpy(m.boundsMax, &boundsMax[0], sizeof(m.boundsMax));
+		positions.insert(positions.end(), vertices.begin(), vertices.begin() + m.vertexCount * 3);
+		Append(colors, meshColors, m.vertexCount * 3);
+		Append(uvs, meshUVs, m.vertexCount * 2);
+		size_t haveNormals = glm::min(meshNormals.size() / 3, (size_t)m.vertexCount);
+		normals.insert(normals.end(), meshNormals.begin(), meshNormals.begin() + haveNormals * 3);
+		for (size_t i = haveNormals; i < m.vertexCount; i++)
+		{
+			normals.push_back(0.0f);
+			normals.push_back(1.0f);
+			normals.push_back(0.0f);
+		}
+		indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+		meshes.push_back(m);
+		return true;
+	}
+	static void Append(vector<GLfloat>& to, const vector<GLfloat>& from, size_t count)
+	{
+		size_t have = from.size() < count ? from.size() : count;
+		to.insert(to.end(), from.begin(), from.begin() + have);
+		to.resize(to.size() + count - have, 0.0f);
+	}
+	static unsigned Aligned(size_t offset) { return (unsigned)((offset + 15) & ~(size_t)15); }
+	// Restart indices (RESTART_INDEX) stay restarts at either width.
+	unsigned IndexBytes()
+	{
+		for (unsigned i = 0; i < meshes.size(); i++)
+			if (meshes[i].vertexCount >= 0xFFFF)
+				return 4;
+		return 2;
+	}
+	bool Write(const char* path)
+	{
+		MeshPackHeader h;
+		memset(&h, 0, sizeof(h));
+		h.magic = MESH_PACK_MAGIC;
+		h.version = MESH_PACK_VERSION;
+		h.indexBytes = IndexBytes();
+		h.meshCount = (unsigned)meshes.size();
+		h.vertexCount = (unsigned)(positions.size() / 3);
+		h.indexCount = (unsigned)indices.size();
+		h.meshOffset = Aligned(sizeof(h));
+		h.positionOffset = Aligned(h.meshOffset + meshes.size() * sizeof(MeshPackEntry));
+		h.colorOffset = Aligned(h.positionOffset + positions.size() * sizeof(GLfloat));
+		h.uvOffset = Aligned(h.colorOffset + colors.size() * sizeof(GLfloat));
+		h.normalOffset = Aligned(h.uvOffset + uvs.size() * sizeof(GLfloat));
+		h.indexOffset = Aligned(h.normalOffset + normals.size() * sizeof(GLfloat));
+		h.fileBytes = Aligned(h.indexOffset + indices.size() * h.indexBytes);
+
+		vector<unsigned char> bytes(h.fileBytes, 0);
+		memcpy(&bytes[0], &h, sizeof(h));
+		if (!meshes.empty())
+			memcpy(&bytes[h.meshOffset], &meshes[0], meshes.size() * sizeof(MeshPackEntry));
+		if (!positions.empty())
+		{
+			memcpy(&bytes[h.positionOffset], &positions[0], positions.size() * sizeof(GLfloat));
+			memcpy(&bytes[h.colorOffset], &colors[0], colors.size() * sizeof(GLfloat));
+			memcpy(&bytes[h.uvOffset], &uvs[0], uvs.size() * sizeof(GLfloat));
+			memcpy(&bytes[h.normalOffset], &normals[0], normals.size() * sizeof(GLfloat));
+			if (h.indexBytes == 4)
+				memcpy(&bytes[h.indexOffset], &indices[0], indices.size() * sizeof(GLuint));
+			else
+				for (unsigned i = 0; i < indices.size(); i++)
+					((GLushort*)&bytes[h.indexOffset])[i] = (GLushort)indices[i];
+		}
+		ofstream out(path, ios::binary);
+		out.write((const char*)&bytes[0], bytes.size());
+		return out.good();
+	}
+};
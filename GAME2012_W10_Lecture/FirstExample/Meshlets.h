@@ -0,0 +1,361 @@
+#pragma once
+#include <vector>
+#include <cfloat>
+#include <cmath>
+#include <GL\glew.h>
+#include "glm\glm.hpp"
+#include "MeshPack.h"
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define MESHLET_SSE2
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+// Meshlets are runs of a mesh's triangles small enough to cull on their own:
+// at most MESHLET_MAX_VERTICES distinct vertices and MESHLET_MAX_TRIANGLES
+// triangles (the limits mesh shaders use), each with a bounding sphere and a
+// normal cone. A run also ends where a triangle faces too far from the rest,
+// so a box splits into its faces and the ones facing away can be dropped.
+// They are ranges of the index buffer as it is, so nothing is re-uploaded;
+// MeshOptimizer's clusters already keep triangles facing alike together.
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+#define MESHLET_SPLIT_COS 0.5f	 // Triangles more than 60 degrees off the meshlet's average normal start a new one.
+#define MESHLET_CONE_MIN_COS 0.1f // Wider cones than this never cull, so don't bother with an apex.
+
+struct MeshletRange
+{
+	unsigned firstIndex, indexCount; // Into the mesh's own indices.
+};
+
+inline glm::vec3 meshletVertex(const MeshView& m, unsigned index)
+{
+	const GLfloat* p = m.positions + m.Index(index) * 3;
+	return glm::vec3(p[0], p[1], p[2]);
+}
+
+// Vertices of triangle t (its first index) not yet in meshlet id.
+inline unsigned newMeshletVertices(const MeshView& m, const vector<unsigned>& usedBy, unsigned t, unsigned id)
+{
+	unsigned a = m.Index(t), b = m.Index(t + 1), c = m.Index(t + 2);
+	return (usedBy[a] != id) + (b != a && usedBy[b] != id) + (c != a && c != b && usedBy[c] != id);
+}
+
+// Splits m's triangles, in order, into meshlets.
+inline void buildMeshlets(const MeshView& m, vector<MeshletRange>& meshlets)
+{
+	meshlets.clear();
+	vector<unsigned> usedBy(m.vertexCount, ~0u); // Meshlet each vertex was last counted in.
+	MeshletRange current = { 0, 0 };
+	unsigned vertices = 0;
+	glm::vec3 normalSum(0.0f);
+	for (unsigned t = 0; t + 2 < m.indexCount; t += 3)
+	{
+		glm::vec3 n = glm::cross(meshletVertex(m, t + 1) - meshletVertex(m, t), meshletVertex(m, t + 2) - meshletVertex(m, t));
+		float area = glm::length(n);
+		unsigned added = newMeshletVertices(m, usedBy, t, (unsigned)meshlets.size());
+		bool turned = area > 0.0f && glm::length(normalSum) > 0.0f && glm::dot(glm::normalize(normalSum), n / area) < MESHLET_SPLIT_COS;
+		if (current.indexCount > 0 && (vertices + added > MESHLET_MAX_VERTICES || current.indexCount / 3 == MESHLET_MAX_TRIANGLES || turned))
+		{
+			meshlets.push_back(current);
+			current.firstIndex = t;
+			current.indexCount = 0;
+			vertices = 0;
+			normalSum = glm::vec3(0.0f);
+			added = newMeshletVertices(m, usedBy, t, (unsigned)meshlets.size());
+		}
+		for (int k = 0; k < 3; k++)
+			usedBy[m.Index(t + k)] = (unsigned)meshlets.size();
+		vertices += added;
+		normalSum += n;
+		current.indexCount += 3;
+	}
+	if (current.indexCount > 0)
+		meshlets.push_back(current);
+}
+
+// Layout glMultiDrawElementsIndirect reads.
+struct DrawElementsIndirectCommand
+{
+	GLuint count, instanceCount, firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// World space meshlets of every placed object, culled against the camera
+// each frame. Bounds are kept in separate arrays, four meshlets to an SSE
+// register. Survivors that are next to each other in the index buffer are
+// merged into one indirect command, and each object draws its commands with
+// one glMultiDrawElementsIndirect.
+struct MeshletCuller
+{
+	struct Object
+	{
+		unsigned firstMeshlet, meshletCount;
+		unsigned firstCommand, commandCount; // This frame's.
+		GLuint firstIndex;					 // Where the mesh is in the pack's GL buffers.
+		GLint baseVertex;
+	};
+	vector<vector<MeshletRange> > meshMeshlets; // Per pack mesh, built when first placed.
+	vector<Object> objects;
+	vector<MeshletRange> ranges; // Per world meshlet.
+	vector<float> centerX, centerY, centerZ, radius, apexX, apexY, apexZ, axisX, axisY, axisZ, cutoff;
+	vector<unsigned char> visible;
+	vector<DrawElementsIndirectCommand> commands;
+	GLuint indirectBuffer;
+	bool supported, enabled;
+	// Last frame, then summed since ResetTotals() for a walk-through.
+	unsigned offscreen, backfacing, drawnTriangles, totalTriangles;
+	double frames, totalMeshlets, totalOffscreen, totalBackfacing, totalCommands, totalDrawn, totalAll;
+
+	MeshletCuller()
+	{
+		indirectBuffer = 0;
+		supported = enabled = true;
+		offscreen = backfacing = drawnTriangles = totalTriangles = 0;
+		ResetTotals();
+	}
+	void Init()
+	{
+		glGenBuffers(1, &indirectBuffer);
+		supported = GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+		enabled = enabled && supported;
+	}
+	void Clean()
+	{
+		glDeleteBuffers(1, &indirectBuffer);
+		indirectBuffer = 0;
+	}
+	void ResetTotals()
+	{
+		frames = totalMeshlets = totalOffscreen = totalBackfacing = totalCommands = totalDrawn = totalAll = 0.0;
+	}
+	unsigned Count() { return (unsigned)ranges.size(); }
+	// Places mesh's meshlets with model, which must include the pack's
+	// Relative() for it. Returns the object's index for Draw().
+	int Add(MeshPack& pack, const MeshPackEntry& mesh, const glm::mat4& model)
+	{
+		unsigned r = pack.representative[pack.Index(mesh)];
+		MeshView view = pack.View(r);
+		if (view.indexCount % 3 != 0)
+			return -1;
+		meshMeshlets.resize(pack.header->meshCount);
+		if (meshMeshlets[r].empty())
+			buildMeshlets(view, meshMeshlets[r]);
+		Object o;
+		o.firstMeshlet = Count();
+		o.meshletCount = (unsigned)meshMeshlets[r].size();
+		o.firstCommand = o.commandCount = 0;
+		o.firstIndex = pack.drawn[r].firstIndex;
+		o.baseVertex = pack.drawn[r].baseVertex;
+		for (unsigned i = 0; i < meshMeshlets[r].size(); i++)
+			AddBounds(view, meshMeshlets[r][i], model);
+		objects.push_back(o);
+		return (int)objects.size() - 1;
+	}
+	// Sphere around the box of the world space vertices, and the cone that
+	// all of the triangles' front sides face into (as in meshoptimizer): the
+	// camera sees none of them from inside it.
+	void AddBounds(const MeshView& m, const MeshletRange& range, const glm::mat4& model)
+	{
+		vector<glm::vec3> world(range.indexCount);
+		glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+		for (unsigned i = 0; i < range.indexCount; i++)
+		{
+			world[i] = glm::vec3(model * glm::vec4(meshletVertex(m, range.firstIndex + i), 1.0f));
+			boundsMin = glm::min(boundsMin, world[i]);
+			boundsMax = glm::max(boundsMax, world[i]);
+		}
+		glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+		float r = 0.0f;
+		for (unsigned i = 0; i < world.size(); i++)
+			r = glm::max(r, glm::length(world[i] - center));
+
+		vector<glm::vec3> normals;
+		glm::vec3 axis(0.0f);
+		for (unsigned i = 0; i < world.size(); i += 3)
+		{
+			glm::vec3 n = glm::cross(world[i + 1] - world[i], world[i + 2] - world[i]);
+			if (glm::length(n) > 0.0f)
+			{
+				normals.push_back(glm::normalize(n));
+				axis += normals.back();
+			}
+		}
+		float minDot = 1.0f;
+		if (glm::length(axis) > 0.0f)
+		{
+			axis = glm::normalize(axis);
+			for (unsigned i = 0; i < normals.size(); i++)
+				minDot = glm::min(minDot, glm::dot(axis, normals[i]));
+		}
+		else
+			minDot = -1.0f;
+		glm::vec3 apex = center;
+		float coneCutoff = 2.0f; // Never culls.
+		if (minDot > MESHLET_CONE_MIN_COS)
+		{
+			// Back the apex off until every triangle's plane is in front of it.
+			float back = 0.0f;
+			for (unsigned i = 0, n = 0; i < world.size(); i += 3)
+			{
+				glm::vec3 e = glm::cross(world[i + 1] - world[i], world[i + 2] - world[i]);
+				if (glm::length(e) == 0.0f)
+					continue;
+				glm::vec3 normal = normals[n++];
+				back = glm::max(back, glm::dot(center - world[i], normal) / glm::dot(axis, normal));
+			}
+			apex = center - axis * back;
+			coneCutoff = sqrt(1.0f - minDot * minDot);
+		}
+
+		ranges.push_back(range);
+		centerX.push_back(center.x);
+		centerY.push_back(center.y);
+		centerZ.push_back(center.z);
+		radius.push_back(r);
+		apexX.push_back(apex.x);
+		apexY.push_back(apex.y);
+		apexZ.push_back(apex.z);
+		axisX.push_back(axis.x);
+		axisY.push_back(axis.y);
+		axisZ.push_back(axis.z);
+		cutoff.push_back(coneCutoff);
+	}
+	// Call once every object is added: pads the arrays to whole SSE blocks
+	// with meshlets that are always off screen.
+	void Finish()
+	{
+		while (centerX.size() % 4)
+		{
+			centerX.push_back(0.0f);
+			centerY.push_back(0.0f);
+			centerZ.push_back(0.0f);
+			radius.push_back(-FLT_MAX);
+			apexX.push_back(0.0f);
+			apexY.push_back(0.0f);
+			apexZ.push_back(0.0f);
+			axisX.push_back(0.0f);
+			axisY.push_back(0.0f);
+			axisZ.push_back(0.0f);
+			cutoff.push_back(2.0f);
+		}
+		visible.assign(centerX.size(), 0);
+	}
+	// Frustum planes from the combined matrix (Gribb and Hartmann), each
+	// normalised so a sphere's centre distance compares with its radius.
+	static void FrustumPlanes(const glm::mat4& m, glm::vec4 planes[6])
+	{
+		glm::vec4 row[4];
+		for (int i = 0; i < 4; i++)
+			row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+		for (int i = 0; i < 3; i++)
+		{
+			planes[i * 2] = row[3] + row[i];
+			planes[i * 2 + 1] = row[3] - row[i];
+		}
+		for (int i = 0; i < 6; i++)
+			planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+	// Fills visible[] and this frame's commands.
+	void Cull(const glm::mat4& viewProjection, glm::vec3 eye)
+	{
+		glm::vec4 planes[6];
+		FrustumPlanes(viewProjection, planes);
+		unsigned count = Count();
+		offscreen = backfacing = 0;
+#ifdef MESHLET_SSE2
+		__m128 px[6], py[6], pz[6], pw[6];
+		for (int p = 0; p < 6; p++)
+		{
+			px[p] = _mm_set1_ps(planes[p].x);
+			py[p] = _mm_set1_ps(planes[p].y);
+			pz[p] = _mm_set1_ps(planes[p].z);
+			pw[p] = _mm_set1_ps(planes[p].w);
+		}
+		__m128 ex = _mm_set1_ps(eye.x), ey = _mm_set1_ps(eye.y), ez = _mm_set1_ps(eye.z);
+		for (unsigned i = 0; i < centerX.size(); i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(&centerX[i]), cy = _mm_loadu_ps(&centerY[i]), cz = _mm_loadu_ps(&centerZ[i]);
+			__m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+			__m128 outside = _mm_setzero_ps();
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, px[p]), _mm_mul_ps(cy, py[p])), _mm_add_ps(_mm_mul_ps(cz, pz[p]), pw[p]));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(d, negR));
+			}
+			__m128 vx = _mm_sub_ps(_mm_loadu_ps(&apexX[i]), ex), vy = _mm_sub_ps(_mm_loadu_ps(&apexY[i]), ey), vz = _mm_sub_ps(_mm_loadu_ps(&apexZ[i]), ez);
+			__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)), _mm_mul_ps(vz, vz)));
+			__m128 along = _mm_add_ps(_mm_add_ps(_mm_mul_ps(vx, _mm_loadu_ps(&axisX[i])), _mm_mul_ps(vy, _mm_loadu_ps(&axisY[i]))),
+				_mm_mul_ps(vz, _mm_loadu_ps(&axisZ[i])));
+			__m128 back = _mm_cmpge_ps(along, _mm_mul_ps(_mm_loadu_ps(&cutoff[i]), length));
+			int outMask = _mm_movemask_ps(outside), backMask = _mm_movemask_ps(back) & ~outMask;
+			for (unsigned k = 0; k < 4; k++)
+				visible[i + k] = !(((outMask | backMask) >> k) & 1);
+			for (unsigned k = 0; k < 4 && i + k < count; k++)
+			{
+				offscreen += (outMask >> k) & 1;
+				backfacing += (backMask >> k) & 1;
+			}
+		}
+#else
+		for (unsigned i = 0; i < count; i++)
+		{
+			glm::vec3 c(centerX[i], centerY[i], centerZ[i]);
+			bool outside = false;
+			for (int p = 0; p < 6; p++)
+				outside = outside || glm::dot(glm::vec3(planes[p]), c) + planes[p].w < -radius[i];
+			glm::vec3 v = glm::vec3(apexX[i], apexY[i], apexZ[i]) - eye;
+			bool back = !outside && glm::dot(v, glm::vec3(axisX[i], axisY[i], axisZ[i])) >= cutoff[i] * glm::length(v);
+			visible[i] = !outside && !back;
+			offscreen += outside;
+			backfacing += back;
+		}
+#endif
+		// Compact the survivors into commands, merging neighbours.
+		commands.clear();
+		drawnTriangles = totalTriangles = 0;
+		for (unsigned o = 0; o < objects.size(); o++)
+		{
+			Object& object = objects[o];
+			object.firstCommand = (unsigned)commands.size();
+			for (unsigned i = object.firstMeshlet; i < object.firstMeshlet + object.meshletCount; i++)
+			{
+				totalTriangles += ranges[i].indexCount / 3;
+				if (!visible[i])
+					continue;
+				drawnTriangles += ranges[i].indexCount / 3;
+				GLuint first = object.firstIndex + ranges[i].firstIndex;
+				if (commands.size() > object.firstCommand && commands.back().firstIndex + commands.back().count == first)
+					commands.back().count += ranges[i].indexCount;
+				else
+				{
+					DrawElementsIndirectCommand c = { ranges[i].indexCount, 1, first, object.baseVertex, 0 };
+					commands.push_back(c);
+				}
+			}
+			object.commandCount = (unsigned)commands.size() - object.firstCommand;
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand),
+			commands.empty() ? NULL : &commands[0], GL_STREAM_DRAW);
+
+		frames++;
+		totalMeshlets += count;
+		totalOffscreen += offscreen;
+		totalBackfacing += backfacing;
+		totalCommands += commands.size();
+		totalDrawn += drawnTriangles;
+		totalAll += totalTriangles;
+	}
+	// With the pack bound. False if nothing of the object survived.
+	bool Draw(int object, GLenum mode, GLenum indexType)
+	{
+		const Object& o = objects[object];
+		if (o.commandCount == 0)
+			return false;
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+		glMultiDrawElementsIndirect(mode, indexType, (void*)(o.firstCommand * sizeof(DrawElementsIndirectCommand)), o.commandCount, 0);
+		return true;
+	}
+};
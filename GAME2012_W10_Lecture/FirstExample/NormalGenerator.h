@@ -0,0 +1,285 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <cmath>
+#include <cfloat>
+#include <GL\glew.h>
+#include "glm\glm.hpp"
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define NORMALS_SSE2
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+// Smooth vertex normals (and tangents) for indexed triangle lists. Each
+// triangle adds its face normal to its three corners, weighted by either
+//  - area: the raw cross product, so big triangles count for more, or
+//  - angle: the unit normal times the corner's angle (Thurmer and Wuthrich),
+//    which doesn't change when a face is split into more triangles.
+// Angle weights take two square roots, two divides and two acos per
+// triangle, so those triangles go four at a time, one component per SSE
+// register, with a polynomial acos. Area weights are one cross product,
+// cheaper than gathering the corners into registers, so they stay scalar.
+// Big meshes split their triangles between threads, each summing into its
+// own copy of the normals, so no vertex is ever written by two threads; the
+// copies are added up and normalised afterwards, again split by vertex
+// range. On one thread the sums build up in place. Normals face the side
+// triangles wind anticlockwise from, the side GL_CCW draws. Vertices no
+// triangle uses (lines, restart indices) get straight up.
+#define NORMALS_SERIAL_TRIANGLES 65536 // Fewer triangles than this aren't worth starting threads for.
+#define NORMALS_MAX_THREADS 8
+
+enum NormalWeighting
+{
+	NORMALS_BY_AREA,
+	NORMALS_BY_ANGLE
+};
+
+inline void addToVertex(GLfloat* sums, unsigned v, float x, float y, float z)
+{
+	GLfloat* sum = sums + (size_t)v * 3;
+	sum[0] += x;
+	sum[1] += y;
+	sum[2] += z;
+}
+
+// False for triangles cut by a restart index or pointing past the vertices.
+inline bool normalTriangle(const GLuint* indices, unsigned t, unsigned vertexCount, unsigned corners[3])
+{
+	for (int k = 0; k < 3; k++)
+	{
+		corners[k] = indices[t * 3 + k];
+		if (corners[k] >= vertexCount)
+			return false;
+	}
+	return true;
+}
+
+inline void accumulateTriangle(const GLfloat* positions, const unsigned corners[3], NormalWeighting weighting, GLfloat* sums)
+{
+	const GLfloat* a = positions + corners[0] * 3;
+	const GLfloat* b = positions + corners[1] * 3;
+	const GLfloat* c = positions + corners[2] * 3;
+	glm::vec3 p0(a[0], a[1], a[2]);
+	glm::vec3 e1 = glm::vec3(b[0], b[1], b[2]) - p0, e2 = glm::vec3(c[0], c[1], c[2]) - p0;
+	glm::vec3 n = glm::cross(e1, e2);
+	if (weighting == NORMALS_BY_AREA)
+	{
+		for (int k = 0; k < 3; k++)
+			addToVertex(sums, corners[k], n.x, n.y, n.z);
+		return;
+	}
+	float length = glm::length(n);
+	if (length == 0.0f)
+		return;
+	n /= length;
+	glm::vec3 e3 = e2 - e1;
+	float l1 = glm::length(e1), l2 = glm::length(e2), l3 = glm::length(e3);
+	float a0 = acos(glm::clamp(glm::dot(e1, e2) / (l1 * l2), -1.0f, 1.0f));
+	float a1 = acos(glm::clamp(-glm::dot(e1, e3) / (l1 * l3), -1.0f, 1.0f));
+	float angles[3] = { a0, a1, glm::max(3.14159265f - a0 - a1, 0.0f) };
+	for (int k = 0; k < 3; k++)
+		addToVertex(sums, corners[k], n.x * angles[k], n.y * angles[k], n.z * angles[k]);
+}
+
+#ifdef NORMALS_SSE2
+// acos to within 7e-5 radians (Abramowitz and Stegun 4.4.45), four at once.
+inline __m128 acosSSE(__m128 x)
+{
+	__m128 negative = _mm_cmplt_ps(x, _mm_setzero_ps());
+	__m128 a = _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+	__m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.0187293f), a), _mm_set1_ps(0.0742610f));
+	p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(-0.2121144f));
+	p = _mm_add_ps(_mm_mul_ps(p, a), _mm_set1_ps(1.5707288f));
+	p = _mm_mul_ps(p, _mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), a)));
+	return _mm_or_ps(_mm_and_ps(negative, _mm_sub_ps(_mm_set1_ps(3.14159265f), p)), _mm_andnot_ps(negative, p));
+}
+
+inline __m128 dotSSE(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+}
+
+// Angle weighted triangles [first, end), four at a time; returns where it stopped.
+inline unsigned accumulateAnglesSSE(const GLfloat* positions, unsigned vertexCount, const GLuint* indices, unsigned first, unsigned end,
+	GLfloat* sums)
+{
+	alignas(16) float px[3][4], py[3][4], pz[3][4];
+	alignas(16) float nx[4], ny[4], nz[4], angles[3][4];
+	unsigned corners[4][3];
+	const __m128 one = _mm_set1_ps(1.0f), minusOne = _mm_set1_ps(-1.0f), tiny = _mm_set1_ps(FLT_MIN), pi = _mm_set1_ps(3.14159265f);
+	unsigned t = first;
+	for (; t + 4 <= end; t += 4)
+	{
+		bool valid[4];
+		for (int lane = 0; lane < 4; lane++)
+		{
+			valid[lane] = normalTriangle(indices, t + lane, vertexCount, corners[lane]);
+			for (int k = 0; k < 3; k++)
+			{
+				const GLfloat* p = positions + (valid[lane] ? corners[lane][k] : 0) * 3;
+				px[k][lane] = p[0];
+				py[k][lane] = p[1];
+				pz[k][lane] = p[2];
+			}
+		}
+		__m128 x0 = _mm_load_ps(px[0]), y0 = _mm_load_ps(py[0]), z0 = _mm_load_ps(pz[0]);
+		__m128 e1x = _mm_sub_ps(_mm_load_ps(px[1]), x0), e1y = _mm_sub_ps(_mm_load_ps(py[1]), y0), e1z = _mm_sub_ps(_mm_load_ps(pz[1]), z0);
+		__m128 e2x = _mm_sub_ps(_mm_load_ps(px[2]), x0), e2y = _mm_sub_ps(_mm_load_ps(py[2]), y0), e2z = _mm_sub_ps(_mm_load_ps(pz[2]), z0);
+		__m128 e3x = _mm_sub_ps(e2x, e1x), e3y = _mm_sub_ps(e2y, e1y), e3z = _mm_sub_ps(e2z, e1z);
+		__m128 cx = _mm_sub_ps(_mm_mul_ps(e1y, e2z), _mm_mul_ps(e1z, e2y));
+		__m128 cy = _mm_sub_ps(_mm_mul_ps(e1z, e2x), _mm_mul_ps(e1x, e2z));
+		__m128 cz = _mm_sub_ps(_mm_mul_ps(e1x, e2y), _mm_mul_ps(e1y, e2x));
+		__m128 length2 = dotSSE(cx, cy, cz, cx, cy, cz);
+		int nonzero = _mm_movemask_ps(_mm_cmpgt_ps(length2, _mm_setzero_ps()));
+		__m128 scale = _mm_div_ps(one, _mm_sqrt_ps(_mm_max_ps(length2, tiny)));
+		_mm_store_ps(nx, _mm_mul_ps(cx, scale));
+		_mm_store_ps(ny, _mm_mul_ps(cy, scale));
+		_mm_store_ps(nz, _mm_mul_ps(cz, scale));
+		// Angles at corners 0 and 1 from their cosines; corner 2 gets what's left of pi.
+		__m128 l1 = dotSSE(e1x, e1y, e1z, e1x, e1y, e1z), l2 = dotSSE(e2x, e2y, e2z, e2x, e2y, e2z), l3 = dotSSE(e3x, e3y, e3z, e3x, e3y, e3z);
+		__m128 c0 = _mm_div_ps(dotSSE(e1x, e1y, e1z, e2x, e2y, e2z), _mm_sqrt_ps(_mm_max_ps(_mm_mul_ps(l1, l2), tiny)));
+		__m128 c1 = _mm_div_ps(_mm_sub_ps(_mm_setzero_ps(), dotSSE(e1x, e1y, e1z, e3x, e3y, e3z)), _mm_sqrt_ps(_mm_max_ps(_mm_mul_ps(l1, l3), tiny)));
+		__m128 a0 = acosSSE(_mm_min_ps(_mm_max_ps(c0, minusOne), one)), a1 = acosSSE(_mm_min_ps(_mm_max_ps(c1, minusOne), one));
+		_mm_store_ps(angles[0], a0);
+		_mm_store_ps(angles[1], a1);
+		_mm_store_ps(angles[2], _mm_max_ps(_mm_sub_ps(_mm_sub_ps(pi, a0), a1), _mm_setzero_ps()));
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (!valid[lane] || !((nonzero >> lane) & 1))
+				continue;
+			for (int k = 0; k < 3; k++)
+				addToVertex(sums, corners[lane][k], nx[lane] * angles[k][lane], ny[lane] * angles[k][lane], nz[lane] * angles[k][lane]);
+		}
+	}
+	return t;
+}
+#endif
+
+// Sums triangles [first, end) into sums (xyz per vertex).
+inline void accumulateNormals(const GLfloat* positions, unsigned vertexCount, const GLuint* indices, unsigned first, unsigned end,
+	NormalWeighting weighting, bool simd, GLfloat* sums)
+{
+	unsigned t = first;
+#ifdef NORMALS_SSE2
+	if (simd && weighting == NORMALS_BY_ANGLE)
+		t = accumulateAnglesSSE(positions, vertexCount, indices, first, end, sums);
+#endif
+	unsigned corners[3];
+	for (; t < end; t++)
+		if (normalTriangle(indices, t, vertexCount, corners))
+			accumulateTriangle(positions, corners, weighting, sums);
+}
+
+// Adds the other threads' sums for vertices [first, end) into normals and
+// brings them to unit length.
+inline void finishNormals(const vector<vector<GLfloat> >& others, unsigned first, unsigned end, GLfloat* normals)
+{
+	for (unsigned v = first; v < end; v++)
+	{
+		GLfloat* n = normals + (size_t)v * 3;
+		for (unsigned s = 0; s < others.size(); s++)
+			for (int k = 0; k < 3; k++)
+				n[k] += others[s][(size_t)v * 3 + k];
+		float length2 = n[0] * n[0] + n[1] * n[1] + n[2] * n[2];
+		if (length2 > 0.0f)
+		{
+			float scale = 1.0f / sqrt(length2);
+			n[0] *= scale;
+			n[1] *= scale;
+			n[2] *= scale;
+		}
+		else
+		{
+			n[0] = n[2] = 0.0f;
+			n[1] = 1.0f;
+		}
+	}
+}
+
+// Fills normals with xyz for each of vertexCount vertices. threads 0 picks
+// by mesh size; 1 keeps it on the calling thread. simd false is the plain
+// scalar path, for comparing.
+inline void generateNormals(const GLfloat* positions, unsigned vertexCount, const GLuint* indices, unsigned indexCount,
+	NormalWeighting weighting, vector<GLfloat>& normals, unsigned threads = 0, bool simd = true)
+{
+	unsigned triangles = indexCount / 3;
+	if (threads == 0)
+		threads = triangles < NORMALS_SERIAL_TRIANGLES ? 1 : glm::clamp(thread::hardware_concurrency(), 1u, (unsigned)NORMALS_MAX_THREADS);
+	normals.assign((size_t)vertexCount * 3, 0.0f);
+	if (vertexCount == 0)
+		return;
+	if (threads == 1)
+	{
+		accumulateNormals(positions, vertexCount, indices, 0, triangles, weighting, simd, &normals[0]);
+		finishNormals(vector<vector<GLfloat> >(), 0, vertexCount, &normals[0]);
+		return;
+	}
+	// The first share sums straight into normals, the rest into their own.
+	vector<vector<GLfloat> > others(threads - 1);
+	vector<thread> workers;
+	for (unsigned i = 0; i < threads; i++)
+		workers.push_back(thread([&, i]() {
+			if (i > 0)
+				others[i - 1].assign((size_t)vertexCount * 3, 0.0f);
+			accumulateNormals(positions, vertexCount, indices, (unsigned)((size_t)triangles * i / threads),
+				(unsigned)((size_t)triangles * (i + 1) / threads), weighting, simd, i == 0 ? &normals[0] : &others[i - 1][0]);
+		}));
+	for (unsigned i = 0; i < threads; i++)
+		workers[i].join();
+	workers.clear();
+	for (unsigned i = 0; i < threads; i++)
+		workers.push_back(thread([&, i]() {
+			finishNormals(others, (unsigned)((size_t)vertexCount * i / threads), (unsigned)((size_t)vertexCount * (i + 1) / threads), &normals[0]);
+		}));
+	for (unsigned i = 0; i < threads; i++)
+		workers[i].join();
+}
+
+// Per-vertex tangents (xyz, and w = +1 or -1 for the side the bitangent is
+// on) along increasing u, from the UVs (Lengyel's method), made
+// perpendicular to the normals. For normal mapping; nothing draws with them
+// yet, so they aren't in Shape or the mesh pack. Tools/NormalBench checks them.
+inline void generateTangents(const GLfloat* positions, const GLfloat* uvs, const GLfloat* normals, unsigned vertexCount,
+	const GLuint* indices, unsigned indexCount, vector<GLfloat>& tangents)
+{
+	vector<GLfloat> uDirections((size_t)vertexCount * 3, 0.0f), vDirections((size_t)vertexCount * 3, 0.0f);
+	unsigned corners[3];
+	for (unsigned t = 0; t < indexCount / 3; t++)
+	{
+		if (!normalTriangle(indices, t, vertexCount, corners))
+			continue;
+		glm::vec3 p[3];
+		glm::vec2 uv[3];
+		for (int k = 0; k < 3; k++)
+		{
+			p[k] = glm::vec3(positions[corners[k] * 3], positions[corners[k] * 3 + 1], positions[corners[k] * 3 + 2]);
+			uv[k] = glm::vec2(uvs[corners[k] * 2], uvs[corners[k] * 2 + 1]);
+		}
+		glm::vec3 e1 = p[1] - p[0], e2 = p[2] - p[0];
+		glm::vec2 d1 = uv[1] - uv[0], d2 = uv[2] - uv[0];
+		float determinant = d1.x * d2.y - d2.x * d1.y;
+		if (determinant == 0.0f)
+			continue;
+		glm::vec3 u = (e1 * d2.y - e2 * d1.y) / determinant, v = (e2 * d1.x - e1 * d2.x) / determinant;
+		for (int k = 0; k < 3; k++)
+		{
+			addToVertex(&uDirections[0], corners[k], u.x, u.y, u.z);
+			addToVertex(&vDirections[0], corners[k], v.x, v.y, v.z);
+		}
+	}
+	tangents.resize((size_t)vertexCount * 4);
+	for (unsigned i = 0; i < vertexCount; i++)
+	{
+		glm::vec3 n(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]);
+		glm::vec3 u(uDirections[i * 3], uDirections[i * 3 + 1], uDirections[i * 3 + 2]), v(vDirections[i * 3], vDirections[i * 3 + 1], vDirections[i * 3 + 2]);
+		glm::vec3 t = u - n * glm::dot(n, u);
+		if (glm::dot(t, t) == 0.0f) // No UV change here; any direction along the surface will do.
+			t = glm::abs(n.x) < 0.9f ? glm::cross(n, glm::vec3(1.0f, 0.0f, 0.0f)) : glm::cross(n, glm::vec3(0.0f, 1.0f, 0.0f));
+		t = glm::normalize(t);
+		tangents[i * 4] = t.x;
+		tangents[i * 4 + 1] = t.y;
+		tangents[i * 4 + 2] = t.z;
+		tangents[i * 4 + 3] = glm::dot(glm::cross(n, t), v) < 0.0f ? -1.0f : 1.0f;
+	}
+}
@@ -0,0 +1,773 @@
+#pragma once
+#include <vector>
+#include <map>
+#include <cmath>
+#include <cfloat>
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+#include <GL\glew.h>
+#include "glm\glm.hpp"
+#include "Meshlets.h" // MeshletCuller::FrustumPlanes.
+#include "GpuTimer.h"
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define PATCH_SSE2
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+#define PATCH_MAX_LEVEL 64			 // The least GL_MAX_TESS_GEN_LEVEL can be, so both backends share it.
+#define PATCH_MIN_INNER 2			 // Keeps a ring of inside vertices for the edges to stitch to.
+#define PATCH_PIXELS_PER_EDGE 8.0f	 // Screen length a tessellated edge aims for.
+#define PATCH_PATTERN_CACHE 4096		 // Level combinations kept before starting over.
+
+// 4x4 control points of a bicubic Bezier patch; points[i * 4 + j] sits at
+// u = i / 3, v = j / 3. Once loaded, du x dv points out of the model.
+struct BezierPatch
+{
+	glm::vec3 points[16];
+};
+
+// How finely one patch is split, the way GL_PATCHES takes it for quads:
+// outer[0] along the u = 0 side, [1] v = 0, [2] u = 1, [3] v = 1;
+// inner[0] across u and [1] across v.
+struct PatchLevels
+{
+	int outer[4];
+	int inner[2];
+};
+
+// Same layout as TerrainVertex: the shade is a fixed sun, in the colour attribute.
+struct PatchVertex
+{
+	GLfloat position[3];
+	GLfloat normal[3];
+	GLfloat uv[2];
+	GLubyte shade[4];
+};
+
+// Bernstein weights of the four control points at t, and their derivatives.
+inline void bernstein(float t, float b[4], float d[4])
+{
+	float s = 1.0f - t;
+	b[0] = s * s * s;
+	b[1] = 3.0f * t * s * s;
+	b[2] = 3.0f * t * t * s;
+	b[3] = t * t * t;
+	d[0] = -3.0f * s * s;
+	d[1] = 3.0f * s * s - 6.0f * t * s;
+	d[2] = 6.0f * t * s - 3.0f * t * t;
+	d[3] = 3.0f * t * t;
+}
+
+// Control points along side s of p, in the order of its parameter (see PatchLevels).
+inline void patchSide(const glm::vec3* points, int s, glm::vec3 side[4])
+{
+	for (int k = 0; k < 4; k++)
+		side[k] = points[s == 0 ? k : s == 1 ? k * 4 : s == 2 ? 12 + k : k * 4 + 3];
+}
+
+// Splits for one side, from its control polygon's length on screen. Written
+// so that reversing the four points gives the same float, since the patch
+// on the other side of the edge may run the other way; teapot.tesc matches.
+inline int edgeLevel(const glm::vec3 side[4], glm::vec3 eye, float pixelScale, float pixelsPerEdge)
+{
+	float length = (glm::length(side[0] - side[1]) + glm::length(side[2] - side[3])) + glm::length(side[1] - side[2]);
+	float distance = max(glm::length((side[0] + side[3]) * 0.5f - eye), 0.01f);
+	float level = ceil(length * pixelScale / distance / pixelsPerEdge);
+	return (int)min(max(level, 1.0f), (float)PATCH_MAX_LEVEL);
+}
+
+inline PatchLevels patchLevels(const glm::vec3* points, glm::vec3 eye, float pixelScale, float pixelsPerEdge)
+{
+	PatchLevels l;
+	for (int s = 0; s < 4; s++)
+	{
+		glm::vec3 side[4];
+		patchSide(points, s, side);
+		l.outer[s] = edgeLevel(side, eye, pixelScale, pixelsPerEdge);
+	}
+	l.inner[0] = max(max(l.outer[1], l.outer[3]), PATCH_MIN_INNER);
+	l.inner[1] = max(max(l.outer[0], l.outer[2]), PATCH_MIN_INNER);
+	return l;
+}
+
+// An arbitrary but fixed order on points, to agree which end of a side is first.
+inline bool pointBefore(const glm::vec3& a, const glm::vec3& b)
+{
+	return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z;
+}
+
+// Position on a side's curve at k / level. Both patches along an edge walk
+// it from the same end, whichever way their own parameter runs, so their
+// vertices there are the same to the bit and the mesh has no cracks.
+inline glm::vec3 sidePoint(const glm::vec3 side[4], int k, int level)
+{
+	if (side[0] == side[1] && side[1] == side[2] && side[2] == side[3])
+		return side[0];
+	bool reverse = pointBefore(side[3], side[0]) || (side[3] == side[0] && pointBefore(side[2], side[1]));
+	const glm::vec3 *p0 = &side[0], *p1 = &side[1], *p2 = &side[2], *p3 = &side[3];
+	if (reverse)
+	{
+		swap(p0, p3);
+		swap(p1, p2);
+		k = level - k;
+	}
+	float b[4], d[4];
+	bernstein((float)k / level, b, d);
+	return b[0] * *p0 + b[1] * *p1 + b[2] * *p2 + b[3] * *p3;
+}
+
+// Position and unit normal at u, v. Where the patch pinches to a point
+// (the teapot's lid and bottom centres) du x dv is zero, so the normal is
+// taken from just inside.
+inline void evaluatePatch(const glm::vec3* points, float u, float v, glm::vec3& position, glm::vec3& normal)
+{
+	for (int attempt = 0; attempt < 2; attempt++)
+	{
+		float bu[4], du[4], bv[4], dv[4];
+		bernstein(u, bu, du);
+		bernstein(v, bv, dv);
+		glm::vec3 p(0.0f), pu(0.0f), pv(0.0f);
+		for (int i = 0; i < 4; i++)
+		{
+			glm::vec3 row = bv[0] * points[i * 4] + bv[1] * points[i * 4 + 1] + bv[2] * points[i * 4 + 2] + bv[3] * points[i * 4 + 3];
+			glm::vec3 rowV = dv[0] * points[i * 4] + dv[1] * points[i * 4 + 1] + dv[2] * points[i * 4 + 2] + dv[3] * points[i * 4 + 3];
+			p += bu[i] * row;
+			pu += du[i] * row;
+			pv += bu[i] * rowV;
+		}
+		if (attempt == 0)
+			position = p;
+		normal = glm::cross(pu, pv);
+		float length = glm::length(normal);
+		if (length > 1e-6f * glm::dot(pu, pu) + 1e-12f || attempt == 1)
+		{
+			normal = length > 0.0f ? normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+			return;
+		}
+		u = glm::clamp(u, 1e-3f, 1.0f - 1e-3f);
+		v = glm::clamp(v, 1e-3f, 1.0f - 1e-3f);
+	}
+}
+
+//---------------------------------------------------------------------
+//
+// loadBezierPatches
+//
+// Builds patches from a control point table and 4x4 index grids (the
+// layout of include/Shapes/Teapot.h) and makes them a consistent surface.
+// Teapot.h lost the minus signs of its z < 0 half, so each of those patches
+// lies on top of its z > 0 twin; the later of each such pair is mirrored
+// back. Then every patch's du x dv is made to agree with its neighbours
+// across shared sides (transposing the grid flips it), and each connected
+// piece is turned outward if its signed volume says it faces in.
+//
+inline void loadBezierPatches(const GLdouble (*vertices)[3], const GLint (*indices)[4][4], int count, vector<BezierPatch>& patches)
+{
+	patches.resize(count);
+	for (int p = 0; p < count; p++)
+		for (int i = 0; i < 4; i++)
+			for (int j = 0; j < 4; j++)
+			{
+				const GLdouble* v = vertices[indices[p][i][j]];
+				patches[p].points[i * 4 + j] = glm::vec3((float)v[0], (float)v[1], (float)v[2]);
+			}
+
+	// Twins: the same 16 points in any order.
+	map<vector<float>, int> seen;
+	for (int p = 0; p < count; p++)
+	{
+		vector<float> key;
+		vector<glm::vec3> sorted(patches[p].points, patches[p].points + 16);
+		sort(sorted.begin(), sorted.end(), pointBefore);
+		for (unsigned k = 0; k < sorted.size(); k++)
+			key.insert(key.end(), { sorted[k].x, sorted[k].y, sorted[k].z });
+		if (seen.count(key))
+			for (int k = 0; k < 16; k++)
+				patches[p].points[k].z = 0.0f - patches[p].points[k].z; // Not -0 on the plane of symmetry.
+		else
+			seen[key] = p;
+	}
+
+	// Sides in the order a patch's boundary runs anticlockwise in u, v:
+	// v = 0 forwards, u = 1 forwards, v = 1 backwards, u = 0 backwards.
+	// Neighbours that agree run their shared side opposite ways.
+	struct Use { int patch; bool forwards; };
+	map<vector<float>, vector<Use> > sides;
+	for (int p = 0; p < count; p++)
+		for (int s = 0; s < 4; s++)
+		{
+			glm::vec3 side[4];
+			patchSide(patches[p].points, s, side);
+			if (side[0] == side[1] && side[1] == side[2] && side[2] == side[3])
+				continue; // Pinched to a point.
+			bool boundaryForwards = s == 1 || s == 2;
+			bool canonical = !pointBefore(side[3], side[0]);
+			if (!canonical)
+			{
+				swap(side[0], side[3]);
+				swap(side[1], side[2]);
+			}
+			vector<float> key;
+			for (int k = 0; k < 4; k++)
+				key.insert(key.end(), { side[k].x, side[k].y, side[k].z });
+			Use use = { p, boundaryForwards == canonical };
+			sides[key].push_back(use);
+		}
+	vector<int> flip(count, -1), piece(count, -1);
+	int pieces = 0;
+	for (int start = 0; start < count; start++)
+	{
+		if (flip[start] >= 0)
+			continue;
+		flip[start] = 0;
+		piece[start] = pieces;
+		vector<int> open(1, start);
+		while (!open.empty())
+		{
+			int p = open.back();
+			open.pop_back();
+			for (map<vector<float>, vector<Use> >::iterator it = sides.begin(); it != sides.end(); ++it)
+			{
+				const vector<Use>& uses = it->second;
+				for (unsigned a = 0; a < uses.size(); a++)
+				{
+					if (uses[a].patch != p)
+						continue;
+					for (unsigned b = 0; b < uses.size(); b++)
+						if (flip[uses[b].patch] < 0)
+						{
+							flip[uses[b].patch] = (uses[a].forwards ^ (flip[p] == 1) ^ uses[b].forwards ^ 1) ? 1 : 0;
+							piece[uses[b].patch] = pieces;
+							open.push_back(uses[b].patch);
+						}
+				}
+			}
+		}
+		pieces++;
+	}
+	for (int p = 0; p < count; p++)
+		if (flip[p])
+		{
+			BezierPatch t = patches[p];
+			for (int i = 0; i < 4; i++)
+				for (int j = 0; j < 4; j++)
+					patches[p].points[i * 4 + j] = t.points[j * 4 + i];
+		}
+
+	// Signed volume of each piece about its own centre, from an 8x8 grid per patch.
+	vector<glm::vec3> centres(pieces, glm::vec3(0.0f));
+	vector<int> members(pieces, 0);
+	for (int p = 0; p < count; p++)
+	{
+		for (int k = 0; k < 16; k++)
+			centres[piece[p]] += patches[p].points[k];
+		members[piece[p]] += 16;
+	}
+	vector<float> volumes(pieces, 0.0f);
+	for (int p = 0; p < count; p++)
+	{
+		glm::vec3 c = centres[piece[p]] / (float)members[piece[p]], grid[9][9], normal;
+		for (int i = 0; i <= 8; i++)
+			for (int j = 0; j <= 8; j++)
+				evaluatePatch(patches[p].points, i / 8.0f, j / 8.0f, grid[i][j], normal);
+		for (int i = 0; i < 8; i++)
+			for (int j = 0; j < 8; j++)
+				volumes[piece[p]] += glm::dot(grid[i][j] - c, glm::cross(grid[i + 1][j] - c, grid[i + 1][j + 1] - c)) +
+					glm::dot(grid[i][j] - c, glm::cross(grid[i + 1][j + 1] - c, grid[i][j + 1] - c));
+	}
+	for (int p = 0; p < count; p++)
+		if (volumes[piece[p]] < 0.0f)
+		{
+			BezierPatch t = patches[p];
+			for (int i = 0; i < 4; i++)
+				for (int j = 0; j < 4; j++)
+					patches[p].points[i * 4 + j] = t.points[j * 4 + i];
+		}
+}
+
+// A ring of GL_PRIMITIVES_GENERATED queries, read a frame or two late like
+// GpuTimer's, for how many triangles the tessellator really made.
+#define PRIMITIVE_QUERIES 4
+
+struct PrimitiveCounter
+{
+	GLuint queries[PRIMITIVE_QUERIES];
+	bool pending[PRIMITIVE_QUERIES];
+	int current;
+	bool running;
+	GLuint last;
+
+	PrimitiveCounter()
+	{
+		for (int i = 0; i < PRIMITIVE_QUERIES; i++)
+		{
+			queries[i] = 0;
+			pending[i] = false;
+		}
+		current = 0;
+		running = false;
+		last = 0;
+	}
+	void Init() { glGenQueries(PRIMITIVE_QUERIES, queries); }
+	void Clean() { glDeleteQueries(PRIMITIVE_QUERIES, queries); }
+	void Begin()
+	{
+		Resolve();
+		if (pending[current])
+			return;
+		glBeginQuery(GL_PRIMITIVES_GENERATED, queries[current]);
+		running = true;
+	}
+	void End()
+	{
+		if (!running)
+			return;
+		glEndQuery(GL_PRIMITIVES_GENERATED);
+		pending[current] = true;
+		running = false;
+		current = (current + 1) % PRIMITIVE_QUERIES;
+	}
+	void Resolve()
+	{
+		for (int i = 0; i < PRIMITIVE_QUERIES; i++)
+		{
+			int q = (current + i) % PRIMITIVE_QUERIES;
+			if (!pending[q])
+				continue;
+			GLint available = 0;
+			glGetQueryObjectiv(queries[q], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				break;
+			glGetQueryObjectuiv(queries[q], GL_QUERY_RESULT, &last);
+			pending[q] = false;
+		}
+	}
+};
+
+// One way of splitting a patch, the same for every patch with those
+// levels: where its vertices sit in u, v and the triangles between them.
+// Vertex ids are the corners (0, 0), (1, 0), (0, 1), (1, 1), then each
+// side's points between its corners, then the inside grid, i across u and
+// j across v, both from 1. Each side's points are zipped to the ring inside
+// it the way the GPU's tessellator joins outer and inner levels.
+struct PatchPattern
+{
+	PatchLevels levels;
+	int sideBase[4], gridBase;
+	vector<float> us, vs;
+	vector<GLuint> triangles;
+
+	GLuint Side(int s, int k) const
+	{
+		static const GLuint first[4] = { 0, 0, 1, 2 }, last[4] = { 2, 1, 3, 3 };
+		return k == 0 ? first[s] : k == levels.outer[s] ? last[s] : (GLuint)(sideBase[s] + k - 1);
+	}
+	GLuint Grid(int i, int j) const { return (GLuint)(gridBase + (i - 1) * (levels.inner[1] - 1) + (j - 1)); }
+	// The inside vertex k along side s, one step in from it.
+	GLuint Inner(int s, int k) const
+	{
+		return s == 0 ? Grid(1, k) : s == 1 ? Grid(k, 1) : s == 2 ? Grid(levels.inner[0] - 1, k) : Grid(k, levels.inner[1] - 1);
+	}
+	int Count() const { return gridBase + (levels.inner[0] - 1) * (levels.inner[1] - 1); }
+	void Build(const PatchLevels& l)
+	{
+		levels = l;
+		int nu = l.inner[0], nv = l.inner[1], next = 4;
+		for (int s = 0; s < 4; s++)
+		{
+			sideBase[s] = next;
+			next += l.outer[s] - 1;
+		}
+		gridBase = next;
+		us.resize(Count());
+		vs.resize(Count());
+		static const float cornerU[4] = { 0.0f, 1.0f, 0.0f, 1.0f }, cornerV[4] = { 0.0f, 0.0f, 1.0f, 1.0f };
+		for (int c = 0; c < 4; c++)
+		{
+			us[c] = cornerU[c];
+			vs[c] = cornerV[c];
+		}
+		for (int s = 0; s < 4; s++)
+			for (int k = 1; k < l.outer[s]; k++)
+			{
+				float t = (float)k / l.outer[s];
+				us[Side(s, k)] = s == 0 ? 0.0f : s == 2 ? 1.0f : t;
+				vs[Side(s, k)] = s == 1 ? 0.0f : s == 3 ? 1.0f : t;
+			}
+		for (int i = 1; i < nu; i++)
+			for (int j = 1; j < nv; j++)
+			{
+				us[Grid(i, j)] = (float)i / nu;
+				vs[Grid(i, j)] = (float)j / nv;
+			}
+
+		triangles.clear();
+		for (int i = 1; i < nu - 1; i++)
+			for (int j = 1; j < nv - 1; j++)
+			{
+				AddTriangle(Grid(i, j), Grid(i + 1, j), Grid(i + 1, j + 1));
+				AddTriangle(Grid(i, j), Grid(i + 1, j + 1), Grid(i, j + 1));
+			}
+		for (int s = 0; s < 4; s++)
+		{
+			int e = l.outer[s], n = (s == 0 || s == 2) ? nv : nu;
+			int outer = 0, inner = 1; // Points along the side, and along the ring inside it.
+			while (outer < e || inner < n - 1)
+			{
+				if (inner == n - 1 || (outer < e && (outer + 1) * n <= (inner + 1) * e))
+				{
+					AddTriangle(Side(s, outer), Side(s, outer + 1), Inner(s, inner));
+					outer++;
+				}
+				else
+				{
+					AddTriangle(Side(s, outer), Inner(s, inner + 1), Inner(s, inner));
+					inner++;
+				}
+			}
+		}
+	}
+	// Anticlockwise in u, v, which is outward since du x dv is.
+	void AddTriangle(GLuint a, GLuint b, GLuint c)
+	{
+		if ((us[b] - us[a]) * (vs[c] - vs[a]) - (vs[b] - vs[a]) * (us[c] - us[a]) < 0.0f)
+			swap(b, c);
+		triangles.push_back(a);
+		triangles.push_back(b);
+		triangles.push_back(c);
+	}
+};
+
+enum PatchBackend { PATCHES_CPU, PATCHES_GPU };
+
+// Tessellates instances of a set of Bezier patches each frame, as finely as
+// each side of each patch needs for its size on screen. Two backends:
+//
+// CPU: Tessellate() culls every instance's patches against the frustum,
+// picks levels, and evaluates the points four at a time with SSE (the
+// Bernstein basis of a row of v applied to all four, then of u), into one
+// world space vertex stream for a single draw. Sides are evaluated from a
+// fixed end so neighbouring patches share vertices exactly. Patterns are
+// kept by levels, since most patches reuse one from earlier.
+//
+// GPU: the control points go up once as GL_PATCHES of 16 with a matrix per
+// instance; teapot.tesc culls and picks the same levels, and teapot.tese
+// evaluates the points. triangles.frag shades both.
+struct PatchTessellator
+{
+	vector<BezierPatch> patches;
+	vector<glm::mat4> instances;
+	PatchBackend backend;
+	bool gpuSupported, simd;
+	float pixelsPerEdge;
+
+	// CPU backend.
+	vector<PatchVertex> vertices;
+	vector<GLuint> indices;
+	map<unsigned long long, PatchPattern> patterns; // By levels; emptied past PATCH_PATTERN_CACHE.
+	GLuint cpuVao, cpuVbo, cpuIbo;
+
+	// GPU backend.
+	GLuint program, gpuVao, controlVbo, instanceVbo;
+	GLint viewID, projID, eyeID, pixelScaleID, pixelsPerEdgeID;
+
+	// Stats.
+	GpuTimer drawTimer;
+	PrimitiveCounter primitives;
+	float tessellateMs; // CPU backend, last frame.
+	unsigned cpuTriangles, patchesDrawn;
+
+	PatchTessellator()
+	{
+		backend = PATCHES_CPU;
+		gpuSupported = false;
+		simd = true;
+		pixelsPerEdge = PATCH_PIXELS_PER_EDGE;
+		cpuVao = cpuVbo = cpuIbo = 0;
+		program = gpuVao = controlVbo = instanceVbo = 0;
+		viewID = projID = eyeID = pixelScaleID = pixelsPerEdgeID = -1;
+		tessellateMs = 0.0f;
+		cpuTriangles = patchesDrawn = 0;
+	}
+	// gpuProgram is teapot.vert/.tesc/.tese with triangles.frag; 0 if it didn't build.
+	void Init(GLuint gpuProgram)
+	{
+		glGenVertexArrays(1, &cpuVao);
+		glBindVertexArray(cpuVao);
+		glGenBuffers(1, &cpuVbo);
+		glGenBuffers(1, &cpuIbo);
+		glBindBuffer(GL_ARRAY_BUFFER, cpuVbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cpuIbo);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(PatchVertex), (void*)offsetof(PatchVertex, position));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(PatchVertex), (void*)offsetof(PatchVertex, shade));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(PatchVertex), (void*)offsetof(PatchVertex, uv));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(PatchVertex), (void*)offsetof(PatchVertex, normal));
+		glEnableVertexAttribArray(3);
+
+		gpuSupported = gpuProgram != 0 && (GLEW_VERSION_4_0 || GLEW_ARB_tessellation_shader);
+		program = gpuProgram;
+		if (gpuSupported)
+		{
+			viewID = glGetUniformLocation(program, "view");
+			projID = glGetUniformLocation(program, "projection");
+			eyeID = glGetUniformLocation(program, "eyePosition");
+			pixelScaleID = glGetUniformLocation(program, "pixelScale");
+			pixelsPerEdgeID = glGetUniformLocation(program, "pixelsPerEdge");
+			glGenVertexArrays(1, &gpuVao);
+			glBindVertexArray(gpuVao);
+			glGenBuffers(1, &controlVbo);
+			glBindBuffer(GL_ARRAY_BUFFER, controlVbo);
+			glBufferData(GL_ARRAY_BUFFER, patches.size() * sizeof(BezierPatch), &patches[0], GL_STATIC_DRAW);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, 0);
+			glEnableVertexAttribArray(0);
+			glGenBuffers(1, &instanceVbo);
+			glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+			glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(glm::mat4), instances.empty() ? NULL : &instances[0], GL_STATIC_DRAW);
+			for (int c = 0; c < 4; c++) // A mat4 attribute takes four locations, a column each.
+			{
+				glVertexAttribPointer(4 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(sizeof(glm::vec4) * c));
+				glEnableVertexAttribArray(4 + c);
+				glVertexAttribDivisor(4 + c, 1);
+			}
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		drawTimer.Init();
+		primitives.Init();
+	}
+	void Clean()
+	{
+		drawTimer.Clean();
+		primitives.Clean();
+		glDeleteBuffers(1, &cpuVbo);
+		glDeleteBuffers(1, &cpuIbo);
+		glDeleteVertexArrays(1, &cpuVao);
+		if (gpuSupported)
+		{
+			glDeleteBuffers(1, &controlVbo);
+			glDeleteBuffers(1, &instanceVbo);
+			glDeleteVertexArrays(1, &gpuVao);
+		}
+	}
+	// Evaluates points at pattern's vertices into out.
+	void Evaluate(const glm::vec3* points, const PatchPattern& pattern, PatchVertex* out)
+	{
+		const glm::vec3 sun = glm::normalize(glm::vec3(0.4f, 0.8f, 0.3f));
+		const vector<float>& us = pattern.us;
+		const vector<float>& vs = pattern.vs;
+		unsigned count = (unsigned)us.size(), k = 0;
+#ifdef PATCH_SSE2
+		if (simd)
+		{
+			__m128 cx[16], cy[16], cz[16];
+			for (int i = 0; i < 16; i++)
+			{
+				cx[i] = _mm_set1_ps(points[i].x);
+				cy[i] = _mm_set1_ps(points[i].y);
+				cz[i] = _mm_set1_ps(points[i].z);
+			}
+			const __m128 one = _mm_set1_ps(1.0f), three = _mm_set1_ps(3.0f), six = _mm_set1_ps(6.0f);
+			for (; k + 4 <= count; k += 4)
+			{
+				__m128 b[2][4], d[2][4];
+				__m128 t[2] = { _mm_loadu_ps(&us[k]), _mm_loadu_ps(&vs[k]) };
+				for (int a = 0; a < 2; a++)
+				{
+					__m128 s = _mm_sub_ps(one, t[a]), ss = _mm_mul_ps(s, s), tt = _mm_mul_ps(t[a], t[a]), ts = _mm_mul_ps(t[a], s);
+					b[a][0] = _mm_mul_ps(ss, s);
+					b[a][1] = _mm_mul_ps(three, _mm_mul_ps(ts, s));
+					b[a][2] = _mm_mul_ps(three, _mm_mul_ps(ts, t[a]));
+					b[a][3] = _mm_mul_ps(tt, t[a]);
+					d[a][0] = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(three, ss));
+					d[a][1] = _mm_sub_ps(_mm_mul_ps(three, ss), _mm_mul_ps(six, ts));
+					d[a][2] = _mm_sub_ps(_mm_mul_ps(six, ts), _mm_mul_ps(three, tt));
+					d[a][3] = _mm_mul_ps(three, tt);
+				}
+				__m128 px = _mm_setzero_ps(), py = px, pz = px, ux = px, uy = px, uz = px, vx = px, vy = px, vz = px;
+				for (int i = 0; i < 4; i++)
+				{
+					// Row i as a curve in v, and its slope.
+					__m128 rx = _mm_setzero_ps(), ry = rx, rz = rx, sx = rx, sy = rx, sz = rx;
+					for (int j = 0; j < 4; j++)
+					{
+						rx = _mm_add_ps(rx, _mm_mul_ps(b[1][j], cx[i * 4 + j]));
+						ry = _mm_add_ps(ry, _mm_mul_ps(b[1][j], cy[i * 4 + j]));
+						rz = _mm_add_ps(rz, _mm_mul_ps(b[1][j], cz[i * 4 + j]));
+						sx = _mm_add_ps(sx, _mm_mul_ps(d[1][j], cx[i * 4 + j]));
+						sy = _mm_add_ps(sy, _mm_mul_ps(d[1][j], cy[i * 4 + j]));
+						sz = _mm_add_ps(sz, _mm_mul_ps(d[1][j], cz[i * 4 + j]));
+					}
+					px = _mm_add_ps(px, _mm_mul_ps(b[0][i], rx));
+					py = _mm_add_ps(py, _mm_mul_ps(b[0][i], ry));
+					pz = _mm_add_ps(pz, _mm_mul_ps(b[0][i], rz));
+					ux = _mm_add_ps(ux, _mm_mul_ps(d[0][i], rx));
+					uy = _mm_add_ps(uy, _mm_mul_ps(d[0][i], ry));
+					uz = _mm_add_ps(uz, _mm_mul_ps(d[0][i], rz));
+					vx = _mm_add_ps(vx, _mm_mul_ps(b[0][i], sx));
+					vy = _mm_add_ps(vy, _mm_mul_ps(b[0][i], sy));
+					vz = _mm_add_ps(vz, _mm_mul_ps(b[0][i], sz));
+				}
+				__m128 nx = _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy));
+				__m128 ny = _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz));
+				__m128 nz = _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx));
+				__m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)));
+				__m128 slope = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ux, ux), _mm_mul_ps(uy, uy)), _mm_mul_ps(uz, uz));
+				int pinched = _mm_movemask_ps(_mm_cmple_ps(length, _mm_add_ps(_mm_mul_ps(slope, _mm_set1_ps(1e-6f)), _mm_set1_ps(1e-12f))));
+				__m128 inverse = _mm_div_ps(one, _mm_max_ps(length, _mm_set1_ps(FLT_MIN)));
+				nx = _mm_mul_ps(nx, inverse);
+				ny = _mm_mul_ps(ny, inverse);
+				nz = _mm_mul_ps(nz, inverse);
+				float lanes[6][4];
+				_mm_storeu_ps(lanes[0], px);
+				_mm_storeu_ps(lanes[1], py);
+				_mm_storeu_ps(lanes[2], pz);
+				_mm_storeu_ps(lanes[3], nx);
+				_mm_storeu_ps(lanes[4], ny);
+				_mm_storeu_ps(lanes[5], nz);
+				for (unsigned l = 0; l < 4; l++)
+				{
+					glm::vec3 p(lanes[0][l], lanes[1][l], lanes[2][l]), n(lanes[3][l], lanes[4][l], lanes[5][l]);
+					if ((pinched >> l) & 1)
+						evaluatePatch(points, us[k + l], vs[k + l], p, n);
+					Write(out[k + l], p, n, us[k + l], vs[k + l], sun);
+				}
+			}
+		}
+#endif
+		for (; k < count; k++)
+		{
+			glm::vec3 p, n;
+			evaluatePatch(points, us[k], vs[k], p, n);
+			Write(out[k], p, n, us[k], vs[k], sun);
+		}
+	}
+	static void Write(PatchVertex& v, glm::vec3 p, glm::vec3 n, float u, float t, glm::vec3 sun)
+	{
+		v.position[0] = p.x;
+		v.position[1] = p.y;
+		v.position[2] = p.z;
+		v.normal[0] = n.x;
+		v.normal[1] = n.y;
+		v.normal[2] = n.z;
+		v.uv[0] = u;
+		v.uv[1] = t;
+		float shade = glm::clamp(0.4f + 0.6f * glm::dot(n, sun) / sun.y, 0.0f, 1.0f);
+		v.shade[0] = v.shade[1] = v.shade[2] = (GLubyte)(shade * 255.0f + 0.5f);
+		v.shade[3] = 255;
+	}
+	// CPU backend: every instance into vertices and indices. Returns triangles.
+	unsigned Tessellate(glm::vec3 eye, const glm::mat4& viewProjection, float pixelScale)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		glm::vec4 planes[6];
+		MeshletCuller::FrustumPlanes(viewProjection, planes);
+		vertices.clear();
+		indices.clear();
+		patchesDrawn = 0;
+		glm::vec3 world[16];
+		for (unsigned m = 0; m < instances.size(); m++)
+			for (unsigned p = 0; p < patches.size(); p++)
+			{
+				// A patch lies inside its control points' hull, so their sphere bounds it.
+				glm::vec3 centre(0.0f);
+				for (int k = 0; k < 16; k++)
+				{
+					world[k] = glm::vec3(instances[m] * glm::vec4(patches[p].points[k], 1.0f));
+					centre += world[k];
+				}
+				centre /= 16.0f;
+				float radius = 0.0f;
+				for (int k = 0; k < 16; k++)
+					radius = max(radius, glm::length(world[k] - centre));
+				bool inside = true;
+				for (int k = 0; k < 6 && inside; k++)
+					inside = glm::dot(glm::vec3(planes[k]), centre) + planes[k].w >= -radius;
+				if (!inside)
+					continue;
+
+				PatchLevels levels = patchLevels(world, eye, pixelScale, pixelsPerEdge);
+				unsigned long long key = 0;
+				for (int s = 0; s < 4; s++)
+					key = key << 8 | levels.outer[s];
+				key = (key << 8 | levels.inner[0]) << 8 | levels.inner[1];
+				map<unsigned long long, PatchPattern>::iterator found = patterns.find(key);
+				if (found == patterns.end())
+				{
+					if (patterns.size() >= PATCH_PATTERN_CACHE)
+						patterns.clear();
+					found = patterns.insert(make_pair(key, PatchPattern())).first;
+					found->second.Build(levels);
+				}
+				const PatchPattern& pattern = found->second;
+
+				size_t base = vertices.size();
+				vertices.resize(base + pattern.us.size());
+				Evaluate(world, pattern, &vertices[base]);
+				for (int s = 0; s < 4; s++)
+				{
+					glm::vec3 side[4];
+					patchSide(world, s, side);
+					for (int k = 0; k <= levels.outer[s]; k++)
+					{
+						glm::vec3 q = sidePoint(side, k, levels.outer[s]);
+						GLfloat* position = vertices[base + pattern.Side(s, k)].position;
+						position[0] = q.x;
+						position[1] = q.y;
+						position[2] = q.z;
+					}
+				}
+				size_t first = indices.size();
+				indices.resize(first + pattern.triangles.size());
+				for (unsigned i = 0; i < pattern.triangles.size(); i++)
+					indices[first + i] = (GLuint)base + pattern.triangles[i];
+				patchesDrawn++;
+			}
+		cpuTriangles = (unsigned)(indices.size() / 3);
+		tessellateMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+		return cpuTriangles;
+	}
+	// Call with the scene's program current; it's left current afterwards.
+	// Either backend shades with triangles.frag, so the caller binds the
+	// texture and sets the lights.
+	void Draw(glm::vec3 eye, const glm::mat4& view, const glm::mat4& projection, float pixelScale, GLuint sceneProgram, GLint modelLoc)
+	{
+		if (instances.empty())
+			return;
+		if (backend == PATCHES_CPU || !gpuSupported)
+			Tessellate(eye, projection * view, pixelScale);
+		drawTimer.Begin();
+		primitives.Begin();
+		if (backend == PATCHES_CPU || !gpuSupported)
+		{
+			glm::mat4 identity(1.0f);
+			glUniformMatrix4fv(modelLoc, 1, GL_FALSE, &identity[0][0]);
+			glBindVertexArray(cpuVao);
+			glBindBuffer(GL_ARRAY_BUFFER, cpuVbo);
+			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(PatchVertex), vertices.empty() ? NULL : &vertices[0], GL_STREAM_DRAW);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.empty() ? NULL : &indices[0], GL_STREAM_DRAW);
+			glDrawElements(GL_TRIANGLES, (GLsizei)indices.size(), GL_UNSIGNED_INT, 0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		else
+		{
+			glUseProgram(program);
+			glUniformMatrix4fv(viewID, 1, GL_FALSE, &view[0][0]);
+			glUniformMatrix4fv(projID, 1, GL_FALSE, &projection[0][0]);
+			glUniform3f(eyeID, eye.x, eye.y, eye.z);
+			glUniform1f(pixelScaleID, pixelScale);
+			glUniform1f(pixelsPerEdgeID, pixelsPerEdge);
+			glBindVertexArray(gpuVao);
+			glPatchParameteri(GL_PATCH_VERTICES, 16);
+			glDrawArraysInstanced(GL_PATCHES, 0, (GLsizei)patches.size() * 16, (GLsizei)instances.size());
+			glUseProgram(sceneProgram);
+		}
+		glBindVertexArray(0);
+		primitives.End();
+		drawTimer.End();
+	}
+};
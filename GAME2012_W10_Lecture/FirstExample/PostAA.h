@@ -0,0 +1,208 @@
+#pragma once
+#include <GL\glew.h>
+#include "glm\glm.hpp"
+#include "LoadShaders.h"
+#include "RenderTarget.h"
+
+enum AAMode { AA_MSAA, AA_NONE, AA_FXAA, AA_SMAA, AA_TAA, AA_MODE_COUNT };
+static const char* aaModeNames[AA_MODE_COUNT] = { "MSAA", "None", "FXAA", "SMAA 1x", "TAA" };
+
+#define TAA_JITTER_FRAMES 8
+#define TAA_BLEND 0.1f
+
+// Radical inverse in the given base, for the TAA jitter pattern.
+inline float halton(int index, int base)
+{
+	float f = 1.0f, r = 0.0f;
+	for (int i = index; i > 0; i /= base)
+	{
+		f /= base;
+		r += f * (i % base);
+	}
+	return r;
+}
+
+// Post-process anti-aliasing on a single-sample RenderTarget, as a cheaper
+// alternative to MSAA. Every pass runs at the target's resolution and the
+// result is stretched onto the window.
+struct PostAA
+{
+	AAMode mode;
+	GLuint emptyVao;
+	GLuint fxaaProgram, edgesProgram, weightsProgram, blendProgram, taaProgram;
+	GLuint edgesTx, weightsTx, outputTx[2];
+	GLuint edgesFbo, weightsFbo, outputFbo[2];
+	int width, height, history, frame;
+	bool historyValid;
+	glm::mat4 previousViewProj;
+
+	PostAA()
+	{
+		mode = AA_MSAA;
+		emptyVao = 0;
+		edgesTx = weightsTx = outputTx[0] = outputTx[1] = 0;
+		edgesFbo = weightsFbo = outputFbo[0] = outputFbo[1] = 0;
+		width = height = history = frame = 0;
+		historyValid = false;
+	}
+	GLuint LoadPost(const char* fragment)
+	{
+		ShaderInfo shaders[] = {
+			{ GL_VERTEX_SHADER, "post.vert" },
+			{ GL_FRAGMENT_SHADER, fragment },
+			{ GL_NONE, NULL }
+		};
+		return LoadShaders(shaders);
+	}
+	void Init()
+	{
+		glGenVertexArrays(1, &emptyVao);
+		fxaaProgram = LoadPost("fxaa.frag");
+		edgesProgram = LoadPost("smaa_edges.frag");
+		weightsProgram = LoadPost("smaa_weights.frag");
+		blendProgram = LoadPost("smaa_blend.frag");
+		taaProgram = LoadPost("taa.frag");
+		glUseProgram(blendProgram);
+		glUniform1i(glGetUniformLocation(blendProgram, "weights"), 1);
+		glUseProgram(taaProgram);
+		glUniform1i(glGetUniformLocation(taaProgram, "history"), 1);
+		glUniform1i(glGetUniformLocation(taaProgram, "depth"), 2);
+		glUseProgram(0);
+	}
+	GLuint MakeTarget(GLuint* fbo, GLenum format)
+	{
+		GLuint tx;
+		glGenTextures(1, &tx);
+		glBindTexture(GL_TEXTURE_2D, tx);
+		glTexStorage2D(GL_TEXTURE_2D, 1, format, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glGenFramebuffers(1, fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, *fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tx, 0);
+		return tx;
+	}
+	void Resize(int w, int h)
+	{
+		DestroyTargets();
+		width = w;
+		height = h;
+		edgesTx = MakeTarget(&edgesFbo, GL_RG8);
+		weightsTx = MakeTarget(&weightsFbo, GL_RGBA8);
+		outputTx[0] = MakeTarget(&outputFbo[0], GL_RGBA16F);
+		outputTx[1] = MakeTarget(&outputFbo[1], GL_RGBA16F);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		historyValid = false;
+	}
+	void DestroyTargets()
+	{
+		if (edgesFbo == 0)
+			return;
+		GLuint fbos[4] = { edgesFbo, weightsFbo, outputFbo[0], outputFbo[1] };
+		GLuint txs[4] = { edgesTx, weightsTx, outputTx[0], outputTx[1] };
+		glDeleteFramebuffers(4, fbos);
+		glDeleteTextures(4, txs);
+		edgesFbo = weightsFbo = outputFbo[0] = outputFbo[1] = 0;
+	}
+	void Clean()
+	{
+		DestroyTargets();
+		glDeleteVertexArrays(1, &emptyVao);
+		glDeleteProgram(fxaaProgram);
+		glDeleteProgram(edgesProgram);
+		glDeleteProgram(weightsProgram);
+		glDeleteProgram(blendProgram);
+		glDeleteProgram(taaProgram);
+	}
+	// MSAA needs a multisampled scene target, the post modes want a single sample.
+	int SceneSamples(int msaaSamples) { return mode == AA_MSAA ? msaaSamples : 0; }
+	void SetMode(AAMode m)
+	{
+		mode = m;
+		historyValid = false;
+	}
+	// Sub-pixel jitter for TAA, applied to the projection used for drawing.
+	glm::mat4 Jitter(glm::mat4 proj, int targetWidth, int targetHeight)
+	{
+		if (mode != AA_TAA)
+			return proj;
+		int i = (frame % TAA_JITTER_FRAMES) + 1;
+		proj[2][0] += (halton(i, 2) - 0.5f) * 2.0f / targetWidth;
+		proj[2][1] += (halton(i, 3) - 0.5f) * 2.0f / targetHeight;
+		return proj;
+	}
+	void Pass(GLuint program, GLuint fbo)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glUseProgram(program);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+	// Resolves the scene, runs the selected filter and puts the result on the window.
+	// viewProj is the unjittered matrix, used by TAA to reproject its history.
+	void Apply(RenderTarget& scene, glm::mat4 viewProj, int windowWidth, int windowHeight)
+	{
+		frame++;
+		if (mode == AA_MSAA || mode == AA_NONE)
+		{
+			scene.Present(windowWidth, windowHeight);
+			return;
+		}
+		if (scene.width != width || scene.height != height)
+			Resize(scene.width, scene.height);
+		scene.Resolve();
+
+		GLint lastProgram;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &lastProgram);
+		glDisable(GL_DEPTH_TEST);
+		glBindVertexArray(emptyVao);
+		glViewport(0, 0, width, height);
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_2D, scene.resolveTx);
+
+		GLuint result = outputFbo[0];
+		if (mode == AA_FXAA)
+		{
+			glUseProgram(fxaaProgram);
+			glUniform2f(glGetUniformLocation(fxaaProgram, "texelSize"), 1.0f / width, 1.0f / height);
+			Pass(fxaaProgram, outputFbo[0]);
+		}
+		else if (mode == AA_SMAA)
+		{
+			Pass(edgesProgram, edgesFbo);
+			glBindTexture(GL_TEXTURE_2D, edgesTx);
+			Pass(weightsProgram, weightsFbo);
+			glBindTexture(GL_TEXTURE_2D, scene.resolveTx);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, weightsTx);
+			Pass(blendProgram, outputFbo[0]);
+		}
+		else if (mode == AA_TAA)
+		{
+			glm::mat4 reprojection = previousViewProj * glm::inverse(viewProj);
+			glUseProgram(taaProgram);
+			glUniformMatrix4fv(glGetUniformLocation(taaProgram, "reprojection"), 1, GL_FALSE, &reprojection[0][0]);
+			glUniform1f(glGetUniformLocation(taaProgram, "blendFactor"), historyValid ? TAA_BLEND : 1.0f);
+			glActiveTexture(GL_TEXTURE1);
+			glBindTexture(GL_TEXTURE_2D, outputTx[history]);
+			glActiveTexture(GL_TEXTURE2);
+			glBindTexture(GL_TEXTURE_2D, scene.depthTx);
+			result = outputFbo[1 - history];
+			Pass(taaProgram, result);
+			history = 1 - history;
+			historyValid = true;
+		}
+		previousViewProj = viewProj;
+		glActiveTexture(GL_TEXTURE0);
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, result);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT,
+			(width == windowWidth && height == windowHeight) ? GL_NEAREST : GL_LINEAR);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, windowWidth, windowHeight);
+		glEnable(GL_DEPTH_TEST);
+		glUseProgram(lastProgram);
+	}
+};
@@ -0,0 +1,116 @@
+#pragma once
+#include <iostream>
+#include <GL\glew.h>
+using namespace std;
+
+// Offscreen colour + depth target that the scene is drawn into. It can be
+// smaller than the window and multisampled; Present() resolves it and
+// scales it up to the window.
+struct RenderTarget
+{
+	GLuint fbo, colorRb, depthRb;
+	GLuint depthTx; // Used instead of depthRb when not multisampled, so post passes can read depth.
+	GLuint resolveFbo, resolveTx; // Single-sample copy, also what post passes read.
+	int width, height, samples;
+
+	RenderTarget()
+	{
+		fbo = colorRb = depthRb = depthTx = resolveFbo = resolveTx = 0;
+		width = height = samples = 0;
+	}
+	bool Matches(int w, int h, int s) { return fbo != 0 && w == width && h == height && s == samples; }
+	// False if the driver can't make a complete framebuffer of that kind.
+	bool Create(int w, int h, int s)
+	{
+		Destroy();
+		width = w;
+		height = h;
+		samples = s;
+
+		glGenRenderbuffers(1, &colorRb);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorRb);
+		glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRb);
+		if (samples > 0)
+		{
+			glGenRenderbuffers(1, &depthRb);
+			glBindRenderbuffer(GL_RENDERBUFFER, depthRb);
+			glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_DEPTH_COMPONENT24, width, height);
+			glBindRenderbuffer(GL_RENDERBUFFER, 0);
+			glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRb);
+		}
+		else
+		{
+			glGenTextures(1, &depthTx);
+			glBindTexture(GL_TEXTURE_2D, depthTx);
+			glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, width, height);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTx, 0);
+		}
+
+		glGenTextures(1, &resolveTx);
+		glBindTexture(GL_TEXTURE_2D, resolveTx);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &resolveFbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, resolveFbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, resolveTx, 0);
+		GLenum resolveStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status == GL_FRAMEBUFFER_COMPLETE && resolveStatus == GL_FRAMEBUFFER_COMPLETE)
+			return true;
+		cout << "Render target " << width << "x" << height << " with " << samples << " samples is incomplete (0x" << hex
+			<< (status != GL_FRAMEBUFFER_COMPLETE ? status : resolveStatus) << dec << ")" << endl;
+		return false;
+	}
+	void Destroy()
+	{
+		if (fbo == 0)
+			return;
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteFramebuffers(1, &resolveFbo);
+		glDeleteRenderbuffers(1, &colorRb);
+		if (depthRb)
+			glDeleteRenderbuffers(1, &depthRb);
+		if (depthTx)
+			glDeleteTextures(1, &depthTx);
+		glDeleteTextures(1, &resolveTx);
+		fbo = colorRb = depthRb = depthTx = resolveFbo = resolveTx = 0;
+	}
+	void Bind()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glViewport(0, 0, width, height);
+	}
+	// Resolves multisampling into resolveTx at the same size.
+	void Resolve()
+	{
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFbo);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	}
+	// Resolves, then stretches onto the window with bilinear filtering.
+	void Present(int windowWidth, int windowHeight)
+	{
+		Resolve();
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFbo);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		glBlitFramebuffer(0, 0, width, height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT,
+			(width == windowWidth && height == windowHeight) ? GL_NEAREST : GL_LINEAR);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, windowWidth, windowHeight);
+	}
+};
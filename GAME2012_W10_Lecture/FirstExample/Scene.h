@@ -0,0 +1,159 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <GL\glew.h>
+#include "glm\glm.hpp"
+#include "glm\gtc\matrix_transform.hpp"
+#include "Shape.h"
+#include "MeshPack.h"
+
+#define MAX_LIGHTS_PER_OBJECT 8 // Must match triangles.frag.
+
+// One placed shape in the world. The model matrix is built once since
+// nothing in the castle moves. Geometry is either a Shape built in code or a
+// mesh from a MeshPack.
+struct SceneObject
+{
+	Shape* shape;
+	const MeshPackEntry* mesh;
+	GLuint* texture; // Points at the texture ID so it can be swapped later.
+	GLenum mode;
+	glm::mat4 model;
+	bool castsShadow;
+	glm::vec3 boundsMin, boundsMax; // World space.
+	int lightCount; // Lights that reach this object, filled in by LightAssigner.
+	GLint lightIndices[MAX_LIGHTS_PER_OBJECT];
+	int meshletObject; // Into MeshletCuller::objects, -1 if drawn whole.
+	SceneObject(Shape& s, GLuint& tx, glm::vec3 scale, glm::vec3 rotationAxis, float rotationAngle,
+		glm::vec3 translation, GLenum drawMode)
+	{
+		shape = &s;
+		mesh = NULL;
+		Place(tx, scale, rotationAxis, rotationAngle, translation, drawMode);
+		shape->CalcBounds();
+		CalcWorldBounds(shape->boundsMin, shape->boundsMax);
+	}
+	SceneObject(const MeshPackEntry& m, GLuint& tx, glm::vec3 scale, glm::vec3 rotationAxis, float rotationAngle,
+		glm::vec3 translation, GLenum drawMode)
+	{
+		shape = NULL;
+		mesh = &m;
+		Place(tx, scale, rotationAxis, rotationAngle, translation, drawMode);
+		CalcWorldBounds(glm::vec3(m.boundsMin[0], m.boundsMin[1], m.boundsMin[2]), glm::vec3(m.boundsMax[0], m.boundsMax[1], m.boundsMax[2]));
+	}
+	void Place(GLuint& tx, glm::vec3 scale, glm::vec3 rotationAxis, float rotationAngle, glm::vec3 translation, GLenum drawMode)
+	{
+		texture = &tx;
+		mode = drawMode;
+		model = glm::mat4(1.0f);
+		model = glm::translate(model, translation);
+		model = glm::rotate(model, glm::radians(rotationAngle), rotationAxis);
+		model = glm::scale(model, scale);
+		castsShadow = (drawMode == GL_TRIANGLES);
+		lightCount = 0;
+		meshletObject = -1;
+	}
+	// Transforms the eight corners of the local box, so rotated shapes stay covered.
+	void CalcWorldBounds(glm::vec3 localMin, glm::vec3 localMax)
+	{
+		boundsMin = glm::vec3(FLT_MAX);
+		boundsMax = glm::vec3(-FLT_MAX);
+		for (int i = 0; i < 8; i++)
+		{
+			glm::vec3 corner((i & 1) ? localMax.x : localMin.x,
+				(i & 2) ? localMax.y : localMin.y,
+				(i & 4) ? localMax.z : localMin.z);
+			glm::vec3 world = glm::vec3(model * glm::vec4(corner, 1.0f));
+			boundsMin = glm::min(boundsMin, world);
+			boundsMax = glm::max(boundsMax, world);
+		}
+	}
+};
+
+// One object line of a .scene file.
+struct ScenePlacement
+{
+	string mesh;
+	int texture; // Into SceneDescription::textureFiles.
+	GLenum mode;
+	bool castsShadow;
+	glm::vec3 scale, rotationAxis, translation;
+	float rotationAngle;
+};
+
+// A .scene file: the mesh pack to map, the textures to load, and where each
+// object goes. Plain text, one entry per line, so a scene can be edited or
+// generated without recompiling; SceneExporter writes the castle's.
+//
+//   meshes castle.mesh
+//   texture <name> <file>
+//   object <mesh> <texture name> <triangles|lines|line_strip> <shadow|noshadow>
+//          <scale x y z> <rotation axis x y z> <degrees> <translation x y z>
+//
+// Anything after a # is a comment.
+struct SceneDescription
+{
+	string meshFile;
+	vector<string> textureNames, textureFiles;
+	vector<ScenePlacement> objects;
+
+	bool Load(const char* file)
+	{
+		ifstream in(file);
+		if (!in)
+		{
+			cout << "Unable to open scene " << file << "!" << endl;
+			return false;
+		}
+		string line;
+		for (int number = 1; getline(in, line); number++)
+		{
+			line = line.substr(0, line.find('#'));
+			istringstream words(line);
+			string keyword;
+			if (!(words >> keyword))
+				continue;
+			bool ok = true;
+			if (keyword == "meshes")
+				ok = (bool)(words >> meshFile);
+			else if (keyword == "texture")
+			{
+				string name, path;
+				ok = (bool)(words >> name >> path);
+				textureNames.push_back(name);
+				textureFiles.push_back(path);
+			}
+			else if (keyword == "object")
+			{
+				ScenePlacement o;
+				string texture, mode, shadow;
+				glm::vec3& s = o.scale, &a = o.rotationAxis, &t = o.translation;
+				ok = (bool)(words >> o.mesh >> texture >> mode >> shadow >> s.x >> s.y >> s.z >> a.x >> a.y >> a.z
+					>> o.rotationAngle >> t.x >> t.y >> t.z);
+				o.texture = TextureIndex(texture);
+				o.mode = mode == "triangles" ? GL_TRIANGLES : mode == "lines" ? GL_LINES : mode == "line_strip" ? GL_LINE_STRIP : GL_NONE;
+				o.castsShadow = shadow == "shadow";
+				ok = ok && o.texture >= 0 && o.mode != GL_NONE && (o.castsShadow || shadow == "noshadow");
+				objects.push_back(o);
+			}
+			else
+				ok = false;
+			if (!ok)
+			{
+				cout << file << "(" << number << "): can't read \"" << line << "\"" << endl;
+				return false;
+			}
+		}
+		return !meshFile.empty();
+	}
+	int TextureIndex(const string& name)
+	{
+		for (unsigned i = 0; i < textureNames.size(); i++)
+			if (textureNames[i] == name)
+				return i;
+		return -1;
+	}
+};
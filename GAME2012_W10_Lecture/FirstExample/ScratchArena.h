@@ -0,0 +1,236 @@
+#pragma once
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <atomic>
+using namespace std;
+
+#define SCRATCH_BLOCK_BYTES (16 * 1024 * 1024) // Each block the arena gets from the heap, unless one allocation needs more.
+#define SCRATCH_ALIGN 16
+
+struct ScratchArena;
+
+// In front of every allocation, arena or heap, so free and realloc can tell
+// which it was. Two pointers' worth keeps the data 16 byte aligned on Win32.
+struct ScratchHeader
+{
+	size_t bytes;
+	ScratchArena* arena; // NULL for a heap fallback.
+	size_t pad[2];
+};
+
+// Linear allocator for short-lived decode memory. Allocating bumps a pointer
+// through a few big blocks; freeing the newest allocation gives its space
+// back, and once everything handed out has been freed (from any thread) the
+// next allocation starts again from the beginning. If that took more than
+// one block, they are swapped for a single one that holds it all, so after
+// the first few images a decode is a walk through one buffer. Reset() after
+// a batch of loads returns the memory to the heap.
+//
+// Only the thread that owns the arena allocates from it. Frees may come from
+// anywhere, e.g. the GL thread releasing pixels after an upload.
+struct ScratchArena
+{
+	struct Block
+	{
+		unsigned char* data;
+		size_t size;
+	};
+	vector<Block> blocks;
+	unsigned current; // Block being bumped through.
+	size_t used;	  // Bytes taken in blocks[current].
+	size_t inUse, peakBytes; // Across all blocks, counting headers.
+	size_t cycleBytes;		 // Most in use since the last rewind.
+	size_t nextBlock;		 // Size for the next block, when folding several into one.
+	atomic<int> live;		 // Allocations not yet freed.
+	int allocations, reallocations, blockAllocations, rewinds;
+
+	ScratchArena() : live(0)
+	{
+		current = 0;
+		used = 0;
+		inUse = peakBytes = cycleBytes = nextBlock = 0;
+		allocations = reallocations = blockAllocations = rewinds = 0;
+	}
+	~ScratchArena() { Reset(); }
+	static size_t Rounded(size_t bytes) { return (bytes + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1); }
+	void* Alloc(size_t bytes)
+	{
+		Rewind();
+		size_t need = sizeof(ScratchHeader) + Rounded(bytes);
+		while (current < blocks.size() && blocks[current].size - used < need)
+		{
+			inUse += blocks[current].size - used; // Left unused until the next rewind.
+			current++;
+			used = 0;
+		}
+		if (current == blocks.size())
+		{
+			Block b;
+			b.size = need > SCRATCH_BLOCK_BYTES ? need : SCRATCH_BLOCK_BYTES;
+			b.size = nextBlock > b.size ? nextBlock : b.size;
+			nextBlock = 0;
+			b.data = (unsigned char*)malloc(b.size);
+			if (!b.data)
+				return NULL;
+			blocks.push_back(b);
+			blockAllocations++;
+		}
+		ScratchHeader* h = (ScratchHeader*)(blocks[current].data + used);
+		h->bytes = bytes;
+		h->arena = this;
+		used += need;
+		inUse += need;
+		Peak();
+		allocations++;
+		live++;
+		return h + 1;
+	}
+	// The newest allocation, which can grow or shrink where it is.
+	bool IsTop(ScratchHeader* h)
+	{
+		return current < blocks.size() && (unsigned char*)h + sizeof(ScratchHeader) + Rounded(h->bytes) == blocks[current].data + used;
+	}
+	void* Realloc(ScratchHeader* h, size_t bytes)
+	{
+		reallocations++;
+		if (IsTop(h) && (unsigned char*)(h + 1) + Rounded(bytes) <= blocks[current].data + blocks[current].size)
+		{
+			size_t oldSize = Rounded(h->bytes), newSize = Rounded(bytes);
+			used += newSize - oldSize;
+			inUse += newSize - oldSize;
+			h->bytes = bytes;
+			Peak();
+			return h + 1;
+		}
+		void* p = Alloc(bytes);
+		if (p)
+		{
+			memcpy(p, h + 1, h->bytes < bytes ? h->bytes : bytes);
+			Free(h);
+		}
+		return p;
+	}
+	// Only the owner can take back the space; anyone can say it's unused.
+	void Free(ScratchHeader* h, bool owner = true)
+	{
+		if (owner && IsTop(h))
+		{
+			size_t size = sizeof(ScratchHeader) + Rounded(h->bytes);
+			used -= size;
+			inUse -= size;
+		}
+		live--;
+	}
+	void Peak()
+	{
+		cycleBytes = inUse > cycleBytes ? inUse : cycleBytes;
+		peakBytes = inUse > peakBytes ? inUse : peakBytes;
+	}
+	// Owner only: with nothing live, start over from the beginning.
+	void Rewind()
+	{
+		if (live != 0 || (current == 0 && used == 0))
+			return;
+		if (blocks.size() > 1)
+		{
+			size_t bytes = cycleBytes;
+			Reset();
+			nextBlock = bytes;
+		}
+		current = 0;
+		used = 0;
+		inUse = 0;
+		cycleBytes = 0;
+		rewinds++;
+	}
+	// Everything must have been freed. Hands the blocks back to the heap.
+	void Reset()
+	{
+		for (unsigned i = 0; i < blocks.size(); i++)
+			free(blocks[i].data);
+		blocks.clear();
+		current = 0;
+		used = 0;
+		inUse = 0;
+		cycleBytes = nextBlock = 0;
+	}
+	size_t Reserved()
+	{
+		size_t bytes = 0;
+		for (unsigned i = 0; i < blocks.size(); i++)
+			bytes += blocks[i].size;
+		return bytes;
+	}
+};
+
+// The arena scratchMalloc() uses on this thread; NULL means the heap.
+inline ScratchArena*& scratchCurrent()
+{
+	static thread_local ScratchArena* current = NULL;
+	return current;
+}
+
+// Allocations that went to the heap because no arena was current.
+inline atomic<int>& scratchHeapAllocations()
+{
+	static atomic<int> count(0);
+	return count;
+}
+
+// Sets the thread's arena for a scope.
+struct ScratchScope
+{
+	ScratchArena* previous;
+	ScratchScope(ScratchArena* arena)
+	{
+		previous = scratchCurrent();
+		scratchCurrent() = arena;
+	}
+	~ScratchScope() { scratchCurrent() = previous; }
+};
+
+// malloc/realloc/free with the same signatures as stb_image wants for
+// STBI_MALLOC, STBI_REALLOC_SIZED and STBI_FREE.
+inline void* scratchMalloc(size_t bytes)
+{
+	ScratchArena* arena = scratchCurrent();
+	if (arena)
+		return arena->Alloc(bytes);
+	ScratchHeader* h = (ScratchHeader*)malloc(sizeof(ScratchHeader) + bytes);
+	if (!h)
+		return NULL;
+	h->bytes = bytes;
+	h->arena = NULL;
+	scratchHeapAllocations()++;
+	return h + 1;
+}
+
+inline void scratchFree(void* p)
+{
+	if (!p)
+		return;
+	ScratchHeader* h = (ScratchHeader*)p - 1;
+	if (h->arena)
+		h->arena->Free(h, h->arena == scratchCurrent());
+	else
+		free(h);
+}
+
+inline void* scratchRealloc(void* p, size_t oldBytes, size_t bytes)
+{
+	(void)oldBytes; // The header knows.
+	if (!p)
+		return scratchMalloc(bytes);
+	ScratchHeader* h = (ScratchHeader*)p - 1;
+	if (h->arena && h->arena == scratchCurrent())
+		return h->arena->Realloc(h, bytes);
+	// Someone else's, or the heap's: move it to wherever this thread allocates.
+	void* moved = scratchMalloc(bytes);
+	if (moved)
+	{
+		memcpy(moved, p, h->bytes < bytes ? h->bytes : bytes);
+		scratchFree(p);
+	}
+	return moved;
+}
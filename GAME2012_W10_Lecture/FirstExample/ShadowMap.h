@@ -0,0 +1,157 @@
+#pragma once
+#include <iostream>
+#include <vector>
+#include <GL\glew.h>
+#include "glm\glm.hpp"
+#include "glm\gtc\matrix_transform.hpp"
+#include "Light.h"
+#include "GpuTimer.h"
+using namespace std;
+
+#define SHADOW_MAX_RESOLUTION 1024
+#define SHADOW_MIN_RESOLUTION 64
+
+// Draws every shadow casting object. Gets the model matrix uniform location
+// of the depth program that is currently bound.
+typedef void (*ShadowCasterFunc)(GLint modelLoc);
+
+// Omnidirectional shadows for point lights. Every light owns six layers of
+// one depth cube-map array, so all lights are sampled through one texture unit.
+// Static geometry only has to be rendered once: a light's cube is redrawn only
+// when the light moves or something dynamic comes into its range.
+struct PointShadowAtlas
+{
+	GLuint depthTx, fbo, program;
+	GLint modelLoc, lightMatrixLoc, lightPosLoc, farPlaneLoc;
+	int resolution, lightCount;
+	size_t memoryBytes;
+	bool cacheEnabled;
+	int facesRendered; // This frame.
+	vector<glm::vec3> cachedPositions;
+	vector<bool> valid;
+	GpuTimer timer;
+
+	PointShadowAtlas()
+	{
+		depthTx = fbo = program = 0;
+		resolution = lightCount = 0;
+		memoryBytes = 0;
+		cacheEnabled = true;
+		facesRendered = 0;
+	}
+	// Picks the largest resolution whose cube array fits in budgetBytes.
+	void Init(GLuint depthProgram, int lights, size_t budgetBytes)
+	{
+		program = depthProgram;
+		lightCount = lights;
+		modelLoc = glGetUniformLocation(program, "model");
+		lightMatrixLoc = glGetUniformLocation(program, "lightMatrix");
+		lightPosLoc = glGetUniformLocation(program, "lightPosition");
+		farPlaneLoc = glGetUniformLocation(program, "farPlane");
+
+		const size_t bytesPerTexel = 4; // GL_DEPTH_COMPONENT32F.
+		resolution = SHADOW_MAX_RESOLUTION;
+		while (resolution > SHADOW_MIN_RESOLUTION &&
+			(size_t)resolution * resolution * 6 * lightCount * bytesPerTexel > budgetBytes)
+			resolution /= 2;
+		memoryBytes = (size_t)resolution * resolution * 6 * lightCount * bytesPerTexel;
+		cout << "Shadow atlas: " << lightCount << " cube maps at " << resolution << "x" << resolution
+			<< " (" << memoryBytes / (1024 * 1024.0f) << " MB)" << endl;
+
+		glGenTextures(1, &depthTx);
+		glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, depthTx);
+		glTexStorage3D(GL_TEXTURE_CUBE_MAP_ARRAY, 1, GL_DEPTH_COMPONENT32F, resolution, resolution, 6 * lightCount);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		// Hardware compare gives us 2x2 PCF for free.
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+		glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		cachedPositions.assign(lightCount, glm::vec3(0.0f));
+		valid.assign(lightCount, false);
+		timer.Init();
+	}
+	void Clean()
+	{
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteTextures(1, &depthTx);
+		timer.Clean();
+	}
+	void Invalidate(int light) { valid[light] = false; }
+	void InvalidateAll() { valid.assign(lightCount, false); }
+	// Call for every dynamic object that moved this frame, where it was and where it is now.
+	void MarkDynamic(PointLight* lights, glm::vec3 center, float radius)
+	{
+		for (int i = 0; i < lightCount; i++)
+			if (glm::length(center - lights[i].position) < lights[i].range + radius)
+				valid[i] = false;
+	}
+	// Re-renders the cube of every light that is out of date.
+	void Update(PointLight* lights, ShadowCasterFunc drawCasters)
+	{
+		facesRendered = 0;
+		timer.Begin();
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		GLint lastProgram, lastFramebuffer;
+		glGetIntegerv(GL_CURRENT_PROGRAM, &lastProgram);
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING, &lastFramebuffer);
+		bool culling = glIsEnabled(GL_CULL_FACE);
+
+		for (int i = 0; i < lightCount; i++)
+		{
+			if (cacheEnabled && valid[i] && lights[i].position == cachedPositions[i])
+				continue;
+			if (facesRendered == 0)
+			{
+				glUseProgram(program);
+				glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+				glViewport(0, 0, resolution, resolution);
+				glDisable(GL_CULL_FACE); // Open meshes like the gate still need to cast.
+			}
+			RenderLight(lights[i], i, drawCasters);
+			cachedPositions[i] = lights[i].position;
+			valid[i] = true;
+		}
+
+		if (facesRendered > 0)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, lastFramebuffer);
+			glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+			glUseProgram(lastProgram);
+			if (culling)
+				glEnable(GL_CULL_FACE);
+		}
+		timer.End();
+	}
+	void RenderLight(PointLight& light, int index, ShadowCasterFunc drawCasters)
+	{
+		static const glm::vec3 dirs[6] = { glm::vec3(1,0,0), glm::vec3(-1,0,0), glm::vec3(0,1,0),
+			glm::vec3(0,-1,0), glm::vec3(0,0,1), glm::vec3(0,0,-1) };
+		static const glm::vec3 ups[6] = { glm::vec3(0,-1,0), glm::vec3(0,-1,0), glm::vec3(0,0,1),
+			glm::vec3(0,0,-1), glm::vec3(0,-1,0), glm::vec3(0,-1,0) };
+		glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, light.range);
+
+		glUniform3f(lightPosLoc, light.position.x, light.position.y, light.position.z);
+		glUniform1f(farPlaneLoc, light.range);
+		for (int face = 0; face < 6; face++)
+		{
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTx, 0, index * 6 + face);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			glm::mat4 lightMatrix = proj * glm::lookAt(light.position, light.position + dirs[face], ups[face]);
+			glUniformMatrix4fv(lightMatrixLoc, 1, GL_FALSE, &lightMatrix[0][0]);
+			drawCasters(modelLoc);
+			facesRendered++;
+		}
+	}
+};
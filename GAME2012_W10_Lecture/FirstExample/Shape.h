@@ -2,34 +2,70 @@
 
 #include <iostream>
 #include <vector>
+#include <cfloat>
 #include "glm\glm.hpp"
+#include "NormalGenerator.h"
 #define PI 3.14159265358979324
+#define RESTART_INDEX 0xFFFFFFFF // Ends a strip in shape_indices. Packs down to 0xFFFF at 16 bits, still a restart.
 using namespace std;
 
 struct Shape
 {
-	vector<GLshort> shape_indices;
+	vector<GLuint> shape_indices;	 // Built at full width; what goes to GL is chosen by PackIndices().
+	vector<GLushort> packed_indices; // shape_indices at 16 bits, when every vertex can be reached that way.
+	GLenum indexType;				 // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT once packed, 0 before.
 	vector<GLfloat> shape_vertices;
 	vector<GLfloat> shape_colors;
 	vector<GLfloat> shape_uvs;
-	vector<GLfloat> shape_normals;
+	vector<GLfloat> shape_normals; // Empty until CalcNormals(); shapes without them draw lit from straight up.
+	glm::vec3 boundsMin, boundsMax; // Local space, filled by CalcBounds().
 
+	Shape() { indexType = 0; }
 	~Shape()
 	{
 		shape_indices.clear();
 		shape_indices.shrink_to_fit();
+		packed_indices.clear();
+		packed_indices.shrink_to_fit();
 		shape_vertices.clear();
 		shape_vertices.shrink_to_fit();
 		shape_colors.clear();
 		shape_colors.shrink_to_fit();
 		shape_uvs.clear();
 		shape_uvs.shrink_to_fit();
+		shape_normals.clear();
+		shape_normals.shrink_to_fit();
 	}
 	GLsizei NumIndices() { return shape_indices.size(); }
-	void BufferShape(GLuint* ibo, GLuint* points_vbo, GLuint* colors_vbo, GLuint* uv_vbo)
+	// Sixteen bits while the vertices fit below the restart value, so small
+	// shapes keep half size index buffers and only big ones (a Grid past 254
+	// quads a side) pay for 32. Runs on first upload; call it again after
+	// changing shape_indices.
+	void PackIndices()
+	{
+		indexType = shape_vertices.size() / 3 < 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		packed_indices.resize(indexType == GL_UNSIGNED_SHORT ? shape_indices.size() : 0);
+		packed_indices.shrink_to_fit();
+		for (unsigned i = 0; i < packed_indices.size(); i++)
+			packed_indices[i] = (GLushort)shape_indices[i];
+	}
+	GLenum IndexType()
+	{
+		if (!indexType)
+			PackIndices();
+		return indexType;
+	}
+	void BufferIndices(GLuint* ibo)
 	{
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, *ibo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(shape_indices[0]) * shape_indices.size(), &shape_indices.front(), GL_STATIC_DRAW);
+		if (IndexType() == GL_UNSIGNED_SHORT)
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(packed_indices[0]) * packed_indices.size(), &packed_indices.front(), GL_STATIC_DRAW);
+		else
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(shape_indices[0]) * shape_indices.size(), &shape_indices.front(), GL_STATIC_DRAW);
+	}
+	void BufferShape(GLuint* ibo, GLuint* points_vbo, GLuint* colors_vbo, GLuint* uv_vbo, GLuint* normals_vbo)
+	{
+		BufferIndices(ibo);
 
 		glBindBuffer(GL_ARRAY_BUFFER, *points_vbo);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(shape_vertices[0]) * shape_vertices.size(), &shape_vertices.front(), GL_STATIC_DRAW);
@@ -46,51 +82,69 @@ struct Shape
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, 0);
 		glEnableVertexAttribArray(2);
 
+		if (shape_normals.size() == shape_vertices.size())
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, *normals_vbo);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(shape_normals[0]) * shape_normals.size(), &shape_normals.front(), GL_STATIC_DRAW);
+			glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, 0);
+			glEnableVertexAttribArray(3);
+		}
+		else
+		{
+			glDisableVertexAttribArray(3);
+			glVertexAttrib3f(3, 0.0f, 1.0f, 0.0f);
+		}
+
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 	}
-	void ColorShape(GLfloat r, GLfloat g, GLfloat b)
+	void CalcBounds()
 	{
-		shape_colors.clear();
-		shape_colors.shrink_to_fit();
-		for (int i = 0; i < shape_vertices.size(); i += 3)
+		boundsMin = glm::vec3(FLT_MAX);
+		boundsMax = glm::vec3(-FLT_MAX);
+		for (unsigned i = 0; i < shape_vertices.size(); i += 3)
 		{
-			shape_colors.push_back(r);
-			shape_colors.push_back(g);
-			shape_colors.push_back(b);
+			glm::vec3 v(shape_vertices[i], shape_vertices[i + 1], shape_vertices[i + 2]);
+			boundsMin = glm::min(boundsMin, v);
+			boundsMax = glm::max(boundsMax, v);
 		}
-		shape_colors.shrink_to_fit(); // Good idea after a bunch of pushes.
 	}
-	void CalcAverageNormals(vector<GLshort>& indices, unsigned indiceCount, vector<GLfloat>& vertices,
-		unsigned verticeCount)
+	// Position-only stream for depth passes.
+	void BufferPositions(GLuint* ibo, GLuint* points_vbo)
 	{
-		// Popular shape_normals so we can use [].
-		for (int i = 0; i < verticeCount; i++)
-			shape_normals.push_back(0);
-		shape_normals.shrink_to_fit();
-		// Calculate the normals of each triangle first.
-		for (unsigned i = 0; i < indiceCount; i += 3)
-		{
-			unsigned int in0 = indices[i] * 3;
-			unsigned int in1 = indices[i + 1] * 3;
-			unsigned int in2 = indices[i + 2] * 3;
-			glm::vec3 v1(vertices[in1] - vertices[in0], vertices[in1 + 1] - vertices[in0 + 1], vertices[in1 + 2] - vertices[in0 + 2]);
-			glm::vec3 v2(vertices[in2] - vertices[in0], vertices[in2 + 1] - vertices[in0 + 1], vertices[in2 + 2] - vertices[in0 + 2]);
-			glm::vec3 normal = glm::cross(v2, v1);
-			normal = glm::normalize(normal); // Finally becomes a unit vector.
+		BufferIndices(ibo);
 
-			// Now populate the normal values for each vertex of the triangle.
-			shape_normals[in0] += normal.x;	shape_normals[in0 + 1] += normal.y;	shape_normals[in0 + 2] += normal.z;
-			shape_normals[in1] += normal.x;	shape_normals[in1 + 1] += normal.y;	shape_normals[in1 + 2] += normal.z;
-			shape_normals[in2] += normal.x;	shape_normals[in2 + 1] += normal.y;	shape_normals[in2 + 2] += normal.z;
-		}
-		// Normalize each of the new normal vectors.
-		for (unsigned i = 0; i < shape_normals.size(); i += 3)
+		glBindBuffer(GL_ARRAY_BUFFER, *points_vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(shape_vertices[0]) * shape_vertices.size(), &shape_vertices.front(), GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(shape_vertices[0]) * 3, 0);
+		glEnableVertexAttribArray(0);
+
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	void ColorShape(GLfloat r, GLfloat g, GLfloat b)
+	{
+		// Sized once up front rather than grown a push at a time.
+		shape_colors.resize(shape_vertices.size());
+		shape_colors.shrink_to_fit();
+		for (unsigned i = 0; i < shape_colors.size(); i += 3)
 		{
-			glm::vec3 vec(shape_normals[i], shape_normals[i + 1], shape_normals[i + 2]);
-			vec = glm::normalize(vec);
-			shape_normals[i] = vec.x; shape_normals[i + 1] = vec.y; shape_normals[i + 2] = vec.z;
+			shape_colors[i] = r;
+			shape_colors[i + 1] = g;
+			shape_colors[i + 2] = b;
 		}
 	}
+	// For shapes drawn as triangle lists; see NormalGenerator.h.
+	void CalcNormals(NormalWeighting weighting = NORMALS_BY_ANGLE)
+	{
+		generateNormals(&shape_vertices.front(), shape_vertices.size() / 3, shape_indices.empty() ? NULL : &shape_indices.front(),
+			shape_indices.size(), weighting, shape_normals);
+	}
+	// The first indiceCount indices of vertices' triangles, area weighted.
+	void CalcAverageNormals(vector<GLuint>& indices, unsigned indiceCount, vector<GLfloat>& vertices,
+		unsigned verticeCount)
+	{
+		generateNormals(&vertices.front(), verticeCount / 3, indices.empty() ? NULL : &indices.front(), indiceCount,
+			NORMALS_BY_AREA, shape_normals);
+	}
 };
 
 struct Plane : public Shape // Vertical plane of 1x1 units across.
@@ -120,6 +174,8 @@ struct Grid : public Shape // Flat grid on ground. Starts at 0,0,0 and increases
 {
 	Grid(int quads)
 	{
+		shape_vertices.reserve((quads + 1) * (quads + 1) * 3);
+		shape_indices.reserve(quads * quads * 6);
 		for (int row = 0; row <= quads; row++)
 		{
 			for (int col = 0; col <= quads; col++)
@@ -162,12 +218,31 @@ struct Grid : public Shape // Flat grid on ground. Starts at 0,0,0 and increases
 			}
 			i++;
 		}
-		for (int i = 0; i < shape_vertices.size(); i += 3)
+		shape_uvs.assign(shape_vertices.size() / 3 * 2, 0.0f); // No texture for grid so value doesn't matter.
+		ColorShape(1.0f, 0.0f, 1.0f);
+	}
+};
+// The same grid's lines for GL_LINE_STRIP: a strip along each row, then
+// one along each column, split by RESTART_INDEX.
+struct GridLines : public Grid
+{
+	GridLines(int quads) : Grid(quads)
+	{
+		shape_indices.clear();
+		shape_indices.reserve((quads + 1) * (quads + 2) * 2);
+		for (int row = 0; row <= quads; row++)
+		{
+			for (int col = 0; col <= quads; col++)
+				shape_indices.push_back(row * (quads + 1) + col);
+			shape_indices.push_back(RESTART_INDEX);
+		}
+		for (int col = 0; col <= quads; col++)
 		{
-			shape_uvs.push_back(0); // No texture for grid so value doesn't matter.
-			shape_uvs.push_back(0);
+			for (int row = 0; row <= quads; row++)
+				shape_indices.push_back(row * (quads + 1) + col);
+			if (col < quads)
+				shape_indices.push_back(RESTART_INDEX);
 		}
-		ColorShape(1.0f, 0.0f, 1.0f);
 	}
 };
 struct RightWall : public Shape
@@ -3589,6 +3664,8 @@ struct TowerPrism : public Shape
 {
 	TowerPrism(int sides)
 	{
+		shape_vertices.reserve((sides + 1) * 2 * 3);
+		shape_indices.reserve(sides * 12);
 		float theta = 0.0f;
 		// Top face.
 		shape_vertices.push_back(0.5f);
@@ -3698,6 +3775,8 @@ struct TowerCone : public Shape
 {
 	TowerCone(int sides)
 	{
+		shape_vertices.reserve((sides + 2) * 3);
+		shape_indices.reserve(sides * 6);
 		float theta = 0.0f;
 		// Bottom face.
 		shape_vertices.push_back(0.5f);
@@ -3733,11 +3812,7 @@ struct TowerCone : public Shape
 		shape_indices.push_back(sides);
 		shape_indices.push_back(sides + 1);
 		shape_indices.push_back(1);
-		for (int i = 0; i < shape_vertices.size(); i += 3)
-		{
-			shape_uvs.push_back(0); // No texture for grid so value doesn't matter.
-			shape_uvs.push_back(0);
-		}
+		shape_uvs.assign(shape_vertices.size() / 3 * 2, 0.0f); // No texture for grid so value doesn't matter.
 		ColorShape(0.0f, 10.0f, 1.0f);
 	}
 };
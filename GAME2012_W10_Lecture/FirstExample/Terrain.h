@@ -0,0 +1,486 @@
+#pragma once
+#include <cmath>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <cstddef>
+#include <GL\glew.h>
+#include "glm\glm.hpp"
+#include "glm\gtc\noise.hpp"
+#include "ThreadPool.h"
+#include "Meshlets.h"	   // MeshletCuller::FrustumPlanes.
+#include "LightCulling.h" // distanceSqToBox.
+#include "stb_image.h"
+using namespace std;
+
+#define TERRAIN_CHUNK_QUADS 64		// Quads along a chunk's side at full detail; a power of two.
+#define TERRAIN_QUAD_SIZE 2.0f		// Metres per quad at full detail.
+#define TERRAIN_CHUNKS 32			// Chunks along each side of the world: 32 x 64 x 2 m = 4096 m.
+#define TERRAIN_LODS 5				// Every vertex, then every 2nd, 4th, 8th and 16th.
+#define TERRAIN_LOD_DISTANCE 128.0f // Metres to a chunk before it drops to level 1; each level after doubles it.
+#define TERRAIN_LOAD_RADIUS 6		// Chunks kept each way around the camera's. Unloaded one chunk further out.
+#define TERRAIN_MAX_QUEUED 8		// Chunks being built at once, so a fast camera doesn't queue stale work.
+#define TERRAIN_UPLOADS_PER_FRAME 4 // Built chunks copied to the GPU per frame, nearest first.
+#define TERRAIN_HEIGHT 120.0f		// Metres from the lowest ground to the highest.
+#define TERRAIN_NOISE_SCALE 900.0f	// Metres across the broadest hills.
+#define TERRAIN_OCTAVES 6
+#define TERRAIN_FLAT_RADIUS 40.0f	// Metres around the centre kept flat for the castle, blending to hills by three times that.
+#define TERRAIN_TEXTURE_METRES 4.0f // Ground covered by one repeat of the texture.
+#define TERRAIN_VIEW_DISTANCE 1200.0f // Far plane to use with the terrain on.
+
+// One vertex of a chunk. The shade goes to the colour attribute, since the
+// scene's lights only reach the castle; it's lambert from a fixed sun.
+struct TerrainVertex
+{
+	GLfloat position[3];
+	GLfloat normal[3];
+	GLfloat uv[2];
+	GLubyte shade[4];
+};
+
+enum TerrainChunkState { CHUNK_UNLOADED, CHUNK_QUEUED, CHUNK_READY, CHUNK_RESIDENT };
+
+struct TerrainChunk
+{
+	TerrainChunkState state;
+	int slot;	 // Which chunk's worth of the vertex buffer it's in, when resident.
+	int ticket;	 // Bumped each time it's queued, so a build for an earlier visit is thrown away.
+	int lod;
+	int stitch;	 // TERRAIN_WEST etc. for each side whose neighbour is a level coarser.
+	float minY, maxY;
+};
+
+// A chunk's vertices, built on the worker and uploaded by Update().
+struct TerrainBuild
+{
+	int chunk, ticket;
+	vector<TerrainVertex> vertices;
+	float minY, maxY;
+};
+
+enum TerrainSide { TERRAIN_WEST = 1, TERRAIN_EAST = 2, TERRAIN_NORTH = 4, TERRAIN_SOUTH = 8 };
+
+// A heightfield cut into TERRAIN_CHUNKS x TERRAIN_CHUNKS square chunks, with
+// only those around the camera in memory. Heights come from a 16 (or 8) bit
+// greyscale image stretched over the whole world, or fractal simplex noise.
+// Chunks are built on a worker thread and copied into fixed slots of one
+// vertex buffer, so loading never reallocates anything on the GPU.
+//
+// Every chunk has the same full detail vertex grid, so one index buffer
+// serves them all: for each level of detail it holds 16 variants, one per
+// combination of sides that meet a coarser neighbour. On those sides the
+// edge skips the vertices the neighbour doesn't have, which is what keeps
+// cracks out (geomipmapping). Neighbouring levels are kept at most one apart.
+struct Terrain
+{
+	static const int sideVertices = TERRAIN_CHUNK_QUADS + 1;
+	static const int chunkVertices = sideVertices * sideVertices;
+	static const int slots = (2 * TERRAIN_LOAD_RADIUS + 3) * (2 * TERRAIN_LOAD_RADIUS + 3);
+
+	vector<TerrainChunk> chunks; // TERRAIN_CHUNKS rows of TERRAIN_CHUNKS, north (-z) first.
+	vector<int> freeSlots;
+	vector<unsigned short> heightmap;
+	int heightmapWidth, heightmapHeight;
+	float originX, originZ; // World position of the north west corner.
+	GLuint vao, vbo, ibo;
+	GLsizei indexCount[TERRAIN_LODS][16];
+	size_t indexOffset[TERRAIN_LODS][16]; // In indices.
+
+	ThreadPool pool;
+	mutex lock;
+	vector<TerrainBuild> finished; // Under lock, filled by the worker.
+	deque<TerrainBuild> ready;	   // Waiting for an upload slot.
+	int queued;
+	vector<int> visible; // Chunks to draw this frame, nearest first.
+	vector<float> distances;
+
+	// Stats.
+	int resident, uploads, drawnTriangles, totalLoads, totalUnloads;
+	float buildMs; // Worker time for the most recent chunk.
+
+	Terrain()
+	{
+		vao = vbo = ibo = 0;
+		heightmapWidth = heightmapHeight = 0;
+		originX = originZ = 0.0f;
+		queued = resident = uploads = drawnTriangles = totalLoads = totalUnloads = 0;
+		buildMs = 0.0f;
+	}
+	// centre is where the castle stands; the world is laid out around it and
+	// kept flat there. heightmapFile may be NULL for noise.
+	bool Init(glm::vec3 centre, const char* heightmapFile = NULL)
+	{
+		const float size = TERRAIN_CHUNKS * TERRAIN_CHUNK_QUADS * TERRAIN_QUAD_SIZE;
+		originX = centre.x - size * 0.5f;
+		originZ = centre.z - size * 0.5f;
+		if (heightmapFile)
+		{
+			int channels;
+			stbi_us* pixels = stbi_load_16(heightmapFile, &heightmapWidth, &heightmapHeight, &channels, 1);
+			if (!pixels)
+			{
+				cout << "Unable to load heightmap " << heightmapFile << ", using noise." << endl;
+				heightmapWidth = heightmapHeight = 0;
+			}
+			else
+			{
+				heightmap.assign(pixels, pixels + heightmapWidth * heightmapHeight);
+				stbi_image_free(pixels);
+			}
+		}
+		TerrainChunk empty = { CHUNK_UNLOADED, -1, 0, 0, 0, 0.0f, 0.0f };
+		chunks.assign(TERRAIN_CHUNKS * TERRAIN_CHUNKS, empty);
+		for (int i = slots - 1; i >= 0; i--)
+			freeSlots.push_back(i);
+
+		vector<GLushort> indices;
+		for (int lod = 0; lod < TERRAIN_LODS; lod++)
+			for (int stitch = 0; stitch < 16; stitch++)
+			{
+				indexOffset[lod][stitch] = indices.size();
+				BuildIndices(lod, stitch, indices);
+				indexCount[lod][stitch] = (GLsizei)(indices.size() - indexOffset[lod][stitch]);
+			}
+
+		glGenVertexArrays(1, &vao);
+		glBindVertexArray(vao);
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)slots * chunkVertices * sizeof(TerrainVertex), NULL, GL_STATIC_DRAW);
+		glGenBuffers(1, &ibo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, position));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(1, 3, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, shade));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, uv));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(TerrainVertex), (void*)offsetof(TerrainVertex, normal));
+		glEnableVertexAttribArray(3);
+		glBindVertexArray(0);
+
+		pool.Start(1);
+		cout << "Terrain: " << size << " m square in " << TERRAIN_CHUNKS * TERRAIN_CHUNKS << " chunks, heights from "
+			<< (heightmap.empty() ? "noise" : heightmapFile) << "; " << slots << " slots of " << chunkVertices * sizeof(TerrainVertex) / 1024
+			<< " KB and " << indices.size() * sizeof(GLushort) / 1024 << " KB of shared indices" << endl;
+		return true;
+	}
+	void Clean()
+	{
+		pool.Stop();
+		glDeleteBuffers(1, &vbo);
+		glDeleteBuffers(1, &ibo);
+		glDeleteVertexArrays(1, &vao);
+	}
+	// Ground height in metres at global vertex gx, gz; callable from any thread.
+	float Height(int gx, int gz) const
+	{
+		const int size = TERRAIN_CHUNKS * TERRAIN_CHUNK_QUADS;
+		float x = originX + gx * TERRAIN_QUAD_SIZE, z = originZ + gz * TERRAIN_QUAD_SIZE;
+		float h;
+		if (!heightmap.empty())
+		{
+			// Rows come bottom up, as the loader flips images for GL, so the last is north.
+			float u = glm::clamp((float)gx / size, 0.0f, 1.0f) * (heightmapWidth - 1);
+			float v = (1.0f - glm::clamp((float)gz / size, 0.0f, 1.0f)) * (heightmapHeight - 1);
+			int x0 = min((int)u, heightmapWidth - 2), y0 = min((int)v, heightmapHeight - 2);
+			x0 = max(x0, 0);
+			y0 = max(y0, 0);
+			int x1 = min(x0 + 1, heightmapWidth - 1), y1 = min(y0 + 1, heightmapHeight - 1);
+			float fx = u - x0, fy = v - y0;
+			float top = heightmap[y0 * heightmapWidth + x0] * (1.0f - fx) + heightmap[y0 * heightmapWidth + x1] * fx;
+			float bottom = heightmap[y1 * heightmapWidth + x0] * (1.0f - fx) + heightmap[y1 * heightmapWidth + x1] * fx;
+			h = (top * (1.0f - fy) + bottom * fy) / 65535.0f;
+		}
+		else
+		{
+			float sum = 0.0f, amplitude = 1.0f, total = 0.0f, frequency = 1.0f / TERRAIN_NOISE_SCALE;
+			for (int o = 0; o < TERRAIN_OCTAVES; o++)
+			{
+				sum += amplitude * glm::simplex(glm::vec2(x, z) * frequency);
+				total += amplitude;
+				amplitude *= 0.5f;
+				frequency *= 2.0f;
+			}
+			h = 0.5f + 0.5f * sum / total;
+		}
+		const float half = TERRAIN_CHUNKS * TERRAIN_CHUNK_QUADS * TERRAIN_QUAD_SIZE * 0.5f;
+		float fromCentre = glm::length(glm::vec2(x - (originX + half), z - (originZ + half)));
+		// Just under the castle's ground plane, so the plane still shows on top.
+		return glm::smoothstep(TERRAIN_FLAT_RADIUS, TERRAIN_FLAT_RADIUS * 3.0f, fromCentre) * h * TERRAIN_HEIGHT - 0.05f;
+	}
+	// Worker side: heights with a one vertex border, so normals on a shared
+	// edge come out the same from both chunks.
+	void Build(int chunk, int ticket)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		const int border = sideVertices + 2;
+		int baseX = (chunk % TERRAIN_CHUNKS) * TERRAIN_CHUNK_QUADS, baseZ = (chunk / TERRAIN_CHUNKS) * TERRAIN_CHUNK_QUADS;
+		vector<float> heights(border * border);
+		for (int z = 0; z < border; z++)
+			for (int x = 0; x < border; x++)
+				heights[z * border + x] = Height(baseX + x - 1, baseZ + z - 1);
+
+		TerrainBuild b;
+		b.chunk = chunk;
+		b.ticket = ticket;
+		b.minY = b.maxY = heights[border + 1];
+		b.vertices.resize(chunkVertices);
+		const glm::vec3 sun = glm::normalize(glm::vec3(0.4f, 0.8f, 0.3f));
+		for (int z = 0; z < sideVertices; z++)
+			for (int x = 0; x < sideVertices; x++)
+			{
+				const float* h = &heights[(z + 1) * border + x + 1];
+				glm::vec3 n = glm::normalize(glm::vec3(h[-1] - h[1], 2.0f * TERRAIN_QUAD_SIZE, h[-border] - h[border]));
+				float shade = glm::clamp(0.4f + 0.6f * glm::dot(n, sun) / sun.y, 0.0f, 1.0f);
+				TerrainVertex& v = b.vertices[z * sideVertices + x];
+				v.position[0] = originX + (baseX + x) * TERRAIN_QUAD_SIZE;
+				v.position[1] = h[0];
+				v.position[2] = originZ + (baseZ + z) * TERRAIN_QUAD_SIZE;
+				v.normal[0] = n.x;
+				v.normal[1] = n.y;
+				v.normal[2] = n.z;
+				v.uv[0] = (baseX + x) * TERRAIN_QUAD_SIZE / TERRAIN_TEXTURE_METRES;
+				v.uv[1] = (baseZ + z) * TERRAIN_QUAD_SIZE / TERRAIN_TEXTURE_METRES;
+				v.shade[0] = v.shade[1] = v.shade[2] = (GLubyte)(shade * 255.0f + 0.5f);
+				v.shade[3] = 255;
+				b.minY = min(b.minY, h[0]);
+				b.maxY = max(b.maxY, h[0]);
+			}
+		lock_guard<mutex> guard(lock);
+		buildMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+		finished.push_back(move(b));
+	}
+	// Appends the triangles for lod with the sides in stitch meeting a level
+	// coarser. The inside is plain quads; each side is a strip between its
+	// edge and the ring of vertices one step in, split from its neighbours
+	// along the corner diagonals, zipped together however the two rows'
+	// spacings fall.
+	static void BuildIndices(int lod, int stitch, vector<GLushort>& indices)
+	{
+		const int n = TERRAIN_CHUNK_QUADS, step = 1 << lod;
+		for (int z = step; z < n - step; z += step)
+			for (int x = step; x < n - step; x += step)
+			{
+				AddTriangle(indices, x, z, x, z + step, x + step, z + step);
+				AddTriangle(indices, x, z, x + step, z + step, x + step, z);
+			}
+		const int sides[4] = { TERRAIN_WEST, TERRAIN_EAST, TERRAIN_NORTH, TERRAIN_SOUTH };
+		for (int s = 0; s < 4; s++)
+		{
+			int outerStep = (stitch & sides[s]) ? step * 2 : step;
+			int outer = 0, inner = step; // How far along the side each row has got.
+			while (outer < n || inner < n - step)
+			{
+				int ax, az, bx, bz, cx, cz;
+				SidePoint(s, outer, 0, ax, az);
+				if (inner >= n - step || (outer < n && outer + outerStep <= inner + step))
+				{
+					SidePoint(s, outer + outerStep, 0, bx, bz);
+					SidePoint(s, inner, step, cx, cz);
+					outer += outerStep;
+				}
+				else
+				{
+					SidePoint(s, inner + step, step, bx, bz);
+					SidePoint(s, inner, step, cx, cz);
+					inner += step;
+				}
+				AddTriangle(indices, ax, az, bx, bz, cx, cz);
+			}
+		}
+	}
+	// Grid position of the point along distance along side s, depth in from its edge.
+	static void SidePoint(int s, int along, int depth, int& x, int& z)
+	{
+		const int n = TERRAIN_CHUNK_QUADS;
+		x = s == 0 ? depth : s == 1 ? n - depth : along;
+		z = s == 2 ? depth : s == 3 ? n - depth : along;
+	}
+	// Anticlockwise seen from above, whichever order the corners come in.
+	static void AddTriangle(vector<GLushort>& indices, int ax, int az, int bx, int bz, int cx, int cz)
+	{
+		if ((bz - az) * (cx - ax) - (bx - ax) * (cz - az) < 0)
+		{
+			swap(bx, cx);
+			swap(bz, cz);
+		}
+		indices.push_back((GLushort)(az * sideVertices + ax));
+		indices.push_back((GLushort)(bz * sideVertices + bx));
+		indices.push_back((GLushort)(cz * sideVertices + cx));
+	}
+	float ChunkSize() const { return TERRAIN_CHUNK_QUADS * TERRAIN_QUAD_SIZE; }
+	glm::vec3 ChunkMin(int c) const
+	{
+		return glm::vec3(originX + (c % TERRAIN_CHUNKS) * ChunkSize(), chunks[c].minY, originZ + (c / TERRAIN_CHUNKS) * ChunkSize());
+	}
+	glm::vec3 ChunkMax(int c) const
+	{
+		return glm::vec3(originX + (c % TERRAIN_CHUNKS + 1) * ChunkSize(), chunks[c].maxY, originZ + (c / TERRAIN_CHUNKS + 1) * ChunkSize());
+	}
+	void Unload(int c)
+	{
+		TerrainChunk& chunk = chunks[c];
+		if (chunk.state == CHUNK_RESIDENT)
+		{
+			freeSlots.push_back(chunk.slot);
+			resident--;
+			totalUnloads++;
+		}
+		chunk.state = CHUNK_UNLOADED;
+		chunk.slot = -1;
+	}
+	// Call once per frame from the GL thread: streams chunks in and out
+	// around eye, picks each one's level of detail and which to draw.
+	void Update(glm::vec3 eye, const glm::mat4& viewProjection)
+	{
+		int eyeX = glm::clamp((int)floor((eye.x - originX) / ChunkSize()), 0, TERRAIN_CHUNKS - 1);
+		int eyeZ = glm::clamp((int)floor((eye.z - originZ) / ChunkSize()), 0, TERRAIN_CHUNKS - 1);
+
+		// Drop what's fallen behind; a chunk on the way in is forgotten and its build discarded.
+		vector<int> wanted;
+		for (int c = 0; c < (int)chunks.size(); c++)
+		{
+			int away = max(abs(c % TERRAIN_CHUNKS - eyeX), abs(c / TERRAIN_CHUNKS - eyeZ));
+			if (away > TERRAIN_LOAD_RADIUS + 1 && chunks[c].state != CHUNK_UNLOADED)
+				Unload(c);
+			else if (away <= TERRAIN_LOAD_RADIUS && chunks[c].state == CHUNK_UNLOADED)
+				wanted.push_back(c);
+		}
+
+		// Collect the worker's results, then queue more, nearest first.
+		{
+			lock_guard<mutex> guard(lock);
+			for (unsigned i = 0; i < finished.size(); i++)
+			{
+				TerrainChunk& chunk = chunks[finished[i].chunk];
+				queued--;
+				if (chunk.state == CHUNK_QUEUED && chunk.ticket == finished[i].ticket)
+				{
+					chunk.state = CHUNK_READY;
+					ready.push_back(TerrainBuild());
+					swap(ready.back(), finished[i]);
+				}
+			}
+			finished.clear();
+		}
+		distances.assign(chunks.size(), 0.0f);
+		for (int c = 0; c < (int)chunks.size(); c++)
+			distances[c] = (float)((c % TERRAIN_CHUNKS - eyeX) * (c % TERRAIN_CHUNKS - eyeX) + (c / TERRAIN_CHUNKS - eyeZ) * (c / TERRAIN_CHUNKS - eyeZ));
+		sort(wanted.begin(), wanted.end(), [this](int a, int b) { return distances[a] < distances[b]; });
+		for (unsigned i = 0; i < wanted.size() && queued < TERRAIN_MAX_QUEUED; i++)
+		{
+			TerrainChunk& chunk = chunks[wanted[i]];
+			chunk.state = CHUNK_QUEUED;
+			int c = wanted[i], ticket = ++chunk.ticket;
+			queued++;
+			pool.Add([this, c, ticket] { Build(c, ticket); });
+		}
+
+		// Upload a few, nearest first.
+		sort(ready.begin(), ready.end(), [this](const TerrainBuild& a, const TerrainBuild& b) { return distances[a.chunk] < distances[b.chunk]; });
+		uploads = 0;
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		while (!ready.empty() && uploads < TERRAIN_UPLOADS_PER_FRAME && !freeSlots.empty())
+		{
+			TerrainBuild& b = ready.front();
+			TerrainChunk& chunk = chunks[b.chunk];
+			if (chunk.state == CHUNK_READY && chunk.ticket == b.ticket)
+			{
+				chunk.slot = freeSlots.back();
+				freeSlots.pop_back();
+				glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)chunk.slot * chunkVertices * sizeof(TerrainVertex),
+					chunkVertices * sizeof(TerrainVertex), &b.vertices[0]);
+				chunk.minY = b.minY;
+				chunk.maxY = b.maxY;
+				chunk.state = CHUNK_RESIDENT;
+				resident++;
+				totalLoads++;
+				uploads++;
+			}
+			ready.pop_front();
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		// Level from the distance to each chunk's box, then pulled in until
+		// no two resident neighbours are more than one apart.
+		vector<int> live;
+		for (int c = 0; c < (int)chunks.size(); c++)
+			if (chunks[c].state == CHUNK_RESIDENT)
+			{
+				distances[c] = sqrt(distanceSqToBox(eye, ChunkMin(c), ChunkMax(c)));
+				chunks[c].lod = distances[c] < TERRAIN_LOD_DISTANCE ? 0 :
+					min(TERRAIN_LODS - 1, 1 + (int)floor(log2(distances[c] / TERRAIN_LOD_DISTANCE)));
+				live.push_back(c);
+			}
+		for (bool changed = true; changed;)
+		{
+			changed = false;
+			for (unsigned i = 0; i < live.size(); i++)
+				for (int s = 0; s < 4; s++)
+				{
+					int other = Neighbour(live[i], s);
+					if (other >= 0 && chunks[other].lod > chunks[live[i]].lod + 1)
+					{
+						chunks[other].lod = chunks[live[i]].lod + 1;
+						changed = true;
+					}
+				}
+		}
+
+		// Stitch towards coarser neighbours, and keep what's in view.
+		glm::vec4 planes[6];
+		MeshletCuller::FrustumPlanes(viewProjection, planes);
+		visible.clear();
+		drawnTriangles = 0;
+		for (unsigned i = 0; i < live.size(); i++)
+		{
+			TerrainChunk& chunk = chunks[live[i]];
+			chunk.stitch = 0;
+			for (int s = 0; s < 4; s++)
+			{
+				int other = Neighbour(live[i], s);
+				if (other >= 0 && chunks[other].lod > chunk.lod)
+					chunk.stitch |= 1 << s;
+			}
+			glm::vec3 lo = ChunkMin(live[i]), hi = ChunkMax(live[i]);
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; p++)
+			{
+				glm::vec3 far(planes[p].x > 0.0f ? hi.x : lo.x, planes[p].y > 0.0f ? hi.y : lo.y, planes[p].z > 0.0f ? hi.z : lo.z);
+				inside = glm::dot(glm::vec3(planes[p]), far) + planes[p].w >= 0.0f;
+			}
+			if (inside)
+			{
+				visible.push_back(live[i]);
+				drawnTriangles += indexCount[chunk.lod][chunk.stitch] / 3;
+			}
+		}
+		sort(visible.begin(), visible.end(), [this](int a, int b) { return distances[a] < distances[b]; });
+	}
+	// The resident chunk across side s (0 west, 1 east, 2 north, 3 south) of c, or -1.
+	int Neighbour(int c, int s) const
+	{
+		int x = c % TERRAIN_CHUNKS + (s == 0 ? -1 : s == 1 ? 1 : 0), z = c / TERRAIN_CHUNKS + (s == 2 ? -1 : s == 3 ? 1 : 0);
+		if (x < 0 || z < 0 || x >= TERRAIN_CHUNKS || z >= TERRAIN_CHUNKS || chunks[z * TERRAIN_CHUNKS + x].state != CHUNK_RESIDENT)
+			return -1;
+		return z * TERRAIN_CHUNKS + x;
+	}
+	// Draws the chunks Update() kept, with whatever program and model matrix are current.
+	void Draw()
+	{
+		glBindVertexArray(vao);
+		for (unsigned i = 0; i < visible.size(); i++)
+		{
+			const TerrainChunk& chunk = chunks[visible[i]];
+			glDrawElementsBaseVertex(GL_TRIANGLES, indexCount[chunk.lod][chunk.stitch], GL_UNSIGNED_SHORT,
+				(void*)(indexOffset[chunk.lod][chunk.stitch] * sizeof(GLushort)), chunk.slot * chunkVertices);
+		}
+		glBindVertexArray(0);
+	}
+	int Queued() const { return queued + (int)ready.size(); }
+};
@@ -0,0 +1,150 @@
+#pragma once
+#include <map>
+#include <deque>
+#include <string>
+#include <algorithm>
+#include "TextureStreamer.h"
+
+// The few ways scene textures are sampled. Each is one sampler object shared
+// by every texture that uses it, instead of parameters set per texture.
+enum SamplerKind { SAMPLER_REPEAT, SAMPLER_CLAMP, SAMPLER_COUNT };
+
+// One file, however many handles point at it.
+struct CachedTexture
+{
+	string path;
+	GLuint texture; // Written by the streamer: placeholder, then the real one.
+	SamplerKind sampler;
+	vector<GLuint*> handles;
+	int request; // Into streamer.loader.requests.
+};
+
+// Every scene texture goes through Load(). Asking for the same file twice
+// (in any spelling of its path) hands back the same texture, and two files
+// with identical pixels end up sharing one as well, via the streamer's
+// content hash. Storage is immutable (glTexStorage2D) and sampling state
+// lives in samplers[], bound next to the texture in Bind().
+struct TextureCache
+{
+	TextureStreamer streamer;
+	deque<CachedTexture> entries; // Deque so entry.texture never moves under the streamer.
+	map<string, int> byPath;
+	map<GLuint, SamplerKind> samplerOf;
+	GLuint samplers[SAMPLER_COUNT];
+	int pathHits;
+
+	TextureCache()
+	{
+		pathHits = 0;
+		for (int i = 0; i < SAMPLER_COUNT; i++)
+			samplers[i] = 0;
+	}
+	void Init()
+	{
+		streamer.Init();
+		glGenSamplers(SAMPLER_COUNT, samplers);
+
+		glSamplerParameteri(samplers[SAMPLER_REPEAT], GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glSamplerParameteri(samplers[SAMPLER_REPEAT], GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glSamplerParameteri(samplers[SAMPLER_REPEAT], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glSamplerParameteri(samplers[SAMPLER_REPEAT], GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		if (GLEW_EXT_texture_filter_anisotropic)
+		{
+			GLfloat maxAnisotropy;
+			glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+			glSamplerParameterf(samplers[SAMPLER_REPEAT], GL_TEXTURE_MAX_ANISOTROPY_EXT, min(8.0f, maxAnisotropy));
+		}
+
+		glSamplerParameteri(samplers[SAMPLER_CLAMP], GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glSamplerParameteri(samplers[SAMPLER_CLAMP], GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glSamplerParameteri(samplers[SAMPLER_CLAMP], GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glSamplerParameteri(samplers[SAMPLER_CLAMP], GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	}
+	void Clean()
+	{
+		glBindSampler(0, 0);
+		glDeleteSamplers(SAMPLER_COUNT, samplers);
+		streamer.Clean();
+	}
+	// "Textures\\Brick.JPG" and "textures/brick.jpg" are the same file on Windows.
+	static string NormalisePath(const char* path)
+	{
+		string key = path;
+		for (size_t i = 0; i < key.size(); i++)
+			key[i] = key[i] == '\\' ? '/' : (char)tolower((unsigned char)key[i]);
+		return key;
+	}
+	// Points handle at the texture for path, queueing the file if it's new.
+	// The first caller's sampler wins for a shared file.
+	void Load(const char* path, GLuint& handle, SamplerKind sampler = SAMPLER_REPEAT)
+	{
+		string key = NormalisePath(path);
+		map<string, int>::iterator found = byPath.find(key);
+		if (found != byPath.end())
+		{
+			CachedTexture& entry = entries[found->second];
+			entry.handles.push_back(&handle);
+			handle = entry.texture;
+			pathHits++;
+			return;
+		}
+		byPath[key] = (int)entries.size();
+		entries.push_back(CachedTexture());
+		CachedTexture& entry = entries.back();
+		entry.path = path;
+		entry.sampler = sampler;
+		entry.request = (int)streamer.loader.requests.size();
+		entry.handles.push_back(&handle);
+		streamer.Add(path, entry.texture);
+		handle = entry.texture;
+	}
+	void Begin(unsigned threads = 0) { streamer.Begin(threads); }
+	// Once per frame, before drawing. Copies each entry's current texture out
+	// to everyone holding it, since streaming and residency both swap them.
+	void Update()
+	{
+		streamer.Update();
+		for (unsigned i = 0; i < entries.size(); i++)
+		{
+			for (unsigned h = 0; h < entries[i].handles.size(); h++)
+				*entries[i].handles[h] = entries[i].texture;
+			if (entries[i].texture != streamer.placeholderTx)
+				samplerOf[entries[i].texture] = entries[i].sampler;
+		}
+	}
+	// Binds tx to unit 0 with the sampler it was loaded for.
+	void Bind(GLuint tx)
+	{
+		glBindTexture(GL_TEXTURE_2D, tx);
+		map<GLuint, SamplerKind>::iterator found = samplerOf.find(tx);
+		glBindSampler(0, samplers[found != samplerOf.end() ? found->second : SAMPLER_CLAMP]);
+	}
+	// After the scene, so passes using their own textures get their own parameters back.
+	void Unbind() { glBindSampler(0, 0); }
+	// Video memory per file, with how many handles and duplicate files share it.
+	void Report()
+	{
+		size_t total = 0;
+		int unique = 0;
+		cout << "Texture cache: " << entries.size() << " files, " << pathHits << " repeated loads by path, "
+			<< streamer.shared << " duplicates by content" << endl;
+		for (unsigned i = 0; i < entries.size(); i++)
+		{
+			const TextureRequest& r = streamer.loader.requests[entries[i].request];
+			cout << "  " << entries[i].path << ": ";
+			if (r.sameAs >= 0)
+				cout << "same as " << streamer.loader.requests[r.sameAs].file;
+			else if (r.levelCount == 0)
+				cout << (streamer.Done() ? "failed" : "loading");
+			else
+			{
+				cout << r.width << "x" << r.height << ", " << r.levelCount << " levels, 0x" << hex << r.internalFormat << dec
+					<< ", " << r.gpuBytes / 1024 << " KB";
+				total += r.gpuBytes;
+				unique++;
+			}
+			cout << ", " << entries[i].handles.size() << (entries[i].handles.size() == 1 ? " user" : " users") << endl;
+		}
+		cout << "  " << unique << " textures, " << total / 1024 << " KB" << endl;
+	}
+};
@@ -0,0 +1,428 @@
+#pragma once
+#include <iostream>
+#include <chrono>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <GL\glew.h>
+#include "stb_image.h"
+#include "gli\gli.hpp"
+#include "gli\gtx\loader.hpp"
+#include "gli\core\generate_mipmaps.hpp"
+#include "ThreadPool.h"
+#include "ScratchArena.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXTURE_LOADER_SSE2
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+// How much detail to keep. Lower tiers cap the largest side of every texture,
+// for machines without the memory for the full size art.
+enum TextureTier { TIER_LOW, TIER_MEDIUM, TIER_HIGH };
+
+// Largest width or height a tier keeps, 0 for no limit.
+inline int tierMaxSize(TextureTier tier)
+{
+	static const int sizes[3] = { 512, 1024, 0 };
+	return sizes[tier];
+}
+
+// One requested image and, once a worker is done with it, its pixels.
+struct TextureRequest
+{
+	string file;
+	GLuint* texture;
+	unsigned char* pixels;
+	int width, height, channels;
+	float decodeMs;
+	gli::texture2D levels; // Whole mip chain, compressed by TextureCooker or built by the loader.
+	unsigned long long hash; // Of the decoded base level, for spotting the same image under two names.
+	int sameAs;				 // Earlier request with identical content, or -1.
+	size_t gpuBytes;		 // Video memory for every level, once allocated.
+	GLenum internalFormat;
+	int levelCount;
+
+	TextureRequest(const char* name, GLuint& tx)
+	{
+		file = name;
+		texture = &tx;
+		pixels = NULL;
+		width = height = channels = 0;
+		decodeMs = 0.0f;
+		hash = 0;
+		sameAs = -1;
+		gpuBytes = 0;
+		internalFormat = GL_NONE;
+		levelCount = 0;
+	}
+};
+
+// Pixel format for a decoded channel count. Internal format is RGBA8 or RGB8.
+inline GLenum pixelFormat(int channels)
+{
+	static const GLenum formats[5] = { GL_RGB, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+	return formats[channels];
+}
+
+// Where TextureCooker writes the compressed version of an image.
+inline string cookedName(const string& file)
+{
+	return file.substr(0, file.rfind('.')) + ".dds";
+}
+
+// GL format of a cooked texture.
+inline GLenum compressedFormat(gli::format format)
+{
+	switch (format)
+	{
+	case gli::DXT1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case gli::DXT5: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case gli::ATI1N_UNORM: return GL_COMPRESSED_RED_RGTC1;
+	case gli::ATI2N_UNORM: return GL_COMPRESSED_RG_RGTC2;
+	default: return GL_NONE;
+	}
+}
+
+// FNV-1a over 64 bit words, enough to tell images apart.
+inline unsigned long long contentHash(const unsigned char* data, size_t bytes)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	size_t words = bytes / 8;
+	for (size_t i = 0; i < words; i++)
+	{
+		unsigned long long word;
+		memcpy(&word, data + i * 8, 8);
+		hash = (hash ^ word) * 1099511628211ull;
+	}
+	for (size_t i = words * 8; i < bytes; i++)
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	return hash;
+}
+
+// True if the levels are block compressed rather than plain texels.
+inline bool compressedLevels(const gli::texture2D& levels)
+{
+	return !levels.empty() && compressedFormat(levels.format()) != GL_NONE;
+}
+
+// Levels in a full chain down to 1x1.
+inline int mipCount(int width, int height)
+{
+	int levels = 1;
+	for (int size = width > height ? width : height; size > 1; size /= 2)
+		levels++;
+	return levels;
+}
+
+// Halvings needed to bring size down to maxSize or under.
+inline int shrinkSteps(int size, int maxSize)
+{
+	int steps = 0;
+	while (maxSize > 0 && ((size + (1 << steps) - 1) >> steps) > maxSize)
+		steps++;
+	return steps;
+}
+
+// Box filters an image down by 2^steps in a single pass, in place: each band
+// of rows is summed into 16 bit totals (SSE2 where there is), then every run
+// of columns is averaged. Blocks cut off by the edge average what they have.
+inline void shrinkPixels(unsigned char* pixels, int& width, int& height, int channels, int steps)
+{
+	int factor = 1 << (steps < 7 ? steps : 7); // 128 * 255 still fits in 16 bits.
+	int outWidth = (width + factor - 1) / factor, outHeight = (height + factor - 1) / factor;
+	size_t rowBytes = (size_t)width * channels;
+	vector<unsigned short> sums(rowBytes);
+	for (int y = 0; y < outHeight; y++)
+	{
+		int rows = height - y * factor < factor ? height - y * factor : factor;
+		memset(&sums[0], 0, rowBytes * sizeof(unsigned short));
+		for (int row = 0; row < rows; row++)
+		{
+			const unsigned char* src = pixels + (size_t)(y * factor + row) * rowBytes;
+			size_t i = 0;
+#ifdef TEXTURE_LOADER_SSE2
+			const __m128i zero = _mm_setzero_si128();
+			for (; i + 16 <= rowBytes; i += 16)
+			{
+				__m128i bytes = _mm_loadu_si128((const __m128i*)(src + i));
+				__m128i* sum = (__m128i*)&sums[i];
+				_mm_storeu_si128(sum, _mm_add_epi16(_mm_loadu_si128(sum), _mm_unpacklo_epi8(bytes, zero)));
+				_mm_storeu_si128(sum + 1, _mm_add_epi16(_mm_loadu_si128(sum + 1), _mm_unpackhi_epi8(bytes, zero)));
+			}
+#endif
+			for (; i < rowBytes; i++)
+				sums[i] += src[i];
+		}
+		// The band has been read, so its output row can overwrite the start of it.
+		unsigned char* dst = pixels + (size_t)y * outWidth * channels;
+		for (int x = 0; x < outWidth; x++)
+		{
+			int columns = width - x * factor < factor ? width - x * factor : factor;
+			unsigned count = (unsigned)(rows * columns);
+			for (int c = 0; c < channels; c++)
+			{
+				unsigned total = 0;
+				for (int column = 0; column < columns; column++)
+					total += sums[(size_t)(x * factor + column) * channels + c];
+				dst[x * channels + c] = (unsigned char)((total + count / 2) / count);
+			}
+		}
+	}
+	width = outWidth;
+	height = outHeight;
+}
+
+// Drops the levels of a cooked chain that are bigger than maxSize.
+inline gli::texture2D trimMipChain(const gli::texture2D& levels, int maxSize)
+{
+	size_t first = 0;
+	while (first + 1 < levels.levels() && maxSize > 0 &&
+		glm::max(levels[first].dimensions().x, levels[first].dimensions().y) > (size_t)maxSize)
+		first++;
+	if (first == 0)
+		return levels;
+	gli::texture2D trimmed(levels.levels() - first);
+	for (size_t level = first; level < levels.levels(); level++)
+		trimmed[level - first] = levels[level];
+	return trimmed;
+}
+
+// Builds the mip chain for decoded pixels with the same gamma-correct filter
+// TextureCooker uses. Each image is already on its own worker, so one thread.
+inline gli::texture2D buildMipChain(const unsigned char* pixels, int width, int height, int channels)
+{
+	static const gli::format formats[5] = { gli::FORMAT_NULL, gli::R8U, gli::RG8U, gli::RGB8U, gli::RGBA8U };
+	gli::texture2D base(1);
+	base[0] = gli::image2D(gli::image2D::dimensions_type(width, height), formats[channels],
+		vector<glm::byte>(pixels, pixels + (size_t)width * height * channels));
+	return gli::generateMipmaps(base, 0, gli::FILTER_BOX, true, 1);
+}
+
+// Decodes every requested image in parallel on a thread pool. LoadAll()
+// uploads them on the GL thread in whatever order they finish, so the big
+// files don't hold up the small ones; Begin() and Poll() let the caller do
+// the uploading itself without waiting. If TextureCooker has left a .dds
+// beside an image, that is loaded instead and nothing is decoded.
+struct TextureLoader
+{
+	vector<TextureRequest> requests;
+	vector<int> finished; // Indices into requests, in completion order.
+	unsigned consumed;	  // How many of finished the GL thread has taken.
+	bool buildMips;		  // Make the mip chain on the workers instead of glGenerateMipmap.
+	bool preferCooked;	  // Load file.dds instead of decoding file.jpg when there is one.
+	int maxSize;		  // Largest width or height kept (see tierMaxSize), 0 for full size.
+	int jpegThreads;	  // Threads each JPEG decode may use; set by Begin().
+	mutex lock;
+	condition_variable done;
+	ThreadPool pool;
+	deque<ScratchArena> arenas; // One per worker, for everything stb_image allocates.
+
+	TextureLoader()
+	{
+		consumed = 0;
+		buildMips = false;
+		preferCooked = true;
+		maxSize = 0;
+		jpegThreads = 1;
+	}
+	void Add(const char* file, GLuint& texture)
+	{
+		TextureRequest r(file, texture);
+		requests.push_back(r);
+	}
+	// Starts decoding everything and returns straight away.
+	void Begin(unsigned threads = 0)
+	{
+		// The flip flag is a global in stb_image, so it's set before any worker reads it.
+		stbi_set_flip_vertically_on_load(true);
+		finished.clear();
+		consumed = 0;
+		pool.Start(threads);
+		if (arenas.size() < pool.workers.size())
+			arenas.resize(pool.workers.size());
+		// With fewer images than workers, the idle workers' share of the cores
+		// goes to splitting up each JPEG instead (see STBI_PARALLEL_JPEG).
+		unsigned hardware = max(thread::hardware_concurrency(), (unsigned)pool.workers.size());
+		unsigned busy = (unsigned)max<size_t>(1, min(requests.size(), pool.workers.size()));
+		jpegThreads = max(1u, hardware / busy);
+		for (unsigned i = 0; i < requests.size(); i++)
+			pool.Add([this, i] { Decode(i); });
+	}
+	// Takes the next decoded request without blocking. False if none is ready.
+	bool Poll(int& index)
+	{
+		lock_guard<mutex> guard(lock);
+		if (consumed >= finished.size())
+			return false;
+		index = finished[consumed++];
+		return true;
+	}
+	bool Done() { return consumed == requests.size(); }
+	// Blocks until every image is decoded and uploaded. Returns total milliseconds.
+	float LoadAll(unsigned threads = 0)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		Begin(threads);
+
+		float uploadMs = 0.0f;
+		while (!Done())
+		{
+			int index;
+			{
+				unique_lock<mutex> guard(lock);
+				done.wait(guard, [this] { return finished.size() > consumed; });
+				index = finished[consumed++];
+			}
+			uploadMs += Upload(requests[index]);
+		}
+		size_t threadCount = pool.workers.size();
+		pool.Stop();
+		ResetScratch();
+
+		float totalMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+		cout << "Loaded " << requests.size() << " textures on " << threadCount << " threads in "
+			<< totalMs << " ms (" << uploadMs << " ms uploading)" << endl;
+		requests.clear();
+		return totalMs;
+	}
+	// Worker side: no GL calls in here.
+	void Decode(int index)
+	{
+		TextureRequest& r = requests[index];
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		if (preferCooked)
+		{
+			r.levels = gli::loadDDS10(cookedName(r.file));
+			if (!compressedLevels(r.levels))
+				r.levels = gli::texture2D();
+			else
+				r.levels = trimMipChain(r.levels, maxSize);
+		}
+		if (!r.levels.empty())
+		{
+			r.width = r.levels[0].dimensions().x;
+			r.height = r.levels[0].dimensions().y;
+			r.channels = r.levels[0].components();
+		}
+		else
+		{
+			// Over maxSize, a JPEG is decoded straight to 1/2, 1/4 or 1/8 size
+			// and whatever is still too big gets box filtered, so the full size
+			// image never exists.
+			// The pixels come out of this worker's arena; once every image it
+			// decoded has been freed, the next one reuses the same memory.
+			ScratchScope scratch(&arenas[ThreadPool::CurrentWorker()]);
+			int w, h, n;
+			stbi_set_jpeg_threads(jpegThreads);
+			if (maxSize > 0 && stbi_info(r.file.c_str(), &w, &h, &n))
+				stbi_set_jpeg_scale_on_load(min(shrinkSteps(max(w, h), maxSize), 3));
+			r.pixels = stbi_load(r.file.c_str(), &r.width, &r.height, &r.channels, 0);
+			stbi_set_jpeg_scale_on_load(0);
+			int steps = shrinkSteps(max(r.width, r.height), maxSize);
+			if (r.pixels && steps > 0)
+				shrinkPixels(r.pixels, r.width, r.height, r.channels, steps);
+		}
+		if (r.pixels && buildMips)
+		{
+			r.levels = buildMipChain(r.pixels, r.width, r.height, r.channels);
+			ScratchScope scratch(&arenas[ThreadPool::CurrentWorker()]);
+			stbi_image_free(r.pixels);
+			r.pixels = NULL;
+		}
+		if (!r.levels.empty())
+			r.hash = contentHash(r.levels[0].data(), gli::size(r.levels[0], gli::LINEAR_SIZE));
+		else if (r.pixels)
+			r.hash = contentHash(r.pixels, (size_t)r.width * r.height * r.channels);
+		r.decodeMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+		{
+			lock_guard<mutex> guard(lock);
+			finished.push_back(index);
+		}
+		done.notify_one();
+	}
+	// Frees the decoded pixels, including any mips.
+	static void Release(TextureRequest& r)
+	{
+		stbi_image_free(r.pixels);
+		r.pixels = NULL;
+		r.levels = gli::texture2D();
+	}
+	// Once the pool is stopped: reports what the arenas did for the batch and
+	// hands their memory back. An arena still holding pixels is kept.
+	void ResetScratch()
+	{
+		int allocations = 0, reallocations = 0, blocks = 0, rewinds = 0;
+		size_t peakBytes = 0, reserved = 0;
+		for (unsigned i = 0; i < arenas.size(); i++)
+		{
+			ScratchArena& a = arenas[i];
+			allocations += a.allocations;
+			reallocations += a.reallocations;
+			blocks += a.blockAllocations;
+			rewinds += a.rewinds;
+			peakBytes += a.peakBytes;
+			reserved += a.Reserved();
+			a.allocations = a.reallocations = a.blockAllocations = a.rewinds = 0;
+			a.peakBytes = 0;
+			if (a.live == 0)
+				a.Reset();
+		}
+		if (allocations == 0)
+			return;
+		cout << "Decode scratch: " << allocations << " allocations (" << reallocations << " resized, "
+			<< scratchHeapAllocations().exchange(0) << " off the heap) in " << blocks << " blocks, peak "
+			<< peakBytes / (1024 * 1024.0f) << " MB of " << reserved / (1024 * 1024.0f) << " MB, reused "
+			<< rewinds << " times" << endl;
+	}
+	static bool Loaded(TextureRequest& r) { return r.pixels || !r.levels.empty(); }
+	// GL side. Returns the milliseconds spent uploading and building mipmaps.
+	float Upload(TextureRequest& r)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		glGenTextures(1, r.texture);
+		glBindTexture(GL_TEXTURE_2D, *r.texture);
+		if (compressedLevels(r.levels))
+		{
+			// Already mipmapped and compressed, so each level goes straight in.
+			GLenum format = compressedFormat(r.levels.format());
+			glTexStorage2D(GL_TEXTURE_2D, (GLsizei)r.levels.levels(), format, r.width, r.height);
+			for (size_t level = 0; level < r.levels.levels(); level++)
+				glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, r.levels[level].dimensions().x,
+					r.levels[level].dimensions().y, format, (GLsizei)gli::size(r.levels[level], gli::LINEAR_SIZE), r.levels[level].data());
+			Release(r);
+		}
+		else if (!r.levels.empty())
+		{
+			// Mipmapped on the worker, in linear light unlike glGenerateMipmap.
+			glTexStorage2D(GL_TEXTURE_2D, (GLsizei)r.levels.levels(), r.channels == 4 ? GL_RGBA8 : GL_RGB8, r.width, r.height);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			for (size_t level = 0; level < r.levels.levels(); level++)
+				glTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, 0, r.levels[level].dimensions().x, r.levels[level].dimensions().y,
+					pixelFormat(r.channels), GL_UNSIGNED_BYTE, r.levels[level].data());
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			Release(r);
+		}
+		else if (r.pixels)
+		{
+			// Upload what the file actually has, e.g. grass.png is RGBA.
+			glTexStorage2D(GL_TEXTURE_2D, mipCount(r.width, r.height), r.channels == 4 ? GL_RGBA8 : GL_RGB8, r.width, r.height);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, r.width, r.height, pixelFormat(r.channels), GL_UNSIGNED_BYTE, r.pixels);
+			glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			Release(r);
+		}
+		else
+			cout << "Unable to load " << r.file << "!" << endl;
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		float uploadMs = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+		cout << "  " << r.file << " " << r.width << "x" << r.height << "x" << r.channels << ": load "
+			<< r.decodeMs << " ms, upload " << uploadMs << " ms" << endl;
+		return uploadMs;
+	}
+};
@@ -0,0 +1,227 @@
+#pragma once
+#include <cmath>
+#include "TextureCache.h"
+
+#define RESIDENCY_DEFAULT_BUDGET (64 * 1024 * 1024) // Bytes of video memory for cached textures.
+#define RESIDENCY_MAX_EVICTIONS 4					 // Reallocations per frame, so trimming never hitches.
+#define RESIDENCY_IDLE_FRAMES 60					 // Unused this long, a texture is first in line.
+
+// What the residency manager knows about one fully streamed texture.
+struct ResidentTexture
+{
+	int entry, request; // Into cache.entries and streamer.loader.requests.
+	int width, height, levels; // Of the whole image, every mip.
+	GLenum format;
+	int firstLevel; // Image level held in texture level 0; above 0 once the top was dropped.
+	size_t bytes;
+	unsigned lastUsed;
+	int wanted; // Finest level any draw asked for last frame.
+	bool restoring;
+};
+
+// Keeps the cached textures inside a video memory budget. Each frame the
+// draws report how big their texture is on screen; when the total is over
+// budget the biggest mips of textures that haven't been drawn lately, or
+// that are drawn smaller than their detail, are dropped by reallocating the
+// texture without them (glCopyImageSubData keeps the levels that stay).
+// When a trimmed texture is wanted closer again and there's room, it gets a
+// full size allocation and the missing levels are decoded and streamed back
+// in through the TextureStreamer, with GL_TEXTURE_BASE_LEVEL hiding them
+// until they arrive.
+struct TextureResidency
+{
+	vector<ResidentTexture> slots;
+	vector<int> slotOfEntry; // -1 until the entry is resident.
+	map<GLuint, int> slotOfTexture;
+	size_t budgetBytes, usedBytes;
+	unsigned frame;
+	float pixelScale;						// Screen pixels per world unit at distance 1.
+	int evictions, restores;				// Last frame.
+	int totalEvictions, totalRestores;
+	bool enabled;
+
+	TextureResidency()
+	{
+		budgetBytes = RESIDENCY_DEFAULT_BUDGET;
+		usedBytes = 0;
+		frame = 0;
+		pixelScale = 1.0f;
+		evictions = restores = totalEvictions = totalRestores = 0;
+		enabled = true;
+	}
+	void Init()
+	{
+		enabled = GLEW_VERSION_4_3 || GLEW_ARB_copy_image;
+		if (!enabled)
+			cout << "No glCopyImageSubData, texture residency budget is off" << endl;
+	}
+	// From drawObject: the object's size on screen decides how much of tx it needs.
+	void Touch(GLuint tx, float size, float distance)
+	{
+		map<GLuint, int>::iterator found = slotOfTexture.find(tx);
+		if (found == slotOfTexture.end())
+			return;
+		ResidentTexture& t = slots[found->second];
+		t.lastUsed = frame;
+		// One level of slack, since the UVs may tile the image across the object.
+		float pixels = size * pixelScale / (distance > 0.1f ? distance : 0.1f);
+		float texels = (float)(t.width > t.height ? t.width : t.height);
+		int level = pixels >= texels ? 0 : (int)floor(log2(texels / (pixels > 1.0f ? pixels : 1.0f))) - 1;
+		level = level < 0 ? 0 : level > t.levels - 1 ? t.levels - 1 : level;
+		if (level < t.wanted)
+			t.wanted = level;
+	}
+	// Before the cache's Update, which hands any reallocated texture out to its users.
+	void Update(TextureCache& cache)
+	{
+		frame++;
+		evictions = restores = 0;
+		if (!enabled)
+			return;
+		TextureStreamer& streamer = cache.streamer;
+		Track(cache);
+
+		usedBytes = 0;
+		for (unsigned i = 0; i < slots.size(); i++)
+		{
+			if (slots[i].restoring && !streamer.Uploading(slots[i].request))
+				slots[i].restoring = false;
+			usedBytes += slots[i].bytes;
+		}
+
+		while (usedBytes > budgetBytes && evictions < RESIDENCY_MAX_EVICTIONS)
+		{
+			int victim = PickVictim();
+			if (victim < 0)
+				break;
+			usedBytes -= slots[victim].bytes;
+			Reallocate(cache, slots[victim], slots[victim].firstLevel + 1);
+			usedBytes += slots[victim].bytes;
+			evictions++;
+		}
+
+		// One restore a frame, only if it fits and it's still on screen.
+		if (evictions == 0)
+			for (unsigned i = 0; i < slots.size(); i++)
+			{
+				ResidentTexture& t = slots[i];
+				if (t.restoring || t.wanted >= t.firstLevel || t.lastUsed + 1 < frame)
+					continue;
+				size_t bytes = ChainBytes(t, t.wanted);
+				if (usedBytes - t.bytes + bytes > budgetBytes)
+					continue;
+				usedBytes += bytes - t.bytes;
+				int oldFirst = t.firstLevel;
+				Reallocate(cache, t, t.wanted);
+				StreamedTexture s;
+				s.request = t.request;
+				s.texture = cache.entries[t.entry].texture;
+				s.level = oldFirst - 1;
+				s.levels = t.levels;
+				s.row = 0;
+				s.baseLevel = t.firstLevel;
+				s.restream = true;
+				streamer.Restream(s);
+				t.restoring = true;
+				restores++;
+				break;
+			}
+
+		totalEvictions += evictions;
+		totalRestores += restores;
+		for (unsigned i = 0; i < slots.size(); i++)
+			slots[i].wanted = slots[i].levels;
+	}
+	// Starts managing entries as soon as the streamer has finished them.
+	void Track(TextureCache& cache)
+	{
+		slotOfEntry.resize(cache.entries.size(), -1);
+		for (unsigned i = 0; i < cache.entries.size(); i++)
+		{
+			const TextureRequest& r = cache.streamer.loader.requests[cache.entries[i].request];
+			if (slotOfEntry[i] >= 0 || r.sameAs >= 0 || r.levelCount == 0 || cache.streamer.Uploading(cache.entries[i].request))
+				continue;
+			ResidentTexture t;
+			t.entry = i;
+			t.request = cache.entries[i].request;
+			t.width = r.width;
+			t.height = r.height;
+			t.levels = r.levelCount;
+			t.format = r.internalFormat;
+			t.firstLevel = 0;
+			t.bytes = r.gpuBytes;
+			t.lastUsed = frame;
+			t.wanted = t.levels;
+			t.restoring = false;
+			slotOfEntry[i] = (int)slots.size();
+			slotOfTexture[cache.entries[i].texture] = (int)slots.size();
+			slots.push_back(t);
+		}
+	}
+	// Longest unused first, then whichever has the most detail to spare, then the biggest.
+	int PickVictim()
+	{
+		int victim = -1;
+		for (unsigned i = 0; i < slots.size(); i++)
+		{
+			const ResidentTexture& t = slots[i];
+			if (t.restoring || t.firstLevel >= t.levels - 1)
+				continue;
+			if (victim < 0)
+			{
+				victim = i;
+				continue;
+			}
+			const ResidentTexture& best = slots[victim];
+			bool idle = t.lastUsed + RESIDENCY_IDLE_FRAMES < frame, bestIdle = best.lastUsed + RESIDENCY_IDLE_FRAMES < frame;
+			int spare = t.wanted - t.firstLevel, bestSpare = best.wanted - best.firstLevel;
+			if (idle != bestIdle ? idle : idle ? t.lastUsed < best.lastUsed : spare != bestSpare ? spare > bestSpare : t.bytes > best.bytes)
+				victim = i;
+		}
+		return victim;
+	}
+	static bool Compressed(GLenum format) { return format != GL_RGBA8 && format != GL_RGB8; }
+	static int LevelSize(int size, int level) { return size >> level > 0 ? size >> level : 1; }
+	// Video memory for the chain from firstLevel down, counted the same way the streamer does.
+	static size_t ChainBytes(const ResidentTexture& t, int firstLevel)
+	{
+		size_t bytes = 0;
+		for (int level = firstLevel; level < t.levels; level++)
+		{
+			int w = LevelSize(t.width, level), h = LevelSize(t.height, level);
+			if (!Compressed(t.format))
+				bytes += (size_t)w * h * 4;
+			else
+			{
+				bool halfBlocks = t.format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || t.format == GL_COMPRESSED_RED_RGTC1;
+				bytes += (size_t)((w + 3) / 4) * ((h + 3) / 4) * (halfBlocks ? 8 : 16);
+			}
+		}
+		return bytes;
+	}
+	// Swaps t's texture for one holding levels firstLevel and down, keeping
+	// whatever levels the two have in common.
+	void Reallocate(TextureCache& cache, ResidentTexture& t, int firstLevel)
+	{
+		CachedTexture& entry = cache.entries[t.entry];
+		GLuint old = entry.texture, texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glTexStorage2D(GL_TEXTURE_2D, t.levels - firstLevel, t.format, LevelSize(t.width, firstLevel), LevelSize(t.height, firstLevel));
+		int common = firstLevel > t.firstLevel ? firstLevel : t.firstLevel;
+		for (int level = common; level < t.levels; level++)
+			glCopyImageSubData(old, GL_TEXTURE_2D, level - t.firstLevel, 0, 0, 0, texture, GL_TEXTURE_2D, level - firstLevel, 0, 0, 0,
+				LevelSize(t.width, level), LevelSize(t.height, level), 1);
+		// Levels above the copied ones aren't there yet.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, common - firstLevel);
+		glDeleteTextures(1, &old);
+
+		cache.streamer.Replace(old, texture);
+		slotOfTexture.erase(old);
+		slotOfTexture[texture] = (int)(&t - &slots[0]);
+		entry.texture = texture;
+		t.firstLevel = firstLevel;
+		t.bytes = ChainBytes(t, firstLevel);
+		cache.streamer.loader.requests[t.request].gpuBytes = t.bytes;
+	}
+};
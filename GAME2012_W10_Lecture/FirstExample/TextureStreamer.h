@@ -0,0 +1,303 @@
+#pragma once
+#include <cstring>
+#include <deque>
+#include <map>
+#include "TextureLoader.h"
+
+#define STREAM_PBO_COUNT 4
+#define STREAM_PBO_BYTES (4 * 1024 * 1024)		 // One staging buffer, the most a single chunk can move.
+#define STREAM_DEFAULT_BUDGET (2 * 1024 * 1024) // Bytes uploaded per frame.
+
+// A decoded texture on its way to the GPU. Levels go smallest first, a few
+// rows at a time, so something is visible after the first frame.
+struct StreamedTexture
+{
+	int request; // Into loader.requests.
+	GLuint texture;
+	int level, levels, row;
+	int baseLevel; // Image level that is level 0 of texture; above 0 if the top was left off.
+	bool restream; // Refilling levels of a texture that's already resident.
+};
+
+// Uploads textures in the background without stalling the GL thread. Images
+// are decoded (and mipmapped) on the loader's worker threads, or read already
+// compressed from a cooked .dds; every frame Update() copies up to budgetBytes
+// of rows into a ring of pixel buffer objects and issues glTexSubImage2D (or
+// glCompressedTexSubImage2D) from them. Until a texture has its
+// smallest mip in, objects using it draw with a grey placeholder, and after
+// that GL_TEXTURE_BASE_LEVEL follows the finest level uploaded so far.
+struct TextureStreamer
+{
+	TextureLoader loader;
+	GLuint placeholderTx;
+	GLuint pbos[STREAM_PBO_COUNT];
+	GLsync fences[STREAM_PBO_COUNT];
+	int nextPbo;
+	size_t budgetBytes, frameBytes, totalBytes;
+	int resident, failed, shared; // shared: same pixels as an earlier file, never uploaded.
+	int restored;
+	deque<StreamedTexture> uploads; // Front one is in progress.
+	map<int, StreamedTexture> restreams; // Waiting on a second decode, by request.
+	vector<GLuint> textures;
+	chrono::high_resolution_clock::time_point start;
+
+	TextureStreamer()
+	{
+		placeholderTx = 0;
+		nextPbo = 0;
+		budgetBytes = STREAM_DEFAULT_BUDGET;
+		frameBytes = totalBytes = 0;
+		resident = failed = shared = restored = 0;
+		for (int i = 0; i < STREAM_PBO_COUNT; i++)
+		{
+			pbos[i] = 0;
+			fences[i] = 0;
+		}
+	}
+	void Init()
+	{
+		const unsigned char grey[3] = { 128, 128, 128 };
+		glGenTextures(1, &placeholderTx);
+		glBindTexture(GL_TEXTURE_2D, placeholderTx);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB8, 1, 1);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, grey);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		glGenBuffers(STREAM_PBO_COUNT, pbos);
+		for (int i = 0; i < STREAM_PBO_COUNT; i++)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, STREAM_PBO_BYTES, NULL, GL_STREAM_DRAW);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	void Clean()
+	{
+		loader.pool.Stop();
+		for (unsigned i = 0; i < loader.requests.size(); i++)
+			TextureLoader::Release(loader.requests[i]);
+		for (int i = 0; i < STREAM_PBO_COUNT; i++)
+			if (fences[i])
+				glDeleteSync(fences[i]);
+		glDeleteBuffers(STREAM_PBO_COUNT, pbos);
+		if (!textures.empty())
+			glDeleteTextures((GLsizei)textures.size(), &textures[0]);
+		glDeleteTextures(1, &placeholderTx);
+	}
+	// texture shows the placeholder until the real one has a level in.
+	void Add(const char* file, GLuint& texture)
+	{
+		loader.Add(file, texture);
+		texture = placeholderTx;
+	}
+	void Begin(unsigned threads = 0)
+	{
+		start = chrono::high_resolution_clock::now();
+		loader.buildMips = true;
+		loader.Begin(threads);
+	}
+	bool Done() { return resident + failed + shared == (int)loader.requests.size(); }
+	bool Idle() { return Done() && uploads.empty() && restreams.empty(); }
+	// True while request still has levels to come, from the first load or a restream.
+	bool Uploading(int request)
+	{
+		if (restreams.count(request))
+			return true;
+		for (unsigned i = 0; i < uploads.size(); i++)
+			if (uploads[i].request == request)
+				return true;
+		return false;
+	}
+	// Call once per frame from the GL thread, before drawing.
+	void Update()
+	{
+		frameBytes = 0;
+		if (!Idle())
+			Stream();
+
+		// Duplicates show whatever their original does, placeholder included.
+		for (unsigned i = 0; i < loader.requests.size(); i++)
+			if (loader.requests[i].sameAs >= 0)
+				*loader.requests[i].texture = *loader.requests[loader.requests[i].sameAs].texture;
+	}
+	void Stream()
+	{
+		bool loading = !Done();
+		int index;
+		while (loader.Poll(index))
+		{
+			map<int, StreamedTexture>::iterator found = restreams.find(index);
+			if (found == restreams.end())
+				Queue(index);
+			else
+			{
+				if (TextureLoader::Loaded(loader.requests[index]))
+					uploads.push_back(found->second);
+				else
+					cout << "Unable to reload " << loader.requests[index].file << "!" << endl;
+				restreams.erase(found);
+			}
+		}
+
+		glActiveTexture(GL_TEXTURE0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		while (!uploads.empty() && frameBytes < budgetBytes)
+			if (!UploadChunk(uploads.front()))
+				break; // Every staging buffer is still in flight.
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		if (loading && Done())
+			cout << "All textures resident after "
+				<< chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count() << " ms ("
+				<< totalBytes / (1024 * 1024.0f) << " MB streamed)" << endl;
+		if (Idle())
+		{
+			loader.pool.Stop();
+			loader.ResetScratch();
+		}
+	}
+	// Decodes an image again and streams levels s.level down to s.baseLevel
+	// into s.texture, which the caller has already allocated.
+	void Restream(const StreamedTexture& s)
+	{
+		restreams[s.request] = s;
+		restreams[s.request].restream = true;
+		restreams[s.request].row = 0;
+		if (loader.pool.workers.empty())
+			loader.pool.Start(1);
+		int index = s.request;
+		loader.pool.Add([this, index] { loader.Decode(index); });
+	}
+	// For a texture reallocated by someone else, so Clean() still deletes it.
+	void Replace(GLuint old, GLuint texture)
+	{
+		for (unsigned i = 0; i < textures.size(); i++)
+			if (textures[i] == old)
+				textures[i] = texture;
+	}
+	// Allocates the whole mip chain for a decoded image and queues its upload.
+	// An image identical to one already queued just shares that texture.
+	void Queue(int index)
+	{
+		TextureRequest& r = loader.requests[index];
+		if (!TextureLoader::Loaded(r))
+		{
+			cout << "Unable to load " << r.file << "!" << endl;
+			failed++;
+			return;
+		}
+		bool compressed = compressedLevels(r.levels);
+		for (unsigned i = 0; i < loader.requests.size(); i++)
+		{
+			const TextureRequest& other = loader.requests[i];
+			if ((int)i != index && other.levelCount > 0 && other.sameAs < 0 && other.hash == r.hash && other.width == r.width &&
+				other.height == r.height && other.channels == r.channels && other.internalFormat ==
+				(compressed ? compressedFormat(r.levels.format()) : r.channels == 4 ? GL_RGBA8 : GL_RGB8))
+			{
+				cout << "  " << r.file << " has the same pixels as " << other.file << ", sharing its texture" << endl;
+				r.sameAs = i;
+				TextureLoader::Release(r);
+				shared++;
+				return;
+			}
+		}
+
+		StreamedTexture s;
+		s.request = index;
+		s.levels = (int)r.levels.levels();
+		s.level = s.levels - 1;
+		s.row = 0;
+		s.baseLevel = 0;
+		s.restream = false;
+		r.levelCount = s.levels;
+		r.internalFormat = compressed ? compressedFormat(r.levels.format()) : r.channels == 4 ? GL_RGBA8 : GL_RGB8;
+		// RGB8 is padded to four bytes a texel by most drivers.
+		r.gpuBytes = 0;
+		for (int level = 0; level < s.levels; level++)
+			r.gpuBytes += compressed ? gli::size(r.levels[level], gli::LINEAR_SIZE) :
+				(size_t)r.levels[level].dimensions().x * r.levels[level].dimensions().y * 4;
+
+		// Immutable storage. Filtering and wrapping come from the sampler
+		// bound at draw time, not from the texture.
+		glGenTextures(1, &s.texture);
+		glBindTexture(GL_TEXTURE_2D, s.texture);
+		glTexStorage2D(GL_TEXTURE_2D, s.levels, r.internalFormat, r.width, r.height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, s.level);
+		textures.push_back(s.texture);
+		uploads.push_back(s);
+	}
+	// Moves the next band of rows through a staging buffer. False if none is free.
+	// Cooked textures move in rows of 4x4 blocks instead of texels.
+	bool UploadChunk(StreamedTexture& s)
+	{
+		TextureRequest& r = loader.requests[s.request];
+		bool compressed = compressedLevels(r.levels);
+		int w = r.width >> s.level, h = r.height >> s.level;
+		w = w > 0 ? w : 1;
+		h = h > 0 ? h : 1;
+		int rowTexels = compressed ? 4 : 1;
+		int rowCount = (h + rowTexels - 1) / rowTexels;
+		size_t rowBytes = compressed ? ((w + 3) / 4) * gli::size(r.levels[s.level], gli::BLOCK_SIZE) : (size_t)w * r.channels;
+		size_t room = budgetBytes - frameBytes < STREAM_PBO_BYTES ? budgetBytes - frameBytes : STREAM_PBO_BYTES;
+		int rows = (int)(room / rowBytes);
+		if (rows < 1)
+			rows = 1; // Always make some progress, even on a tiny budget.
+		if (rows > rowCount - s.row)
+			rows = rowCount - s.row;
+
+		GLsync& fence = fences[nextPbo];
+		if (fence)
+		{
+			if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+				return false;
+			glDeleteSync(fence);
+			fence = 0;
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[nextPbo]);
+		void* staging = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, rows * rowBytes,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		memcpy(staging, r.levels[s.level].data() + s.row * rowBytes, rows * rowBytes);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindTexture(GL_TEXTURE_2D, s.texture);
+		if (compressed)
+		{
+			int y = s.row * rowTexels, height = rows * rowTexels < h - y ? rows * rowTexels : h - y;
+			glCompressedTexSubImage2D(GL_TEXTURE_2D, s.level - s.baseLevel, 0, y, w, height, compressedFormat(r.levels.format()),
+				(GLsizei)(rows * rowBytes), (void*)0);
+		}
+		else
+			glTexSubImage2D(GL_TEXTURE_2D, s.level - s.baseLevel, 0, s.row, w, rows, pixelFormat(r.channels), GL_UNSIGNED_BYTE, (void*)0);
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		nextPbo = (nextPbo + 1) % STREAM_PBO_COUNT;
+		frameBytes += rows * rowBytes;
+		totalBytes += rows * rowBytes;
+
+		s.row += rows;
+		if (s.row < rowCount)
+			return true;
+		// Level finished, so it becomes the one that's sampled.
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, s.level - s.baseLevel);
+		if (s.level == s.levels - 1 && !s.restream)
+			*r.texture = s.texture;
+		if (s.level > s.baseLevel)
+		{
+			s.level--;
+			s.row = 0;
+			return true;
+		}
+		if (s.restream)
+			restored++;
+		else
+		{
+			cout << "  " << r.file << " " << r.width << "x" << r.height << "x" << r.channels << " resident after "
+				<< chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count() << " ms (decode "
+				<< r.decodeMs << " ms)" << endl;
+			resident++;
+		}
+		TextureLoader::Release(r);
+		uploads.pop_front();
+		return true;
+	}
+};
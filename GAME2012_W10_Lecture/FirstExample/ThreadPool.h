@@ -0,0 +1,76 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+using namespace std;
+
+// Fixed set of worker threads pulling jobs off a shared queue. Jobs must not
+// touch GL; anything that needs the context goes back to the main thread.
+struct ThreadPool
+{
+	vector<thread> workers;
+	deque<function<void()>> jobs;
+	mutex lock;
+	condition_variable wake;
+	bool stopping;
+
+	ThreadPool() { stopping = false; }
+	~ThreadPool() { Stop(); }
+	// 0 threads means one per hardware thread.
+	void Start(unsigned threads = 0)
+	{
+		if (threads == 0)
+			threads = thread::hardware_concurrency();
+		if (threads == 0)
+			threads = 2;
+		stopping = false;
+		for (unsigned i = 0; i < threads; i++)
+			workers.push_back(thread(&ThreadPool::Work, this, i));
+	}
+	// Lets queued jobs finish, then joins every worker.
+	void Stop()
+	{
+		{
+			lock_guard<mutex> guard(lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (unsigned i = 0; i < workers.size(); i++)
+			workers[i].join();
+		workers.clear();
+	}
+	void Add(function<void()> job)
+	{
+		{
+			lock_guard<mutex> guard(lock);
+			jobs.push_back(job);
+		}
+		wake.notify_one();
+	}
+	// Which worker the calling thread is, from 0; -1 on any other thread.
+	static int& CurrentWorker()
+	{
+		static thread_local int index = -1;
+		return index;
+	}
+	void Work(int index)
+	{
+		CurrentWorker() = index;
+		for (;;)
+		{
+			function<void()> job;
+			{
+				unique_lock<mutex> guard(lock);
+				wake.wait(guard, [this] { return stopping || !jobs.empty(); });
+				if (jobs.empty())
+					return;
+				job = jobs.front();
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+};
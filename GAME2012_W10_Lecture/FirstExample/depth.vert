@@ -0,0 +1,15 @@
+#version 430 core
+
+layout(location = 0) in vec3 vertex_position;
+
+// Must match triangles.vert exactly so the GL_EQUAL shading pass lines up.
+invariant gl_Position;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(vertex_position, 1.0f);
+}
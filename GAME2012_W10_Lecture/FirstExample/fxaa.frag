@@ -0,0 +1,142 @@
+#version 430 core
+
+// FXAA 3.11 style: find the edge direction from local luma, walk along the
+// edge to its ends, then resample across it by the estimated coverage.
+in vec2 texCoord;
+out vec4 frag_colour;
+
+uniform sampler2D source;
+uniform vec2 texelSize;
+
+#define EDGE_THRESHOLD_MIN 0.0312f
+#define EDGE_THRESHOLD_MAX 0.125f
+#define SUBPIXEL_QUALITY 0.75f
+#define ITERATIONS 12
+
+const float stepScale[ITERATIONS] = float[](1.0f, 1.0f, 1.0f, 1.0f, 1.0f, 1.5f, 2.0f, 2.0f, 2.0f, 2.0f, 4.0f, 8.0f);
+
+float luma(vec3 c)
+{
+	return sqrt(dot(c, vec3(0.299f, 0.587f, 0.114f)));
+}
+
+float lumaAt(vec2 uv)
+{
+	return luma(textureLod(source, uv, 0.0f).rgb);
+}
+
+float lumaOffset(ivec2 offset)
+{
+	return luma(textureLodOffset(source, texCoord, 0.0f, offset).rgb);
+}
+
+void main()
+{
+	vec3 colourCenter = textureLod(source, texCoord, 0.0f).rgb;
+	float lumaCenter = luma(colourCenter);
+	float lumaDown = lumaOffset(ivec2(0, -1));
+	float lumaUp = lumaOffset(ivec2(0, 1));
+	float lumaLeft = lumaOffset(ivec2(-1, 0));
+	float lumaRight = lumaOffset(ivec2(1, 0));
+
+	float lumaMin = min(lumaCenter, min(min(lumaDown, lumaUp), min(lumaLeft, lumaRight)));
+	float lumaMax = max(lumaCenter, max(max(lumaDown, lumaUp), max(lumaLeft, lumaRight)));
+	float lumaRange = lumaMax - lumaMin;
+	if (lumaRange < max(EDGE_THRESHOLD_MIN, lumaMax * EDGE_THRESHOLD_MAX))
+	{
+		frag_colour = vec4(colourCenter, 1.0f); // Not an edge.
+		return;
+	}
+
+	float lumaDownLeft = lumaOffset(ivec2(-1, -1));
+	float lumaUpRight = lumaOffset(ivec2(1, 1));
+	float lumaUpLeft = lumaOffset(ivec2(-1, 1));
+	float lumaDownRight = lumaOffset(ivec2(1, -1));
+
+	float lumaDownUp = lumaDown + lumaUp;
+	float lumaLeftRight = lumaLeft + lumaRight;
+	float lumaLeftCorners = lumaDownLeft + lumaUpLeft;
+	float lumaDownCorners = lumaDownLeft + lumaDownRight;
+	float lumaRightCorners = lumaDownRight + lumaUpRight;
+	float lumaUpCorners = lumaUpRight + lumaUpLeft;
+
+	float edgeHorizontal = abs(-2.0f * lumaLeft + lumaLeftCorners) + abs(-2.0f * lumaCenter + lumaDownUp) * 2.0f +
+		abs(-2.0f * lumaRight + lumaRightCorners);
+	float edgeVertical = abs(-2.0f * lumaUp + lumaUpCorners) + abs(-2.0f * lumaCenter + lumaLeftRight) * 2.0f +
+		abs(-2.0f * lumaDown + lumaDownCorners);
+	bool isHorizontal = (edgeHorizontal >= edgeVertical);
+
+	// Which side of the pixel the edge is on.
+	float luma1 = isHorizontal ? lumaDown : lumaLeft;
+	float luma2 = isHorizontal ? lumaUp : lumaRight;
+	float gradient1 = luma1 - lumaCenter;
+	float gradient2 = luma2 - lumaCenter;
+	bool is1Steepest = abs(gradient1) >= abs(gradient2);
+	float gradientScaled = 0.25f * max(abs(gradient1), abs(gradient2));
+
+	float stepLength = isHorizontal ? texelSize.y : texelSize.x;
+	float lumaLocalAverage;
+	if (is1Steepest)
+	{
+		stepLength = -stepLength;
+		lumaLocalAverage = 0.5f * (luma1 + lumaCenter);
+	}
+	else
+		lumaLocalAverage = 0.5f * (luma2 + lumaCenter);
+
+	// Walk both ways along the edge until the luma changes.
+	vec2 edgeUv = texCoord;
+	if (isHorizontal)
+		edgeUv.y += stepLength * 0.5f;
+	else
+		edgeUv.x += stepLength * 0.5f;
+	vec2 offset = isHorizontal ? vec2(texelSize.x, 0.0f) : vec2(0.0f, texelSize.y);
+	vec2 uv1 = edgeUv - offset;
+	vec2 uv2 = edgeUv + offset;
+	float lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+	float lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+	bool reached1 = abs(lumaEnd1) >= gradientScaled;
+	bool reached2 = abs(lumaEnd2) >= gradientScaled;
+	if (!reached1)
+		uv1 -= offset;
+	if (!reached2)
+		uv2 += offset;
+	for (int i = 2; i < ITERATIONS && !(reached1 && reached2); i++)
+	{
+		if (!reached1)
+			lumaEnd1 = lumaAt(uv1) - lumaLocalAverage;
+		if (!reached2)
+			lumaEnd2 = lumaAt(uv2) - lumaLocalAverage;
+		reached1 = abs(lumaEnd1) >= gradientScaled;
+		reached2 = abs(lumaEnd2) >= gradientScaled;
+		if (!reached1)
+			uv1 -= offset * stepScale[i];
+		if (!reached2)
+			uv2 += offset * stepScale[i];
+	}
+
+	float distance1 = isHorizontal ? (texCoord.x - uv1.x) : (texCoord.y - uv1.y);
+	float distance2 = isHorizontal ? (uv2.x - texCoord.x) : (uv2.y - texCoord.y);
+	bool isDirection1 = distance1 < distance2;
+	float distanceFinal = min(distance1, distance2);
+	float edgeLength = distance1 + distance2;
+	float pixelOffset = -distanceFinal / edgeLength + 0.5f;
+
+	// Only offset if the end we are closest to varies the right way.
+	bool isLumaCenterSmaller = lumaCenter < lumaLocalAverage;
+	bool correctVariation = ((isDirection1 ? lumaEnd1 : lumaEnd2) < 0.0f) != isLumaCenterSmaller;
+	float finalOffset = correctVariation ? pixelOffset : 0.0f;
+
+	// Sub-pixel aliasing, for features thinner than a pixel.
+	float lumaAverage = (1.0f / 12.0f) * (2.0f * (lumaDownUp + lumaLeftRight) + lumaLeftCorners + lumaRightCorners);
+	float subPixel1 = clamp(abs(lumaAverage - lumaCenter) / lumaRange, 0.0f, 1.0f);
+	float subPixel2 = (-2.0f * subPixel1 + 3.0f) * subPixel1 * subPixel1;
+	finalOffset = max(finalOffset, subPixel2 * subPixel2 * SUBPIXEL_QUALITY);
+
+	vec2 finalUv = texCoord;
+	if (isHorizontal)
+		finalUv.y += finalOffset * stepLength;
+	else
+		finalUv.x += finalOffset * stepLength;
+	frag_colour = vec4(textureLod(source, finalUv, 0.0f).rgb, 1.0f);
+}
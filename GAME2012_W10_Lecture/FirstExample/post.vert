@@ -0,0 +1,11 @@
+#version 430 core
+
+// Fullscreen triangle from gl_VertexID, draw 3 vertices with an empty VAO.
+out vec2 texCoord;
+
+void main()
+{
+	vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	texCoord = pos;
+	gl_Position = vec4(pos * 2.0f - 1.0f, 0.0f, 1.0f);
+}
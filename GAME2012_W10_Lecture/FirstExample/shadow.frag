@@ -0,0 +1,12 @@
+#version 430 core
+
+in vec3 fragPos;
+
+uniform vec3 lightPosition;
+uniform float farPlane;
+
+void main()
+{
+	// Store linear distance to the light so every face of the cube compares the same way.
+	gl_FragDepth = length(fragPos - lightPosition) / farPlane;
+}
@@ -0,0 +1,15 @@
+#version 430 core
+
+layout(location = 0) in vec3 vertex_position;
+
+out vec3 fragPos;
+
+uniform mat4 model;
+uniform mat4 lightMatrix; // Projection * view of one cube face.
+
+void main()
+{
+	vec4 worldPos = model * vec4(vertex_position, 1.0f);
+	fragPos = worldPos.xyz;
+	gl_Position = lightMatrix * worldPos;
+}
@@ -0,0 +1,37 @@
+#version 430 core
+
+// SMAA 1x pass 3: neighbourhood blending. Gathers the four weights that
+// touch this pixel and blends along whichever axis has more coverage.
+out vec4 frag_colour;
+
+uniform sampler2D source;
+uniform sampler2D weights;
+
+vec4 fetch(sampler2D tex, ivec2 p)
+{
+	return texelFetch(tex, clamp(p, ivec2(0), textureSize(tex, 0) - 1), 0);
+}
+
+void main()
+{
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	vec4 w = fetch(weights, p);
+	float wBelow = w.r;
+	float wLeft = w.b;
+	float wAbove = fetch(weights, p + ivec2(0, 1)).g;
+	float wRight = fetch(weights, p + ivec2(1, 0)).a;
+
+	vec4 colour = fetch(source, p);
+	float horizontal = wLeft + wRight;
+	float vertical = wBelow + wAbove;
+	if (max(horizontal, vertical) == 0.0f)
+	{
+		frag_colour = colour;
+		return;
+	}
+	if (vertical >= horizontal)
+		colour = colour * (1.0f - vertical) + fetch(source, p + ivec2(0, -1)) * wBelow + fetch(source, p + ivec2(0, 1)) * wAbove;
+	else
+		colour = colour * (1.0f - horizontal) + fetch(source, p + ivec2(-1, 0)) * wLeft + fetch(source, p + ivec2(1, 0)) * wRight;
+	frag_colour = vec4(colour.rgb, 1.0f);
+}
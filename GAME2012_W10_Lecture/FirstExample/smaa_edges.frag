@@ -0,0 +1,43 @@
+#version 430 core
+
+// SMAA 1x pass 1: luma edge detection with local contrast adaptation.
+// r = edge with the pixel to the left, g = edge with the pixel below.
+out vec4 frag_colour;
+
+uniform sampler2D source;
+
+#define THRESHOLD 0.1f
+#define CONTRAST_ADAPTATION 2.0f
+
+float lumaAt(ivec2 p)
+{
+	p = clamp(p, ivec2(0), textureSize(source, 0) - 1);
+	return dot(texelFetch(source, p, 0).rgb, vec3(0.2126f, 0.7152f, 0.0722f));
+}
+
+void main()
+{
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	float L = lumaAt(p);
+	float left = lumaAt(p + ivec2(-1, 0));
+	float below = lumaAt(p + ivec2(0, -1));
+	vec2 delta = abs(L - vec2(left, below));
+	vec2 edges = step(THRESHOLD, delta);
+	if (dot(edges, vec2(1.0f)) == 0.0f)
+	{
+		frag_colour = vec4(0.0f);
+		return;
+	}
+
+	// Drop edges that are much weaker than a neighbouring one, like SMAA does.
+	float right = lumaAt(p + ivec2(1, 0));
+	float above = lumaAt(p + ivec2(0, 1));
+	vec2 maxDelta = max(delta, abs(L - vec2(right, above)));
+	float leftLeft = lumaAt(p + ivec2(-2, 0));
+	float belowBelow = lumaAt(p + ivec2(0, -2));
+	maxDelta = max(maxDelta, abs(vec2(left, below) - vec2(leftLeft, belowBelow)));
+	float finalDelta = max(maxDelta.x, maxDelta.y);
+	edges *= step(finalDelta, CONTRAST_ADAPTATION * delta);
+
+	frag_colour = vec4(edges, 0.0f, 0.0f);
+}
@@ -0,0 +1,82 @@
+#version 430 core
+
+// SMAA 1x pass 2: blending weights. For every edge we search both ways for
+// its ends, look at the crossing edges there to classify the shape (L, Z or
+// U), and compute the coverage of the re-vectorised silhouette line at this
+// pixel analytically instead of through SMAA's precomputed area texture.
+//   r: this pixel takes colour from the pixel below
+//   g: the pixel below takes colour from this one
+//   b: this pixel takes colour from the pixel to the left
+//   a: the pixel to the left takes colour from this one
+out vec4 frag_colour;
+
+uniform sampler2D edges;
+
+#define MAX_SEARCH 16
+
+ivec2 size;
+
+vec2 edgeAt(ivec2 p)
+{
+	if (any(lessThan(p, ivec2(0))) || any(greaterThanEqual(p, size)))
+		return vec2(0.0f);
+	return texelFetch(edges, p, 0).rg;
+}
+
+// Height of the silhouette line, in pixels, at this pixel's centre. The edge
+// runs from -distNeg to distPos + 1 along its own axis; h1 and h2 are the
+// heights at the two ends (+0.5 crossing towards our side, -0.5 away, 0 none).
+float lineHeight(float distNeg, float distPos, float h1, float h2)
+{
+	float len = distNeg + distPos + 1.0f;
+	float x = distNeg + 0.5f; // Our centre, measured from the negative end.
+	if (h1 * h2 < 0.0f) // Z shape: one line from end to end.
+		return mix(h1, h2, x / len);
+	float halfLength = len * 0.5f;
+	if (x < halfLength) // L and U shapes: each end slopes to zero at the middle.
+		return h1 * (1.0f - x / halfLength);
+	return h2 * ((x - halfLength) / halfLength);
+}
+
+float crossing(float towards, float away)
+{
+	return (towards > 0.0f && away == 0.0f) ? 0.5f : ((away > 0.0f && towards == 0.0f) ? -0.5f : 0.0f);
+}
+
+void main()
+{
+	size = textureSize(edges, 0);
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	vec2 e = edgeAt(p);
+	vec4 weights = vec4(0.0f);
+
+	if (e.g > 0.0f) // Horizontal edge along our bottom side.
+	{
+		int dl = 0, dr = 0;
+		while (dl < MAX_SEARCH && edgeAt(p + ivec2(-dl - 1, 0)).g > 0.0f)
+			dl++;
+		while (dr < MAX_SEARCH && edgeAt(p + ivec2(dr + 1, 0)).g > 0.0f)
+			dr++;
+		// Crossing edges are the vertical (left) edges at each end, in our row or the row below.
+		float h1 = crossing(edgeAt(p + ivec2(-dl, 0)).r, edgeAt(p + ivec2(-dl, -1)).r);
+		float h2 = crossing(edgeAt(p + ivec2(dr + 1, 0)).r, edgeAt(p + ivec2(dr + 1, -1)).r);
+		float h = lineHeight(float(dl), float(dr), h1, h2);
+		weights.r = max(h, 0.0f);
+		weights.g = max(-h, 0.0f);
+	}
+	if (e.r > 0.0f) // Vertical edge along our left side.
+	{
+		int dd = 0, du = 0;
+		while (dd < MAX_SEARCH && edgeAt(p + ivec2(0, -dd - 1)).r > 0.0f)
+			dd++;
+		while (du < MAX_SEARCH && edgeAt(p + ivec2(0, du + 1)).r > 0.0f)
+			du++;
+		// Crossing edges are the horizontal (bottom) edges at each end, in our column or the one to the left.
+		float h1 = crossing(edgeAt(p + ivec2(0, -dd)).g, edgeAt(p + ivec2(-1, -dd)).g);
+		float h2 = crossing(edgeAt(p + ivec2(0, du + 1)).g, edgeAt(p + ivec2(-1, du + 1)).g);
+		float h = lineHeight(float(dd), float(du), h1, h2);
+		weights.b = max(h, 0.0f);
+		weights.a = max(-h, 0.0f);
+	}
+	frag_colour = weights;
+}
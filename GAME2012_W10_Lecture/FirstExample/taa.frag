@@ -0,0 +1,38 @@
+#version 430 core
+
+// Temporal AA: the projection is jittered by a sub-pixel offset every frame
+// and each frame is blended into a reprojected history. The history is
+// clamped to the current 3x3 neighbourhood to stop ghosting.
+in vec2 texCoord;
+out vec4 frag_colour;
+
+uniform sampler2D source;
+uniform sampler2D history;
+uniform sampler2D depth;
+uniform mat4 reprojection; // Previous view-projection * inverse of current one.
+uniform float blendFactor; // Weight of the current frame, 1 resets the history.
+
+void main()
+{
+	ivec2 p = ivec2(gl_FragCoord.xy);
+	ivec2 maxP = textureSize(source, 0) - 1;
+	vec3 current = texelFetch(source, p, 0).rgb;
+	vec3 lo = current, hi = current;
+	for (int y = -1; y <= 1; y++)
+		for (int x = -1; x <= 1; x++)
+		{
+			vec3 c = texelFetch(source, clamp(p + ivec2(x, y), ivec2(0), maxP), 0).rgb;
+			lo = min(lo, c);
+			hi = max(hi, c);
+		}
+
+	float d = texelFetch(depth, p, 0).r;
+	vec4 previous = reprojection * vec4(texCoord * 2.0f - 1.0f, d * 2.0f - 1.0f, 1.0f);
+	vec2 previousUv = (previous.xy / previous.w) * 0.5f + 0.5f;
+
+	float alpha = blendFactor;
+	if (any(lessThan(previousUv, vec2(0.0f))) || any(greaterThan(previousUv, vec2(1.0f))))
+		alpha = 1.0f; // Newly visible, nothing to reuse.
+	vec3 past = clamp(texture(history, previousUv).rgb, lo, hi);
+	frag_colour = vec4(mix(past, current, alpha), 1.0f);
+}
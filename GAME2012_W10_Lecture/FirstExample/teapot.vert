@@ -0,0 +1,11 @@
+#version 430 core
+
+layout(location = 0) in vec3 control_point;
+layout(location = 4) in mat4 model; // Per instance.
+
+out vec3 worldPoint;
+
+void main()
+{
+	worldPoint = (model * vec4(control_point, 1.0f)).xyz;
+}
@@ -3,6 +3,7 @@
 #ifndef NUM_POINT_LIGHTS
     #define NUM_POINT_LIGHTS 2
 #endif
+#define MAX_LIGHTS_PER_OBJECT 8
 
 in vec3 colour;
 in vec2 texCoord;
@@ -29,6 +30,7 @@ struct PointLight
 	float constant;
 	float linear;
 	float exponent;
+	float range;
 };
 
 struct Material
@@ -38,11 +40,16 @@ struct Material
 };
 
 uniform sampler2D texture0;
+uniform samplerCubeArrayShadow shadowMaps; // Six layers per point light.
+uniform bool shadowsEnabled;
+uniform float lodBias; // Raised by the frame governor to sample smaller mips.
 
 uniform vec3 eyePosition;
 
 uniform AmbientLight aLight;
 uniform PointLight pLights[NUM_POINT_LIGHTS];
+uniform int lightCount; // Lights that reach this object, chosen on the CPU.
+uniform int lightIndices[MAX_LIGHTS_PER_OBJECT];
 uniform Material mat;
 
 vec4 calcLightByDirection(Light l, vec3 dir)
@@ -66,13 +73,25 @@ vec4 calcLightByDirection(Light l, vec3 dir)
 	return (diffuse + specular);
 }
 
-vec4 calcPointLight(PointLight p)
+float calcShadow(int index, PointLight p, vec3 lightToFrag)
+{
+	if (!shadowsEnabled)
+		return 1.0f;
+	float current = length(lightToFrag) / p.range;
+	if (current >= 1.0f)
+		return 1.0f; // Outside the light's range, nothing was rendered.
+	const float bias = 0.005f;
+	return texture(shadowMaps, vec4(lightToFrag, index), current - bias);
+}
+
+vec4 calcPointLight(int index, PointLight p)
 {
 	vec3 direction = fragPos - p.position;
 	float distance = length(direction);
+	float shadow = calcShadow(index, p, direction);
 	direction = normalize(direction);
 
-	vec4 colour = calcLightByDirection(p.base, direction);
+	vec4 colour = calcLightByDirection(p.base, direction) * shadow;
 	float attenuation = p.exponent * distance * distance +
 						p.linear * distance +
 						p.constant;
@@ -88,8 +107,8 @@ void main()
 
 	calcColour += ambient;
 
-	for (int i = 0; i < NUM_POINT_LIGHTS; i++)
-		calcColour += calcPointLight(pLights[i]);
+	for (int i = 0; i < lightCount; i++)
+		calcColour += calcPointLight(lightIndices[i], pLights[lightIndices[i]]);
 
-	frag_colour = texture(texture0, texCoord) * vec4(colour, 1.0f) * calcColour;
+	frag_colour = texture(texture0, texCoord, lodBias) * vec4(colour, 1.0f) * calcColour;
 }
\ No newline at end of file
@@ -10,6 +10,9 @@ out vec2 texCoord;
 out vec3 normal;
 out vec3 fragPos;
 
+// Same position maths as depth.vert, so the depth pre-pass can be tested with GL_EQUAL.
+invariant gl_Position;
+
 // Values that stay constant for the whole mesh.
 uniform mat4 model;
 uniform mat4 view;
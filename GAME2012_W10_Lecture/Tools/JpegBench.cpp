@@ -0,0 +1,384 @@
+//***************************************************************************
+// JpegBench.cpp
+//
+// Times stb_image's JPEG decode on 1, 2, 4 ... threads (stbi_set_jpeg_threads,
+// built with STBI_PARALLEL_JPEG) and checks every result against the single
+// threaded pixels. Each file is also re-encoded as a baseline JPEG with a
+// restart marker after every row of blocks and timed again, since only
+// files with restart intervals get their entropy decoding split; without
+// them just the IDCT and colour conversion run in parallel.
+//
+// Usage: JpegBench [file.jpg ...]   (default the lecture's two big textures)
+// Nothing is written to disk.
+//***************************************************************************
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#define STBI_PARALLEL_JPEG
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+using namespace std;
+
+#define BENCH_RUNS 5
+#define ENCODE_QUALITY 90
+
+// Huffman tables from the JPEG spec (K.3), used for all three components.
+static const unsigned char dcBits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const unsigned char dcValues[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+static const unsigned char acBits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const unsigned char acValues[162] = {
+	0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+	0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+	0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+	0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+	0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+	0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+	0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+	0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+	0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+	0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+	0xf9, 0xfa
+};
+// The spec's luminance quantisation table, for every component.
+static const int baseQuant[64] = {
+	16, 11, 10, 16, 24, 40, 51, 61, 12, 12, 14, 19, 26, 58, 60, 55,
+	14, 13, 16, 24, 40, 57, 69, 56, 14, 17, 22, 29, 51, 87, 80, 62,
+	18, 22, 37, 56, 68, 109, 103, 77, 24, 35, 55, 64, 81, 104, 113, 92,
+	49, 64, 78, 87, 103, 121, 120, 101, 72, 92, 95, 98, 112, 100, 103, 99
+};
+
+// Just enough of a baseline encoder to make test files: 4:4:4 YCbCr, one
+// set of tables, a plain separable DCT, and a restart marker every
+// restartInterval blocks.
+struct JpegWriter
+{
+	vector<unsigned char> out;
+	unsigned bitBuffer;
+	int bitCount;
+	unsigned short dcCode[12], acCode[256];
+	unsigned char dcSize[12], acSize[256];
+	int quant[64], zigzag[64];
+	float cosines[8][8];
+
+	JpegWriter()
+	{
+		bitBuffer = 0;
+		bitCount = 0;
+		BuildCodes(dcBits, dcValues, dcCode, dcSize);
+		BuildCodes(acBits, acValues, acCode, acSize);
+
+		int scale = ENCODE_QUALITY < 50 ? 5000 / ENCODE_QUALITY : 200 - ENCODE_QUALITY * 2;
+		for (int i = 0; i < 64; i++)
+			quant[i] = min(255, max(1, (baseQuant[i] * scale + 50) / 100));
+		// Walk the diagonals to get the zigzag order.
+		for (int i = 0, x = 0, y = 0; i < 64; i++)
+		{
+			zigzag[i] = y * 8 + x;
+			if ((x + y) % 2 == 0)
+			{
+				if (x == 7) y++;
+				else if (y == 0) x++;
+				else { x++; y--; }
+			}
+			else
+			{
+				if (y == 7) x++;
+				else if (x == 0) y++;
+				else { x--; y++; }
+			}
+		}
+		for (int u = 0; u < 8; u++)
+			for (int x = 0; x < 8; x++)
+				cosines[u][x] = (u == 0 ? sqrtf(0.125f) : 0.5f) * cosf((2 * x + 1) * u * 3.14159265f / 16);
+	}
+	// Canonical codes from the counts per length, as the decoder rebuilds them.
+	static void BuildCodes(const unsigned char* bits, const unsigned char* values, unsigned short* code, unsigned char* size)
+	{
+		int next = 0, k = 0;
+		for (int length = 1; length <= 16; length++)
+		{
+			for (int i = 0; i < bits[length - 1]; i++, k++)
+			{
+				code[values[k]] = (unsigned short)next++;
+				size[values[k]] = (unsigned char)length;
+			}
+			next <<= 1;
+		}
+	}
+	void Byte(int b) { out.push_back((unsigned char)b); }
+	void Word(int w) { Byte(w >> 8); Byte(w & 255); }
+	void Bits(unsigned code, int size)
+	{
+		bitBuffer = (bitBuffer << size) | code;
+		bitCount += size;
+		while (bitCount >= 8)
+		{
+			int b = (bitBuffer >> (bitCount - 8)) & 255;
+			Byte(b);
+			if (b == 0xff)
+				Byte(0); // Stuffed, so it isn't read as a marker.
+			bitCount -= 8;
+		}
+	}
+	// Pads the last byte with ones.
+	void Flush()
+	{
+		if (bitCount > 0)
+			Bits((1 << (8 - bitCount)) - 1, 8 - bitCount);
+		bitBuffer = 0;
+	}
+	static int Category(int value)
+	{
+		int size = 0;
+		for (int a = abs(value); a; a >>= 1)
+			size++;
+		return size;
+	}
+	static unsigned Magnitude(int value, int size) { return (value < 0 ? value - 1 : value) & ((1 << size) - 1); }
+	void Block(const float* samples, int& previousDc)
+	{
+		float rows[64];
+		int coefficients[64];
+		for (int y = 0; y < 8; y++)
+			for (int u = 0; u < 8; u++)
+			{
+				float sum = 0.0f;
+				for (int x = 0; x < 8; x++)
+					sum += samples[y * 8 + x] * cosines[u][x];
+				rows[y * 8 + u] = sum;
+			}
+		for (int v = 0; v < 8; v++)
+			for (int u = 0; u < 8; u++)
+			{
+				float sum = 0.0f;
+				for (int y = 0; y < 8; y++)
+					sum += rows[y * 8 + u] * cosines[v][y];
+				coefficients[v * 8 + u] = (int)floorf(sum / quant[v * 8 + u] + 0.5f);
+			}
+
+		int dc = coefficients[0], diff = dc - previousDc, size = Category(diff);
+		previousDc = dc;
+		Bits(dcCode[size], dcSize[size]);
+		if (size)
+			Bits(Magnitude(diff, size), size);
+		int run = 0;
+		for (int i = 1; i < 64; i++)
+		{
+			int value = coefficients[zigzag[i]];
+			if (value == 0)
+			{
+				run++;
+				continue;
+			}
+			for (; run >= 16; run -= 16)
+				Bits(acCode[0xf0], acSize[0xf0]);
+			size = Category(value);
+			Bits(acCode[run << 4 | size], acSize[run << 4 | size]);
+			Bits(Magnitude(value, size), size);
+			run = 0;
+		}
+		if (run)
+			Bits(acCode[0], acSize[0]);
+	}
+	void Table(int id, const unsigned char* bits, const unsigned char* values, int count)
+	{
+		Word(0xffc4);
+		Word(2 + 1 + 16 + count);
+		Byte(id);
+		out.insert(out.end(), bits, bits + 16);
+		out.insert(out.end(), values, values + count);
+	}
+	// pixels is RGB, top row first.
+	void Write(const unsigned char* pixels, int width, int height, int restartInterval)
+	{
+		out.clear();
+		Word(0xffd8);
+		Word(0xffe0); // JFIF, so the decoder knows it's YCbCr.
+		Word(16);
+		const char jfif[] = { 'J', 'F', 'I', 'F', 0, 1, 1, 0, 0, 1, 0, 1, 0, 0 };
+		out.insert(out.end(), jfif, jfif + sizeof(jfif));
+		Word(0xffdb);
+		Word(2 + 65);
+		Byte(0);
+		for (int i = 0; i < 64; i++)
+			Byte(quant[zigzag[i]]);
+		Word(0xffc0);
+		Word(8 + 3 * 3);
+		Byte(8);
+		Word(height);
+		Word(width);
+		Byte(3);
+		for (int c = 1; c <= 3; c++)
+		{
+			Byte(c);
+			Byte(0x11);
+			Byte(0);
+		}
+		Table(0x00, dcBits, dcValues, 12);
+		Table(0x10, acBits, acValues, 162);
+		Word(0xffdd);
+		Word(4);
+		Word(restartInterval);
+		Word(0xffda);
+		Word(6 + 2 * 3);
+		Byte(3);
+		for (int c = 1; c <= 3; c++)
+		{
+			Byte(c);
+			Byte(0x00);
+		}
+		Byte(0);
+		Byte(63);
+		Byte(0);
+
+		int blocksX = (width + 7) / 8, blocksY = (height + 7) / 8, restarts = 0;
+		int dc[3] = { 0, 0, 0 };
+		float block[3][64];
+		for (int by = 0; by < blocksY; by++)
+			for (int bx = 0; bx < blocksX; bx++)
+			{
+				int mcu = by * blocksX + bx;
+				if (restartInterval && mcu > 0 && mcu % restartInterval == 0)
+				{
+					Flush();
+					Word(0xffd0 + (restarts++ & 7));
+					dc[0] = dc[1] = dc[2] = 0;
+				}
+				for (int y = 0; y < 8; y++)
+					for (int x = 0; x < 8; x++)
+					{
+						// Edge blocks repeat the last row and column.
+						const unsigned char* p = pixels + ((size_t)min(by * 8 + y, height - 1) * width + min(bx * 8 + x, width - 1)) * 3;
+						float r = p[0], g = p[1], b = p[2];
+						block[0][y * 8 + x] = 0.299f * r + 0.587f * g + 0.114f * b - 128.0f;
+						block[1][y * 8 + x] = -0.168736f * r - 0.331264f * g + 0.5f * b;
+						block[2][y * 8 + x] = 0.5f * r - 0.418688f * g - 0.081312f * b;
+					}
+				for (int c = 0; c < 3; c++)
+					Block(block[c], dc[c]);
+			}
+		Flush();
+		Word(0xffd9);
+	}
+};
+
+static bool hasRestarts(const vector<unsigned char>& data)
+{
+	for (size_t i = 0; i + 1 < data.size(); i++)
+		if (data[i] == 0xff && data[i + 1] == 0xdd)
+			return true;
+	return false;
+}
+
+static bool isProgressive(const vector<unsigned char>& data)
+{
+	for (size_t i = 0; i + 1 < data.size(); i++)
+		if (data[i] == 0xff && data[i + 1] == 0xc2)
+			return true;
+	return false;
+}
+
+float elapsedMs(chrono::high_resolution_clock::time_point start)
+{
+	return chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+// Decodes data from memory on each thread count, best of BENCH_RUNS.
+void bench(const string& name, const vector<unsigned char>& data, const vector<int>& threadCounts)
+{
+	int width, height, channels;
+	stbi_set_jpeg_threads(1);
+	unsigned char* reference = stbi_load_from_memory(&data[0], (int)data.size(), &width, &height, &channels, 0);
+	if (!reference)
+	{
+		cout << name << ": " << stbi_failure_reason() << endl;
+		return;
+	}
+	size_t bytes = (size_t)width * height * channels;
+	cout << name << ": " << width << "x" << height << (isProgressive(data) ? ", progressive" : ", baseline")
+		<< (hasRestarts(data) ? ", restart markers" : ", no restart markers") << endl;
+
+	float singleMs = 0.0f;
+	for (unsigned t = 0; t < threadCounts.size(); t++)
+	{
+		stbi_set_jpeg_threads(threadCounts[t]);
+		float bestMs = 1e9f;
+		bool match = true;
+		for (int run = 0; run < BENCH_RUNS; run++)
+		{
+			chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+			unsigned char* pixels = stbi_load_from_memory(&data[0], (int)data.size(), &width, &height, &channels, 0);
+			bestMs = min(bestMs, elapsedMs(start));
+			match = match && pixels && memcmp(pixels, reference, bytes) == 0;
+			stbi_image_free(pixels);
+		}
+		if (t == 0)
+			singleMs = bestMs;
+		cout << "  " << threadCounts[t] << (threadCounts[t] == 1 ? " thread:  " : " threads: ") << bestMs << " ms, "
+			<< singleMs / bestMs << "x" << (match ? "" : "  PIXELS DIFFER") << endl;
+	}
+	stbi_set_jpeg_threads(1);
+	stbi_image_free(reference);
+}
+
+int main(int argc, char** argv)
+{
+	vector<string> files;
+	for (int i = 1; i < argc; i++)
+		files.push_back(argv[i]);
+	if (files.empty())
+	{
+		files.push_back("../FirstExample/gatetower.jpg");
+		files.push_back("../FirstExample/stairs.jpg");
+	}
+
+	// 1, 2, 4 ... up to the hardware threads, and that count itself.
+	unsigned hardware = max(2u, thread::hardware_concurrency());
+	vector<int> threadCounts;
+	for (unsigned t = 1; t < hardware; t *= 2)
+		threadCounts.push_back(t);
+	threadCounts.push_back(hardware);
+
+	JpegWriter writer;
+	for (unsigned i = 0; i < files.size(); i++)
+	{
+		vector<unsigned char> data;
+		FILE* f;
+#ifdef WIN32
+		if (fopen_s(&f, files[i].c_str(), "rb") != 0)
+			f = NULL;
+#else
+		f = fopen(files[i].c_str(), "rb");
+#endif
+		if (f)
+		{
+			fseek(f, 0, SEEK_END);
+			data.resize(ftell(f));
+			fseek(f, 0, SEEK_SET);
+			data.resize(fread(data.empty() ? NULL : &data[0], 1, data.size(), f));
+			fclose(f);
+		}
+		if (data.empty())
+		{
+			cout << "Unable to read " << files[i] << endl;
+			continue;
+		}
+		bench(files[i], data, threadCounts);
+
+		int width, height, channels;
+		unsigned char* pixels = stbi_load_from_memory(&data[0], (int)data.size(), &width, &height, &channels, 3);
+		if (!pixels)
+			continue;
+		writer.Write(pixels, width, height, (width + 7) / 8);
+		stbi_image_free(pixels);
+		bench(files[i] + " re-encoded with a restart every block row", writer.out, threadCounts);
+	}
+	return 0;
+}
@@ -0,0 +1,262 @@
+//***************************************************************************
+// NormalBench.cpp
+//
+// Times vertex normal generation (NormalGenerator.h) in meshes per second:
+// over the castle's triangle meshes, which are small and many, and over
+// rolling terrain grids big enough to split between threads. Each is run
+// the way Shape::CalcAverageNormals used to work (one unit face normal per
+// triangle, pushed through glm a vertex at a time), then area and angle
+// weighted, scalar and (for angles) SSE, on 1, 2, 4 ... threads. Every
+// result is checked against the scalar one on a single thread; the SSE
+// angle weights use an approximate acos, so they may differ by a few
+// millionths. Tangents (generateTangents) are checked on a grid whose UVs
+// run along x and z, once as laid out and once mirrored in u: unit length,
+// perpendicular to the normal, pointing along increasing u, and on the
+// side the layout puts the bitangent.
+//
+// Usage: NormalBench [size] [scene]   (default 1024 quads a side, ../FirstExample/castle.scene)
+// Nothing is written to disk. Exits with 1 if the tangents are wrong.
+//***************************************************************************
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <GL\glew.h>
+#include "Scene.h"
+#include "MeshPack.h"
+#include "NormalGenerator.h"
+using namespace std;
+
+#define BENCH_RUNS 5
+#define CASTLE_REPEATS 200 // The castle's meshes take microseconds, so each run does them this many times.
+#define TANGENT_GRID 64 // Quads a side of the terrain the tangents are checked on.
+#define TANGENT_TOLERANCE 1e-4f
+
+// An indexed triangle list, like a Shape's streams.
+struct BenchMesh
+{
+	vector<GLfloat> positions;
+	vector<GLuint> indices;
+	unsigned VertexCount() const { return (unsigned)(positions.size() / 3); }
+};
+
+// size x size quads of hills, two triangles each.
+BenchMesh Terrain(unsigned size)
+{
+	BenchMesh m;
+	m.positions.reserve((size_t)(size + 1) * (size + 1) * 3);
+	for (unsigned z = 0; z <= size; z++)
+		for (unsigned x = 0; x <= size; x++)
+		{
+			float u = (float)x / size, v = (float)z / size;
+			m.positions.push_back(u);
+			m.positions.push_back(0.05f * sin(u * 37.0f) * cos(v * 23.0f) + 0.02f * sin((u + v) * 91.0f));
+			m.positions.push_back(v);
+		}
+	m.indices.reserve((size_t)size * size * 6);
+	for (unsigned z = 0; z < size; z++)
+		for (unsigned x = 0; x < size; x++)
+		{
+			GLuint i = z * (size + 1) + x;
+			GLuint quad[6] = { i, i + size + 1, i + 1, i + 1, i + size + 1, i + size + 2 };
+			m.indices.insert(m.indices.end(), quad, quad + 6);
+		}
+	return m;
+}
+
+// Tangents for a size x size Terrain with u along x (or against it, when
+// mirrored) and v along z. Normals point up, so the bitangent n x t is
+// against v as laid out and along it mirrored: w is -1 and then +1.
+bool CheckTangents(unsigned size, bool mirrored)
+{
+	BenchMesh m = Terrain(size);
+	unsigned vertexCount = m.VertexCount();
+	vector<GLfloat> uvs, normals, tangents;
+	for (unsigned i = 0; i < vertexCount; i++)
+	{
+		uvs.push_back(mirrored ? 1.0f - m.positions[i * 3] : m.positions[i * 3]);
+		uvs.push_back(m.positions[i * 3 + 2]);
+	}
+	generateNormals(&m.positions[0], vertexCount, &m.indices[0], (unsigned)m.indices.size(), NORMALS_BY_AREA, normals, 1, false);
+	generateTangents(&m.positions[0], &uvs[0], &normals[0], vertexCount, &m.indices[0], (unsigned)m.indices.size(), tangents);
+	float expectedSign = mirrored ? 1.0f : -1.0f, worstLength = 0.0f, worstDot = 0.0f;
+	unsigned wrongSide = 0, wrongWay = 0;
+	for (unsigned i = 0; i < vertexCount; i++)
+	{
+		glm::vec3 n(normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2]), t(tangents[i * 4], tangents[i * 4 + 1], tangents[i * 4 + 2]);
+		worstLength = max(worstLength, fabs(glm::length(t) - 1.0f));
+		worstDot = max(worstDot, fabs(glm::dot(t, n)));
+		wrongSide += tangents[i * 4 + 3] != expectedSign;
+		wrongWay += (mirrored ? -t.x : t.x) <= 0.0f;
+	}
+	bool ok = worstLength < TANGENT_TOLERANCE && worstDot < TANGENT_TOLERANCE && wrongSide == 0 && wrongWay == 0;
+	cout << "Tangents on " << size << "x" << size << (mirrored ? ", u mirrored" : "") << ": length off by " << worstLength
+		<< ", t.n up to " << worstDot << ", " << wrongSide << " wrong handedness, " << wrongWay << " against u"
+		<< (ok ? "" : " - wrong!") << endl;
+	return ok;
+}
+
+// What Shape::CalcAverageNormals did before NormalGenerator.h, kept to
+// compare against.
+void LegacyNormals(const BenchMesh& m, vector<GLfloat>& normals)
+{
+	normals.assign(m.positions.size(), 0.0f);
+	normals.shrink_to_fit();
+	for (unsigned i = 0; i < m.indices.size(); i += 3)
+	{
+		unsigned in0 = m.indices[i] * 3, in1 = m.indices[i + 1] * 3, in2 = m.indices[i + 2] * 3;
+		glm::vec3 v1(m.positions[in1] - m.positions[in0], m.positions[in1 + 1] - m.positions[in0 + 1], m.positions[in1 + 2] - m.positions[in0 + 2]);
+		glm::vec3 v2(m.positions[in2] - m.positions[in0], m.positions[in2 + 1] - m.positions[in0 + 1], m.positions[in2 + 2] - m.positions[in0 + 2]);
+		glm::vec3 normal = glm::normalize(glm::cross(v2, v1)); // Inward for anticlockwise triangles, one of the things fixed.
+		normals[in0] += normal.x; normals[in0 + 1] += normal.y; normals[in0 + 2] += normal.z;
+		normals[in1] += normal.x; normals[in1 + 1] += normal.y; normals[in1 + 2] += normal.z;
+		normals[in2] += normal.x; normals[in2 + 1] += normal.y; normals[in2 + 2] += normal.z;
+	}
+	for (unsigned i = 0; i < normals.size(); i += 3)
+	{
+		glm::vec3 vec = glm::normalize(glm::vec3(normals[i], normals[i + 1], normals[i + 2]));
+		normals[i] = vec.x; normals[i + 1] = vec.y; normals[i + 2] = vec.z;
+	}
+}
+
+float elapsedMs(chrono::high_resolution_clock::time_point start)
+{
+	return chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+float MaxDifference(const vector<vector<GLfloat> >& a, const vector<vector<GLfloat> >& b)
+{
+	float worst = 0.0f;
+	for (unsigned m = 0; m < a.size(); m++)
+		for (unsigned i = 0; i < a[m].size(); i++)
+			worst = max(worst, fabs(a[m][i] - b[m][i]));
+	return worst;
+}
+
+// One way of making normals, run over every mesh repeats times.
+struct Method
+{
+	const char* name;
+	bool legacy, simd;
+	NormalWeighting weighting;
+	unsigned threads;
+};
+
+// Best of BENCH_RUNS, as meshes per second. Leaves the last run's normals in results.
+double Time(const Method& how, const vector<BenchMesh>& meshes, unsigned repeats, vector<vector<GLfloat> >& results)
+{
+	results.resize(meshes.size());
+	float best = 0.0f;
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		for (unsigned r = 0; r < repeats; r++)
+			for (unsigned m = 0; m < meshes.size(); m++)
+				if (how.legacy)
+					LegacyNormals(meshes[m], results[m]);
+				else
+					generateNormals(&meshes[m].positions[0], meshes[m].VertexCount(), &meshes[m].indices[0], (unsigned)meshes[m].indices.size(),
+						how.weighting, results[m], how.threads, how.simd);
+		float ms = elapsedMs(start);
+		if (run == 0 || ms < best)
+			best = ms;
+	}
+	return meshes.size() * repeats / (best / 1000.0);
+}
+
+void Bench(const string& title, const vector<BenchMesh>& meshes, unsigned repeats, bool threaded)
+{
+	size_t triangles = 0;
+	for (unsigned m = 0; m < meshes.size(); m++)
+		triangles += meshes[m].indices.size() / 3;
+	cout << title << ": " << meshes.size() << " meshes, " << triangles << " triangles" << endl;
+
+	vector<Method> methods;
+	Method legacy = { "old CalcAverageNormals", true, false, NORMALS_BY_AREA, 1 };
+	methods.push_back(legacy);
+	for (int w = 0; w < 2; w++)
+	{
+		NormalWeighting weighting = w == 0 ? NORMALS_BY_AREA : NORMALS_BY_ANGLE;
+		Method scalar = { w == 0 ? "area, scalar" : "angle, scalar", false, false, weighting, 1 };
+		Method fastest = { w == 0 ? "area" : "angle, SSE", false, true, weighting, 1 }; // Area weights are scalar either way.
+		methods.push_back(scalar);
+		if (w == 1)
+			methods.push_back(fastest);
+		for (unsigned t = 2; threaded && t <= NORMALS_MAX_THREADS; t *= 2)
+		{
+			fastest.threads = t;
+			methods.push_back(fastest);
+		}
+	}
+	vector<vector<GLfloat> > reference, results;
+	for (unsigned i = 0; i < methods.size(); i++)
+	{
+		const Method& how = methods[i];
+		double meshesPerSecond = Time(how, meshes, repeats, results);
+		cout << "  " << how.name;
+		if (!how.legacy && how.simd)
+			cout << ", " << how.threads << (how.threads == 1 ? " thread" : " threads");
+		cout << ": " << meshesPerSecond << " meshes/s, " << meshesPerSecond * triangles / meshes.size() / 1e6 << " M triangles/s";
+		if (!how.legacy && !how.simd)
+			reference = results;
+		else if (!how.legacy)
+			cout << ", max difference " << MaxDifference(reference, results);
+		cout << endl;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	unsigned size = 1024;
+	string sceneFile = "../FirstExample/castle.scene";
+	for (int i = 1; i < argc; i++)
+	{
+		if (argv[i][0] == '-')
+		{
+			cout << "Usage: NormalBench [size] [scene]" << endl;
+			return 1;
+		}
+		else if (atoi(argv[i]) > 0)
+			size = atoi(argv[i]);
+		else
+			sceneFile = argv[i];
+	}
+	cout << thread::hardware_concurrency() << " hardware threads" << endl;
+
+	// The castle's triangle meshes, as the exporter gives them normals.
+	SceneDescription scene;
+	MeshPack pack;
+	size_t slash = sceneFile.find_last_of("/\\");
+	if (scene.Load(sceneFile.c_str()) &&
+		pack.Open(((slash == string::npos ? "" : sceneFile.substr(0, slash + 1)) + scene.meshFile).c_str()))
+	{
+		vector<BenchMesh> castle;
+		for (unsigned i = 0; i < pack.header->meshCount; i++)
+		{
+			bool triangles = false;
+			for (unsigned o = 0; o < scene.objects.size(); o++)
+				triangles = triangles || (scene.objects[o].mesh == pack.meshes[i].name && scene.objects[o].mode == GL_TRIANGLES);
+			if (!triangles)
+				continue;
+			MeshView v = pack.View(i);
+			BenchMesh m;
+			m.positions.assign(v.positions, v.positions + v.vertexCount * 3);
+			for (unsigned k = 0; k < v.indexCount; k++)
+				m.indices.push_back(v.Index(k));
+			castle.push_back(m);
+		}
+		Bench("Castle (x" + to_string(CASTLE_REPEATS) + ")", castle, CASTLE_REPEATS, false);
+	}
+
+	vector<BenchMesh> terrain(1, Terrain(size));
+	Bench("Terrain " + to_string(size) + "x" + to_string(size), terrain, 1, true);
+
+	bool tangentsOk = CheckTangents(TANGENT_GRID, false);
+	tangentsOk = CheckTangents(TANGENT_GRID, true) && tangentsOk;
+	return tangentsOk ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+//***************************************************************************
+// PackOptimizer.cpp
+//
+// Runs the mesh optimizer (MeshOptimizer.h) over a mesh pack that already
+// exists, e.g. one written with SceneExporter -noopt or edited by another
+// tool: triangle order for the post-transform vertex cache, then for
+// overdraw, then vertex order for fetch. Only meshes the scene draws purely
+// as triangles are touched; lines and strips draw in index order. Prints
+// ACMR and ATVR per mesh and in total, before and after.
+//
+// Usage: PackOptimizer [-stats] [-nooverdraw] [-shapes] [scene]   (default ../FirstExample/castle.scene)
+// -stats only reports, leaving the pack as it is. -nooverdraw skips the
+// cluster sort, for comparing its cost in cache misses. -shapes reports on
+// large generated shapes instead of a pack.
+//***************************************************************************
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <GL\glew.h>
+#include "Scene.h"
+#include "MeshPack.h"
+#include "MeshOptimizer.h"
+using namespace std;
+
+bool overdraw = true;
+
+void Report(const string& name, const VertexCacheStats& before, const VertexCacheStats& after)
+{
+	cout << "  " << name << ": " << before.triangles << " triangles, ACMR " << before.Acmr() << " -> " << after.Acmr()
+		<< ", ATVR " << before.Atvr() << " -> " << after.Atvr() << endl;
+}
+
+template <class T> void ReportShape(const string& name, T shape)
+{
+	VertexCacheStats before = vertexCacheStats(shape);
+	optimizeShape(shape, overdraw);
+	Report(name, before, vertexCacheStats(shape));
+}
+
+// Bigger versions of the castle's generated shapes, where order matters more.
+void ReportShapes()
+{
+	cout << "Generated shapes, " << VCACHE_SIZE << " entry FIFO cache:" << endl;
+	ReportShape("Grid(64)", Grid(64));
+	ReportShape("Grid(256)", Grid(256));
+	ReportShape("Grid(1000)", Grid(1000));
+	ReportShape("TowerPrism(64)", TowerPrism(64));
+	ReportShape("TowerCone(64)", TowerCone(64));
+	ReportShape("GateTower", GateTower());
+}
+
+// Copies mesh i out of the pack into a shape's streams.
+void ToShape(MeshPack& pack, unsigned i, Shape& shape)
+{
+	MeshView v = pack.View(i);
+	shape.shape_vertices.assign(v.positions, v.positions + v.vertexCount * 3);
+	shape.shape_colors.assign(v.colors, v.colors + v.vertexCount * 3);
+	shape.shape_uvs.assign(v.uvs, v.uvs + v.vertexCount * 2);
+	shape.shape_normals.assign(v.normals, v.normals + v.vertexCount * 3);
+	shape.shape_indices.resize(v.indexCount);
+	for (unsigned k = 0; k < v.indexCount; k++)
+	{
+		unsigned index = v.Index(k);
+		shape.shape_indices[k] = v.indexBytes == 2 && index == 0xFFFF ? RESTART_INDEX : index; // Keep restarts restarts at any width.
+	}
+}
+
+int main(int argc, char** argv)
+{
+	bool statsOnly = false;
+	string sceneFile = "../FirstExample/castle.scene";
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-stats") == 0)
+			statsOnly = true;
+		else if (strcmp(argv[i], "-nooverdraw") == 0)
+			overdraw = false;
+		else if (strcmp(argv[i], "-shapes") == 0)
+		{
+			ReportShapes();
+			return 0;
+		}
+		else if (argv[i][0] == '-')
+		{
+			cout << "Usage: PackOptimizer [-stats] [-nooverdraw] [-shapes] [scene]" << endl;
+			return 1;
+		}
+		else
+			sceneFile = argv[i];
+	}
+
+	SceneDescription scene;
+	if (!scene.Load(sceneFile.c_str()))
+		return 1;
+	size_t slash = sceneFile.find_last_of("/\\");
+	string meshFile = (slash == string::npos ? "" : sceneFile.substr(0, slash + 1)) + scene.meshFile;
+	MeshPack pack;
+	if (!pack.Open(meshFile.c_str()))
+		return 1;
+
+	cout << meshFile << ", " << VCACHE_SIZE << " entry FIFO cache:" << endl;
+	MeshPackBuilder out;
+	VertexCacheStats totalBefore, totalAfter;
+	unsigned changed = 0;
+	for (unsigned i = 0; i < pack.header->meshCount; i++)
+	{
+		const char* name = pack.meshes[i].name;
+		bool triangles = false, other = false;
+		for (unsigned o = 0; o < scene.objects.size(); o++)
+			if (scene.objects[o].mesh == name)
+				(scene.objects[o].mode == GL_TRIANGLES ? triangles : other) = true;
+		Shape shape;
+		ToShape(pack, i, shape);
+		if (triangles && !other)
+		{
+			VertexCacheStats before = vertexCacheStats(shape);
+			Shape original(shape);
+			if (optimizeShape(shape, overdraw))
+			{
+				changed += shape.shape_indices != original.shape_indices || shape.shape_vertices != original.shape_vertices;
+				VertexCacheStats after = vertexCacheStats(shape);
+				Report(name, before, after);
+				totalBefore.Add(before);
+				totalAfter.Add(after);
+			}
+		}
+		out.Add(name, shape.shape_indices, shape.shape_vertices, shape.shape_colors, shape.shape_uvs, shape.shape_normals);
+	}
+	Report("Total", totalBefore, totalAfter);
+	if (statsOnly)
+		return 0;
+	if (changed == 0)
+	{
+		cout << meshFile << " is already in optimized order, left as it is" << endl;
+		return 0;
+	}
+
+	pack.file.Close(); // The mapping has to go before the file can be written over.
+	if (!out.Write(meshFile.c_str()))
+	{
+		cout << "Unable to write " << meshFile << "!" << endl;
+		return 1;
+	}
+	cout << "Wrote " << meshFile << ", " << changed << " meshes reordered" << endl;
+	return 0;
+}
@@ -0,0 +1,371 @@
+//***************************************************************************
+// PngBench.cpp
+//
+// Times stb_image's PNG decode (inflate plus unfiltering) on the
+// FirstExample PNGs and on a corpus of large generated images, 8 bit RGB
+// and RGBA, written with every row filter forced in turn and with the
+// usual per-row choice. The generated images are checked against the
+// pixels they were made from; the FirstExample ones are re-encoded and
+// checked to decode back to the same pixels.
+//
+// Usage: PngBench [size] [file.png ...]   (default 2048, images are size x size)
+// Nothing is written to disk.
+//***************************************************************************
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+using namespace std;
+
+#define BENCH_RUNS 5
+#define MATCH_CHAIN 16 // Earlier positions tried per match, in the writer.
+#define FILTER_ADAPTIVE -1
+
+static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const int distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const int distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// Just enough of a PNG encoder to make test files: one IDAT, deflate with
+// the fixed Huffman codes, and greedy LZ77 matches from a hash chain.
+struct PngWriter
+{
+	vector<unsigned char> out;
+	unsigned bitBuffer;
+	int bitCount;
+	unsigned crcTable[256];
+
+	PngWriter()
+	{
+		bitBuffer = 0;
+		bitCount = 0;
+		for (unsigned n = 0; n < 256; n++)
+		{
+			unsigned c = n;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+			crcTable[n] = c;
+		}
+	}
+	// Deflate packs values from the bottom bit up.
+	void Bits(unsigned value, int count)
+	{
+		bitBuffer |= value << bitCount;
+		bitCount += count;
+		while (bitCount >= 8)
+		{
+			out.push_back((unsigned char)bitBuffer);
+			bitBuffer >>= 8;
+			bitCount -= 8;
+		}
+	}
+	// ...but Huffman codes from their top bit down.
+	void Code(unsigned code, int length)
+	{
+		unsigned reversed = 0;
+		for (int i = 0; i < length; i++)
+			reversed |= ((code >> i) & 1) << (length - 1 - i);
+		Bits(reversed, length);
+	}
+	void Symbol(int symbol)
+	{
+		if (symbol < 144)
+			Code(0x30 + symbol, 8);
+		else if (symbol < 256)
+			Code(0x190 + symbol - 144, 9);
+		else if (symbol < 280)
+			Code(symbol - 256, 7);
+		else
+			Code(0xc0 + symbol - 280, 8);
+	}
+	void Match(int length, int distance)
+	{
+		int l = 28;
+		while (lengthBase[l] > length)
+			l--;
+		Symbol(257 + l);
+		Bits(length - lengthBase[l], lengthExtra[l]);
+		int d = 29;
+		while (distBase[d] > distance)
+			d--;
+		Code(d, 5);
+		Bits(distance - distBase[d], distExtra[d]);
+	}
+	void Deflate(const vector<unsigned char>& data)
+	{
+		const int hashBits = 15, window = 32768;
+		vector<int> head(1 << hashBits, -1), previous(data.size());
+		int size = (int)data.size();
+		Bits(1, 1); // Final block,
+		Bits(1, 2); // fixed codes.
+		for (int i = 0; i < size;)
+		{
+			int bestLength = 0, bestDistance = 0;
+			if (i + 3 <= size)
+			{
+				unsigned hash = ((data[i] << 16 | data[i + 1] << 8 | data[i + 2]) * 2654435761u) >> (32 - hashBits);
+				int limit = min(258, size - i);
+				for (int candidate = head[hash], tries = 0; candidate >= 0 && i - candidate <= window && tries < MATCH_CHAIN;
+					candidate = previous[candidate], tries++)
+				{
+					int length = 0;
+					while (length < limit && data[candidate + length] == data[i + length])
+						length++;
+					if (length > bestLength)
+					{
+						bestLength = length;
+						bestDistance = i - candidate;
+					}
+				}
+				previous[i] = head[hash];
+				head[hash] = i;
+			}
+			if (bestLength >= 3)
+			{
+				Match(bestLength, bestDistance);
+				// The positions inside the match go into the chains too.
+				for (int j = i + 1; j < i + bestLength && j + 3 <= size; j++)
+				{
+					unsigned hash = ((data[j] << 16 | data[j + 1] << 8 | data[j + 2]) * 2654435761u) >> (32 - hashBits);
+					previous[j] = head[hash];
+					head[hash] = j;
+				}
+				i += bestLength;
+			}
+			else
+				Symbol(data[i++]);
+		}
+		Symbol(256);
+		if (bitCount > 0)
+			Bits(0, 8 - bitCount);
+	}
+	void Word(unsigned w)
+	{
+		out.push_back((unsigned char)(w >> 24));
+		out.push_back((unsigned char)(w >> 16));
+		out.push_back((unsigned char)(w >> 8));
+		out.push_back((unsigned char)w);
+	}
+	// Length, type and data are already in out from start; adds the CRC.
+	void EndChunk(size_t start)
+	{
+		unsigned length = (unsigned)(out.size() - start - 8);
+		for (int i = 0; i < 4; i++)
+			out[start + i] = (unsigned char)(length >> (24 - i * 8));
+		unsigned crc = 0xffffffffu;
+		for (size_t i = start + 4; i < out.size(); i++)
+			crc = crcTable[(crc ^ out[i]) & 255] ^ (crc >> 8);
+		Word(crc ^ 0xffffffffu);
+	}
+	size_t BeginChunk(const char* type)
+	{
+		size_t start = out.size();
+		Word(0);
+		out.insert(out.end(), type, type + 4);
+		return start;
+	}
+	static int Paeth(int a, int b, int c)
+	{
+		int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+		return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+	}
+	// Row y with filter type 0-4, after its filter byte.
+	static void FilterRow(const unsigned char* pixels, int width, int channels, int y, int type, unsigned char* row)
+	{
+		int bytes = width * channels;
+		const unsigned char* cur = pixels + (size_t)y * bytes;
+		const unsigned char* prior = y > 0 ? cur - bytes : NULL;
+		for (int i = 0; i < bytes; i++)
+		{
+			int a = i >= channels ? cur[i - channels] : 0, b = prior ? prior[i] : 0, c = prior && i >= channels ? prior[i - channels] : 0;
+			int predicted = type == 1 ? a : type == 2 ? b : type == 3 ? (a + b) >> 1 : type == 4 ? Paeth(a, b, c) : 0;
+			row[i] = (unsigned char)(cur[i] - predicted);
+		}
+	}
+	// pixels is top row first. filter is 0-4 for every row, or
+	// FILTER_ADAPTIVE for the smallest sum of signed differences per row.
+	void Write(const unsigned char* pixels, int width, int height, int channels, int filter)
+	{
+		int bytes = width * channels;
+		vector<unsigned char> filtered((size_t)(bytes + 1) * height), row(bytes);
+		for (int y = 0; y < height; y++)
+		{
+			unsigned char* dst = &filtered[(size_t)y * (bytes + 1)];
+			int best = filter;
+			if (filter == FILTER_ADAPTIVE)
+			{
+				unsigned bestSum = ~0u;
+				for (int type = 0; type < 5; type++)
+				{
+					FilterRow(pixels, width, channels, y, type, &row[0]);
+					unsigned sum = 0;
+					for (int i = 0; i < bytes; i++)
+						sum += row[i] < 128 ? row[i] : 256 - row[i];
+					if (sum < bestSum)
+					{
+						bestSum = sum;
+						best = type;
+					}
+				}
+			}
+			dst[0] = (unsigned char)best;
+			FilterRow(pixels, width, channels, y, best, dst + 1);
+		}
+
+		const unsigned char signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+		out.assign(signature, signature + 8);
+		size_t chunk = BeginChunk("IHDR");
+		Word(width);
+		Word(height);
+		out.push_back(8);
+		out.push_back(channels == 4 ? 6 : 2);
+		out.push_back(0);
+		out.push_back(0);
+		out.push_back(0);
+		EndChunk(chunk);
+
+		chunk = BeginChunk("IDAT");
+		out.push_back(0x78);
+		out.push_back(0x01);
+		bitBuffer = 0;
+		bitCount = 0;
+		Deflate(filtered);
+		unsigned s1 = 1, s2 = 0;
+		for (size_t i = 0; i < filtered.size(); i++)
+		{
+			s1 = (s1 + filtered[i]) % 65521;
+			s2 = (s2 + s1) % 65521;
+		}
+		Word(s2 << 16 | s1);
+		EndChunk(chunk);
+
+		chunk = BeginChunk("IEND");
+		EndChunk(chunk);
+	}
+};
+
+// Smooth gradients and soft blobs with a little noise, roughly like a
+// photo; alpha is a slower pattern of its own.
+vector<unsigned char> makeImage(int size, int channels)
+{
+	vector<unsigned char> pixels((size_t)size * size * channels);
+	unsigned seed = 12345;
+	for (int y = 0; y < size; y++)
+		for (int x = 0; x < size; x++)
+		{
+			unsigned char* p = &pixels[((size_t)y * size + x) * channels];
+			for (int c = 0; c < channels; c++)
+			{
+				seed = seed * 1664525 + 1013904223;
+				int noise = (int)(seed >> 29) - 4;
+				int value = c == 3 ? (x / 16 + y / 16) % 2 * 128 + (x * 127) / size
+					: (x * (c + 1) * 255 / size + y * (3 - c) * 255 / size + ((x / 64) ^ (y / 64)) % 5 * 20) / 4 + noise;
+				p[c] = (unsigned char)min(255, max(0, value));
+			}
+		}
+	return pixels;
+}
+
+float elapsedMs(chrono::high_resolution_clock::time_point start)
+{
+	return chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+// Best of BENCH_RUNS, and whether the result is expected (if given).
+void bench(const string& name, const vector<unsigned char>& data, const unsigned char* expected)
+{
+	float bestMs = 1e9f;
+	int width = 0, height = 0, channels = 0;
+	bool match = true;
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		unsigned char* pixels = stbi_load_from_memory(&data[0], (int)data.size(), &width, &height, &channels, 0);
+		bestMs = min(bestMs, elapsedMs(start));
+		if (!pixels)
+		{
+			cout << name << ": " << stbi_failure_reason() << endl;
+			return;
+		}
+		if (run == 0 && expected)
+			match = memcmp(pixels, expected, (size_t)width * height * channels) == 0;
+		stbi_image_free(pixels);
+	}
+	float megabytes = (float)width * height * channels / (1024.0f * 1024.0f);
+	cout << name << ": " << width << "x" << height << "x" << channels << ", " << data.size() / 1024 << " KB, "
+		<< bestMs << " ms (" << megabytes / (bestMs / 1000.0f) << " MB/s)" << (match ? "" : "  PIXELS DIFFER") << endl;
+}
+
+int main(int argc, char** argv)
+{
+	int size = argc > 1 ? atoi(argv[1]) : 2048;
+	if (size < 1 || size > 16384)
+	{
+		cout << "Usage: PngBench [size] [file.png ...]" << endl;
+		return 1;
+	}
+	vector<string> files;
+	for (int i = 2; i < argc; i++)
+		files.push_back(argv[i]);
+	if (files.empty())
+	{
+		files.push_back("../FirstExample/grass.png");
+		files.push_back("../FirstExample/gizmo.png");
+	}
+
+	PngWriter writer;
+	for (unsigned i = 0; i < files.size(); i++)
+	{
+		vector<unsigned char> data;
+		FILE* f;
+#ifdef WIN32
+		if (fopen_s(&f, files[i].c_str(), "rb") != 0)
+			f = NULL;
+#else
+		f = fopen(files[i].c_str(), "rb");
+#endif
+		if (f)
+		{
+			fseek(f, 0, SEEK_END);
+			data.resize(ftell(f));
+			fseek(f, 0, SEEK_SET);
+			data.resize(fread(data.empty() ? NULL : &data[0], 1, data.size(), f));
+			fclose(f);
+		}
+		if (data.empty())
+		{
+			cout << "Unable to read " << files[i] << endl;
+			continue;
+		}
+		int width, height, channels;
+		unsigned char* pixels = stbi_load_from_memory(&data[0], (int)data.size(), &width, &height, &channels, 0);
+		bench(files[i], data, pixels);
+		if (!pixels)
+			continue;
+		if (channels >= 3)
+		{
+			writer.Write(pixels, width, height, channels, FILTER_ADAPTIVE);
+			bench(files[i] + " re-encoded", writer.out, pixels);
+		}
+		stbi_image_free(pixels);
+	}
+
+	const char* filterNames[6] = { "adaptive", "none", "sub", "up", "average", "paeth" };
+	for (int channels = 3; channels <= 4; channels++)
+	{
+		vector<unsigned char> pixels = makeImage(size, channels);
+		for (int filter = FILTER_ADAPTIVE; filter <= 4; filter++)
+		{
+			writer.Write(&pixels[0], size, size, channels, filter);
+			bench(string(channels == 4 ? "RGBA " : "RGB ") + filterNames[filter + 1], writer.out, &pixels[0]);
+		}
+	}
+	return 0;
+}
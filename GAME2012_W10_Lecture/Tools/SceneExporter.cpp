@@ -0,0 +1,375 @@
+//***************************************************************************
+// SceneExporter.cpp
+//
+// Turns the castle that FirstExample used to build in code into data. Every
+// Shape struct the castle uses is constructed once and written to
+// castle.mesh, a MeshPack the game maps and uploads in one go, and the
+// placements that used to be hard-coded in buildScene() are written to
+// castle.scene (see SceneDescription in Scene.h for the format). The game
+// only reads those two files, so objects can be added, moved or retextured
+// by editing castle.scene.
+//
+// Shapes that are another one resized or moved (the tower prisms, the
+// walls cut from the same box) are written once; their placements draw the
+// one that was kept, with the difference folded into scale and translation.
+// Meshes only ever drawn as triangles are put in vertex cache, overdraw and
+// fetch order first (see MeshOptimizer.h), and the cache statistics printed;
+// they also get angle weighted smooth normals (NormalGenerator.h). Lines get
+// normals pointing up.
+//
+// Usage: SceneExporter [-meshes] [-nodedup] [-noopt] [directory]   (default ../FirstExample)
+// -meshes writes only castle.mesh, keeping a castle.scene that has been
+// edited by hand. As that scene may name any of the meshes, it implies
+// -nodedup, which writes every mesh as built; the game still merges
+// duplicates when it uploads the pack. -noopt keeps the order the shapes
+// were built in.
+//***************************************************************************
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <map>
+#include <GL\glew.h>
+#include "Shape.h"
+#include "MeshPack.h"
+#include "MeshDedup.h"
+#include "MeshOptimizer.h"
+#include "NormalGenerator.h"
+using namespace std;
+
+#define X_AXIS glm::vec3(1,0,0)
+
+// Where one object goes. Shadows are off for anything that isn't triangles.
+struct Placement
+{
+	const char* mesh;
+	const char* texture;
+	GLenum mode;
+	bool castsShadow;
+	glm::vec3 scale, rotationAxis;
+	float rotationAngle;
+	glm::vec3 translation;
+};
+
+static const char* textureNames[] = { "brick", "blank", "grass", "hedge", "gate", "gatetower", "stone" };
+static const char* textureFiles[] = { "brick.jpg", "blank.jpg", "grass.png", "hedge.png", "gate.jpg", "gatetower.jpg", "stairs.jpg" };
+
+// The castle as buildScene() placed it, in the same order.
+static const Placement castle[] = {
+	{ "Grid", "grass", GL_LINE_STRIP, false, glm::vec3(1.0f, 1.0f, 1.0f), X_AXIS, -90.0f, glm::vec3(0.0f, 0.0f, 0.0f) }, // g_grid
+	{ "Plane", "grass", GL_TRIANGLES, false, glm::vec3(10.0f, 10.0f, 1.0f), X_AXIS, -90.0f, glm::vec3(0.0f, 0.0f, 0.0f) }, // g_plane
+	{ "LeftWall", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // LWall
+	{ "RightWall", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // RWall
+	{ "BackWall", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // BWall
+	{ "FrontWallR", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // FWallR
+	{ "FrontWallM", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // FWallM
+	{ "FrontWallL", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // FWallL
+	{ "FrontWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // FWP1
+	{ "FrontWallParapet2", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // FWP2
+	{ "FrontWallParapet3", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // FWP3
+	{ "FrontWallParapet4", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // FWP4
+	{ "FrontWallParapet5", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // FWP5
+	{ "LeftWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // LWP1
+	{ "LeftWallParapet2", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // LWP2
+	{ "LeftWallParapet3", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // LWP3
+	{ "LeftWallParapet4", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // LWP4
+	{ "LeftWallParapet5", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // LWP5
+	{ "BackWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // BWP1
+	{ "BackWallParapet2", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // BWP2
+	{ "BackWallParapet3", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // BWP3
+	{ "BackWallParapet4", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // BWP4
+	{ "BackWallParapet5", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // BWP5
+	{ "RightWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // RWP1
+	{ "RightWallParapet2", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // RWP2
+	{ "RightWallParapet3", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // RWP3
+	{ "RightWallParapet4", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // RWP4
+	{ "RightWallParapet5", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // RWP5
+	{ "Gate", "gate", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // gate
+	{ "Gate", "gate", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -4.4f) }, // gate1
+	{ "Gate", "gate", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -2.5f) }, // gate2
+	{ "OHedgeMazeF", "hedge", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // OHMF
+	{ "OHedgeMazeR", "hedge", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // OHMR
+	{ "OHedgeMazeL", "hedge", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // OHML
+	{ "OHedgeMazeB", "hedge", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // OHMB
+	{ "IHedgeMaze1", "hedge", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // IHM1
+	{ "IHedgeMaze2", "hedge", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // IHM2
+	{ "IHedgeMaze3", "hedge", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // IHM3
+	{ "IHedgeMaze4", "hedge", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // IHM4
+	{ "IHedgeMaze5", "hedge", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // IHM5
+	{ "MidMazeSquare", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.5f, 0.0f, -3.5f) }, // MMS
+	{ "TowerPrism", "brick", GL_TRIANGLES, true, glm::vec3(1.0f, 2.5f, 1.0f), X_AXIS, 0.0f, glm::vec3(9.7f, 0.0f, -10.9f) }, // BRP
+	{ "TowerPrism", "brick", GL_TRIANGLES, true, glm::vec3(1.0f, 2.5f, 1.0f), X_AXIS, 0.0f, glm::vec3(9.7f, 0.0f, -0.2f) }, // FRP
+	{ "TowerPrism", "brick", GL_TRIANGLES, true, glm::vec3(1.0f, 2.5f, 1.0f), X_AXIS, 0.0f, glm::vec3(-0.8f, 0.0f, -0.2f) }, // FLP
+	{ "TowerPrism", "brick", GL_TRIANGLES, true, glm::vec3(1.0f, 2.5f, 1.0f), X_AXIS, 0.0f, glm::vec3(-0.8f, 0.0f, -10.9f) }, // BLP
+	{ "TowerCone", "blank", GL_TRIANGLES, true, glm::vec3(1.5f, 1.0f, 1.5f), X_AXIS, 0.0f, glm::vec3(9.45f, 2.5f, -11.15f) }, // BRC
+	{ "TowerCone", "blank", GL_TRIANGLES, true, glm::vec3(1.5f, 1.0f, 1.5f), X_AXIS, 0.0f, glm::vec3(9.45f, 2.5f, -0.45f) }, // FRC
+	{ "TowerCone", "blank", GL_TRIANGLES, true, glm::vec3(1.5f, 1.0f, 1.5f), X_AXIS, 0.0f, glm::vec3(-1.05f, 2.5f, -11.15f) }, // BLC
+	{ "TowerCone", "blank", GL_TRIANGLES, true, glm::vec3(1.5f, 1.0f, 1.5f), X_AXIS, 0.0f, glm::vec3(-1.05f, 2.5f, -0.45f) }, // FLC
+	{ "GateTower", "brick", GL_TRIANGLES, true, glm::vec3(1.0f, 3.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(5.5f, 0.0f, -1.0f) }, // RGT
+	{ "GateTower", "brick", GL_TRIANGLES, true, glm::vec3(1.0f, 3.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(3.5f, 0.0f, -1.0f) }, // LGT
+	{ "GateTower", "brick", GL_TRIANGLES, true, glm::vec3(1.0f, 1.6f, 2.0f), X_AXIS, 0.0f, glm::vec3(4.5f, 1.4f, -1.0f) }, // MGT
+	{ "FrontWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(4.0f, 1.0f, -2.5f) }, // GHP1
+	{ "FrontWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(3.0f, 1.0f, -2.5f) }, // GHP2
+	{ "FrontWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(5.0f, 1.0f, -2.5f) }, // GHP3
+	{ "RightWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(2.0f, 2.0f, 1.0f), X_AXIS, 0.0f, glm::vec3(3.5f, 1.0f, -2.0f) }, // GHP4
+	{ "RightWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(2.0f, 2.0f, 1.0f), X_AXIS, 0.0f, glm::vec3(3.5f, 1.0f, -1.0f) }, // GHP5
+	{ "RightWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(2.0f, 2.0f, 1.0f), X_AXIS, 0.0f, glm::vec3(0.6f, 1.0f, -1.6f) }, // GHP6
+	{ "RightWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(2.0f, 2.0f, 1.0f), X_AXIS, 0.0f, glm::vec3(0.6f, 1.0f, -0.6f) }, // GHP7
+	{ "FrontWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.8f, 1.0f, -4.4f) }, // GHP8
+	{ "FrontWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(3.8f, 1.0f, -4.4f) }, // GHP9
+	{ "FrontWallParapet1", "brick", GL_TRIANGLES, true, glm::vec3(2.5f, 2.0f, 2.0f), X_AXIS, 0.0f, glm::vec3(4.8f, 1.0f, -4.4f) }, // GHP10
+	{ "MidMazeSquare", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 0.5f, 2.0f), X_AXIS, 0.0f, glm::vec3(2.27f, 0.0f, 1.0f) }, // S1
+	{ "MidMazeSquare", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 0.5f, 1.5f), X_AXIS, 0.0f, glm::vec3(2.27f, 0.01f, 0.5f) }, // S2
+	{ "MidMazeSquare", "brick", GL_TRIANGLES, true, glm::vec3(5.0f, 0.5f, 1.0f), X_AXIS, 0.0f, glm::vec3(2.27f, 0.02f, 0.0f) }, // S3
+	{ "StoneSteps", "stone", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 5.0f), X_AXIS, 0.0f, glm::vec3(2.5f, -2.5f, -7.5f) }, // SS4
+	{ "StoneSteps", "stone", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 5.0f), X_AXIS, 0.0f, glm::vec3(2.5f, -2.5f, -7.25f) }, // SS5
+	{ "StoneSteps", "stone", GL_TRIANGLES, true, glm::vec3(5.0f, 2.0f, 5.0f), X_AXIS, 0.0f, glm::vec3(2.5f, -2.5f, -7.0f) }, // SS1
+	{ "StoneSteps", "stone", GL_TRIANGLES, true, glm::vec3(5.0f, 1.0f, 5.0f), X_AXIS, 0.0f, glm::vec3(2.5f, -1.5f, -6.75f) }, // SS3
+	{ "StoneSteps", "stone", GL_TRIANGLES, true, glm::vec3(5.0f, 0.5f, 5.0f), X_AXIS, 0.0f, glm::vec3(2.5f, -1.0f, -6.5f) }, // SS2
+};
+
+bool optimizeMeshes = true;
+VertexCacheStats statsBefore, statsAfter;
+
+// Lines and strips draw in index order, so only these can be reordered.
+bool DrawnAsTriangles(const char* name)
+{
+	bool placed = false;
+	for (unsigned i = 0; i < sizeof(castle) / sizeof(castle[0]); i++)
+		if (strcmp(castle[i].mesh, name) == 0)
+		{
+			if (castle[i].mode != GL_TRIANGLES)
+				return false;
+			placed = true;
+		}
+	return placed;
+}
+
+// Most shapes were tinted the castle's sandstone colour before being placed.
+template <class T> void AddShape(MeshPackBuilder& pack, const char* name, T shape, bool sandstone)
+{
+	if (sandstone)
+		shape.ColorShape(1.0f, 0.9f, 0.65f);
+	bool triangles = DrawnAsTriangles(name);
+	if (optimizeMeshes && triangles)
+	{
+		VertexCacheStats before = vertexCacheStats(shape);
+		if (optimizeShape(shape))
+		{
+			VertexCacheStats after = vertexCacheStats(shape);
+			statsBefore.Add(before);
+			statsAfter.Add(after);
+			if (after.Acmr() < before.Acmr())
+				cout << "  " << name << ": ACMR " << before.Acmr() << " -> " << after.Acmr() << ", ATVR " << before.Atvr() << " -> " << after.Atvr() << endl;
+		}
+	}
+	if (triangles)
+		shape.CalcNormals(NORMALS_BY_ANGLE);
+	else
+		shape.shape_normals.clear();
+	if (!pack.Add(name, shape.shape_indices, shape.shape_vertices, shape.shape_colors, shape.shape_uvs, shape.shape_normals))
+		cout << "Unable to add " << name << "!" << endl;
+}
+
+void BuildMeshes(MeshPackBuilder& pack)
+{
+	AddShape(pack, "Grid", GridLines(10), false);
+	AddShape(pack, "Plane", Plane(), false);
+	AddShape(pack, "LeftWall", LeftWall(), true);
+	AddShape(pack, "RightWall", RightWall(), true);
+	AddShape(pack, "BackWall", BackWall(), true);
+	AddShape(pack, "FrontWallR", FrontWallR(), true);
+	AddShape(pack, "FrontWallM", FrontWallM(), true);
+	AddShape(pack, "FrontWallL", FrontWallL(), true);
+	AddShape(pack, "FrontWallParapet1", FrontWallParapet1(), true);
+	AddShape(pack, "FrontWallParapet2", FrontWallParapet2(), true);
+	AddShape(pack, "FrontWallParapet3", FrontWallParapet3(), true);
+	AddShape(pack, "FrontWallParapet4", FrontWallParapet4(), true);
+	AddShape(pack, "FrontWallParapet5", FrontWallParapet5(), true);
+	AddShape(pack, "LeftWallParapet1", LeftWallParapet1(), true);
+	AddShape(pack, "LeftWallParapet2", LeftWallParapet2(), true);
+	AddShape(pack, "LeftWallParapet3", LeftWallParapet3(), true);
+	AddShape(pack, "LeftWallParapet4", LeftWallParapet4(), true);
+	AddShape(pack, "LeftWallParapet5", LeftWallParapet5(), true);
+	AddShape(pack, "BackWallParapet1", BackWallParapet1(), true);
+	AddShape(pack, "BackWallParapet2", BackWallParapet2(), true);
+	AddShape(pack, "BackWallParapet3", BackWallParapet3(), true);
+	AddShape(pack, "BackWallParapet4", BackWallParapet4(), true);
+	AddShape(pack, "BackWallParapet5", BackWallParapet5(), true);
+	AddShape(pack, "RightWallParapet1", RightWallParapet1(), true);
+	AddShape(pack, "RightWallParapet2", RightWallParapet2(), true);
+	AddShape(pack, "RightWallParapet3", RightWallParapet3(), true);
+	AddShape(pack, "RightWallParapet4", RightWallParapet4(), true);
+	AddShape(pack, "RightWallParapet5", RightWallParapet5(), true);
+	AddShape(pack, "Gate", Gate(), true);
+	AddShape(pack, "OHedgeMazeF", OHedgeMazeF(), true);
+	AddShape(pack, "OHedgeMazeR", OHedgeMazeR(), true);
+	AddShape(pack, "OHedgeMazeL", OHedgeMazeL(), true);
+	AddShape(pack, "OHedgeMazeB", OHedgeMazeB(), true);
+	AddShape(pack, "IHedgeMaze1", IHedgeMaze1(), true);
+	AddShape(pack, "IHedgeMaze2", IHedgeMaze2(), true);
+	AddShape(pack, "IHedgeMaze3", IHedgeMaze3(), true);
+	AddShape(pack, "IHedgeMaze4", IHedgeMaze4(), true);
+	AddShape(pack, "IHedgeMaze5", IHedgeMaze5(), true);
+	AddShape(pack, "MidMazeSquare", MidMazeSquare(), true);
+	AddShape(pack, "TowerPrism", TowerPrism(12), false);
+	AddShape(pack, "TowerCone", TowerCone(12), false);
+	AddShape(pack, "GateTower", GateTower(), true);
+	AddShape(pack, "StoneSteps", StoneSteps(), true);
+}
+
+// What a mesh name in the placement table is drawn with after deduplication.
+struct Merged
+{
+	string mesh;		// The mesh kept in its place, possibly itself.
+	glm::mat4 relative; // Scale and offset from that mesh to this one.
+};
+
+// Rebuilds the pack with only the first mesh of each kind.
+void Deduplicate(MeshPackBuilder& pack, map<string, Merged>& merged)
+{
+	MeshDeduplicator dedup;
+	for (unsigned i = 0; i < pack.meshes.size(); i++)
+	{
+		const MeshPackEntry& m = pack.meshes[i];
+		MeshView v = { &pack.positions[m.baseVertex * 3], &pack.colors[m.baseVertex * 3], &pack.uvs[m.baseVertex * 2], &pack.normals[m.baseVertex * 3],
+			m.vertexCount,
+			(const unsigned char*)&pack.indices[m.firstIndex], sizeof(GLuint), m.indexCount };
+		dedup.Add(v);
+	}
+	MeshPackBuilder unique;
+	for (unsigned i = 0; i < pack.meshes.size(); i++)
+	{
+		const MeshPackEntry& m = pack.meshes[i];
+		Merged& into = merged[m.name];
+		into.mesh = pack.meshes[dedup.representative[i]].name;
+		into.relative = dedup.Relative(i);
+		if (dedup.representative[i] != (int)i)
+			continue;
+		vector<GLuint> indices(pack.indices.begin() + m.firstIndex, pack.indices.begin() + m.firstIndex + m.indexCount);
+		vector<GLfloat> positions(pack.positions.begin() + m.baseVertex * 3, pack.positions.begin() + (m.baseVertex + m.vertexCount) * 3);
+		vector<GLfloat> colors(pack.colors.begin() + m.baseVertex * 3, pack.colors.begin() + (m.baseVertex + m.vertexCount) * 3);
+		vector<GLfloat> uvs(pack.uvs.begin() + m.baseVertex * 2, pack.uvs.begin() + (m.baseVertex + m.vertexCount) * 2);
+		vector<GLfloat> normals(pack.normals.begin() + m.baseVertex * 3, pack.normals.begin() + (m.baseVertex + m.vertexCount) * 3);
+		unique.Add(m.name, indices, positions, colors, uvs, normals);
+	}
+	pack = unique;
+}
+
+// Moves the relative scale and offset of a merged mesh into its placement:
+// translate(t) * rotate(r) * scale(s) * translate(o) * scale(d) is
+// translate(t + r(s * o)) * rotate(r) * scale(s * d).
+Placement Remapped(const Placement& p, const Merged& into)
+{
+	Placement q = p;
+	q.mesh = into.mesh.c_str();
+	glm::vec3 offset(into.relative[3]), scale(into.relative[0][0], into.relative[1][1], into.relative[2][2]);
+	glm::mat4 model = glm::translate(glm::mat4(1.0f), p.translation);
+	model = glm::rotate(model, glm::radians(p.rotationAngle), p.rotationAxis);
+	model = glm::scale(model, p.scale);
+	q.translation = glm::vec3(model * glm::vec4(offset, 1.0f));
+	q.scale = p.scale * scale;
+	return q;
+}
+
+const char* ModeName(GLenum mode)
+{
+	return mode == GL_TRIANGLES ? "triangles" : mode == GL_LINES ? "lines" : "line_strip";
+}
+
+bool WriteScene(const string& path, map<string, Merged>& merged)
+{
+	ofstream out(path.c_str());
+	out << "# FirstExample castle, written by SceneExporter." << endl;
+	out << "# object <mesh> <texture> <mode> <shadow|noshadow> <scale xyz> <rotation axis xyz> <degrees> <translation xyz>" << endl;
+	out << "meshes castle.mesh" << endl << endl;
+	for (unsigned i = 0; i < sizeof(textureNames) / sizeof(textureNames[0]); i++)
+		out << "texture " << textureNames[i] << " " << textureFiles[i] << endl;
+	out << endl;
+	for (unsigned i = 0; i < sizeof(castle) / sizeof(castle[0]); i++)
+	{
+		Placement p = merged.count(castle[i].mesh) ? Remapped(castle[i], merged[castle[i].mesh]) : castle[i];
+		out << "object " << p.mesh << " " << p.texture << " " << ModeName(p.mode) << " " << (p.castsShadow ? "shadow" : "noshadow")
+			<< "  " << p.scale.x << " " << p.scale.y << " " << p.scale.z
+			<< "  " << p.rotationAxis.x << " " << p.rotationAxis.y << " " << p.rotationAxis.z << " " << p.rotationAngle
+			<< "  " << p.translation.x << " " << p.translation.y << " " << p.translation.z << endl;
+	}
+	return out.good();
+}
+
+int main(int argc, char** argv)
+{
+	bool meshesOnly = false, dedup = true;
+	string directory = "../FirstExample";
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-meshes") == 0)
+		{
+			meshesOnly = true;
+			dedup = false;
+		}
+		else if (strcmp(argv[i], "-nodedup") == 0)
+			dedup = false;
+		else if (strcmp(argv[i], "-noopt") == 0)
+			optimizeMeshes = false;
+		else if (argv[i][0] == '-')
+		{
+			cout << "Usage: SceneExporter [-meshes] [-nodedup] [-noopt] [directory]" << endl;
+			return 1;
+		}
+		else
+			directory = argv[i];
+	}
+
+	MeshPackBuilder pack;
+	BuildMeshes(pack);
+	if (statsBefore.triangles)
+		cout << "Vertex cache (" << VCACHE_SIZE << " entry FIFO) over " << statsBefore.triangles << " triangles: ACMR " << statsBefore.Acmr()
+			<< " -> " << statsAfter.Acmr() << ", ATVR " << statsBefore.Atvr() << " -> " << statsAfter.Atvr() << endl;
+	map<string, Merged> merged;
+	size_t built = pack.meshes.size();
+	if (dedup)
+		Deduplicate(pack, merged);
+	string meshFile = directory + "/castle.mesh", sceneFile = directory + "/castle.scene";
+	if (!pack.Write(meshFile.c_str()))
+	{
+		cout << "Unable to write " << meshFile << "!" << endl;
+		return 1;
+	}
+	cout << meshFile << ": " << pack.meshes.size() << " meshes, " << pack.positions.size() / 3 << " vertices, "
+		<< pack.indices.size() << " indices";
+	if (pack.meshes.size() < built)
+		cout << " (" << built - pack.meshes.size() << " duplicates merged)";
+	cout << endl;
+
+	// The grid's strips have to come back as restarts at the width the pack chose.
+	MeshPack written;
+	const MeshPackEntry* grid = written.Open(meshFile.c_str()) ? written.Find("Grid") : NULL;
+	unsigned restarts = 0, expected = 0;
+	GridLines lines(10);
+	for (unsigned k = 0; k < lines.shape_indices.size(); k++)
+		expected += lines.shape_indices[k] == RESTART_INDEX;
+	if (grid)
+	{
+		MeshView v = written.View(written.Index(*grid));
+		for (unsigned k = 0; k < v.indexCount; k++)
+			restarts += v.Index(k) == (v.indexBytes == 2 ? 0xFFFFu : RESTART_INDEX);
+	}
+	if (restarts != expected)
+	{
+		cout << meshFile << ": the grid has " << restarts << " restarts, expected " << expected << "!" << endl;
+		return 1;
+	}
+	cout << "Grid: " << expected + 1 << " line strips, restarts intact at " << written.header->indexBytes * 8 << " bits" << endl;
+	if (meshesOnly)
+		return 0;
+	if (!WriteScene(sceneFile, merged))
+	{
+		cout << "Unable to write " << sceneFile << "!" << endl;
+		return 1;
+	}
+	cout << sceneFile << ": " << sizeof(castle) / sizeof(castle[0]) << " objects" << endl;
+	return 0;
+}
@@ -0,0 +1,201 @@
+//***************************************************************************
+// TargaBench.cpp
+//
+// Times vtarga::open_targa (lib/targa.cpp) against stb_image's TGA loader on
+// large generated images: 24 and 32 bit colour and 16 bit grey and alpha, raw
+// and RLE, bottom up and top down.
+// Both sides get the image in OpenGL row order and then read every byte, so
+// page faults from the memory mapped path are counted too. Each result is
+// also checked against the other loader's pixels.
+//
+// Usage: TargaBench [size]   (default 4096, images are size x size)
+// The .tga files are written to the working directory and deleted after.
+//***************************************************************************
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "targa.h"
+using namespace std;
+
+#define BENCH_RUNS 5
+
+// Blocks of flat colour with noisy stripes between them, so RLE has both
+// long runs and raw packets to deal with.
+vector<unsigned char> makeImage(int size, int channels)
+{
+	vector<unsigned char> pixels((size_t)size * size * channels);
+	unsigned seed = 12345;
+	for (int y = 0; y < size; y++)
+		for (int x = 0; x < size; x++)
+		{
+			unsigned char* p = &pixels[((size_t)y * size + x) * channels];
+			bool noisy = (y / 64 + x / 96) % 3 == 0;
+			for (int c = 0; c < channels; c++)
+			{
+				seed = seed * 1664525 + 1013904223;
+				p[c] = noisy ? (unsigned char)(seed >> 24) : (unsigned char)((x / 96 * 37 + y / 64 * 91 + c * 50) & 255);
+			}
+		}
+	return pixels;
+}
+
+// pixels is bottom up, like GL; topDown writes it the other way round in the file.
+// Two channels are grey and alpha, anything else BGR(A).
+bool writeTarga(const string& file, const vector<unsigned char>& pixels, int size, int channels, bool rle, bool topDown)
+{
+	FILE* f;
+#ifdef WIN32
+	if (fopen_s(&f, file.c_str(), "wb") != 0)
+		return false;
+#else
+	f = fopen(file.c_str(), "wb");
+	if (!f)
+		return false;
+#endif
+	unsigned char header[18] = { 0 };
+	header[2] = (unsigned char)((channels == 2 ? 3 : 2) | (rle ? 0x08 : 0));
+	header[12] = size & 255;
+	header[13] = size >> 8;
+	header[14] = size & 255;
+	header[15] = size >> 8;
+	header[16] = (unsigned char)(channels * 8);
+	header[17] = (unsigned char)((channels == 4 || channels == 2 ? 8 : 0) | (topDown ? 0x20 : 0));
+	fwrite(header, 1, sizeof(header), f);
+
+	vector<unsigned char> row;
+	for (int i = 0; i < size; i++)
+	{
+		const unsigned char* src = &pixels[(size_t)(topDown ? size - 1 - i : i) * size * channels];
+		if (!rle)
+		{
+			fwrite(src, channels, size, f);
+			continue;
+		}
+		// Packets stay within a row, as the format asks writers to do.
+		row.clear();
+		for (int x = 0; x < size;)
+		{
+			int run = 1;
+			while (x + run < size && run < 128 && memcmp(src + (x + run) * channels, src + x * channels, channels) == 0)
+				run++;
+			if (run > 1)
+			{
+				row.push_back((unsigned char)(0x80 | (run - 1)));
+				row.insert(row.end(), src + x * channels, src + (x + 1) * channels);
+				x += run;
+				continue;
+			}
+			int raw = 1;
+			while (x + raw < size && raw < 128 &&
+				(x + raw + 1 >= size || memcmp(src + (x + raw) * channels, src + (x + raw + 1) * channels, channels) != 0))
+				raw++;
+			row.push_back((unsigned char)(raw - 1));
+			row.insert(row.end(), src + x * channels, src + (x + raw) * channels);
+			x += raw;
+		}
+		fwrite(&row[0], 1, row.size(), f);
+	}
+	fclose(f);
+	return true;
+}
+
+// Touches every cache line of the result, so a mapped file is actually read.
+volatile unsigned checksumSink;
+void checksum(const unsigned char* data, size_t bytes)
+{
+	unsigned sum = 0;
+	for (size_t i = 0; i < bytes; i += 64)
+		sum += data[i];
+	checksumSink += sum + data[bytes - 1];
+}
+
+float elapsedMs(chrono::high_resolution_clock::time_point start)
+{
+	return chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+void bench(int size, int channels, bool rle, bool topDown)
+{
+	vector<unsigned char> pixels = makeImage(size, channels);
+	string file = "bench.tga";
+	if (!writeTarga(file, pixels, size, channels, rle, topDown))
+	{
+		cout << "Unable to write " << file << endl;
+		return;
+	}
+	size_t bytes = pixels.size();
+
+	float vtargaMs = 1e9f, stbMs = 1e9f;
+	bool zeroCopy = false, match = true;
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		vtarga::targa_image image;
+		if (!vtarga::open_targa(file.c_str(), image))
+		{
+			cout << "vtarga failed on " << file << endl;
+			return;
+		}
+		checksum(image.pixels, bytes);
+		vtargaMs = min(vtargaMs, elapsedMs(start));
+		zeroCopy = image.mapped;
+
+		start = chrono::high_resolution_clock::now();
+		int w, h, n;
+		unsigned char* stb = stbi_load(file.c_str(), &w, &h, &n, 0);
+		if (!stb)
+		{
+			cout << "stb_image failed on " << file << " (" << stbi_failure_reason() << ")" << endl;
+			vtarga::close_targa(image);
+			return;
+		}
+		checksum(stb, bytes);
+		stbMs = min(stbMs, elapsedMs(start));
+
+		// stb_image swizzles to RGB(A); vtarga leaves BGR(A) for GL to read.
+		// Grey and alpha are in the same order for both, and must come back as GL_RG, not 1555 colour.
+		if (run == 0 && channels == 2)
+			match = image.format == GL_RG && memcmp(image.pixels, stb, bytes) == 0 && memcmp(image.pixels, &pixels[0], bytes) == 0;
+		else if (run == 0)
+			for (size_t i = 0; i < bytes && match; i += channels)
+				match = image.pixels[i] == stb[i + 2] && image.pixels[i + 1] == stb[i + 1] && image.pixels[i + 2] == stb[i] &&
+					(channels == 3 || image.pixels[i + 3] == stb[i + 3]) && image.pixels[i] == pixels[i];
+		stbi_image_free(stb);
+		vtarga::close_targa(image);
+	}
+	remove(file.c_str());
+
+	float megabytes = bytes / (1024.0f * 1024.0f);
+	cout << size << "x" << size << "x" << channels << (rle ? " RLE" : " raw") << (topDown ? " top down " : " bottom up")
+		<< ": vtarga " << vtargaMs << " ms (" << megabytes / (vtargaMs / 1000.0f) << " MB/s" << (zeroCopy ? ", mapped" : "")
+		<< "), stb_image " << stbMs << " ms (" << megabytes / (stbMs / 1000.0f) << " MB/s), "
+		<< stbMs / vtargaMs << "x" << (match ? "" : "  PIXELS DIFFER") << endl;
+}
+
+int main(int argc, char** argv)
+{
+	int size = argc > 1 ? atoi(argv[1]) : 4096;
+	if (size < 1 || size > 65535)
+	{
+		cout << "Usage: TargaBench [size]" << endl;
+		return 1;
+	}
+
+	// GL row order for stb_image too, so both loaders do the same job.
+	stbi_set_flip_vertically_on_load(true);
+	for (int channels = 3; channels <= 4; channels++)
+		for (int rle = 0; rle < 2; rle++)
+			for (int topDown = 0; topDown < 2; topDown++)
+				bench(size, channels, rle != 0, topDown != 0);
+	for (int rle = 0; rle < 2; rle++)
+		bench(size, 2, rle != 0, false);
+	return 0;
+}
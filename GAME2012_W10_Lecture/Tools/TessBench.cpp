@@ -0,0 +1,155 @@
+//***************************************************************************
+// TessBench.cpp
+//
+// Times the CPU backend of PatchTessellator.h in triangles per second:
+// a square of teapots (Teapot.h's Bezier patches) seen from near, middle
+// and far, so the levels run from fine to coarse, tessellated with scalar
+// evaluation and with SSE. The SSE points are checked against the scalar
+// ones, and the mesh for cracks: a side of a triangle with no twin running
+// the other way is open, which the teapot has where its pieces meet, but
+// an open end within a hair of some other vertex means two patches put an
+// edge point in different places. The GPU backend is timed in the game
+// ('j' with -teapots on the command line).
+//
+// Usage: TessBench [teapots]   (default 100)
+// Nothing is written to disk.
+//***************************************************************************
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <GL\glew.h>
+#include "Shapes\Teapot.h"
+#include "PatchTessellator.h"
+#include "glm\gtc\matrix_transform.hpp"
+using namespace std;
+
+#define BENCH_RUNS 5
+#define CRACK_DISTANCE 1e-4f // Closer than this but not equal is a crack.
+
+float elapsedMs(chrono::high_resolution_clock::time_point start)
+{
+	return chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+}
+
+glm::vec3 Position(const PatchVertex& v) { return glm::vec3(v.position[0], v.position[1], v.position[2]); }
+
+// Open ends that nearly meet another vertex. Vertices are bucketed by
+// CRACK_DISTANCE cells, so only neighbouring cells are searched.
+unsigned CountCracks(const vector<PatchVertex>& vertices, const vector<GLuint>& indices, unsigned& openSides)
+{
+	typedef vector<float> Key;
+	map<pair<Key, Key>, int> sides;
+	for (unsigned i = 0; i < indices.size(); i += 3)
+		for (int k = 0; k < 3; k++)
+		{
+			glm::vec3 a = Position(vertices[indices[i + k]]), b = Position(vertices[indices[i + (k + 1) % 3]]);
+			sides[make_pair(Key({ a.x, a.y, a.z }), Key({ b.x, b.y, b.z }))]++;
+		}
+	map<vector<int>, vector<glm::vec3> > cells;
+	for (unsigned i = 0; i < vertices.size(); i++)
+	{
+		glm::vec3 p = Position(vertices[i]);
+		cells[{ (int)floor(p.x / CRACK_DISTANCE), (int)floor(p.y / CRACK_DISTANCE), (int)floor(p.z / CRACK_DISTANCE) }].push_back(p);
+	}
+	unsigned cracks = 0;
+	openSides = 0;
+	for (map<pair<Key, Key>, int>::iterator it = sides.begin(); it != sides.end(); ++it)
+	{
+		if (sides.count(make_pair(it->first.second, it->first.first)))
+			continue;
+		openSides++;
+		glm::vec3 e(it->first.first[0], it->first.first[1], it->first.first[2]);
+		int cx = (int)floor(e.x / CRACK_DISTANCE), cy = (int)floor(e.y / CRACK_DISTANCE), cz = (int)floor(e.z / CRACK_DISTANCE);
+		bool found = false;
+		for (int x = cx - 1; x <= cx + 1 && !found; x++)
+			for (int y = cy - 1; y <= cy + 1 && !found; y++)
+				for (int z = cz - 1; z <= cz + 1 && !found; z++)
+				{
+					map<vector<int>, vector<glm::vec3> >::iterator cell = cells.find({ x, y, z });
+					if (cell == cells.end())
+						continue;
+					for (unsigned v = 0; v < cell->second.size() && !found; v++)
+					{
+						float d = glm::length(cell->second[v] - e);
+						found = d > 0.0f && d < CRACK_DISTANCE;
+					}
+				}
+		if (found)
+			cracks++;
+	}
+	return cracks;
+}
+
+// Best of BENCH_RUNS, as triangles per second; the first run fills the pattern cache.
+double Time(PatchTessellator& t, glm::vec3 eye, const glm::mat4& viewProjection, float pixelScale)
+{
+	float best = 0.0f;
+	unsigned triangles = 0;
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+		triangles = t.Tessellate(eye, viewProjection, pixelScale);
+		float ms = elapsedMs(start);
+		if (run == 0 || ms < best)
+			best = ms;
+	}
+	return triangles / (best / 1000.0);
+}
+
+int main(int argc, char** argv)
+{
+	int count = 100;
+	if (argc > 2 || (argc == 2 && atoi(argv[1]) <= 0))
+	{
+		cout << "Usage: TessBench [teapots]" << endl;
+		return 1;
+	}
+	if (argc == 2)
+		count = atoi(argv[1]);
+
+	// Laid out like placeTeapots() in the game.
+	PatchTessellator t;
+	loadBezierPatches(TeapotVertices, TeapotIndices, NumTeapotPatches, t.patches);
+	int side = (int)ceil(sqrt((float)count));
+	for (int i = 0; i < count; i++)
+	{
+		glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(2.0f * (i % side), 0.0f, -2.0f * (i / side)));
+		model = glm::rotate(model, glm::radians(37.0f * i), glm::vec3(0.0f, 1.0f, 0.0f));
+		t.instances.push_back(glm::scale(model, glm::vec3(0.25f)));
+	}
+	glm::vec3 centre(side - 1.0f, 0.4f, 1.0f - side);
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 1000.0f);
+	float pixelScale = 1024 / (2.0f * tan(glm::radians(45.0f) * 0.5f)); // The game's 1024 pixel high window.
+	cout << count << " teapots of " << t.patches.size() << " patches, " << PATCH_PIXELS_PER_EDGE << " pixels per edge" << endl;
+
+	const char* names[] = { "Near", "Middle", "Far" };
+	float distances[] = { 0.5f, 2.0f, 8.0f }; // Times the square's width.
+	for (int d = 0; d < 3; d++)
+	{
+		glm::vec3 eye = centre + glm::vec3(0.0f, 0.5f, 1.0f) * (distances[d] * 2.0f * side);
+		glm::mat4 viewProjection = projection * glm::lookAt(eye, centre, glm::vec3(0.0f, 1.0f, 0.0f));
+
+		t.simd = false;
+		double scalar = Time(t, eye, viewProjection, pixelScale);
+		vector<PatchVertex> reference = t.vertices;
+		t.simd = true;
+		double simd = Time(t, eye, viewProjection, pixelScale);
+		float worst = 0.0f;
+		for (unsigned i = 0; i < reference.size(); i++)
+			worst = max(worst, glm::length(Position(reference[i]) - Position(t.vertices[i])));
+		unsigned openSides = 0, cracks = CountCracks(t.vertices, t.indices, openSides);
+
+		cout << names[d] << ": " << t.patchesDrawn << " patches on screen, " << t.cpuTriangles << " triangles, "
+			<< t.patterns.size() << " patterns; scalar " << scalar / 1e6 << " M triangles/s";
+#ifdef PATCH_SSE2
+		cout << ", SSE " << simd / 1e6 << " M triangles/s, max difference " << worst;
+#endif
+		cout << "; " << openSides << " open sides, " << cracks << " cracks" << endl;
+	}
+	return 0;
+}
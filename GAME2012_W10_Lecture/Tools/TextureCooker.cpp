@@ -0,0 +1,201 @@
+//***************************************************************************
+// TextureCooker.cpp
+//
+// Offline converter from the JPG/PNG assets to DDS files that the game can
+// upload without decoding: the full mip chain is built here and every level
+// is block compressed (BC1 for opaque colour, BC3 with alpha, BC4 or BC5 on
+// request for one or two channel data such as masks and normal maps). Mips
+// are filtered in linear light unless -linear says the data isn't colour;
+// BC4 and BC5 imply -linear. -hq swaps the fast encoder for a cluster fit.
+//
+// Usage: TextureCooker [-bc1|-bc3|-bc4|-bc5] [-fast|-hq] [-box|-kaiser] [-linear] [-bench] [file...]
+// Each file.ext is written next to itself as file.dds. With no files the
+// textures used by FirstExample are cooked. -bench only times mip generation
+// and both encoders.
+//***************************************************************************
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include "gli\gli.hpp"
+#include "gli\gtx\loader.hpp"
+#include "gli\gtx\compression.hpp"
+using namespace std;
+
+// castle.scene also names hedge.png, which isn't in the repository.
+static const char* defaultFiles[] = { "../FirstExample/brick.jpg", "../FirstExample/blank.jpg",
+	"../FirstExample/grass.png", "../FirstExample/gate.jpg", "../FirstExample/gatetower.jpg",
+	"../FirstExample/stairs.jpg" };
+
+// Names the output the same way the game looks it up.
+string cookedName(const string& file)
+{
+	return file.substr(0, file.rfind('.')) + ".dds";
+}
+
+const char* formatName(gli::format format)
+{
+	return format == gli::DXT1 ? "BC1" : format == gli::DXT5 ? "BC3" : format == gli::ATI1N_UNORM ? "BC4" : "BC5";
+}
+
+// BC3 only if the image actually uses its alpha channel.
+gli::format pickFormat(const unsigned char* pixels, int width, int height, int channels)
+{
+	if (channels == 4)
+		for (size_t i = 3; i < (size_t)width * height * 4; i += 4)
+			if (pixels[i] != 255)
+				return gli::DXT5;
+	return gli::DXT1;
+}
+
+// Cooking options from the command line.
+gli::format forcedFormat = gli::FORMAT_NULL;
+gli::filter mipFilter = gli::FILTER_BOX;
+gli::quality encoderQuality = gli::QUALITY_FAST;
+bool linearData = false;
+
+// Decodes file into a single level RGB8U or RGBA8U texture.
+bool load(const string& file, gli::texture2D& source, int& channels)
+{
+	int width, height;
+	unsigned char* pixels = stbi_load(file.c_str(), &width, &height, &channels, 0);
+	if (!pixels)
+	{
+		cout << file << ": unable to load (" << stbi_failure_reason() << ")" << endl;
+		return false;
+	}
+	// Anything that isn't 3 or 4 channels is expanded to RGBA first.
+	if (channels != 3 && channels != 4)
+	{
+		stbi_image_free(pixels);
+		pixels = stbi_load(file.c_str(), &width, &height, &channels, 4);
+		channels = 4;
+	}
+	source = gli::texture2D(1);
+	source[0] = gli::image2D(gli::image2D::dimensions_type(width, height), channels == 4 ? gli::RGBA8U : gli::RGB8U,
+		vector<glm::byte>(pixels, pixels + (size_t)width * height * channels));
+	stbi_image_free(pixels);
+	return true;
+}
+
+bool cook(const string& file)
+{
+	chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+	gli::texture2D source;
+	int channels;
+	if (!load(file, source, channels))
+		return false;
+	int width = source[0].dimensions().x, height = source[0].dimensions().y;
+	gli::format format = forcedFormat != gli::FORMAT_NULL ? forcedFormat : pickFormat(source[0].data(), width, height, channels);
+
+	bool srgb = !linearData && format != gli::ATI1N_UNORM && format != gli::ATI2N_UNORM;
+	gli::texture2D mipmapped = gli::generateMipmaps(source, 0, mipFilter, srgb);
+	gli::texture2D compressed = gli::compress(mipmapped, format, encoderQuality);
+	gli::saveDDS10(compressed, cookedName(file));
+
+	// Uncompressed textures end up as 4 bytes a texel on the GPU.
+	size_t rawBytes = 0;
+	for (size_t level = 0; level < mipmapped.levels(); level++)
+		rawBytes += (size_t)mipmapped[level].dimensions().x * mipmapped[level].dimensions().y * 4;
+	size_t cookedBytes = gli::size(compressed, gli::LINEAR_SIZE);
+	float ms = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+	cout << cookedName(file) << ": " << width << "x" << height << ", " << compressed.levels() << " levels, "
+		<< formatName(format) << ", " << rawBytes / 1024 << " KB -> " << cookedBytes / 1024 << " KB ("
+		<< (float)rawBytes / cookedBytes << "x), " << gli::psnr(mipmapped[0], compressed[0]) << " dB in " << ms << " ms" << endl;
+	return true;
+}
+
+// Mip chain throughput for every filter, colour space and thread count, then
+// both encoders. MPixels/s counts the base level only.
+void benchmark(const string& file)
+{
+	gli::texture2D source;
+	int channels;
+	if (!load(file, source, channels))
+		return;
+	float megapixels = source[0].dimensions().x * source[0].dimensions().y / 1000000.0f;
+	cout << file << ": " << source[0].dimensions().x << "x" << source[0].dimensions().y << "x" << channels << endl;
+
+	const char* filterNames[] = { "box", "kaiser" };
+	unsigned cores = thread::hardware_concurrency();
+	for (int filter = gli::FILTER_BOX; filter <= gli::FILTER_KAISER; filter++)
+		for (int srgb = 0; srgb < 2; srgb++)
+			for (unsigned threads = 1; threads <= max(cores, 1u); threads = threads == 1 && cores > 1 ? cores : threads + cores)
+			{
+				const int runs = 3;
+				chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+				for (int run = 0; run < runs; run++)
+					gli::generateMipmaps(source, 0, (gli::filter)filter, srgb != 0, threads);
+				float ms = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count() / runs;
+				cout << "  " << filterNames[filter] << (srgb ? " sRGB  " : " linear") << ", " << threads << " threads: "
+					<< ms << " ms, " << megapixels / (ms / 1000.0f) << " MPixels/s" << endl;
+			}
+
+	// Base level only, in whatever format the file would be cooked to.
+	gli::format format = forcedFormat != gli::FORMAT_NULL ? forcedFormat : pickFormat(source[0].data(), source[0].dimensions().x,
+		source[0].dimensions().y, channels);
+	const char* qualityNames[] = { "fast", "hq" };
+	for (int quality = gli::QUALITY_FAST; quality <= gli::QUALITY_HIGH; quality++)
+		for (unsigned threads = 1; threads <= max(cores, 1u); threads = threads == 1 && cores > 1 ? cores : threads + cores)
+		{
+			chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now();
+			gli::image2D compressed = gli::compress(source[0], format, (gli::quality)quality, threads);
+			float ms = chrono::duration<float, milli>(chrono::high_resolution_clock::now() - start).count();
+			cout << "  " << formatName(format) << " " << qualityNames[quality] << ", " << threads << " threads: " << ms << " ms, "
+				<< megapixels / (ms / 1000.0f) << " MPixels/s, " << gli::psnr(source[0], compressed) << " dB" << endl;
+		}
+}
+
+int main(int argc, char** argv)
+{
+	bool bench = false;
+	vector<string> files;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-bc1") == 0)
+			forcedFormat = gli::DXT1;
+		else if (strcmp(argv[i], "-bc3") == 0)
+			forcedFormat = gli::DXT5;
+		else if (strcmp(argv[i], "-bc4") == 0)
+			forcedFormat = gli::ATI1N_UNORM;
+		else if (strcmp(argv[i], "-bc5") == 0)
+			forcedFormat = gli::ATI2N_UNORM;
+		else if (strcmp(argv[i], "-fast") == 0)
+			encoderQuality = gli::QUALITY_FAST;
+		else if (strcmp(argv[i], "-hq") == 0)
+			encoderQuality = gli::QUALITY_HIGH;
+		else if (strcmp(argv[i], "-box") == 0)
+			mipFilter = gli::FILTER_BOX;
+		else if (strcmp(argv[i], "-kaiser") == 0)
+			mipFilter = gli::FILTER_KAISER;
+		else if (strcmp(argv[i], "-linear") == 0)
+			linearData = true;
+		else if (strcmp(argv[i], "-bench") == 0)
+			bench = true;
+		else if (argv[i][0] == '-')
+		{
+			cout << "Usage: TextureCooker [-bc1|-bc3|-bc4|-bc5] [-fast|-hq] [-box|-kaiser] [-linear] [-bench] [file...]" << endl;
+			return 1;
+		}
+		else
+			files.push_back(argv[i]);
+	}
+	if (files.empty())
+		files.assign(defaultFiles, defaultFiles + sizeof(defaultFiles) / sizeof(defaultFiles[0]));
+
+	// Same orientation the game loads with, so cooked files need no flipping.
+	stbi_set_flip_vertically_on_load(true);
+	int failed = 0;
+	for (size_t i = 0; i < files.size(); i++)
+		if (bench)
+			benchmark(files[i]);
+		else if (!cook(files[i]))
+			failed++;
+	return failed ? 1 : 0;
+}
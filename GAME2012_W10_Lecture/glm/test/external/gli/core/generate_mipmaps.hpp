@@ -11,13 +11,39 @@
 #define GLI_GENERATE_MIPMAPS_INCLUDED
 
 #include "texture2d.hpp"
+#include "operation.hpp"
 
 namespace gli
 {
+	enum filter
+	{
+		FILTER_BOX,		//!< Average of the texels each destination texel covers.
+		FILTER_KAISER	//!< Kaiser windowed sinc, sharper at the cost of more taps.
+	};
+
+	//! Fill in every level below BaseLevel with a linear box filter.
 	texture2D generateMipmaps(
 		texture2D const & Texture, 
 		texture2D::level_type const & BaseLevel);
 
+	//! Fill in every level below BaseLevel. R8U, RG8U, RGB8U and RGBA8U only.
+	//! With SRGB the colour channels are linearized before filtering and
+	//! encoded again afterwards; alpha is always filtered as is. Each level is
+	//! split in row bands over Threads threads, 0 meaning one per core.
+	texture2D generateMipmaps(
+		texture2D const & Texture, 
+		texture2D::level_type const & BaseLevel,
+		filter const & Filter,
+		bool const & SRGB,
+		unsigned const & Threads = 0);
+
+	//! The next level down of a single image, any size.
+	image2D generateMipmap(
+		image2D const & Image,
+		filter const & Filter,
+		bool const & SRGB,
+		unsigned const & Threads = 0);
+
 }//namespace gli
 
 #include "generate_mipmaps.inl"
@@ -7,63 +7,280 @@
 // File    : gli/core/generate_mipmaps.inl
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-namespace gli
+#include <thread>
+#include <functional>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define GLI_MIPMAP_SSE2
+#	include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#	define GLI_MIPMAP_AVX2
+#	include <immintrin.h>
+#endif
+
+namespace gli{
+namespace detail
 {
-/*
-	inline texture2D generateMipmaps
-	(
-		texture2D const & Image, 
-		texture2D::level_type const & BaseLevel
-	)
+	#define GLI_SRGB_ENCODE_SIZE	8192	// Entries in the linear to sRGB table.
+	#define GLI_KAISER_WIDTH		1.5f	// Half width, in destination texels.
+	#define GLI_KAISER_ALPHA		4.0f
+	#define GLI_MIPMAP_BAND_ROWS	32		// Smallest row band worth a thread.
+
+	// Built once, on first use from whichever thread gets there first.
+	struct srgb_tables
 	{
-		assert(BaseLevel < Image.levels());
-		texture2D::format_type Format = Image[BaseLevel].format();
+		float ToLinear[256];
+		glm::byte ToSRGB[GLI_SRGB_ENCODE_SIZE];
 
-		assert(Format == R8U || Format == RG8U || Format == RGB8U || Format == RGBA8U);
-		texture2D::level_type Levels = std::size_t(glm::log2(float(glm::compMax(Image[0].dimensions())))) + 1;
+		srgb_tables()
+		{
+			for(int i = 0; i < 256; ++i)
+			{
+				float c = i / 255.0f;
+				ToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for(int i = 0; i < GLI_SRGB_ENCODE_SIZE; ++i)
+			{
+				float l = i / float(GLI_SRGB_ENCODE_SIZE - 1);
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * std::pow(l, 1.0f / 2.4f) - 0.055f;
+				ToSRGB[i] = glm::byte(c * 255.0f + 0.5f);
+			}
+		}
+	};
 
-		texture2D Result(Levels);
-		for(texture2D::level_type Level = 0; Level <= BaseLevel; ++Level)
-			Result[Level] = detail::duplicate(Image[Level]);
+	inline srgb_tables const & srgbTables()
+	{
+		static srgb_tables Tables;
+		return Tables;
+	}
 
-		for(texture2D::level_type Level = BaseLevel; Level < Levels - 1; ++Level)
+	inline float besselI0(float x)
+	{
+		float Sum = 1.0f, Term = 1.0f;
+		for(int k = 1; k < 20; ++k)
 		{
-			std::size_t BaseWidth = Result[Level + 0].dimensions().x;
-			texture2D::value_type * DataSrc = Result[Level + 0].data();
+			Term *= (x * 0.5f / k) * (x * 0.5f / k);
+			Sum += Term;
+		}
+		return Sum;
+	}
 
-			texture2D::dimensions_type LevelDimensions = Result[Level + 0].dimensions() >> texture2D::dimensions_type(1);
-			LevelDimensions = glm::max(LevelDimensions, texture2D::dimensions_type(1));
-			texture2D::size_type Components = Result[Level + 0].components();
+	// Taps for resampling one axis, Taps per destination texel. Source
+	// indices are clamped to the edge and unused taps have weight 0.
+	struct mipmap_kernel
+	{
+		std::size_t Taps;
+		std::vector<std::size_t> Index;
+		std::vector<float> Weight;
+	};
+
+	inline mipmap_kernel buildKernel(std::size_t Src, std::size_t Dst, filter const & Filter)
+	{
+		float Scale = float(Src) / float(Dst);
+		float Radius = Filter == FILTER_BOX ? Scale * 0.5f : GLI_KAISER_WIDTH * Scale;
 
-			texture2D::data_type DataDst(glm::compMul(LevelDimensions) * Components);
+		mipmap_kernel Kernel;
+		Kernel.Taps = std::size_t(std::ceil(Radius * 2.0f)) + 2;
+		Kernel.Index.assign(Dst * Kernel.Taps, 0);
+		Kernel.Weight.assign(Dst * Kernel.Taps, 0.0f);
 
-			for(std::size_t j = 0; j < LevelDimensions.y; ++j)
-			for(std::size_t i = 0; i < LevelDimensions.x;  ++i)
-			for(std::size_t c = 0; c < Components; ++c)
+		for(std::size_t i = 0; i < Dst; ++i)
+		{
+			float Center = (i + 0.5f) * Scale;
+			int First = int(std::floor(Center - Radius));
+			float Total = 0.0f;
+			for(std::size_t t = 0; t < Kernel.Taps; ++t)
 			{
-				std::size_t x = (i << 1);
-				std::size_t y = (j << 1);
+				int j = First + int(t);
+				float Weight = 0.0f;
+				if(Filter == FILTER_BOX)
+				{
+					// Overlap of source texel [j, j + 1) with the footprint.
+					float Lo = glm::max(float(j), Center - Radius);
+					float Hi = glm::min(float(j + 1), Center + Radius);
+					Weight = glm::max(Hi - Lo, 0.0f);
+				}
+				else
+				{
+					float x = (j + 0.5f - Center) / Scale; // In destination texels.
+					if(glm::abs(x) < GLI_KAISER_WIDTH)
+					{
+						float Sinc = x == 0.0f ? 1.0f : std::sin(3.14159265f * x) / (3.14159265f * x);
+						float r = x / GLI_KAISER_WIDTH;
+						Weight = Sinc * besselI0(GLI_KAISER_ALPHA * std::sqrt(1.0f - r * r)) / besselI0(GLI_KAISER_ALPHA);
+					}
+				}
+				Kernel.Index[i * Kernel.Taps + t] = std::size_t(glm::clamp(j, 0, int(Src) - 1));
+				Kernel.Weight[i * Kernel.Taps + t] = Weight;
+				Total += Weight;
+			}
+			for(std::size_t t = 0; t < Kernel.Taps; ++t)
+				Kernel.Weight[i * Kernel.Taps + t] /= Total;
+		}
+		return Kernel;
+	}
 
-				std::size_t Index00 = ((x + 0) + (y + 0) * BaseWidth) * Components + c;
-				std::size_t Index01 = ((x + 0) + (y + 1) * BaseWidth) * Components + c;
-				std::size_t Index11 = ((x + 1) + (y + 1) * BaseWidth) * Components + c;
-				std::size_t Index10 = ((x + 1) + (y + 0) * BaseWidth) * Components + c;
+	// Runs Job over [0, Rows) split in bands, one thread each.
+	inline void parallelRows(std::size_t Rows, unsigned Threads, std::function<void(std::size_t, std::size_t)> const & Job)
+	{
+		if(Threads == 0)
+			Threads = glm::max(std::thread::hardware_concurrency(), 1u);
+		Threads = unsigned(glm::min(std::size_t(Threads), (Rows + GLI_MIPMAP_BAND_ROWS - 1) / GLI_MIPMAP_BAND_ROWS));
+		if(Threads <= 1)
+		{
+			Job(0, Rows);
+			return;
+		}
 
-				glm::u32 Data00 = reinterpret_cast<texture2D::value_type*>(DataSrc)[Index00];
-				glm::u32 Data01 = reinterpret_cast<texture2D::value_type*>(DataSrc)[Index01];
-				glm::u32 Data11 = reinterpret_cast<texture2D::value_type*>(DataSrc)[Index11];
-				glm::u32 Data10 = reinterpret_cast<texture2D::value_type*>(DataSrc)[Index10];
+		std::vector<std::thread> Workers;
+		std::size_t Band = (Rows + Threads - 1) / Threads;
+		for(std::size_t Begin = 0; Begin < Rows; Begin += Band)
+			Workers.push_back(std::thread(Job, Begin, glm::min(Begin + Band, Rows)));
+		for(std::size_t i = 0; i < Workers.size(); ++i)
+			Workers[i].join();
+	}
 
-				texture2D::value_type Result = (Data00 + Data01 + Data11 + Data10) >> 2;
-				texture2D::value_type * Data = reinterpret_cast<texture2D::value_type*>(DataDst.data());
+	// Dst[x] += Weight * Src[x] over Count floats, Count a multiple of 4.
+	inline void accumulateRow(float * Dst, float const * Src, float Weight, std::size_t Count)
+	{
+		std::size_t x = 0;
+#		if defined(GLI_MIPMAP_AVX2)
+			__m256 Weight8 = _mm256_set1_ps(Weight);
+			for(; x + 8 <= Count; x += 8)
+				_mm256_storeu_ps(Dst + x, _mm256_add_ps(_mm256_loadu_ps(Dst + x), _mm256_mul_ps(Weight8, _mm256_loadu_ps(Src + x))));
+#		endif
+#		if defined(GLI_MIPMAP_SSE2)
+			__m128 Weight4 = _mm_set1_ps(Weight);
+			for(; x + 4 <= Count; x += 4)
+				_mm_storeu_ps(Dst + x, _mm_add_ps(_mm_loadu_ps(Dst + x), _mm_mul_ps(Weight4, _mm_loadu_ps(Src + x))));
+#		endif
+		for(; x < Count; ++x)
+			Dst[x] += Weight * Src[x];
+	}
 
-				*(Data + ((i + j * LevelDimensions.x) * Components + c)) = Result;
+	// One RGBA float texel: the weighted sum of the kernel's taps in Src.
+	inline void filterTexel(float * Dst, float const * Src, std::size_t const * Index, float const * Weight, std::size_t Taps)
+	{
+#		if defined(GLI_MIPMAP_SSE2)
+			__m128 Sum = _mm_setzero_ps();
+			for(std::size_t t = 0; t < Taps; ++t)
+				Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_set1_ps(Weight[t]), _mm_loadu_ps(Src + Index[t] * 4)));
+			_mm_storeu_ps(Dst, Sum);
+#		else
+			Dst[0] = Dst[1] = Dst[2] = Dst[3] = 0.0f;
+			for(std::size_t t = 0; t < Taps; ++t)
+			for(std::size_t c = 0; c < 4; ++c)
+				Dst[c] += Weight[t] * Src[Index[t] * 4 + c];
+#		endif
+	}
+
+}//namespace detail
+
+	inline image2D generateMipmap
+	(
+		image2D const & Image,
+		filter const & Filter,
+		bool const & SRGB,
+		unsigned const & Threads
+	)
+	{
+		image2D::format_type Format = Image.format();
+		assert(Format == R8U || Format == RG8U || Format == RGB8U || Format == RGBA8U);
+
+		image2D::dimensions_type SrcDimensions = Image.dimensions();
+		image2D::dimensions_type DstDimensions = glm::max(SrcDimensions >> image2D::dimensions_type(1), image2D::dimensions_type(1));
+		std::size_t Components = Image.components();
+		std::size_t ColorComponents = Components == 4 ? 3 : Components; // Alpha stays linear.
+
+		detail::mipmap_kernel KernelX = detail::buildKernel(SrcDimensions.x, DstDimensions.x, Filter);
+		detail::mipmap_kernel KernelY = detail::buildKernel(SrcDimensions.y, DstDimensions.y, Filter);
+		float const * ToLinear = detail::srgbTables().ToLinear;
+		glm::byte const * ToSRGB = detail::srgbTables().ToSRGB;
+
+		// Horizontal pass: every source row, widened to linear RGBA floats,
+		// filtered down to the destination width.
+		std::vector<float> Horizontal(std::size_t(SrcDimensions.y) * DstDimensions.x * 4);
+		glm::byte const * SrcData = Image.data();
+		detail::parallelRows(SrcDimensions.y, Threads, [&](std::size_t Begin, std::size_t End)
+		{
+			std::vector<float> Row(std::size_t(SrcDimensions.x) * 4, 0.0f);
+			for(std::size_t y = Begin; y < End; ++y)
+			{
+				glm::byte const * Src = SrcData + y * SrcDimensions.x * Components;
+				for(std::size_t x = 0; x < SrcDimensions.x; ++x)
+				for(std::size_t c = 0; c < Components; ++c)
+				{
+					glm::byte Value = Src[x * Components + c];
+					Row[x * 4 + c] = (SRGB && c < ColorComponents) ? ToLinear[Value] : Value / 255.0f;
+				}
+				float * Dst = &Horizontal[y * DstDimensions.x * 4];
+				for(std::size_t x = 0; x < DstDimensions.x; ++x)
+					detail::filterTexel(Dst + x * 4, &Row[0], &KernelX.Index[x * KernelX.Taps], &KernelX.Weight[x * KernelX.Taps], KernelX.Taps);
 			}
+		});
 
-			Result[Level + 1] = image2D(LevelDimensions, Format, DataDst);
-		}
+		// Vertical pass, one destination row at a time, then back to bytes.
+		image2D::data_type DstData(std::size_t(DstDimensions.x) * DstDimensions.y * Components);
+		detail::parallelRows(DstDimensions.y, Threads, [&](std::size_t Begin, std::size_t End)
+		{
+			std::size_t Count = std::size_t(DstDimensions.x) * 4;
+			std::vector<float> Row(Count);
+			for(std::size_t y = Begin; y < End; ++y)
+			{
+				std::fill(Row.begin(), Row.end(), 0.0f);
+				for(std::size_t t = 0; t < KernelY.Taps; ++t)
+				{
+					float Weight = KernelY.Weight[y * KernelY.Taps + t];
+					if(Weight != 0.0f)
+						detail::accumulateRow(&Row[0], &Horizontal[KernelY.Index[y * KernelY.Taps + t] * Count], Weight, Count);
+				}
+
+				glm::byte * Dst = &DstData[y * DstDimensions.x * Components];
+				for(std::size_t x = 0; x < DstDimensions.x; ++x)
+				for(std::size_t c = 0; c < Components; ++c)
+				{
+					float Value = glm::clamp(Row[x * 4 + c], 0.0f, 1.0f);
+					Dst[x * Components + c] = (SRGB && c < ColorComponents) ?
+						ToSRGB[int(Value * (GLI_SRGB_ENCODE_SIZE - 1) + 0.5f)] : glm::byte(Value * 255.0f + 0.5f);
+				}
+			}
+		});
+
+		return image2D(DstDimensions, Format, DstData);
+	}
+
+	inline texture2D generateMipmaps
+	(
+		texture2D const & Image,
+		texture2D::level_type const & BaseLevel,
+		filter const & Filter,
+		bool const & SRGB,
+		unsigned const & Threads
+	)
+	{
+		assert(BaseLevel < Image.levels());
+		texture2D::level_type Levels = std::size_t(glm::log2(float(glm::compMax(Image[0].dimensions())))) + 1;
+
+		texture2D Result(Levels);
+		for(texture2D::level_type Level = 0; Level <= BaseLevel; ++Level)
+			Result[Level] = detail::duplicate(Image[Level]);
+
+		// Each level comes from the one above, so levels run in order and the
+		// threads share out the rows of each.
+		for(texture2D::level_type Level = BaseLevel; Level < Levels - 1; ++Level)
+			Result[Level + 1] = generateMipmap(Result[Level], Filter, SRGB, Threads);
 
 		return Result;
 	}
-*/
+
+	inline texture2D generateMipmaps
+	(
+		texture2D const & Image,
+		texture2D::level_type const & BaseLevel
+	)
+	{
+		return generateMipmaps(Image, BaseLevel, FILTER_BOX, false, 1);
+	}
+
 }//namespace gli
@@ -10,11 +10,57 @@
 #ifndef GLI_GTX_COMPRESSION_INCLUDED
 #define GLI_GTX_COMPRESSION_INCLUDED
 
+#include "../gli.hpp"
+#include <climits>
+#include <algorithm>
+#include <limits>
+
 namespace gli{
 namespace gtx{
 namespace compression
 {
+	enum quality
+	{
+		QUALITY_FAST,	//!< Bounding box endpoints and projected indices, SIMD where available.
+		QUALITY_HIGH	//!< Cluster fit along the principal axis, keeps whichever is better.
+	};
+
+	//! Block compress every level of an RGB8U or RGBA8U texture.
+	//! Format can be DXT1 (BC1), DXT5 (BC3), ATI1N_UNORM (BC4, red only)
+	//! or ATI2N_UNORM (BC5, red and green only). R8U and RG8U are accepted
+	//! for the last two. Fast quality, one thread per core.
+	texture2D compress(
+		texture2D const & Texture, 
+		format const & Format);
+
+	//! Rows of blocks are shared out over Threads threads, 0 meaning one per core.
+	texture2D compress(
+		texture2D const & Texture, 
+		format const & Format,
+		quality const & Quality,
+		unsigned const & Threads = 0);
+
+	//! Compress one level.
+	image2D compress(
+		image2D const & Image, 
+		format const & Format);
+
+	image2D compress(
+		image2D const & Image, 
+		format const & Format,
+		quality const & Quality,
+		unsigned const & Threads = 0);
+
+	//! Decode a DXT1, DXT5, ATI1N_UNORM or ATI2N_UNORM image to RGBA8U, the
+	//! way GL samples it (BC4 and BC5 leave the missing channels at 0).
+	image2D decompress(
+		image2D const & Image);
 
+	//! Peak signal to noise ratio in dB of Compressed against the Reference
+	//! it came from, over the channels the format keeps. Infinite if exact.
+	double psnr(
+		image2D const & Reference, 
+		image2D const & Compressed);
 
 }//namespace compression
 }//namespace gtx
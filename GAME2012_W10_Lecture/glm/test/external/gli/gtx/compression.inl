@@ -6,3 +6,795 @@
 // Licence : This source is under MIT License
 // File    : gli/gtx/compression.inl
 ///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#	define GLI_COMPRESSION_SSE2
+#	include <emmintrin.h>
+#endif
+
+namespace gli{
+namespace gtx{
+namespace compression{
+namespace detail
+{
+	inline glm::uint16 packRGB565(int const Color[3])
+	{
+		return glm::uint16(
+			(((Color[0] * 31 + 127) / 255) << 11) |
+			(((Color[1] * 63 + 127) / 255) << 5) |
+			(((Color[2] * 31 + 127) / 255) << 0));
+	}
+
+	inline void unpackRGB565(glm::uint16 const Packed, int Color[3])
+	{
+		int R = (Packed >> 11) & 31, G = (Packed >> 5) & 63, B = Packed & 31;
+		Color[0] = (R << 3) | (R >> 2);
+		Color[1] = (G << 2) | (G >> 4);
+		Color[2] = (B << 3) | (B >> 2);
+	}
+
+	// Per channel minimum and maximum of a block, alpha included.
+	inline void blockBounds(glm::byte const Texels[16][4], glm::byte Min[4], glm::byte Max[4])
+	{
+#		if defined(GLI_COMPRESSION_SSE2)
+			__m128i const * Src = reinterpret_cast<__m128i const *>(Texels);
+			__m128i Row0 = _mm_loadu_si128(Src + 0), Row1 = _mm_loadu_si128(Src + 1);
+			__m128i Row2 = _mm_loadu_si128(Src + 2), Row3 = _mm_loadu_si128(Src + 3);
+			__m128i Lo = _mm_min_epu8(_mm_min_epu8(Row0, Row1), _mm_min_epu8(Row2, Row3));
+			__m128i Hi = _mm_max_epu8(_mm_max_epu8(Row0, Row1), _mm_max_epu8(Row2, Row3));
+			Lo = _mm_min_epu8(Lo, _mm_shuffle_epi32(Lo, _MM_SHUFFLE(1, 0, 3, 2)));
+			Hi = _mm_max_epu8(Hi, _mm_shuffle_epi32(Hi, _MM_SHUFFLE(1, 0, 3, 2)));
+			Lo = _mm_min_epu8(Lo, _mm_shuffle_epi32(Lo, _MM_SHUFFLE(2, 3, 0, 1)));
+			Hi = _mm_max_epu8(Hi, _mm_shuffle_epi32(Hi, _MM_SHUFFLE(2, 3, 0, 1)));
+			int PackedMin = _mm_cvtsi128_si32(Lo), PackedMax = _mm_cvtsi128_si32(Hi);
+			memcpy(Min, &PackedMin, 4);
+			memcpy(Max, &PackedMax, 4);
+#		else
+			for(int c = 0; c < 4; ++c)
+			{
+				Min[c] = 255;
+				Max[c] = 0;
+			}
+			for(int t = 0; t < 16; ++t)
+			for(int c = 0; c < 4; ++c)
+			{
+				Min[c] = glm::min(Min[c], Texels[t][c]);
+				Max[c] = glm::max(Max[c], Texels[t][c]);
+			}
+#		endif
+	}
+
+	// Dot product of every texel's RGB with Axis, four texels at a time.
+	inline void projectBlock(glm::byte const Texels[16][4], int const Axis[3], int Dots[16])
+	{
+#		if defined(GLI_COMPRESSION_SSE2)
+			__m128i Zero = _mm_setzero_si128();
+			__m128i Weights = _mm_setr_epi16(
+				short(Axis[0]), short(Axis[1]), short(Axis[2]), 0,
+				short(Axis[0]), short(Axis[1]), short(Axis[2]), 0);
+			for(int i = 0; i < 4; ++i)
+			{
+				__m128i Quad = _mm_loadu_si128(reinterpret_cast<__m128i const *>(Texels[i * 4]));
+				// Each madd leaves R*x+G*y and B*z side by side for two texels.
+				__m128i Lo = _mm_madd_epi16(_mm_unpacklo_epi8(Quad, Zero), Weights);
+				__m128i Hi = _mm_madd_epi16(_mm_unpackhi_epi8(Quad, Zero), Weights);
+				__m128 Even = _mm_shuffle_ps(_mm_castsi128_ps(Lo), _mm_castsi128_ps(Hi), _MM_SHUFFLE(2, 0, 2, 0));
+				__m128 Odd = _mm_shuffle_ps(_mm_castsi128_ps(Lo), _mm_castsi128_ps(Hi), _MM_SHUFFLE(3, 1, 3, 1));
+				_mm_storeu_si128(reinterpret_cast<__m128i *>(Dots + i * 4),
+					_mm_add_epi32(_mm_castps_si128(Even), _mm_castps_si128(Odd)));
+			}
+#		else
+			for(int t = 0; t < 16; ++t)
+				Dots[t] = Texels[t][0] * Axis[0] + Texels[t][1] * Axis[1] + Texels[t][2] * Axis[2];
+#		endif
+	}
+
+	// The four colours of a BC1 block in index order, Color0 > Color1.
+	inline void colorPalette(glm::uint16 const Color0, glm::uint16 const Color1, int Palette[4][3])
+	{
+		unpackRGB565(Color0, Palette[0]);
+		unpackRGB565(Color1, Palette[1]);
+		for(int c = 0; c < 3; ++c)
+		{
+			Palette[2][c] = (2 * Palette[0][c] + Palette[1][c]) / 3;
+			Palette[3][c] = (Palette[0][c] + 2 * Palette[1][c]) / 3;
+		}
+	}
+
+	// Nearest palette entry for every texel. Returns the squared error.
+	inline int matchColors(glm::byte const Texels[16][4], int const Palette[4][3], glm::uint32 & Indices)
+	{
+		int Total = 0;
+		Indices = 0;
+		for(int t = 0; t < 16; ++t)
+		{
+			int Best = 0, BestError = INT_MAX;
+			for(int i = 0; i < 4; ++i)
+			{
+				int Error = 0;
+				for(int c = 0; c < 3; ++c)
+					Error += (Texels[t][c] - Palette[i][c]) * (Texels[t][c] - Palette[i][c]);
+				if(Error < BestError)
+				{
+					Best = i;
+					BestError = Error;
+				}
+			}
+			Indices |= glm::uint32(Best) << (t * 2);
+			Total += BestError;
+		}
+		return Total;
+	}
+
+	// Indices by where each texel falls along the line between the endpoints.
+	inline glm::uint32 projectColors(glm::byte const Texels[16][4], int const Palette[4][3])
+	{
+		static int const Order[4] = {1, 3, 2, 0};
+
+		int Axis[3] = {Palette[0][0] - Palette[1][0], Palette[0][1] - Palette[1][1], Palette[0][2] - Palette[1][2]};
+		int Start = Palette[1][0] * Axis[0] + Palette[1][1] * Axis[1] + Palette[1][2] * Axis[2];
+		int Length = Axis[0] * Axis[0] + Axis[1] * Axis[1] + Axis[2] * Axis[2];
+		int Dots[16];
+		projectBlock(Texels, Axis, Dots);
+
+		glm::uint32 Indices = 0;
+		for(int t = 0; t < 16; ++t)
+		{
+			int Offset = glm::clamp(Dots[t] - Start, 0, Length);
+			int Step = (Offset * 6 + Length) / (Length * 2);
+			Indices |= glm::uint32(Order[Step]) << (t * 2);
+		}
+		return Indices;
+	}
+
+	// Fast endpoints: the block's bounding box diagonal that follows the
+	// colours, by the sign of green and blue's covariance with red, inset a
+	// little so the ends aren't wasted on outliers.
+	inline void fitColorsBox(glm::byte const Texels[16][4], glm::uint16 & Color0, glm::uint16 & Color1)
+	{
+		glm::byte Lo[4], Hi[4];
+		blockBounds(Texels, Lo, Hi);
+
+		int Min[3] = {Lo[0], Lo[1], Lo[2]}, Max[3] = {Hi[0], Hi[1], Hi[2]}, Mean[3] = {0, 0, 0};
+		for(int t = 0; t < 16; ++t)
+		for(int c = 0; c < 3; ++c)
+			Mean[c] += Texels[t][c];
+
+		int Covariance[3] = {0, 0, 0};
+		for(int t = 0; t < 16; ++t)
+		for(int c = 1; c < 3; ++c)
+			Covariance[c] += (Texels[t][0] * 16 - Mean[0]) * (Texels[t][c] * 16 - Mean[c]);
+		for(int c = 1; c < 3; ++c)
+			if(Covariance[c] < 0)
+				std::swap(Min[c], Max[c]);
+
+		for(int c = 0; c < 3; ++c)
+		{
+			int Inset = (Max[c] - Min[c]) / 16;
+			Max[c] -= Inset;
+			Min[c] += Inset;
+		}
+
+		Color0 = packRGB565(Max);
+		Color1 = packRGB565(Min);
+	}
+
+	// Rounds a colour to the nearest 565 value.
+	inline glm::uint16 quantizeRGB565(float const Color[3])
+	{
+		int Rounded[3];
+		for(int c = 0; c < 3; ++c)
+			Rounded[c] = int(glm::clamp(Color[c], 0.0f, 255.0f) + 0.5f);
+		return packRGB565(Rounded);
+	}
+
+	// Every way to split 16 ordered texels over the four palette entries,
+	// with the terms of its least squares system that don't depend on the
+	// colours. Built once, on first use from whichever thread gets there first.
+	struct cluster_splits
+	{
+		struct split
+		{
+			int First, Second, Third;	// Ends of the A, 2/3 A and 1/3 A runs.
+			float Alpha2, Beta2, AlphaBeta, InverseDeterminant;
+		};
+		std::vector<split> Splits;
+
+		cluster_splits()
+		{
+			for(int i = 0; i <= 16; ++i)
+			for(int j = i; j <= 16; ++j)
+			for(int k = j; k <= 16; ++k)
+			{
+				float Near = float(j - i), Far = float(k - j);
+				split Split;
+				Split.First = i;
+				Split.Second = j;
+				Split.Third = k;
+				Split.Alpha2 = i + Near * (4.0f / 9.0f) + Far * (1.0f / 9.0f);
+				Split.Beta2 = (16 - k) + Near * (1.0f / 9.0f) + Far * (4.0f / 9.0f);
+				Split.AlphaBeta = (Near + Far) * (2.0f / 9.0f);
+				float Determinant = Split.Alpha2 * Split.Beta2 - Split.AlphaBeta * Split.AlphaBeta;
+				// One run on its own has no unique endpoints.
+				if(Determinant < FLT_EPSILON)
+					continue;
+				Split.InverseDeterminant = 1.0f / Determinant;
+				Splits.push_back(Split);
+			}
+		}
+	};
+
+	inline cluster_splits const & clusterSplits()
+	{
+		static cluster_splits Splits;
+		return Splits;
+	}
+
+	// Cluster fit: texels are ordered along the principal axis of their
+	// colours and every split of that order over the four palette entries is
+	// tried, each with its least squares endpoints snapped to 565. Prefix sums
+	// keep each of the 969 splits constant time. False for a flat block.
+	inline bool fitColorsCluster(glm::byte const Texels[16][4], glm::uint16 & Color0, glm::uint16 & Color1)
+	{
+		float Mean[3] = {0, 0, 0};
+		for(int t = 0; t < 16; ++t)
+		for(int c = 0; c < 3; ++c)
+			Mean[c] += Texels[t][c] / 16.0f;
+
+		float Covariance[3][3] = {{0}};
+		for(int t = 0; t < 16; ++t)
+		for(int i = 0; i < 3; ++i)
+		for(int j = 0; j < 3; ++j)
+			Covariance[i][j] += (Texels[t][i] - Mean[i]) * (Texels[t][j] - Mean[j]);
+
+		// Power iteration converges on the direction of most variance.
+		float Axis[3] = {1, 1, 1};
+		for(int Iteration = 0; Iteration < 8; ++Iteration)
+		{
+			float Next[3];
+			for(int i = 0; i < 3; ++i)
+				Next[i] = Covariance[i][0] * Axis[0] + Covariance[i][1] * Axis[1] + Covariance[i][2] * Axis[2];
+			float Largest = glm::max(glm::abs(Next[0]), glm::max(glm::abs(Next[1]), glm::abs(Next[2])));
+			if(Largest < FLT_EPSILON)
+				return false;
+			for(int i = 0; i < 3; ++i)
+				Axis[i] = Next[i] / Largest;
+		}
+
+		int Order[16];
+		float Dots[16];
+		for(int t = 0; t < 16; ++t)
+		{
+			float Dot = Texels[t][0] * Axis[0] + Texels[t][1] * Axis[1] + Texels[t][2] * Axis[2];
+			int i = t;
+			for(; i > 0 && Dots[i - 1] > Dot; --i)
+			{
+				Dots[i] = Dots[i - 1];
+				Order[i] = Order[i - 1];
+			}
+			Dots[i] = Dot;
+			Order[i] = t;
+		}
+
+		// Fourth lane stays zero so the SIMD path can treat colours as float4.
+		float Sum[17][4] = {{0}};
+		for(int t = 0; t < 16; ++t)
+		for(int c = 0; c < 3; ++c)
+			Sum[t + 1][c] = Sum[t][c] + Texels[Order[t]][c];
+
+		// Endpoints are snapped to the 565 grid before measuring, so the
+		// error is that of what the block will actually store.
+		static float const Grid[4] = {31.0f / 255.0f, 63.0f / 255.0f, 31.0f / 255.0f, 0.0f};
+		static float const Ungrid[4] = {255.0f / 31.0f, 255.0f / 63.0f, 255.0f / 31.0f, 0.0f};
+		std::vector<cluster_splits::split> const & Splits = clusterSplits().Splits;
+		float BestError = FLT_MAX, BestA[4], BestB[4];
+#		if defined(GLI_COMPRESSION_SSE2)
+			__m128 Total = _mm_loadu_ps(Sum[16]), GridScale = _mm_loadu_ps(Grid), UngridScale = _mm_loadu_ps(Ungrid);
+			__m128 Zero = _mm_setzero_ps(), Full = _mm_set1_ps(255.0f), Half = _mm_set1_ps(0.5f), Two = _mm_set1_ps(2.0f);
+			__m128 TwoThirds = _mm_set1_ps(2.0f / 3.0f), OneThird = _mm_set1_ps(1.0f / 3.0f);
+			__m128 BestErrors = _mm_set1_ps(FLT_MAX);
+			for(std::size_t s = 0; s < Splits.size(); ++s)
+			{
+				cluster_splits::split const & Split = Splits[s];
+				__m128 First = _mm_loadu_ps(Sum[Split.First]), Second = _mm_loadu_ps(Sum[Split.Second]);
+				__m128 AlphaX = _mm_add_ps(First, _mm_add_ps(_mm_mul_ps(_mm_sub_ps(Second, First), TwoThirds),
+					_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(Sum[Split.Third]), Second), OneThird)));
+				__m128 BetaX = _mm_sub_ps(Total, AlphaX);
+				__m128 Alpha2 = _mm_set1_ps(Split.Alpha2), Beta2 = _mm_set1_ps(Split.Beta2), AlphaBeta = _mm_set1_ps(Split.AlphaBeta);
+				__m128 Inverse = _mm_set1_ps(Split.InverseDeterminant);
+				__m128 A = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(AlphaX, Beta2), _mm_mul_ps(BetaX, AlphaBeta)), Inverse);
+				__m128 B = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(BetaX, Alpha2), _mm_mul_ps(AlphaX, AlphaBeta)), Inverse);
+				A = _mm_min_ps(_mm_max_ps(A, Zero), Full);
+				B = _mm_min_ps(_mm_max_ps(B, Zero), Full);
+				__m128 a = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(A, GridScale), Half))), UngridScale);
+				__m128 b = _mm_mul_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(B, GridScale), Half))), UngridScale);
+				__m128 Cross = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(a, b), AlphaBeta), _mm_add_ps(_mm_mul_ps(a, AlphaX), _mm_mul_ps(b, BetaX)));
+				__m128 Errors = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_mul_ps(a, a), Alpha2), _mm_mul_ps(_mm_mul_ps(b, b), Beta2)),
+					_mm_mul_ps(Cross, Two));
+				Errors = _mm_add_ps(Errors, _mm_shuffle_ps(Errors, Errors, _MM_SHUFFLE(2, 3, 0, 1)));
+				Errors = _mm_add_ps(Errors, _mm_shuffle_ps(Errors, Errors, _MM_SHUFFLE(1, 0, 3, 2)));
+				if(_mm_comilt_ss(Errors, BestErrors))
+				{
+					BestErrors = Errors;
+					_mm_storeu_ps(BestA, A);
+					_mm_storeu_ps(BestB, B);
+				}
+			}
+			BestError = _mm_cvtss_f32(BestErrors);
+#		else
+			for(std::size_t s = 0; s < Splits.size(); ++s)
+			{
+				cluster_splits::split const & Split = Splits[s];
+				float Error = 0.0f, A[3], B[3];
+				for(int c = 0; c < 3; ++c)
+				{
+					float AlphaX = Sum[Split.First][c] + (Sum[Split.Second][c] - Sum[Split.First][c]) * (2.0f / 3.0f) +
+						(Sum[Split.Third][c] - Sum[Split.Second][c]) * (1.0f / 3.0f);
+					float BetaX = Sum[16][c] - AlphaX;
+					A[c] = glm::clamp((AlphaX * Split.Beta2 - BetaX * Split.AlphaBeta) * Split.InverseDeterminant, 0.0f, 255.0f);
+					B[c] = glm::clamp((BetaX * Split.Alpha2 - AlphaX * Split.AlphaBeta) * Split.InverseDeterminant, 0.0f, 255.0f);
+					float a = float(int(A[c] * Grid[c] + 0.5f)) * Ungrid[c];
+					float b = float(int(B[c] * Grid[c] + 0.5f)) * Ungrid[c];
+					Error += a * a * Split.Alpha2 + b * b * Split.Beta2 + 2.0f * (a * b * Split.AlphaBeta - a * AlphaX - b * BetaX);
+				}
+				if(Error < BestError)
+				{
+					BestError = Error;
+					std::copy(A, A + 3, BestA);
+					std::copy(B, B + 3, BestB);
+				}
+			}
+#		endif
+		if(BestError == FLT_MAX)
+			return false;
+		Color0 = quantizeRGB565(BestA);
+		Color1 = quantizeRGB565(BestB);
+		return true;
+	}
+
+	// BC1 colour block, always in four colour mode so it is valid inside BC3.
+	inline void compressColorBlock(glm::byte const Texels[16][4], glm::byte * Dst, quality const & Quality)
+	{
+		glm::uint16 Color0, Color1;
+		fitColorsBox(Texels, Color0, Color1);
+		if(Color0 < Color1)
+			std::swap(Color0, Color1);
+
+		glm::uint32 Indices = 0;
+		if(Color0 != Color1)
+		{
+			int Palette[4][3];
+			colorPalette(Color0, Color1, Palette);
+			if(Quality == QUALITY_FAST)
+				Indices = projectColors(Texels, Palette);
+			else
+			{
+				int Error = matchColors(Texels, Palette, Indices);
+				glm::uint16 Fit0, Fit1;
+				if(Error > 0 && fitColorsCluster(Texels, Fit0, Fit1))
+				{
+					if(Fit0 < Fit1)
+						std::swap(Fit0, Fit1);
+					glm::uint32 FitIndices;
+					colorPalette(Fit0, Fit1, Palette);
+					if(Fit0 != Fit1 && matchColors(Texels, Palette, FitIndices) < Error)
+					{
+						Color0 = Fit0;
+						Color1 = Fit1;
+						Indices = FitIndices;
+					}
+				}
+			}
+		}
+
+		memcpy(Dst + 0, &Color0, 2);
+		memcpy(Dst + 2, &Color1, 2);
+		memcpy(Dst + 4, &Indices, 4);
+	}
+
+	// The eight values of a BC4 block. With Value0 > Value1 six are
+	// interpolated, otherwise four and the last two are 0 and 255.
+	inline void alphaPalette(int const Value0, int const Value1, int Palette[8])
+	{
+		Palette[0] = Value0;
+		Palette[1] = Value1;
+		if(Value0 > Value1)
+		{
+			for(int i = 1; i < 7; ++i)
+				Palette[i + 1] = ((7 - i) * Value0 + i * Value1) / 7;
+		}
+		else
+		{
+			for(int i = 1; i < 5; ++i)
+				Palette[i + 1] = ((5 - i) * Value0 + i * Value1) / 5;
+			Palette[6] = 0;
+			Palette[7] = 255;
+		}
+	}
+
+	inline int matchAlpha(glm::byte const Values[16], int const Palette[8], glm::uint64 & Indices)
+	{
+		int Total = 0;
+		Indices = 0;
+		for(int t = 0; t < 16; ++t)
+		{
+			int Best = 0, BestError = INT_MAX;
+			for(int i = 0; i < 8; ++i)
+			{
+				int Error = (Values[t] - Palette[i]) * (Values[t] - Palette[i]);
+				if(Error < BestError)
+				{
+					Best = i;
+					BestError = Error;
+				}
+			}
+			Indices |= glm::uint64(Best) << (t * 3);
+			Total += BestError;
+		}
+		return Total;
+	}
+
+	// Least squares endpoints for fixed six-interpolant indices. False if
+	// they don't stay in eight value order.
+	inline bool refineAlpha(glm::byte const Values[16], glm::uint64 const Indices, int & Value0, int & Value1)
+	{
+		float Alpha2 = 0, Beta2 = 0, AlphaBeta = 0, AlphaX = 0, BetaX = 0;
+		for(int t = 0; t < 16; ++t)
+		{
+			int Index = int(Indices >> (t * 3)) & 7;
+			float Alpha = Index == 0 ? 1.0f : Index == 1 ? 0.0f : (8 - Index) / 7.0f, Beta = 1.0f - Alpha;
+			Alpha2 += Alpha * Alpha;
+			Beta2 += Beta * Beta;
+			AlphaBeta += Alpha * Beta;
+			AlphaX += Alpha * Values[t];
+			BetaX += Beta * Values[t];
+		}
+		float Determinant = Alpha2 * Beta2 - AlphaBeta * AlphaBeta;
+		if(Determinant < FLT_EPSILON)
+			return false;
+		Value0 = int(glm::clamp((AlphaX * Beta2 - BetaX * AlphaBeta) / Determinant, 0.0f, 255.0f) + 0.5f);
+		Value1 = int(glm::clamp((BetaX * Alpha2 - AlphaX * AlphaBeta) / Determinant, 0.0f, 255.0f) + 0.5f);
+		return Value0 > Value1;
+	}
+
+	// BC4 block, used for BC3 alpha and the BC5 channels. Fast quality spans
+	// min to max and indexes arithmetically; high quality also refines those
+	// endpoints and tries the mode with exact 0 and 255.
+	inline void compressAlphaBlock(glm::byte const Values[16], glm::byte * Dst, quality const & Quality)
+	{
+		int Min, Max;
+#		if defined(GLI_COMPRESSION_SSE2)
+			__m128i Lo = _mm_loadu_si128(reinterpret_cast<__m128i const *>(Values)), Hi = Lo;
+			Lo = _mm_min_epu8(Lo, _mm_srli_si128(Lo, 8));
+			Hi = _mm_max_epu8(Hi, _mm_srli_si128(Hi, 8));
+			Lo = _mm_min_epu8(Lo, _mm_srli_si128(Lo, 4));
+			Hi = _mm_max_epu8(Hi, _mm_srli_si128(Hi, 4));
+			Lo = _mm_min_epu8(Lo, _mm_srli_si128(Lo, 2));
+			Hi = _mm_max_epu8(Hi, _mm_srli_si128(Hi, 2));
+			Lo = _mm_min_epu8(Lo, _mm_srli_si128(Lo, 1));
+			Hi = _mm_max_epu8(Hi, _mm_srli_si128(Hi, 1));
+			Min = _mm_cvtsi128_si32(Lo) & 255;
+			Max = _mm_cvtsi128_si32(Hi) & 255;
+#		else
+			Min = 255;
+			Max = 0;
+			for(int t = 0; t < 16; ++t)
+			{
+				Min = glm::min(Min, int(Values[t]));
+				Max = glm::max(Max, int(Values[t]));
+			}
+#		endif
+
+		int Value0 = Max, Value1 = Min;
+		glm::uint64 Indices = 0;
+		if(Max != Min && Quality == QUALITY_FAST)
+		{
+			for(int t = 0; t < 16; ++t)
+			{
+				int Step = ((Values[t] - Min) * 14 + (Max - Min)) / ((Max - Min) * 2);
+				int Index = Step == 7 ? 0 : Step == 0 ? 1 : 8 - Step;
+				Indices |= glm::uint64(Index) << (t * 3);
+			}
+		}
+		else if(Max != Min)
+		{
+			int Palette[8];
+			alphaPalette(Value0, Value1, Palette);
+			int Error = matchAlpha(Values, Palette, Indices);
+
+			for(int Iteration = 0; Iteration < 2 && Error > 0; ++Iteration)
+			{
+				int Refined0, Refined1;
+				glm::uint64 RefinedIndices;
+				if(!refineAlpha(Values, Indices, Refined0, Refined1))
+					break;
+				alphaPalette(Refined0, Refined1, Palette);
+				int RefinedError = matchAlpha(Values, Palette, RefinedIndices);
+				if(RefinedError >= Error)
+					break;
+				Value0 = Refined0;
+				Value1 = Refined1;
+				Indices = RefinedIndices;
+				Error = RefinedError;
+			}
+
+			// Blocks with a few fully on or off texels do better leaving those
+			// to the fixed 0 and 255 and spanning only the rest.
+			int InnerMin = 255, InnerMax = 0;
+			for(int t = 0; t < 16; ++t)
+				if(Values[t] != 0 && Values[t] != 255)
+				{
+					InnerMin = glm::min(InnerMin, int(Values[t]));
+					InnerMax = glm::max(InnerMax, int(Values[t]));
+				}
+			if(Error > 0 && InnerMin <= InnerMax)
+			{
+				glm::uint64 InnerIndices;
+				alphaPalette(InnerMin, InnerMax, Palette);
+				int InnerError = matchAlpha(Values, Palette, InnerIndices);
+				if(InnerError < Error)
+				{
+					Value0 = InnerMin;
+					Value1 = InnerMax;
+					Indices = InnerIndices;
+				}
+			}
+		}
+
+		Dst[0] = glm::byte(Value0);
+		Dst[1] = glm::byte(Value1);
+		for(int i = 0; i < 6; ++i)
+			Dst[2 + i] = glm::byte(Indices >> (i * 8));
+	}
+
+	// Gathers a 4x4 block as RGBA, clamping at the right and top edges.
+	inline void fetchBlock(image2D const & Image, std::size_t BlockX, std::size_t BlockY, glm::byte Texels[16][4])
+	{
+		image2D::dimensions_type Dimensions = Image.dimensions();
+		std::size_t Components = Image.components();
+		glm::byte const * Data = Image.data();
+		for(std::size_t j = 0; j < 4; ++j)
+		for(std::size_t i = 0; i < 4; ++i)
+		{
+			std::size_t x = glm::min(BlockX * 4 + i, std::size_t(Dimensions.x - 1));
+			std::size_t y = glm::min(BlockY * 4 + j, std::size_t(Dimensions.y - 1));
+			glm::byte const * Texel = Data + (x + y * Dimensions.x) * Components;
+			for(std::size_t c = 0; c < 4; ++c)
+				Texels[j * 4 + i][c] = c < Components ? Texel[c] : glm::byte(255);
+		}
+	}
+
+	inline void compressBlock(glm::byte const Texels[16][4], format const & Format, quality const & Quality, glm::byte * Dst)
+	{
+		glm::byte Channel[2][16];
+		for(int t = 0; t < 16; ++t)
+		{
+			Channel[0][t] = Texels[t][Format == DXT5 ? 3 : 0];
+			Channel[1][t] = Texels[t][1];
+		}
+
+		switch(Format)
+		{
+		case DXT1:
+			compressColorBlock(Texels, Dst, Quality);
+			break;
+		case DXT5:
+			compressAlphaBlock(Channel[0], Dst, Quality);
+			compressColorBlock(Texels, Dst + 8, Quality);
+			break;
+		case ATI1N_UNORM:
+			compressAlphaBlock(Channel[0], Dst, Quality);
+			break;
+		case ATI2N_UNORM:
+			compressAlphaBlock(Channel[0], Dst, Quality);
+			compressAlphaBlock(Channel[1], Dst + 8, Quality);
+			break;
+		default:
+			assert(0);
+		}
+	}
+
+	// Three colour mode (Color0 <= Color1) only exists in BC1 itself.
+	inline void decompressColorBlock(glm::byte const * Src, bool const ThreeColor, glm::byte Texels[16][4])
+	{
+		glm::uint16 Color0, Color1;
+		glm::uint32 Indices;
+		memcpy(&Color0, Src + 0, 2);
+		memcpy(&Color1, Src + 2, 2);
+		memcpy(&Indices, Src + 4, 4);
+
+		int Palette[4][3];
+		colorPalette(Color0, Color1, Palette);
+		bool Transparent = ThreeColor && Color0 <= Color1;
+		if(Transparent)
+			for(int c = 0; c < 3; ++c)
+			{
+				Palette[2][c] = (Palette[0][c] + Palette[1][c]) / 2;
+				Palette[3][c] = 0;
+			}
+
+		for(int t = 0; t < 16; ++t)
+		{
+			int Index = (Indices >> (t * 2)) & 3;
+			for(int c = 0; c < 3; ++c)
+				Texels[t][c] = glm::byte(Palette[Index][c]);
+			Texels[t][3] = Transparent && Index == 3 ? 0 : 255;
+		}
+	}
+
+	inline void decompressAlphaBlock(glm::byte const * Src, glm::byte Values[16])
+	{
+		int Palette[8];
+		alphaPalette(Src[0], Src[1], Palette);
+		glm::uint64 Indices = 0;
+		for(int i = 0; i < 6; ++i)
+			Indices |= glm::uint64(Src[2 + i]) << (i * 8);
+		for(int t = 0; t < 16; ++t)
+			Values[t] = glm::byte(Palette[(Indices >> (t * 3)) & 7]);
+	}
+
+	// Channels a format stores, the ones that count towards its PSNR.
+	inline std::size_t keptComponents(format const & Format)
+	{
+		switch(Format)
+		{
+		case DXT1: return 3;
+		case DXT5: return 4;
+		case ATI1N_UNORM: return 1;
+		case ATI2N_UNORM: return 2;
+		default: return 0;
+		}
+	}
+
+}//namespace detail
+
+	inline image2D compress
+	(
+		image2D const & Image,
+		format const & Format,
+		quality const & Quality,
+		unsigned const & Threads
+	)
+	{
+		assert(Image.format() == RGB8U || Image.format() == RGBA8U ||
+			((Image.format() == R8U || Image.format() == RG8U) && (Format == ATI1N_UNORM || Format == ATI2N_UNORM)));
+		assert(Format == DXT1 || Format == DXT5 || Format == ATI1N_UNORM || Format == ATI2N_UNORM);
+
+		image2D::dimensions_type Dimensions = glm::max(Image.dimensions(), image2D::dimensions_type(1));
+		std::size_t BlocksX = (Dimensions.x + 3) >> 2;
+		std::size_t BlocksY = (Dimensions.y + 3) >> 2;
+		std::size_t BlockSize = gli::detail::sizeBlock(Format);
+		image2D::data_type Data(BlocksX * BlocksY * BlockSize);
+
+		// Blocks are independent, so rows of them go to different threads.
+		gli::detail::parallelRows(BlocksY, Threads, [&](std::size_t Begin, std::size_t End)
+		{
+			for(std::size_t BlockY = Begin; BlockY < End; ++BlockY)
+			for(std::size_t BlockX = 0; BlockX < BlocksX; ++BlockX)
+			{
+				glm::byte Texels[16][4];
+				detail::fetchBlock(Image, BlockX, BlockY, Texels);
+				detail::compressBlock(Texels, Format, Quality, &Data[(BlockX + BlockY * BlocksX) * BlockSize]);
+			}
+		});
+
+		return image2D(Dimensions, Format, Data);
+	}
+
+	inline image2D compress
+	(
+		image2D const & Image,
+		format const & Format
+	)
+	{
+		return compress(Image, Format, QUALITY_FAST, 0);
+	}
+
+	inline texture2D compress
+	(
+		texture2D const & Texture,
+		format const & Format,
+		quality const & Quality,
+		unsigned const & Threads
+	)
+	{
+		texture2D Result(Texture.levels());
+		for(texture2D::level_type Level = 0; Level < Texture.levels(); ++Level)
+			Result[Level] = compress(Texture[Level], Format, Quality, Threads);
+		return Result;
+	}
+
+	inline texture2D compress
+	(
+		texture2D const & Texture,
+		format const & Format
+	)
+	{
+		return compress(Texture, Format, QUALITY_FAST, 0);
+	}
+
+	inline image2D decompress
+	(
+		image2D const & Image
+	)
+	{
+		format Format = Image.format();
+		assert(detail::keptComponents(Format) > 0);
+
+		image2D::dimensions_type Dimensions = glm::max(Image.dimensions(), image2D::dimensions_type(1));
+		std::size_t BlocksX = (Dimensions.x + 3) >> 2;
+		std::size_t BlocksY = (Dimensions.y + 3) >> 2;
+		std::size_t BlockSize = gli::detail::sizeBlock(Format);
+		image2D::data_type Data(std::size_t(Dimensions.x) * Dimensions.y * 4);
+
+		for(std::size_t BlockY = 0; BlockY < BlocksY; ++BlockY)
+		for(std::size_t BlockX = 0; BlockX < BlocksX; ++BlockX)
+		{
+			glm::byte const * Src = Image.data() + (BlockX + BlockY * BlocksX) * BlockSize;
+			glm::byte Texels[16][4] = {{0}};
+			glm::byte Values[16];
+			switch(Format)
+			{
+			case DXT1:
+				detail::decompressColorBlock(Src, true, Texels);
+				break;
+			case DXT5:
+				detail::decompressColorBlock(Src + 8, false, Texels);
+				detail::decompressAlphaBlock(Src, Values);
+				for(int t = 0; t < 16; ++t)
+					Texels[t][3] = Values[t];
+				break;
+			default:
+				for(std::size_t Channel = 0; Channel < detail::keptComponents(Format); ++Channel)
+				{
+					detail::decompressAlphaBlock(Src + Channel * 8, Values);
+					for(int t = 0; t < 16; ++t)
+						Texels[t][Channel] = Values[t];
+				}
+				for(int t = 0; t < 16; ++t)
+					Texels[t][3] = 255;
+				break;
+			}
+
+			for(std::size_t j = 0; j < 4 && BlockY * 4 + j < std::size_t(Dimensions.y); ++j)
+			for(std::size_t i = 0; i < 4 && BlockX * 4 + i < std::size_t(Dimensions.x); ++i)
+				memcpy(&Data[((BlockY * 4 + j) * Dimensions.x + BlockX * 4 + i) * 4], Texels[j * 4 + i], 4);
+		}
+
+		return image2D(Dimensions, RGBA8U, Data);
+	}
+
+	inline double psnr
+	(
+		image2D const & Reference,
+		image2D const & Compressed
+	)
+	{
+		assert(glm::all(glm::equal(glm::max(Reference.dimensions(), image2D::dimensions_type(1)), Compressed.dimensions())));
+
+		image2D Decoded = decompress(Compressed);
+		std::size_t Kept = detail::keptComponents(Compressed.format());
+		std::size_t Components = Reference.components();
+		std::size_t Texels = std::size_t(Compressed.dimensions().x) * Compressed.dimensions().y;
+
+		double SquaredError = 0.0;
+		for(std::size_t t = 0; t < Texels; ++t)
+		for(std::size_t c = 0; c < Kept; ++c)
+		{
+			int Expected = c < Components ? Reference.data()[t * Components + c] : 255;
+			int Difference = Expected - Decoded.data()[t * 4 + c];
+			SquaredError += Difference * Difference;
+		}
+
+		if(SquaredError == 0.0)
+			return std::numeric_limits<double>::infinity();
+		double MeanSquaredError = SquaredError / double(Texels * Kept);
+		return 10.0 * std::log10(255.0 * 255.0 / MeanSquaredError);
+	}
+
+}//namespace compression
+}//namespace gtx
+}//namespace gli
@@ -14,6 +14,7 @@
 
    You can #define STBI_ASSERT(x) before the #include to avoid using assert.h.
    And #define STBI_MALLOC, STBI_REALLOC, and STBI_FREE to avoid using malloc,realloc,free
+   #define STBI_PARALLEL_JPEG (C++11 only) to allow stbi_set_jpeg_threads()
 
 
    QUICK NOTES:
@@ -467,6 +468,18 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// decode JPEGs at 1/2, 1/4 or 1/8 size (shift 1, 2 or 3) with a reduced IDCT,
+// so the full size image is never produced; 0 turns it off. x and y report the
+// reduced size. the setting is per thread where STBI_THREAD_LOCAL is available.
+STBIDEF void stbi_set_jpeg_scale_on_load(int scale_shift);
+
+// with STBI_PARALLEL_JPEG, decode JPEGs on up to this many threads: scans that
+// have restart markers are split at them, and the IDCT of progressive files
+// and the colour conversion of every file run in row bands. 0 or 1 is the
+// plain single threaded decode, as is any build without STBI_PARALLEL_JPEG.
+// per thread, like stbi_set_jpeg_scale_on_load.
+STBIDEF void stbi_set_jpeg_threads(int threads);
+
 // ZLIB client - used by PNG, available for other purposes
 
 STBIDEF char *stbi_zlib_decode_malloc_guesssize(const char *buffer, int len, int initial_size, int *outlen);
@@ -546,6 +559,15 @@ STBIDEF int   stbi_zlib_decode_noheader_buffer(char *obuffer, int olen, const ch
 #define STBI_ASSERT(x) assert(x)
 #endif
 
+#ifdef STBI_PARALLEL_JPEG
+#ifndef __cplusplus
+#error "STBI_PARALLEL_JPEG uses std::thread, so the implementation must be compiled as C++11"
+#endif
+#include <thread>
+#include <vector>
+#include <atomic>
+#endif
+
 #ifdef __cplusplus
 #define STBI_EXTERN extern "C"
 #else
@@ -590,6 +612,21 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32)==4 ? 1 : -1];
 #define STBI_HAS_LROTL
 #endif
 
+#ifndef STBI_NO_THREAD_LOCALS
+   #if defined(__cplusplus) && __cplusplus >= 201103L
+      #define STBI_THREAD_LOCAL       thread_local
+   #elif defined(_MSC_VER)
+      #define STBI_THREAD_LOCAL       __declspec(thread)
+   #elif defined(__GNUC__)
+      #define STBI_THREAD_LOCAL       __thread
+   #elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+      #define STBI_THREAD_LOCAL       _Thread_local
+   #endif
+#endif
+#ifndef STBI_THREAD_LOCAL
+   #define STBI_THREAD_LOCAL
+#endif
+
 #ifdef STBI_HAS_LROTL
    #define stbi_lrot(x,y)  _lrotl(x,y)
 #else
@@ -676,7 +713,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -687,7 +724,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -874,7 +911,7 @@ static int      stbi__pnm_info(stbi__context *s, int *x, int *y, int *comp);
 #endif
 
 // this is not threadsafe
-static const char *stbi__g_failure_reason;
+static STBI_THREAD_LOCAL const char *stbi__g_failure_reason;
 
 STBIDEF const char *stbi_failure_reason(void)
 {
@@ -1002,6 +1039,37 @@ STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
     stbi__vertically_flip_on_load = flag_true_if_should_flip;
 }
 
+static STBI_THREAD_LOCAL int stbi__jpeg_scale_shift = 0;
+static STBI_THREAD_LOCAL int stbi__jpeg_threads = 1;
+
+STBIDEF void stbi_set_jpeg_scale_on_load(int scale_shift)
+{
+    stbi__jpeg_scale_shift = scale_shift < 0 ? 0 : scale_shift > 3 ? 3 : scale_shift;
+}
+
+STBIDEF void stbi_set_jpeg_threads(int threads)
+{
+    stbi__jpeg_threads = threads < 1 ? 1 : threads;
+}
+
+#ifdef STBI_PARALLEL_JPEG
+// calls job(0) .. job(count-1), spread over up to threads threads including
+// this one. each thread takes every threads'th index.
+template <typename Job>
+static void stbi__parallel_for(int count, int threads, Job job)
+{
+   std::vector<std::thread> workers;
+   int i,t;
+   if (threads > count) threads = count;
+   for (t=1; t < threads; ++t)
+      workers.push_back(std::thread([=] { int k; for (k=t; k < count; k += threads) job(k); }));
+   for (i=0; i < count; i += threads > 1 ? threads : 1)
+      job(i);
+   for (t=0; t < (int) workers.size(); ++t)
+      workers[t].join();
+}
+#endif
+
 static void *stbi__load_main(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri, int bpc)
 {
    memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1811,6 +1879,9 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+   int scale_shift; // blocks decode to (8 >> scale_shift) pixels square
+   int mcu_first, mcu_count; // which MCUs of a scan to decode, all of them unless split at restarts
+   int threads;
 
 // kernels
    void (*idct_block_kernel)(stbi_uc *out, int out_stride, short data[64]);
@@ -2327,6 +2398,61 @@ static void stbi__idct_block(stbi_uc *out, int out_stride, short data[64])
    }
 }
 
+// reduced size IDCTs: the 8-point basis sampled at the centres of the 4, 2 or
+// 1 output pixels, using only the low frequency coefficients that survive.
+// stbi__idct_reduced_4 and _2 are C(u) * cos((2x+1)u*pi/2n) in 1.11 fixed point,
+// indexed [x*4+u]
+static const int stbi__idct_reduced_4[16] = {
+   1448, 1892, 1448,  784,
+   1448,  784,-1448,-1892,
+   1448, -784,-1448, 1892,
+   1448,-1892, 1448, -784,
+};
+static const int stbi__idct_reduced_2[16] = {
+   1448, 1448,    0,    0,
+   1448,-1448,    0,    0,
+};
+
+static void stbi__idct_reduced(stbi_uc *out, int out_stride, short data[64], const int *table, int n)
+{
+   int i,j,k,tmp[16];
+   // columns
+   for (i=0; i < n; ++i) {
+      for (j=0; j < n; ++j) {
+         int sum = 0;
+         for (k=0; k < n; ++k)
+            sum += table[j*4+k] * data[k*8+i];
+         tmp[j*4+i] = (sum + 1024) >> 11;
+      }
+   }
+   // rows; the full transform has an overall scale of 1/4, so 11 + 2 bits come off
+   for (j=0; j < n; ++j, out += out_stride) {
+      for (i=0; i < n; ++i) {
+         int sum = 0;
+         for (k=0; k < n; ++k)
+            sum += table[i*4+k] * tmp[j*4+k];
+         out[i] = stbi__clamp(((sum + 4096) >> 13) + 128);
+      }
+   }
+}
+
+static void stbi__idct_block_4x4(stbi_uc *out, int out_stride, short data[64])
+{
+   stbi__idct_reduced(out, out_stride, data, stbi__idct_reduced_4, 4);
+}
+
+static void stbi__idct_block_2x2(stbi_uc *out, int out_stride, short data[64])
+{
+   stbi__idct_reduced(out, out_stride, data, stbi__idct_reduced_2, 2);
+}
+
+// 1/8 size is just the block average, which is the DC term
+static void stbi__idct_block_1x1(stbi_uc *out, int out_stride, short data[64])
+{
+   STBI_NOTUSED(out_stride);
+   out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2755,7 +2881,8 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
    stbi__jpeg_reset(z);
    if (!z->progressive) {
       if (z->scan_n == 1) {
-         int i,j;
+         int i,j,m;
+         int bs = 8 >> z->scale_shift;
          STBI_SIMD_ALIGN(short, data[64]);
          int n = z->order[0];
          // non-interleaved data, we just need to process one block at a time,
@@ -2764,56 +2891,57 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          // component has, independent of interleaved MCU blocking and such
          int w = (z->img_comp[n].x+7) >> 3;
          int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               int ha = z->img_comp[n].ha;
-               if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  // if it's NOT a restart, then just bail, so we get corrupt data
-                  // rather than no data
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
+         for (m=z->mcu_first; m < z->mcu_first + z->mcu_count && m < w*h; ++m) {
+            int ha = z->img_comp[n].ha;
+            i = m % w;
+            j = m / w;
+            if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*bs+i*bs, z->img_comp[n].w2, data);
+            // every data block is an MCU, so countdown the restart interval
+            if (--z->todo <= 0) {
+               if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+               // if it's NOT a restart, then just bail, so we get corrupt data
+               // rather than no data
+               if (!STBI__RESTART(z->marker)) return 1;
+               stbi__jpeg_reset(z);
             }
          }
          return 1;
       } else { // interleaved
-         int i,j,k,x,y;
+         int i,j,k,m,x,y;
+         int bs = 8 >> z->scale_shift;
          STBI_SIMD_ALIGN(short, data[64]);
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x)*8;
-                        int y2 = (j*z->img_comp[n].v + y)*8;
-                        int ha = z->img_comp[n].ha;
-                        if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                        z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
-                     }
+         for (m=z->mcu_first; m < z->mcu_first + z->mcu_count && m < z->img_mcu_x*z->img_mcu_y; ++m) {
+            i = m % z->img_mcu_x;
+            j = m / z->img_mcu_x;
+            // scan an interleaved mcu... process scan_n components in order
+            for (k=0; k < z->scan_n; ++k) {
+               int n = z->order[k];
+               // scan out an mcu's worth of this component; that's just determined
+               // by the basic H and V specified for the component
+               for (y=0; y < z->img_comp[n].v; ++y) {
+                  for (x=0; x < z->img_comp[n].h; ++x) {
+                     int x2 = (i*z->img_comp[n].h + x)*bs;
+                     int y2 = (j*z->img_comp[n].v + y)*bs;
+                     int ha = z->img_comp[n].ha;
+                     if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                     z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data);
                   }
                }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
+            }
+            // after all interleaved components, that's an interleaved MCU,
+            // so now count down the restart interval
+            if (--z->todo <= 0) {
+               if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+               if (!STBI__RESTART(z->marker)) return 1;
+               stbi__jpeg_reset(z);
             }
          }
          return 1;
       }
    } else {
       if (z->scan_n == 1) {
-         int i,j;
+         int m;
          int n = z->order[0];
          // non-interleaved data, we just need to process one block at a time,
          // in trivial scanline order
@@ -2821,52 +2949,50 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
          // component has, independent of interleaved MCU blocking and such
          int w = (z->img_comp[n].x+7) >> 3;
          int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               if (z->spec_start == 0) {
-                  if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
-                     return 0;
-               } else {
-                  int ha = z->img_comp[n].ha;
-                  if (!stbi__jpeg_decode_block_prog_ac(z, data, &z->huff_ac[ha], z->fast_ac[ha]))
-                     return 0;
-               }
-               // every data block is an MCU, so countdown the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
+         for (m=z->mcu_first; m < z->mcu_first + z->mcu_count && m < w*h; ++m) {
+            short *data = z->img_comp[n].coeff + 64 * (m % w + (m / w) * z->img_comp[n].coeff_w);
+            if (z->spec_start == 0) {
+               if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
+                  return 0;
+            } else {
+               int ha = z->img_comp[n].ha;
+               if (!stbi__jpeg_decode_block_prog_ac(z, data, &z->huff_ac[ha], z->fast_ac[ha]))
+                  return 0;
+            }
+            // every data block is an MCU, so countdown the restart interval
+            if (--z->todo <= 0) {
+               if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+               if (!STBI__RESTART(z->marker)) return 1;
+               stbi__jpeg_reset(z);
             }
          }
          return 1;
       } else { // interleaved
-         int i,j,k,x,y;
-         for (j=0; j < z->img_mcu_y; ++j) {
-            for (i=0; i < z->img_mcu_x; ++i) {
-               // scan an interleaved mcu... process scan_n components in order
-               for (k=0; k < z->scan_n; ++k) {
-                  int n = z->order[k];
-                  // scan out an mcu's worth of this component; that's just determined
-                  // by the basic H and V specified for the component
-                  for (y=0; y < z->img_comp[n].v; ++y) {
-                     for (x=0; x < z->img_comp[n].h; ++x) {
-                        int x2 = (i*z->img_comp[n].h + x);
-                        int y2 = (j*z->img_comp[n].v + y);
-                        short *data = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
-                        if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
-                           return 0;
-                     }
+         int i,j,k,m,x,y;
+         for (m=z->mcu_first; m < z->mcu_first + z->mcu_count && m < z->img_mcu_x*z->img_mcu_y; ++m) {
+            i = m % z->img_mcu_x;
+            j = m / z->img_mcu_x;
+            // scan an interleaved mcu... process scan_n components in order
+            for (k=0; k < z->scan_n; ++k) {
+               int n = z->order[k];
+               // scan out an mcu's worth of this component; that's just determined
+               // by the basic H and V specified for the component
+               for (y=0; y < z->img_comp[n].v; ++y) {
+                  for (x=0; x < z->img_comp[n].h; ++x) {
+                     int x2 = (i*z->img_comp[n].h + x);
+                     int y2 = (j*z->img_comp[n].v + y);
+                     short *data = z->img_comp[n].coeff + 64 * (x2 + y2 * z->img_comp[n].coeff_w);
+                     if (!stbi__jpeg_decode_block_prog_dc(z, data, &z->huff_dc[z->img_comp[n].hd], n))
+                        return 0;
                   }
                }
-               // after all interleaved components, that's an interleaved MCU,
-               // so now count down the restart interval
-               if (--z->todo <= 0) {
-                  if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                  if (!STBI__RESTART(z->marker)) return 1;
-                  stbi__jpeg_reset(z);
-               }
+            }
+            // after all interleaved components, that's an interleaved MCU,
+            // so now count down the restart interval
+            if (--z->todo <= 0) {
+               if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+               if (!STBI__RESTART(z->marker)) return 1;
+               stbi__jpeg_reset(z);
             }
          }
          return 1;
@@ -2874,6 +3000,55 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg *z)
    }
 }
 
+#ifdef STBI_PARALLEL_JPEG
+// reads the rest of a scan's entropy coded data into memory, splits it at the
+// restart markers and decodes the intervals in parallel: each one starts from
+// fresh DC predictions and bit buffer, so they're independent. leaves z->marker
+// at the marker after the scan, as stbi__parse_entropy_coded_data would.
+static int stbi__parse_entropy_coded_data_parallel(stbi__jpeg *z)
+{
+   std::vector<stbi_uc> data;
+   std::vector<size_t> starts(1, 0);
+   std::atomic<int> ok(1);
+   int segments;
+   z->marker = STBI__MARKER_none;
+   while (!stbi__at_eof(z->s)) {
+      stbi_uc c = stbi__get8(z->s);
+      if (c != 0xff) {
+         data.push_back(c);
+         continue;
+      }
+      c = stbi__get8(z->s);
+      while (c == 0xff && !stbi__at_eof(z->s)) c = stbi__get8(z->s); // fill bytes
+      if (c == 0) {
+         // stuffed zero, left in for the decoder to skip
+         data.push_back(0xff);
+         data.push_back(0);
+      } else if (STBI__RESTART(c)) {
+         starts.push_back(data.size());
+      } else {
+         z->marker = c;
+         break;
+      }
+   }
+   data.push_back(0); // so every interval has a readable byte, even an empty one
+
+   segments = (int) starts.size();
+   stbi__parallel_for(segments, z->threads, [&](int k) {
+      stbi__jpeg local = *z;
+      stbi__context s;
+      size_t end = k+1 < segments ? starts[k+1] : data.size();
+      stbi__start_mem(&s, &data[starts[k]], (int) (end - starts[k]));
+      local.s = &s;
+      local.mcu_first = k * z->restart_interval;
+      local.mcu_count = z->restart_interval;
+      if (!stbi__parse_entropy_coded_data(&local))
+         ok = 0;
+   });
+   return ok;
+}
+#endif
+
 static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
 {
    int i;
@@ -2881,21 +3056,34 @@ static void stbi__jpeg_dequantize(short *data, stbi__uint16 *dequant)
       data[i] *= dequant[i];
 }
 
+// dequantize and idct one row of blocks of a progressive image
+static void stbi__jpeg_finish_row(stbi__jpeg *z, int n, int j)
+{
+   int i;
+   int bs = 8 >> z->scale_shift;
+   int w = (z->img_comp[n].x+7) >> 3;
+   for (i=0; i < w; ++i) {
+      short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+      stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+      z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*bs+i*bs, z->img_comp[n].w2, data);
+   }
+}
+
 static void stbi__jpeg_finish(stbi__jpeg *z)
 {
    if (z->progressive) {
       // dequantize and idct the data
-      int i,j,n;
+      int j,n;
       for (n=0; n < z->s->img_n; ++n) {
-         int w = (z->img_comp[n].x+7) >> 3;
          int h = (z->img_comp[n].y+7) >> 3;
-         for (j=0; j < h; ++j) {
-            for (i=0; i < w; ++i) {
-               short *data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-               stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data);
-            }
+#ifdef STBI_PARALLEL_JPEG
+         if (z->threads > 1) {
+            stbi__parallel_for(h, z->threads, [=](int row) { stbi__jpeg_finish_row(z, n, row); });
+            continue;
          }
+#endif
+         for (j=0; j < h; ++j)
+            stbi__jpeg_finish_row(z, n, j);
       }
    }
 }
@@ -3122,9 +3310,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // discard the extra data until colorspace conversion
       //
       // img_mcu_x, img_mcu_y: <=17 bits; comp[i].h and .v are <=4 (checked earlier)
-      // so these muls can't overflow with 32-bit ints (which we require)
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
+      // so these muls can't overflow with 32-bit ints (which we require).
+      // a reduced scale decode only needs (8 >> scale_shift) pixels per block
+      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * (8 >> z->scale_shift);
+      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * (8 >> z->scale_shift);
       z->img_comp[i].coeff = 0;
       z->img_comp[i].raw_coeff = 0;
       z->img_comp[i].linebuf = NULL;
@@ -3134,10 +3323,10 @@ static int stbi__process_frame_header(stbi__jpeg *z, int scan)
       // align blocks for idct using mmx/sse
       z->img_comp[i].data = (stbi_uc*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
       if (z->progressive) {
-         // w2, h2 are multiples of 8 (see above)
-         z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
-         z->img_comp[i].coeff_h = z->img_comp[i].h2 / 8;
-         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].w2, z->img_comp[i].h2, sizeof(short), 15);
+         // one 64 coefficient block per 8x8 of the full size image, whatever the scale
+         z->img_comp[i].coeff_w = z->img_mcu_x * z->img_comp[i].h;
+         z->img_comp[i].coeff_h = z->img_mcu_y * z->img_comp[i].v;
+         z->img_comp[i].raw_coeff = stbi__malloc_mad3(z->img_comp[i].coeff_w * 64, z->img_comp[i].coeff_h, sizeof(short), 15);
          if (z->img_comp[i].raw_coeff == NULL)
             return stbi__free_jpeg_components(z, i+1, stbi__err("outofmem", "Out of memory"));
          z->img_comp[i].coeff = (short*) (((size_t) z->img_comp[i].raw_coeff + 15) & ~15);
@@ -3194,6 +3383,11 @@ static int stbi__decode_jpeg_image(stbi__jpeg *j)
    while (!stbi__EOI(m)) {
       if (stbi__SOS(m)) {
          if (!stbi__process_scan_header(j)) return 0;
+#ifdef STBI_PARALLEL_JPEG
+         if (j->threads > 1 && j->restart_interval) {
+            if (!stbi__parse_entropy_coded_data_parallel(j)) return 0;
+         } else
+#endif
          if (!stbi__parse_entropy_coded_data(j)) return 0;
          if (j->marker == STBI__MARKER_none ) {
             // handle 0s at the end of image data from IP Kamera 9060
@@ -3612,6 +3806,14 @@ static void stbi__setup_jpeg(stbi__jpeg *j)
    j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
    j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
 #endif
+
+   j->scale_shift = stbi__jpeg_scale_shift;
+   j->mcu_first = 0;
+   j->mcu_count = 0x7fffffff;
+   j->threads = stbi__jpeg_threads;
+   if (j->scale_shift == 1) j->idct_block_kernel = stbi__idct_block_4x4;
+   if (j->scale_shift == 2) j->idct_block_kernel = stbi__idct_block_2x2;
+   if (j->scale_shift == 3) j->idct_block_kernel = stbi__idct_block_1x1;
 }
 
 // clean up the temporary component buffers
@@ -3637,6 +3839,130 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// resample and color-convert output rows y0 up to y1. res_comp holds each
+// component's resampling state for row y0 and is advanced; linebuf gives
+// each component a line buffer of img_x+3 bytes. if last_row isn't NULL,
+// row y1-1 goes there instead of into output (the 3 channel writers store
+// a 4th byte past the end of each row, which the next row overwrites)
+static void stbi__jpeg_convert_rows(stbi__jpeg *z, stbi_uc *output, int n, int decode_n, int is_rgb,
+                                    stbi__resample *res_comp, stbi_uc **linebuf, unsigned int y0, unsigned int y1,
+                                    stbi_uc *last_row)
+{
+   int k;
+   unsigned int i,j;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   for (j=y0; j < y1; ++j) {
+      stbi_uc *out = last_row && j+1 == y1 ? last_row : output + n * z->s->img_x * j;
+      for (k=0; k < decode_n; ++k) {
+         stbi__resample *r = &res_comp[k];
+         int y_bot = r->ystep >= (r->vs >> 1);
+         coutput[k] = r->resample(linebuf[k],
+                                  y_bot ? r->line1 : r->line0,
+                                  y_bot ? r->line0 : r->line1,
+                                  r->w_lores, r->hs);
+         if (++r->ystep >= r->vs) {
+            r->ystep = 0;
+            r->line0 = r->line1;
+            if (++r->ypos < z->img_comp[k].y)
+               r->line1 += z->img_comp[k].w2;
+         }
+      }
+      if (n >= 3) {
+         stbi_uc *y = coutput[0];
+         if (z->s->img_n == 3) {
+            if (is_rgb) {
+               for (i=0; i < z->s->img_x; ++i) {
+                  out[0] = y[i];
+                  out[1] = coutput[1][i];
+                  out[2] = coutput[2][i];
+                  out[3] = 255;
+                  out += n;
+               }
+            } else {
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                  out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                  out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                  out[3] = 255;
+                  out += n;
+               }
+            } else if (z->app14_color_transform == 2) { // YCCK
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+               for (i=0; i < z->s->img_x; ++i) {
+                  stbi_uc m = coutput[3][i];
+                  out[0] = stbi__blinn_8x8(255 - out[0], m);
+                  out[1] = stbi__blinn_8x8(255 - out[1], m);
+                  out[2] = stbi__blinn_8x8(255 - out[2], m);
+                  out += n;
+               }
+            } else { // YCbCr + alpha?  Ignore the fourth channel for now
+               z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+         } else
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = out[1] = out[2] = y[i];
+               out[3] = 255; // not used if n==3
+               out += n;
+            }
+      } else {
+         if (is_rgb) {
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i)
+                  *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+               for (i=0; i < z->s->img_x; ++i, out += 2) {
+                  out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                  out[1] = 255;
+               }
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+               stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+               stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+               out[0] = stbi__compute_y(r, g, b);
+               out[1] = 255;
+               out += n;
+            }
+         } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+               out[1] = 255;
+               out += n;
+            }
+         } else {
+            stbi_uc *y = coutput[0];
+            if (n == 1)
+               for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+               for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+         }
+      }
+   }
+}
+
+#ifdef STBI_PARALLEL_JPEG
+// moves a component's resampling state on by rows, without producing them
+static void stbi__jpeg_skip_rows(stbi__jpeg *z, stbi__resample *r, int k, unsigned int rows)
+{
+   unsigned int j;
+   for (j=0; j < rows; ++j) {
+      if (++r->ystep >= r->vs) {
+         r->ystep = 0;
+         r->line0 = r->line1;
+         if (++r->ypos < z->img_comp[k].y)
+            r->line1 += z->img_comp[k].w2;
+      }
+   }
+}
+#endif
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3648,6 +3974,17 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // load a jpeg image from whichever source, but leave in YCbCr format
    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
+   // blocks went straight to the reduced size, so from here on the image is that size
+   if (z->scale_shift) {
+      int k, round = (1 << z->scale_shift) - 1;
+      z->s->img_x = (z->s->img_x + round) >> z->scale_shift;
+      z->s->img_y = (z->s->img_y + round) >> z->scale_shift;
+      for (k=0; k < z->s->img_n; ++k) {
+         z->img_comp[k].x = (z->img_comp[k].x + round) >> z->scale_shift;
+         z->img_comp[k].y = (z->img_comp[k].y + round) >> z->scale_shift;
+      }
+   }
+
    // determine actual number of components to generate
    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
@@ -3661,9 +3998,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // resample and color-convert
    {
       int k;
-      unsigned int i,j;
       stbi_uc *output;
-      stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
 
       stbi__resample res_comp[4];
 
@@ -3694,99 +4029,40 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
       if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
       // now go ahead and resample
-      for (j=0; j < z->s->img_y; ++j) {
-         stbi_uc *out = output + n * z->s->img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi__resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+#ifdef STBI_PARALLEL_JPEG
+      if (z->threads > 1 && z->s->img_y >= 64) {
+         // bands of rows, each starting from its own copy of the resampling
+         // state and with its own line buffers. a band's last row is made
+         // in a spare buffer and copied, so its padding byte can't land on
+         // the next band's first row after that band wrote it. every band's
+         // buffers come out of one allocation made up front, on this thread
+         int band_rows = 32;
+         int bands = (int) ((z->s->img_y + band_rows - 1) / band_rows);
+         size_t row_bytes = (size_t) n * z->s->img_x + 1, line_bytes = (size_t) z->s->img_x + 3;
+         size_t band_bytes = row_bytes + decode_n * line_bytes;
+         stbi_uc *band_scratch = (stbi_uc *) stbi__malloc(band_bytes * bands);
+         if (!band_scratch) { STBI_FREE(output); stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+         stbi__parallel_for(bands, z->threads, [&](int b) {
+            stbi__resample band_comp[4];
+            stbi_uc *band_linebuf[4] = { NULL, NULL, NULL, NULL };
+            stbi_uc *last_row = band_scratch + band_bytes * b;
+            unsigned int y0 = (unsigned int) b * band_rows;
+            unsigned int y1 = y0 + band_rows < z->s->img_y ? y0 + band_rows : z->s->img_y;
+            int c;
+            for (c=0; c < decode_n; ++c) {
+               band_comp[c] = res_comp[c];
+               stbi__jpeg_skip_rows(z, &band_comp[c], c, y0);
+               band_linebuf[c] = last_row + row_bytes + c * line_bytes;
             }
-         }
+            stbi__jpeg_convert_rows(z, output, n, decode_n, is_rgb, band_comp, band_linebuf, y0, y1, last_row);
+            memcpy(output + n * z->s->img_x * (y1-1), last_row, n * z->s->img_x);
+         });
+         STBI_FREE(band_scratch);
+      } else
+#endif
+      {
+         stbi_uc *linebuf[4] = { z->img_comp[0].linebuf, z->img_comp[1].linebuf, z->img_comp[2].linebuf, z->img_comp[3].linebuf };
+         stbi__jpeg_convert_rows(z, output, n, decode_n, is_rgb, res_comp, linebuf, 0, z->s->img_y, NULL);
       }
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
@@ -3856,6 +4132,11 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 
+// literal/length lookahead: each entry resolves up to two literals, or a
+// whole match length including its extra bits, from this many input bits
+#define STBI__ZLIT_BITS   11
+#define STBI__ZLIT_MASK   ((1 << STBI__ZLIT_BITS) - 1)
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -3950,6 +4231,10 @@ typedef struct
    int   z_expandable;
 
    stbi__zhuffman z_length, z_distance;
+   // entry: bits consumed << 24 | kind << 16 | payload, where kind is 1 for
+   // a literal (low byte), 2 for two literals (low byte first) and 3 for a
+   // match length (low 16 bits). 0 means decode the slow way
+   stbi__uint32 z_lit[1 << STBI__ZLIT_BITS];
 } stbi__zbuf;
 
 stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
@@ -3960,6 +4245,14 @@ stbi_inline static stbi_uc stbi__zget8(stbi__zbuf *z)
 
 static void stbi__fill_bits(stbi__zbuf *z)
 {
+   if (z->zbuffer_end - z->zbuffer >= 4) {
+      // away from the end of the input, no need to check each byte
+      do {
+         z->code_buffer |= (unsigned int) *z->zbuffer++ << z->num_bits;
+         z->num_bits += 8;
+      } while (z->num_bits <= 24);
+      return;
+   }
    do {
       STBI_ASSERT(z->code_buffer < (1U << z->num_bits));
       z->code_buffer |= (unsigned int) stbi__zget8(z) << z->num_bits;
@@ -4042,21 +4335,85 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
 
+// decodes the symbol at the bottom of bits if its code is no longer than
+// avail bits; -1 if it's longer (or invalid). bits above avail are zero
+static int stbi__zpeek_symbol(stbi__zhuffman *z, int bits, int avail, int *len)
+{
+   int b = z->fast[bits & STBI__ZFAST_MASK], s, k;
+   if (b) {
+      s = b >> 9;
+      if (s > avail) return -1;
+      *len = s;
+      return b & 511;
+   }
+   k = stbi__bit_reverse(bits, 16);
+   for (s=STBI__ZFAST_BITS+1; s <= avail; ++s) {
+      if (k < z->maxcode[s]) {
+         *len = s;
+         return z->value[(k >> (16-s)) - z->firstcode[s] + z->firstsymbol[s]];
+      }
+   }
+   return -1;
+}
+
+static void stbi__zbuild_lit(stbi__zbuf *a)
+{
+   int i;
+   for (i=0; i < (1 << STBI__ZLIT_BITS); ++i) {
+      int len, len2, sym2;
+      int sym = stbi__zpeek_symbol(&a->z_length, i, STBI__ZLIT_BITS, &len);
+      stbi__uint32 e = 0;
+      if (sym >= 0 && sym < 256) {
+         sym2 = stbi__zpeek_symbol(&a->z_length, i >> len, STBI__ZLIT_BITS - len, &len2);
+         if (sym2 >= 0 && sym2 < 256)
+            e = ((stbi__uint32) (len + len2) << 24) | (2 << 16) | (sym2 << 8) | sym;
+         else
+            e = ((stbi__uint32) len << 24) | (1 << 16) | sym;
+      } else if (sym > 256 && sym < 286) {
+         int extra = stbi__zlength_extra[sym-257];
+         if (len + extra <= STBI__ZLIT_BITS)
+            e = ((stbi__uint32) (len + extra) << 24) | (3 << 16) |
+                (stbi__zlength_base[sym-257] + ((i >> len) & ((1 << extra) - 1)));
+      }
+      a->z_lit[i] = e;
+   }
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
-      if (z < 256) {
-         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
-         if (zout >= a->zout_end) {
-            if (!stbi__zexpand(a, zout, 1)) return 0;
-            zout = a->zout;
+      stbi_uc *p;
+      int z,len,dist;
+      stbi__uint32 e;
+      if (a->num_bits < 16) stbi__fill_bits(a);
+      e = a->z_lit[a->code_buffer & STBI__ZLIT_MASK];
+      if (e) {
+         int kind = (e >> 16) & 3;
+         a->code_buffer >>= e >> 24;
+         a->num_bits -= e >> 24;
+         if (kind != 3) {
+            if (zout + kind > a->zout_end) {
+               if (!stbi__zexpand(a, zout, kind)) return 0;
+               zout = a->zout;
+            }
+            zout[0] = (char) e;
+            if (kind == 2) zout[1] = (char) (e >> 8);
+            zout += kind;
+            continue;
          }
-         *zout++ = (char) z;
+         len = e & 0xffff;
       } else {
-         stbi_uc *p;
-         int len,dist;
+         z = stbi__zhuffman_decode(a, &a->z_length);
+         if (z < 256) {
+            if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
+            if (zout >= a->zout_end) {
+               if (!stbi__zexpand(a, zout, 1)) return 0;
+               zout = a->zout;
+            }
+            *zout++ = (char) z;
+            continue;
+         }
          if (z == 256) {
             a->zout = zout;
             return 1;
@@ -4064,22 +4421,32 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
          z -= 257;
          len = stbi__zlength_base[z];
          if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
-         z = stbi__zhuffman_decode(a, &a->z_distance);
-         if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
-         dist = stbi__zdist_base[z];
-         if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
-         if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
-         if (zout + len > a->zout_end) {
-            if (!stbi__zexpand(a, zout, len)) return 0;
-            zout = a->zout;
-         }
-         p = (stbi_uc *) (zout - dist);
-         if (dist == 1) { // run of one byte; common in images.
-            stbi_uc v = *p;
-            if (len) { do *zout++ = v; while (--len); }
-         } else {
-            if (len) { do *zout++ = *p++; while (--len); }
-         }
+      }
+      z = stbi__zhuffman_decode(a, &a->z_distance);
+      if (z < 0) return stbi__err("bad huffman code","Corrupt PNG");
+      dist = stbi__zdist_base[z];
+      if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
+      if (zout - a->zout_start < dist) return stbi__err("bad dist","Corrupt PNG");
+      if (zout + len > a->zout_end) {
+         if (!stbi__zexpand(a, zout, len)) return 0;
+         zout = a->zout;
+      }
+      p = (stbi_uc *) (zout - dist);
+      if (dist == 1) { // run of one byte; common in images.
+         memset(zout, *p, len);
+         zout += len;
+      } else if (dist >= 8 && a->zout_end - zout >= len + 8) {
+         // 8 bytes at a time, running over the end of the match into space
+         // the output has anyway; a source at least 8 back never overlaps
+         char *end = zout + len;
+         do {
+            memcpy(zout, p, 8);
+            zout += 8;
+            p += 8;
+         } while (zout < end);
+         zout = end;
+      } else {
+         if (len) { do *zout++ = *p++; while (--len); }
       }
    }
 }
@@ -4226,6 +4593,7 @@ static int stbi__parse_zlib(stbi__zbuf *a, int parse_header)
          } else {
             if (!stbi__compute_huffman_codes(a)) return 0;
          }
+         stbi__zbuild_lit(a);
          if (!stbi__parse_huffman_block(a)) return 0;
       }
    } while (!final);
@@ -4393,6 +4761,85 @@ static int stbi__paeth(int a, int b, int c)
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
+#ifdef STBI_SSE2
+// unfiltering for 8-bit RGB and RGBA rows below the first: a pixel per
+// register for the filters that depend on the pixel to the left, 16 bytes
+// at a time for Up. gives exactly what the scalar loops do
+stbi_inline static __m128i stbi__png_load_pixel(const stbi_uc *p, int bpp)
+{
+   stbi__uint32 v;
+   if (bpp == 4)
+      memcpy(&v, p, 4);
+   else
+      v = p[0] | (p[1] << 8) | (p[2] << 16);
+   return _mm_cvtsi32_si128((int) v);
+}
+
+stbi_inline static void stbi__png_store_pixel(stbi_uc *p, __m128i x, int bpp)
+{
+   stbi__uint32 v = (stbi__uint32) _mm_cvtsi128_si32(x);
+   if (bpp == 4)
+      memcpy(p, &v, 4);
+   else {
+      p[0] = (stbi_uc) v;
+      p[1] = (stbi_uc) (v >> 8);
+      p[2] = (stbi_uc) (v >> 16);
+   }
+}
+
+static void stbi__png_unfilter_row_sse2(stbi_uc *cur, const stbi_uc *prior, const stbi_uc *raw, int filter, int bpp, stbi__uint32 width)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i a = zero, c = zero; // left and upper left, none for the first pixel
+   stbi__uint32 i, bytes = width * bpp;
+   switch (filter) {
+      case STBI__F_sub:
+         for (i=0; i < bytes; i += bpp) {
+            a = _mm_add_epi8(a, stbi__png_load_pixel(raw+i, bpp));
+            stbi__png_store_pixel(cur+i, a, bpp);
+         }
+         break;
+      case STBI__F_up:
+         for (i=0; i+16 <= bytes; i += 16)
+            _mm_storeu_si128((__m128i *) (cur+i), _mm_add_epi8(_mm_loadu_si128((const __m128i *) (raw+i)),
+                                                              _mm_loadu_si128((const __m128i *) (prior+i))));
+         for (; i < bytes; ++i)
+            cur[i] = STBI__BYTECAST(raw[i] + prior[i]);
+         break;
+      case STBI__F_avg: {
+         // _mm_avg_epu8 rounds up, and the filter wants (a+b)>>1
+         __m128i one = _mm_set1_epi8(1);
+         for (i=0; i < bytes; i += bpp) {
+            __m128i b = stbi__png_load_pixel(prior+i, bpp);
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            a = _mm_add_epi8(avg, stbi__png_load_pixel(raw+i, bpp));
+            stbi__png_store_pixel(cur+i, a, bpp);
+         }
+         break;
+      }
+      case STBI__F_paeth:
+         // in 16 bit lanes: pa = |b-c|, pb = |a-c|, pc = |a+b-2c|, then the
+         // same tie breaking as stbi__paeth
+         for (i=0; i < bytes; i += bpp) {
+            __m128i b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior+i, bpp), zero);
+            __m128i a16 = _mm_unpacklo_epi8(a, zero), c16 = _mm_unpacklo_epi8(c, zero);
+            __m128i bc = _mm_sub_epi16(b, c16), ac = _mm_sub_epi16(a16, c16), abc = _mm_add_epi16(bc, ac);
+            __m128i pa = _mm_max_epi16(bc, _mm_sub_epi16(zero, bc));
+            __m128i pb = _mm_max_epi16(ac, _mm_sub_epi16(zero, ac));
+            __m128i pc = _mm_max_epi16(abc, _mm_sub_epi16(zero, abc));
+            __m128i use_c = _mm_cmpgt_epi16(pb, pc);
+            __m128i bc_pick = _mm_or_si128(_mm_and_si128(use_c, c16), _mm_andnot_si128(use_c, b));
+            __m128i use_bc = _mm_cmpgt_epi16(pa, _mm_min_epi16(pb, pc));
+            __m128i pred = _mm_or_si128(_mm_and_si128(use_bc, bc_pick), _mm_andnot_si128(use_bc, a16));
+            a = _mm_add_epi8(_mm_packus_epi16(pred, zero), stbi__png_load_pixel(raw+i, bpp));
+            c = _mm_packus_epi16(b, zero);
+            stbi__png_store_pixel(cur+i, a, bpp);
+         }
+         break;
+   }
+}
+#endif
+
 // create the png data from post-deflated data
 static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
 {
@@ -4406,6 +4853,9 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
    int width = x;
+#ifdef STBI_SSE2
+   int simd = depth == 8 && img_n == out_n && (img_n == 3 || img_n == 4) && stbi__sse2_available();
+#endif
 
    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n+1);
    a->out = (stbi_uc *) stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
@@ -4436,6 +4886,14 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       }
       prior = cur - stride; // bugfix: need to compute this after 'cur +=' computation above
 
+#ifdef STBI_SSE2
+      if (simd && j > 0 && filter != STBI__F_none) {
+         stbi__png_unfilter_row_sse2(cur, prior, raw, filter, img_n, x);
+         raw += x*img_n;
+         continue;
+      }
+#endif
+
       // if first row, use special filter that doesn't sample previous row
       if (j == 0) filter = first_row_filter[filter];
 
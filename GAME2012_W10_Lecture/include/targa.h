@@ -0,0 +1,49 @@
+#ifndef __TARGA_H__
+#define __TARGA_H__
+
+#include "vgl.h"
+
+namespace vtarga
+{
+
+// A decoded (or mapped) TGA image, rows bottom up the way glTexImage2D
+// wants them. Pixels stay in the file's BGR(A) order; format and type say
+// how to upload them, so no swizzle happens on the CPU:
+//
+//     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+//     glTexImage2D(GL_TEXTURE_2D, 0, image.internal_format, image.width,
+//                  image.height, 0, image.format, image.type, image.pixels);
+//
+// Uncompressed files that are already bottom up aren't copied at all:
+// pixels points into a read-only mapping of the file.
+struct targa_image
+{
+    const unsigned char *   pixels;
+    int                     width;
+    int                     height;
+    int                     size;               // Bytes per pixel
+    GLenum                  internal_format;
+    GLenum                  format;
+    GLenum                  type;
+    bool                    mapped;             // pixels is in the file mapping, not a copy
+
+    // Owned storage, released by close_targa
+    unsigned char *         buffer;
+    const unsigned char *   view;
+    size_t                  view_size;
+    void *                  mapping;
+};
+
+// Opens filename and decodes it if it has to. Handles 8 bit greyscale and
+// 16, 24 and 32 bit colour, raw or RLE, either vertical origin. Returns
+// false for anything else, or for a truncated file.
+bool open_targa(const char * filename, targa_image &image);
+void close_targa(targa_image &image);
+
+// Older interface: always a copy, free it with delete []. 16 bit images
+// return 0 since their packed type can't be reported here.
+unsigned char * load_targa(const char * filename, GLenum &format, int &width, int &height);
+
+}
+
+#endif /* __TARGA_H__ */
@@ -1,5 +1,17 @@
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #include <stdio.h>
-#include "vgl.h"
+#include <string.h>
+#include "targa.h"
 
 namespace vtarga
 {
@@ -38,45 +50,91 @@ struct targa_header
 #pragma pack (pop)
 #endif
 
+static const size_t targa_header_size = 18;
+
+// The header is read field by field, little endian, so the layout of the
+// struct above (which isn't packed outside MSVC) doesn't matter.
+static void read_targa_header(const unsigned char * src, targa_header &header)
+{
+    header.id_length = src[0];
+    header.cmap_type = src[1];
+    header.image_type = src[2];
+    header.cmap_spec.cmap_table_offset = (unsigned short)(src[3] | (src[4] << 8));
+    header.cmap_spec.cmap_entry_count = (unsigned short)(src[5] | (src[6] << 8));
+    header.cmap_spec.cmap_entry_size = src[7];
+    header.image_spec.x_origin = (unsigned short)(src[8] | (src[9] << 8));
+    header.image_spec.y_origin = (unsigned short)(src[10] | (src[11] << 8));
+    header.image_spec.width = (unsigned short)(src[12] | (src[13] << 8));
+    header.image_spec.height = (unsigned short)(src[14] | (src[15] << 8));
+    header.image_spec.bits_per_pixel = src[16];
+    header.image_spec.alpha_depth = src[17] & 0x0F;
+    header.image_spec.image_origin = (src[17] >> 4) & 0x03;
+}
+
 static bool is_compressed_targa(const targa_header &header)
 {
     return (header.image_type & 0x08) != 0;
 }
 
-static bool get_targa_format_type_and_size(const targa_header &header, GLenum &format, GLenum &type, int &size)
+// Rows stored top first, rather than OpenGL's bottom first.
+static bool is_top_down_targa(const targa_header &header)
+{
+    return (header.image_spec.image_origin & 0x02) != 0;
+}
+
+static bool get_targa_format_type_and_size(const targa_header &header, GLenum &internal_format, GLenum &format, GLenum &type, int &size)
 {
     // TODO: Support paletted TGA files. Note, L8 files are actually stored as
     // paletted bitmaps with a 256 entry grayscale palette.
     if (header.cmap_type != 0)
         return false;
 
+    // Only true colour (2) and greyscale (3), raw or RLE.
+    if ((header.image_type & ~0x08) != 2 && (header.image_type & ~0x08) != 3)
+        return false;
+
+    // Right to left pixel order isn't worth a slow path.
+    if ((header.image_spec.image_origin & 0x01) != 0)
+        return false;
+
     // By default...
     type = GL_UNSIGNED_BYTE;
 
     switch (header.image_spec.bits_per_pixel)
     {
         case 8:
+            internal_format = GL_R8;
             format = GL_RED;
             size = 1;
             return true;
         case 16:
-            switch (header.image_spec.alpha_depth)
+            if ((header.image_type & ~0x08) == 3)
             {
-                case 0:
-                    format = GL_RG8;
-                    break;
-                case 8:
-                    format = GL_RG;
-                    break;
-                default:
-                    return false;
+                // Grey then alpha, a byte each.
+                switch (header.image_spec.alpha_depth)
+                {
+                    case 0:
+                    case 8:
+                        internal_format = GL_RG8;
+                        format = GL_RG;
+                        break;
+                    default:
+                        return false;
+                }
+                size = 2;
+                return true;
             }
+            // A1R5G5B5 in a little endian short.
+            internal_format = header.image_spec.alpha_depth ? GL_RGB5_A1 : GL_RGB5;
+            format = GL_BGRA;
+            type = GL_UNSIGNED_SHORT_1_5_5_5_REV;
             size = 2;
             return true;
         case 24:
             switch (header.image_spec.alpha_depth)
             {
                 case 0:
+                    internal_format = GL_RGB8;
                     format = GL_BGR;
                     break;
                 default:
@@ -86,15 +144,10 @@ static bool get_targa_format_type_and_size(const targa_header &header, GLenum &f
             size = 3;
             return true;
         case 32:
-            switch (header.image_spec.alpha_depth)
-            {
-                case 8:
-                    format = GL_ABGR_EXT;
-                    break;
-                default:
-                    // 32-bit image without alpha.
-                    return false;
-            }
+            // Without alpha bits the fourth byte is padding, which an RGB
+            // internal format ignores.
+            internal_format = header.image_spec.alpha_depth ? GL_RGBA8 : GL_RGB8;
+            format = GL_BGRA;
             size = 4;
             return true;
         default:
@@ -102,39 +155,251 @@ static bool get_targa_format_type_and_size(const targa_header &header, GLenum &f
     }
 }
 
-unsigned char * load_targa(const char * filename, GLenum &format, int &width, int &height)
+static const unsigned char * map_file(const char * filename, size_t &size, void *&mapping)
 {
-    targa_header header;
-    FILE * f;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return 0;
+
+    LARGE_INTEGER file_size;
+    HANDLE file_mapping = NULL;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+        file_mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!file_mapping)
+        return 0;
 
-    f = fopen(filename, "rb");
+    const unsigned char * view = (const unsigned char *)MapViewOfFile(file_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(file_mapping);
+        return 0;
+    }
+    size = (size_t)file_size.QuadPart;
+    mapping = file_mapping;
+    return view;
+#else
+    int file = open(filename, O_RDONLY);
+    if (file < 0)
+        return 0;
 
-    if (!f)
+    struct stat info;
+    void * view = MAP_FAILED;
+    if (fstat(file, &info) == 0 && info.st_size > 0)
+        view = mmap(0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    close(file);
+    if (view == MAP_FAILED)
         return 0;
 
-    fread(&header, sizeof(header), 1, f);
+    madvise(view, (size_t)info.st_size, MADV_SEQUENTIAL);
+    size = (size_t)info.st_size;
+    mapping = view;
+    return (const unsigned char *)view;
+#endif
+}
+
+static void unmap_file(const unsigned char * view, size_t size, void * mapping)
+{
+#ifdef _WIN32
+    (void)size;
+    UnmapViewOfFile(view);
+    CloseHandle((HANDLE)mapping);
+#else
+    (void)mapping;
+    munmap((void *)view, size);
+#endif
+}
+
+// Writes count copies of one pixel. Wider runs double what's already
+// written instead of going pixel by pixel.
+static void fill_run(unsigned char * dst, const unsigned char * pixel, int count, int size)
+{
+    switch (size)
+    {
+        case 1:
+            memset(dst, pixel[0], count);
+            break;
+        case 2:
+        case 4:
+        {
+            // 16 bit pixels go two to a word.
+            unsigned int value;
+            if (size == 2)
+            {
+                unsigned short half;
+                memcpy(&half, pixel, 2);
+                value = half * 0x00010001u;
+            }
+            else
+                memcpy(&value, pixel, 4);
+            size_t bytes = (size_t)count * size, i = 0;
+            for (; i + 4 <= bytes; i += 4)
+                memcpy(dst + i, &value, 4);
+            if (i < bytes)
+                memcpy(dst + i, &value, 2);
+            break;
+        }
+        default:
+        {
+            memcpy(dst, pixel, size);
+            int done = 1;
+            while (done < count)
+            {
+                int n = done < count - done ? done : count - done;
+                memcpy(dst + done * size, dst, n * size);
+                done += n;
+            }
+            break;
+        }
+    }
+}
+
+// Decodes RLE packets straight into their final rows, so flipping a top down
+// image costs nothing extra. Packets are allowed to run over the end of a
+// row. False if the data stops early.
+static bool decode_rle(const unsigned char * src, const unsigned char * end, unsigned char * dst, int width, int height, int size, bool top_down)
+{
+    ptrdiff_t row_bytes = (ptrdiff_t)width * size;
+    unsigned char * row = dst + (top_down ? (height - 1) * row_bytes : 0);
+    ptrdiff_t row_step = top_down ? -row_bytes : row_bytes;
+    int x = 0, y = 0;
+
+    while (y < height)
+    {
+        if (src >= end)
+            return false;
+        int packet = *src++;
+        int count = (packet & 0x7F) + 1;
+        bool run = (packet & 0x80) != 0;
+        if (end - src < (run ? size : count * size))
+            return false;
+
+        const unsigned char * pixel = src;
+        src += run ? size : count * size;
+        while (count > 0 && y < height)
+        {
+            int n = count < width - x ? count : width - x;
+            if (run)
+                fill_run(row + x * size, pixel, n, size);
+            else
+            {
+                memcpy(row + x * size, pixel, n * size);
+                pixel += n * size;
+            }
+            x += n;
+            count -= n;
+            if (x == width)
+            {
+                x = 0;
+                y++;
+                row += row_step;
+            }
+        }
+    }
+    return true;
+}
+
+static bool decode_targa(targa_image &image)
+{
+    if (image.view_size < targa_header_size)
+        return false;
 
-    width = header.image_spec.width;
-    height = header.image_spec.height;
+    targa_header header;
+    read_targa_header(image.view, header);
+    if (!get_targa_format_type_and_size(header, image.internal_format, image.format, image.type, image.size))
+        return false;
 
-    GLenum type;
-    int size;
+    image.width = header.image_spec.width;
+    image.height = header.image_spec.height;
+    if (image.width == 0 || image.height == 0)
+        return false;
 
-    get_targa_format_type_and_size(header, format, type, size);
+    const unsigned char * src = image.view + targa_header_size + header.id_length;
+    const unsigned char * end = image.view + image.view_size;
+    if (src > end)
+        return false;
 
-    unsigned char * data = new unsigned char [width * height * size];
+    size_t row_bytes = (size_t)image.width * image.size;
+    size_t image_bytes = row_bytes * image.height;
+    bool top_down = is_top_down_targa(header);
 
-    if (is_compressed_targa(header))
+    if (!is_compressed_targa(header))
     {
-        // TODO: Handle compressed targa files
+        if ((size_t)(end - src) < image_bytes)
+            return false;
+        if (!top_down)
+        {
+            // Already in OpenGL's row order, so upload from the mapping.
+            image.pixels = src;
+            image.mapped = true;
+            return true;
+        }
+        image.buffer = new unsigned char [image_bytes];
+        for (int y = 0; y < image.height; y++)
+            memcpy(image.buffer + (image.height - 1 - y) * row_bytes, src + y * row_bytes, row_bytes);
     }
     else
     {
-        fread(data, width * height, size, f);
+        image.buffer = new unsigned char [image_bytes];
+        if (!decode_rle(src, end, image.buffer, image.width, image.height, image.size, top_down))
+            return false;
+    }
+
+    image.pixels = image.buffer;
+    return true;
+}
+
+bool open_targa(const char * filename, targa_image &image)
+{
+    memset(&image, 0, sizeof(image));
+
+    image.view = map_file(filename, image.view_size, image.mapping);
+    if (!image.view)
+        return false;
+
+    if (!decode_targa(image))
+    {
+        close_targa(image);
+        return false;
+    }
+
+    // A decoded copy doesn't need the file any more.
+    if (!image.mapped)
+    {
+        unmap_file(image.view, image.view_size, image.mapping);
+        image.view = 0;
+        image.mapping = 0;
     }
+    return true;
+}
+
+void close_targa(targa_image &image)
+{
+    if (image.view)
+        unmap_file(image.view, image.view_size, image.mapping);
+    delete [] image.buffer;
+    memset(&image, 0, sizeof(image));
+}
 
-    fclose(f);
+unsigned char * load_targa(const char * filename, GLenum &format, int &width, int &height)
+{
+    targa_image image;
+    if (!open_targa(filename, image))
+        return 0;
+
+    unsigned char * data = 0;
+    if (image.type == GL_UNSIGNED_BYTE)
+    {
+        size_t image_bytes = (size_t)image.width * image.height * image.size;
+        data = new unsigned char [image_bytes];
+        memcpy(data, image.pixels, image_bytes);
+        format = image.format;
+        width = image.width;
+        height = image.height;
+    }
 
+    close_targa(image);
     return data;
 }
 